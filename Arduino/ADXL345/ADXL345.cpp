@@ -56,8 +56,10 @@ ADXL345::ADXL345(uint8_t address) {
  */
 void ADXL345::initialize() {
     I2Cdev::writeByte(devAddr, ADXL345_RA_POWER_CTL, 0); // reset all power settings
-    setAutoSleepEnabled(true);
-    setMeasureEnabled(true);
+    I2CdevFields<ADXL345_RA_POWER_CTL>() // then auto-sleep and measure, in one write
+        .set<ADXL345_PCTL_AUTOSLEEP>(1)
+        .set<ADXL345_PCTL_MEASURE>(1)
+        .replace(devAddr);
 }
 
 /** Verify the I2C connection.
@@ -68,6 +70,16 @@ bool ADXL345::testConnection() {
     return getDeviceID() == 0xE5;
 }
 
+/** Shadow the configuration registers, so that each bit update is a single write.
+ * None of the ADXL345's writable registers change by themselves, so all are shadowed.
+ * @param enabled True to shadow registers, false to stop
+ * @return False if I2Cdev can't shadow another device
+ * @see I2Cdev::shadowEnable()
+ */
+bool ADXL345::setShadowEnabled(bool enabled) {
+    return I2Cdev::shadowEnable(devAddr, enabled);
+}
+
 // DEVID register
 
 /** Get Device ID.
@@ -877,7 +889,7 @@ void ADXL345::setLinkEnabled(bool enabled) {
  * @see ADXL345_PCTL_AUTOSLEEP_BIT
  */
 bool ADXL345::getAutoSleepEnabled() {
-    I2Cdev::readBit(devAddr, ADXL345_RA_POWER_CTL, ADXL345_PCTL_AUTOSLEEP_BIT, buffer);
+    ADXL345_PCTL_AUTOSLEEP::read(devAddr, buffer);
     return buffer[0];
 }
 /** Set auto-sleep enabled status.
@@ -887,7 +899,7 @@ bool ADXL345::getAutoSleepEnabled() {
  * @see ADXL345_PCTL_AUTOSLEEP_BIT
  */
 void ADXL345::setAutoSleepEnabled(bool enabled) {
-    I2Cdev::writeBit(devAddr, ADXL345_RA_POWER_CTL, ADXL345_PCTL_AUTOSLEEP_BIT, enabled);
+    ADXL345_PCTL_AUTOSLEEP::write(devAddr, enabled);
 }
 /** Get measurement enabled status.
  * A setting of 0 in the measure bit places the part into standby mode, and a
@@ -898,7 +910,7 @@ void ADXL345::setAutoSleepEnabled(bool enabled) {
  * @see ADXL345_PCTL_MEASURE_BIT
  */
 bool ADXL345::getMeasureEnabled() {
-    I2Cdev::readBit(devAddr, ADXL345_RA_POWER_CTL, ADXL345_PCTL_MEASURE_BIT, buffer);
+    ADXL345_PCTL_MEASURE::read(devAddr, buffer);
     return buffer[0];
 }
 /** Set measurement enabled status.
@@ -908,7 +920,7 @@ bool ADXL345::getMeasureEnabled() {
  * @see ADXL345_PCTL_MEASURE_BIT
  */
 void ADXL345::setMeasureEnabled(bool enabled) {
-    I2Cdev::writeBit(devAddr, ADXL345_RA_POWER_CTL, ADXL345_PCTL_MEASURE_BIT, enabled);
+    ADXL345_PCTL_MEASURE::write(devAddr, enabled);
 }
 /** Get sleep mode enabled status.
  * A setting of 0 in the sleep bit puts the part into the normal mode of
@@ -1521,6 +1533,22 @@ void ADXL345::getAcceleration(int16_t* x, int16_t* y, int16_t* z) {
     *y = (((int16_t)buffer[3]) << 8) | buffer[2];
     *z = (((int16_t)buffer[5]) << 8) | buffer[4];
 }
+/** Get 3-axis accleration measurements, with the time at which they were read.
+ * @param x 16-bit signed integer container for X-axis acceleration
+ * @param y 16-bit signed integer container for Y-axis acceleration
+ * @param z 16-bit signed integer container for Z-axis acceleration
+ * @param timestamp Container for the start and end times of the read
+ * @return Whether the read succeeded and its times are known
+ * @see getAcceleration()
+ * @see I2Cdev::getTimestamp()
+ */
+bool ADXL345::getAcceleration(int16_t* x, int16_t* y, int16_t* z, I2CdevTimestamp* timestamp) {
+    int8_t count = I2Cdev::readBytes(devAddr, ADXL345_RA_DATAX0, 6, buffer);
+    *x = (((int16_t)buffer[1]) << 8) | buffer[0];
+    *y = (((int16_t)buffer[3]) << 8) | buffer[2];
+    *z = (((int16_t)buffer[5]) << 8) | buffer[4];
+    return I2Cdev::getTimestamp(timestamp) && count == 6;
+}
 /** Get X-axis accleration measurement.
  * @return 16-bit signed X-axis acceleration value
  * @see ADXL345_RA_DATAX0
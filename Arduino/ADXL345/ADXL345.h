@@ -163,6 +163,10 @@ THE SOFTWARE.
 #define ADXL345_FIFOSTAT_LENGTH_BIT         5
 #define ADXL345_FIFOSTAT_LENGTH_LENGTH      6
 
+// register fields, with masks and shifts fixed at compile time (see I2CdevField)
+typedef I2CdevField<ADXL345_RA_POWER_CTL, ADXL345_PCTL_AUTOSLEEP_BIT, 1> ADXL345_PCTL_AUTOSLEEP;
+typedef I2CdevField<ADXL345_RA_POWER_CTL, ADXL345_PCTL_MEASURE_BIT, 1>   ADXL345_PCTL_MEASURE;
+
 class ADXL345 {
     public:
         ADXL345();
@@ -170,6 +174,7 @@ class ADXL345 {
 
         void initialize();
         bool testConnection();
+        bool setShadowEnabled(bool enabled);
 
         // DEVID register
         uint8_t getDeviceID();
@@ -337,6 +342,7 @@ class ADXL345 {
 
         // DATA* registers
         void getAcceleration(int16_t* x, int16_t* y, int16_t* z);
+        bool getAcceleration(int16_t* x, int16_t* y, int16_t* z, I2CdevTimestamp* timestamp);
         int16_t getAccelerationX();
         int16_t getAccelerationY();
         int16_t getAccelerationZ();
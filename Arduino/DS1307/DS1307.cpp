@@ -455,6 +455,13 @@ void DS1307::setDateTime24(uint16_t year, uint8_t month, uint8_t day, uint8_t ho
         return (day + 6) % 7; // Jan 1, 2000 is a Saturday, i.e. returns 6
     }
     
+    long DateTime::secondstime(void) const {
+        long t;
+        uint16_t days = date2days(yOff, m, d);
+        t = time2long(days, hh, mm, ss);
+        return t;
+    }
+
     uint32_t DateTime::unixtime(void) const {
         uint32_t t;
         uint16_t days = date2days(yOff, m, d);
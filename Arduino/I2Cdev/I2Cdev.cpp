@@ -87,6 +87,257 @@ THE SOFTWARE.
 
 #endif
 
+#if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+    #include <RPi2cTransaction.h>
+#endif
+
+#if I2CDEV_BUS_INTERFACE
+    // the calling thread's I2CdevBus, if any; see I2Cdev::setThreadBus()
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        static __thread I2CdevBus *currentBus = 0;
+    #else
+        static I2CdevBus *currentBus = 0;
+    #endif
+#endif
+
+// identifies the bus that the calling thread's transfers go to, for keeping state per device
+static inline const void *busKey() {
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) return currentBus;
+    #endif
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        return RPi2c::bus();
+    #else
+        return 0;
+    #endif
+}
+
+#if I2CDEV_SHADOW_DEVICES > 0
+
+    #include <string.h>
+
+    // Register shadow cache: the last value written to, or read from, each single register of the devices for
+    // which shadowEnable() has been called, so that writeBit() & co. can skip the read of a read-modify-write.
+    // Devices are keyed by bus as well as address, so the same address on two buses is two devices.
+    struct I2CdevShadow {
+        const void *bus;        // see busKey()
+        uint8_t devAddr;
+        bool used;
+        bool enabled;
+        uint8_t known[32];      // bit per register: value is known
+        uint8_t word[32];       // bit per register: value is a 16-bit word
+        uint8_t volatiles[32];  // bit per register: never cached
+        uint16_t value[256];
+    };
+
+    static I2CdevShadow shadows[I2CDEV_SHADOW_DEVICES];
+
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        static pthread_mutex_t shadowMutex = PTHREAD_MUTEX_INITIALIZER;
+        #define I2CDEV_SHADOW_LOCK()    pthread_mutex_lock(&shadowMutex)
+        #define I2CDEV_SHADOW_UNLOCK()  pthread_mutex_unlock(&shadowMutex)
+    #else
+        #define I2CDEV_SHADOW_LOCK()
+        #define I2CDEV_SHADOW_UNLOCK()
+    #endif
+
+    #define I2CDEV_SHADOW_BIT(bits, regAddr)    (bits[(regAddr) >> 3] & (1 << ((regAddr) & 7)))
+    #define I2CDEV_SHADOW_SET(bits, regAddr)    (bits[(regAddr) >> 3] |= (1 << ((regAddr) & 7)))
+    #define I2CDEV_SHADOW_CLEAR(bits, regAddr)  (bits[(regAddr) >> 3] &= ~(1 << ((regAddr) & 7)))
+
+    // call with the lock held; returns 0 if the device has no slot and none is free (or create is false)
+    static I2CdevShadow *shadowFind(uint8_t devAddr, bool create) {
+        const void *bus = busKey();
+        I2CdevShadow *unused = 0;
+        for (uint8_t i = 0; i < I2CDEV_SHADOW_DEVICES; i++) {
+            if (!shadows[i].used) {
+                if (!unused) unused = shadows + i;
+            } else if (shadows[i].devAddr == devAddr && shadows[i].bus == bus) {
+                return shadows + i;
+            }
+        }
+        if (create && unused) {
+            memset(unused, 0, sizeof(I2CdevShadow));
+            unused->bus = bus;
+            unused->devAddr = devAddr;
+            unused->used = true;
+        }
+        return create ? unused : 0;
+    }
+
+    static bool shadowGet(uint8_t devAddr, uint8_t regAddr, bool word, uint16_t *value) {
+        bool known = false;
+        I2CDEV_SHADOW_LOCK();
+        I2CdevShadow *shadow = shadowFind(devAddr, false);
+        if (shadow && shadow->enabled && I2CDEV_SHADOW_BIT(shadow->known, regAddr)
+                && (I2CDEV_SHADOW_BIT(shadow->word, regAddr) != 0) == word) {
+            *value = shadow->value[regAddr];
+            known = true;
+            I2Cdev::shadowHits++;
+        }
+        I2CDEV_SHADOW_UNLOCK();
+        return known;
+    }
+
+    static void shadowPut(uint8_t devAddr, uint8_t regAddr, bool word, uint16_t value) {
+        I2CDEV_SHADOW_LOCK();
+        I2CdevShadow *shadow = shadowFind(devAddr, false);
+        if (shadow && shadow->enabled && !I2CDEV_SHADOW_BIT(shadow->volatiles, regAddr)) {
+            shadow->value[regAddr] = value;
+            I2CDEV_SHADOW_SET(shadow->known, regAddr);
+            if (word) {
+                I2CDEV_SHADOW_SET(shadow->word, regAddr);
+            } else {
+                I2CDEV_SHADOW_CLEAR(shadow->word, regAddr);
+            }
+        }
+        I2CDEV_SHADOW_UNLOCK();
+    }
+
+    static void shadowForget(uint8_t devAddr, uint8_t regAddr, uint16_t length) {
+        I2CDEV_SHADOW_LOCK();
+        I2CdevShadow *shadow = shadowFind(devAddr, false);
+        if (shadow) {
+            for (uint16_t r = regAddr; r < (uint16_t)regAddr + length && r < 256; r++) {
+                I2CDEV_SHADOW_CLEAR(shadow->known, r);
+            }
+        }
+        I2CDEV_SHADOW_UNLOCK();
+    }
+
+#endif
+
+// Write batch: while open, writeByte()s to the batch's device are queued (in order) rather than sent, and
+// on flush each run of adjacent registers goes out as one writeBytes() burst if the device auto-increments.
+// Any other transfer flushes the queue first, so reads (including those of a read-modify-write) see the
+// writes before them. One batch per thread on Linux.
+struct I2CdevBatch {
+    const void *bus;        // see busKey()
+    uint8_t devAddr;
+    uint8_t capabilities;
+    bool open;
+    bool flushing;
+    bool failed;            // a burst has failed since the batch was opened
+    uint8_t count;
+    uint8_t regAddr[I2CDEV_BATCH_LENGTH];
+    uint8_t data[I2CDEV_BATCH_LENGTH];
+};
+
+#if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+    static __thread I2CdevBatch batch;
+#else
+    static I2CdevBatch batch;
+#endif
+
+// send whatever is queued; called at the start of every transfer
+static inline void batchFlushPending() {
+    if (batch.count && !batch.flushing) I2Cdev::flushWriteBatch();
+}
+
+// returns true if the write was queued
+static bool batchQueue(uint8_t devAddr, uint8_t regAddr, uint8_t data) {
+    if (!batch.open || batch.flushing || batch.devAddr != devAddr || batch.bus != busKey()) return false;
+    if (batch.count == I2CDEV_BATCH_LENGTH) I2Cdev::flushWriteBatch();
+    batch.regAddr[batch.count] = regAddr;
+    batch.data[batch.count] = data;
+    batch.count++;
+    return true;
+}
+
+// the last value queued in the batch for a register of the device, if any
+static bool batchQueued(uint8_t devAddr, uint8_t regAddr, uint8_t *data) {
+    if (!batch.count || batch.devAddr != devAddr || batch.bus != busKey()) return false;
+    for (uint8_t i = batch.count; i-- > 0; ) {
+        if (batch.regAddr[i] == regAddr) {
+            *data = batch.data[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+// read half of a read-modify-write; skipped if the register is queued in the batch or shadowed
+static int8_t readForUpdate(uint8_t devAddr, uint8_t regAddr, uint8_t *data) {
+    if (batchQueued(devAddr, regAddr, data)) return 1;
+    #if I2CDEV_SHADOW_DEVICES > 0
+        uint16_t value;
+        if (shadowGet(devAddr, regAddr, false, &value)) {
+            *data = (uint8_t)value;
+            return 1;
+        }
+    #endif
+    return I2Cdev::readByte(devAddr, regAddr, data);
+}
+
+static int8_t readForUpdateW(uint8_t devAddr, uint8_t regAddr, uint16_t *data) {
+    uint8_t queued;
+    if (batchQueued(devAddr, regAddr, &queued) || batchQueued(devAddr, regAddr + 1, &queued)) {
+        batchFlushPending(); // a word can't be put together from the queue; sending it updates the shadow
+    }
+    #if I2CDEV_SHADOW_DEVICES > 0
+        if (shadowGet(devAddr, regAddr, true, data)) return 1;
+    #endif
+    return I2Cdev::readWord(devAddr, regAddr, data);
+}
+
+#if I2CDEV_BUS_INTERFACE
+    // I2Cdev calls routed through the calling thread's I2CdevBus; words are MSB first
+    static int8_t busReadBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t *data, uint16_t timeout) {
+        int16_t count = currentBus->read(devAddr, regAddr, length, data, timeout);
+        #if I2CDEV_SHADOW_DEVICES > 0
+            if (length == 1 && count == 1) shadowPut(devAddr, regAddr, false, data[0]);
+        #endif
+        return (int8_t)count;
+    }
+
+    static void busWordsFromBytes(uint16_t *data, int16_t count) {
+        for (int16_t i = 0; i < count; i++) {
+            uint8_t *bytes = (uint8_t *)(data + i);
+            data[i] = ((uint16_t)bytes[0] << 8) | bytes[1];
+        }
+    }
+
+    static int8_t busReadWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16_t *data, uint16_t timeout) {
+        int16_t count = currentBus->read(devAddr, regAddr, length * 2, (uint8_t *)data, timeout);
+        if (count < 0) return -1;
+        count /= 2;
+        busWordsFromBytes(data, count);
+        #if I2CDEV_SHADOW_DEVICES > 0
+            if (length == 1 && count == 1) shadowPut(devAddr, regAddr, true, data[0]);
+        #endif
+        return (int8_t)count;
+    }
+
+    static bool busWriteBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t *data) {
+        bool success = currentBus->write(devAddr, regAddr, length, data);
+        #if I2CDEV_SHADOW_DEVICES > 0
+            if (success && length == 1) {
+                shadowPut(devAddr, regAddr, false, data[0]);
+            } else {
+                shadowForget(devAddr, regAddr, length);
+            }
+        #endif
+        return success;
+    }
+
+    static bool busWriteWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16_t *data) {
+        uint8_t bytes[2 * 255];
+        for (uint8_t i = 0; i < length; i++) {
+            bytes[2 * i] = (uint8_t)(data[i] >> 8);
+            bytes[2 * i + 1] = (uint8_t)data[i];
+        }
+        bool success = currentBus->write(devAddr, regAddr, length * 2, bytes);
+        #if I2CDEV_SHADOW_DEVICES > 0
+            if (success && length == 1) {
+                shadowPut(devAddr, regAddr, true, data[0]);
+            } else {
+                shadowForget(devAddr, regAddr, length);
+            }
+        #endif
+        return success;
+    }
+#endif
+
 /** Default constructor.
  */
 I2Cdev::I2Cdev() {
@@ -204,6 +455,11 @@ int8_t I2Cdev::readWord(uint8_t devAddr, uint8_t regAddr, uint16_t *data, uint16
  * @return Number of bytes read (-1 indicates failure)
  */
 int8_t I2Cdev::readBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t *data, uint16_t timeout) {
+    batchFlushPending();
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) return busReadBytes(devAddr, regAddr, length, data, timeout);
+    #endif
+
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.print("I2C (0x");
         Serial.print(devAddr, HEX);
@@ -303,7 +559,7 @@ int8_t I2Cdev::readBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8
 
     #elif (I2CDEV_IMPLEMENTATION == I2CDEV_RPI)
 
-	int status = RPi2c::bus()->busRead (devAddr, regAddr, length, data);
+	int status = RPi2c::bus()->busRead (devAddr, regAddr, length, data, true, timeout * 1000UL);
 	if (status < 0) {
         #ifdef I2CDEV_SERIAL_DEBUG
             Serial.print(RPi2c::bus()->lastError ());
@@ -318,6 +574,10 @@ int8_t I2Cdev::readBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8
     // check for timeout
     if (timeout > 0 && millis() - t1 >= timeout && count < length) count = -1; // timeout
 
+    #if I2CDEV_SHADOW_DEVICES > 0
+        if (length == 1 && count == 1) shadowPut(devAddr, regAddr, false, data[0]);
+    #endif
+
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.print(". Done (");
         Serial.print(count, DEC);
@@ -336,6 +596,11 @@ int8_t I2Cdev::readBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8
  * @return Number of words read (-1 indicates failure)
  */
 int8_t I2Cdev::readWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16_t *data, uint16_t timeout) {
+    batchFlushPending();
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) return busReadWords(devAddr, regAddr, length, data, timeout);
+    #endif
+
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.print("I2C (0x");
         Serial.print(devAddr, HEX);
@@ -468,7 +733,7 @@ int8_t I2Cdev::readWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint1
 
     #elif (I2CDEV_IMPLEMENTATION == I2CDEV_RPI)
 
-	int status = RPi2c::bus()->busRead (devAddr, regAddr, length, data, false /* not LSB */);
+	int status = RPi2c::bus()->busRead (devAddr, regAddr, length, data, false /* not LSB */, true, timeout * 1000UL);
 	if (status < 0) {
         #ifdef I2CDEV_SERIAL_DEBUG
             Serial.print(RPi2c::bus()->lastError ());
@@ -482,6 +747,10 @@ int8_t I2Cdev::readWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint1
 
     if (timeout > 0 && millis() - t1 >= timeout && count < length) count = -1; // timeout
 
+    #if I2CDEV_SHADOW_DEVICES > 0
+        if (length == 1 && count == 1) shadowPut(devAddr, regAddr, true, data[0]);
+    #endif
+
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.print(". Done (");
         Serial.print(count, DEC);
@@ -509,6 +778,14 @@ int8_t I2Cdev::readWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint1
  * @return Number of bytes read (0 indicates failure)
  */
 int8_t I2Cdev::readBytesOnly(uint8_t devAddr, uint8_t length, uint8_t * data, uint16_t timeout) {
+    batchFlushPending();
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) {
+            int16_t count = currentBus->transfer(devAddr, 0, 0, data, length, timeout);
+            return count < 0 ? 0 : (int8_t)count;
+        }
+    #endif
+
     #ifdef I2CDEV_SERIAL_DEBUG
 	Serial.print("I2C (0x");
 	Serial.print(devAddr, HEX);
@@ -521,7 +798,7 @@ int8_t I2Cdev::readBytesOnly(uint8_t devAddr, uint8_t length, uint8_t * data, ui
 
     #if (I2CDEV_IMPLEMENTATION == I2CDEV_RPI)
 
-	int status = RPi2c::bus()->busReadOnly (devAddr, length, data);
+	int status = RPi2c::bus()->busReadOnly (devAddr, length, data, timeout * 1000UL);
 	if (status < 0) {
         #ifdef I2CDEV_SERIAL_DEBUG
             Serial.print(RPi2c::bus()->lastError ());
@@ -568,6 +845,16 @@ int8_t I2Cdev::readBytesOnly(uint8_t devAddr, uint8_t length, uint8_t * data, ui
  * @return Number of words read (0 indicates failure)
  */
 int8_t I2Cdev::readWordsOnly(uint8_t devAddr, uint8_t length, uint16_t * data, uint16_t timeout) {
+    batchFlushPending();
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) {
+            int16_t count = currentBus->transfer(devAddr, 0, 0, (uint8_t *)data, length * 2, timeout);
+            if (count < 0) return 0;
+            busWordsFromBytes(data, count / 2);
+            return (int8_t)(count / 2);
+        }
+    #endif
+
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.print("I2C (0x");
         Serial.print(devAddr, HEX);
@@ -580,7 +867,7 @@ int8_t I2Cdev::readWordsOnly(uint8_t devAddr, uint8_t length, uint16_t * data, u
 
     #if (I2CDEV_IMPLEMENTATION == I2CDEV_RPI)
 
-	int status = RPi2c::bus()->busReadOnly (devAddr, length, data, false /* not LSB */);
+	int status = RPi2c::bus()->busReadOnly (devAddr, length, data, false /* not LSB */, timeout * 1000UL);
 	if (status < 0) {
         #ifdef I2CDEV_SERIAL_DEBUG
             Serial.print(RPi2c::bus()->lastError ());
@@ -618,6 +905,90 @@ int8_t I2Cdev::readWordsOnly(uint8_t devAddr, uint8_t length, uint16_t * data, u
     return count;
 }
 
+/** Read several blocks of consecutive registers, possibly on different devices, e.g., a status register, a count and
+ * a data register that aren't adjacent. On the Raspberry Pi the reads go out as one combined transfer (a single
+ * I2C_RDWR, with a repeated start between messages) and land directly in the callers' buffers; elsewhere, or if
+ * the adapter only supports SMBus, they are read one after another.
+ * @param spans Reads to perform; each span's count is set to the number of bytes read (-1 indicates failure)
+ * @param count Number of spans
+ * @param timeout Optional read timeout in milliseconds (0 to disable, leave off to use default class value in I2Cdev::readTimeout)
+ * @return Number of spans read in full
+ */
+uint8_t I2Cdev::readScatter(I2CdevReadSpan *spans, uint8_t count, uint16_t timeout) {
+    batchFlushPending();
+    uint8_t complete = 0;
+
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) {
+            complete = currentBus->readScatter(spans, count, timeout);
+        } else
+    #endif
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        if (!RPi2c::bus()->isSMBus()) {
+            I2CdevRPi2c bus(RPi2c::bus());
+            complete = bus.readScatter(spans, count, timeout);
+        } else
+    #endif
+        {
+            for (uint8_t i = 0; i < count; i++) {
+                spans[i].count = readBytes(spans[i].devAddr, spans[i].regAddr, spans[i].length, spans[i].data, timeout);
+                if (spans[i].count == spans[i].length) complete++;
+            }
+            return complete; // readBytes() has shadowed them
+        }
+
+    #if I2CDEV_SHADOW_DEVICES > 0
+        for (uint8_t i = 0; i < count; i++) {
+            if (spans[i].length == 1 && spans[i].count == 1) shadowPut(spans[i].devAddr, spans[i].regAddr, false, spans[i].data[0]);
+        }
+    #endif
+    return complete;
+}
+
+/** Read a burst of bytes starting at a register, for bursts too long for readBytes() (more than 255 bytes), e.g., a
+ * whole bank of memory through a data port register. On the Raspberry Pi, or through an I2CdevBus, the burst is read
+ * as one transfer (if the adapter allows); elsewhere it is read in pieces of up to 255 bytes, each from regAddr.
+ * @param devAddr I2C slave device address
+ * @param regAddr First register regAddr to read from
+ * @param length Number of bytes to read
+ * @param data Buffer to store read data in
+ * @param timeout Optional read timeout in milliseconds (0 to disable, leave off to use default class value in I2Cdev::readTimeout)
+ * @return Number of bytes read (-1 indicates failure)
+ */
+int16_t I2Cdev::readBurst(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, uint16_t timeout) {
+    int16_t count = 0;
+
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) {
+            batchFlushPending();
+            count = currentBus->read(devAddr, regAddr, length, data, timeout);
+        } else
+    #endif
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        {
+            batchFlushPending();
+            int status = RPi2c::bus()->busRead (devAddr, regAddr, length, data, true, timeout * 1000UL);
+            count = (status < 0) ? -1 : status;
+        }
+    #else
+        {
+            while (count < (int16_t)length) {
+                uint8_t piece = (length - count > 255) ? 255 : (uint8_t)(length - count);
+                int8_t status = readBytes(devAddr, regAddr, piece, data + count, timeout);
+                if (status < 0) return -1;
+                count += status;
+                if (status < piece) break;
+            }
+            return count; // readBytes() has shadowed them
+        }
+    #endif
+
+    #if I2CDEV_SHADOW_DEVICES > 0
+        if (length == 1 && count == 1) shadowPut(devAddr, regAddr, false, data[0]);
+    #endif
+    return count;
+}
+
 /** write a single bit in an 8-bit device register.
  * @param devAddr I2C slave device address
  * @param regAddr Register regAddr to write to
@@ -627,7 +998,7 @@ int8_t I2Cdev::readWordsOnly(uint8_t devAddr, uint8_t length, uint16_t * data, u
  */
 bool I2Cdev::writeBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t data) {
     uint8_t b;
-    readByte(devAddr, regAddr, &b);
+    readForUpdate(devAddr, regAddr, &b);
     b = (data != 0) ? (b | (1 << bitNum)) : (b & ~(1 << bitNum));
     return writeByte(devAddr, regAddr, b);
 }
@@ -641,7 +1012,7 @@ bool I2Cdev::writeBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t
  */
 bool I2Cdev::writeBitW(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint16_t data) {
     uint16_t w;
-    readWord(devAddr, regAddr, &w);
+    readForUpdateW(devAddr, regAddr, &w);
     w = (data != 0) ? (w | (1 << bitNum)) : (w & ~(1 << bitNum));
     return writeWord(devAddr, regAddr, w);
 }
@@ -662,10 +1033,25 @@ bool I2Cdev::writeBits(uint8_t devAddr, uint8_t regAddr, uint8_t bitStart, uint8
     // 10101111 original value (sample)
     // 10100011 original & ~mask
     // 10101011 masked | value
+    uint8_t mask = ((1 << length) - 1) << (bitStart - length + 1);
+    data <<= (bitStart - length + 1); // shift data into correct position
+    return writeMasked(devAddr, regAddr, mask, data);
+}
+
+/** Write the bits of an 8-bit device register selected by a mask, leaving the others unchanged.
+ * The register is read first (unless shadowed), except when the mask covers all 8 bits.
+ * @param devAddr I2C slave device address
+ * @param regAddr Register regAddr to write to
+ * @param mask Bits to write
+ * @param data New bit values, in position (not right-aligned); bits outside the mask are ignored
+ * @return Status of operation (true = success)
+ * @see I2CdevField
+ */
+bool I2Cdev::writeMasked(uint8_t devAddr, uint8_t regAddr, uint8_t mask, uint8_t data) {
+    if (mask == 0xFF) return writeByte(devAddr, regAddr, data);
+
     uint8_t b;
-    if (readByte(devAddr, regAddr, &b) != 0) {
-        uint8_t mask = ((1 << length) - 1) << (bitStart - length + 1);
-        data <<= (bitStart - length + 1); // shift data into correct position
+    if (readForUpdate(devAddr, regAddr, &b) != 0) {
         data &= mask; // zero all non-important bits in data
         b &= ~(mask); // zero all important bits in existing byte
         b |= data; // combine data with existing byte
@@ -692,7 +1078,7 @@ bool I2Cdev::writeBitsW(uint8_t devAddr, uint8_t regAddr, uint8_t bitStart, uint
     // 1010001110010110 original & ~mask
     // 1010101110010110 masked | value
     uint16_t w;
-    if (readWord(devAddr, regAddr, &w) != 0) {
+    if (readForUpdateW(devAddr, regAddr, &w) != 0) {
         uint16_t mask = ((1 << length) - 1) << (bitStart - length + 1);
         data <<= (bitStart - length + 1); // shift data into correct position
         data &= mask; // zero all non-important bits in data
@@ -711,6 +1097,7 @@ bool I2Cdev::writeBitsW(uint8_t devAddr, uint8_t regAddr, uint8_t bitStart, uint
  * @return Status of operation (true = success)
  */
 bool I2Cdev::writeByte(uint8_t devAddr, uint8_t regAddr, uint8_t data) {
+    if (batchQueue(devAddr, regAddr, data)) return true;
     return writeBytes(devAddr, regAddr, 1, &data);
 }
 
@@ -732,6 +1119,11 @@ bool I2Cdev::writeWord(uint8_t devAddr, uint8_t regAddr, uint16_t data) {
  * @return Status of operation (true = success)
  */
 bool I2Cdev::writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t* data) {
+    batchFlushPending();
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) return busWriteBytes(devAddr, regAddr, length, data);
+    #endif
+
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.print("I2C (0x");
         Serial.print(devAddr, HEX);
@@ -774,15 +1166,20 @@ bool I2Cdev::writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_
         //status = Fastwire::endTransmission();
     #endif
     #if (I2CDEV_IMPLEMENTATION == I2CDEV_RPI)
-        status = RPi2c::bus()->busWrite (devAddr, regAddr, length, data);
-	if (status < 0) {
+	if (RPi2c::bus()->busWrite (devAddr, regAddr, length, data) < 0) {
         #ifdef I2CDEV_SERIAL_DEBUG
             Serial.print(RPi2c::bus()->lastError ());
         #endif
-	} else {
-            status = 0; // success
+            status = 1; // error; status is unsigned, so can't hold busWrite()'s -1
 	}
     #endif
+    #if I2CDEV_SHADOW_DEVICES > 0
+        if (status == 0 && length == 1) {
+            shadowPut(devAddr, regAddr, false, data[0]);
+        } else {
+            shadowForget(devAddr, regAddr, length); // e.g., a burst, perhaps to a FIFO
+        }
+    #endif
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.println(". Done.");
     #endif
@@ -797,6 +1194,11 @@ bool I2Cdev::writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_
  * @return Status of operation (true = success)
  */
 bool I2Cdev::writeWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16_t* data) {
+    batchFlushPending();
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) return busWriteWords(devAddr, regAddr, length, data);
+    #endif
+
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.print("I2C (0x");
         Serial.print(devAddr, HEX);
@@ -843,21 +1245,327 @@ bool I2Cdev::writeWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16
         //status = Fastwire::endTransmission();
     #endif
     #if (I2CDEV_IMPLEMENTATION == I2CDEV_RPI)
-        status = RPi2c::bus()->busWrite (devAddr, regAddr, length, data, false /* not LSB */);
-	if (status < 0) {
+	if (RPi2c::bus()->busWrite (devAddr, regAddr, length, data, false /* not LSB */) < 0) {
         #ifdef I2CDEV_SERIAL_DEBUG
             Serial.print(RPi2c::bus()->lastError ());
         #endif
-	} else {
-            status = 0; // success
+            status = 1; // error; status is unsigned, so can't hold busWrite()'s -1
 	}
     #endif
+    #if I2CDEV_SHADOW_DEVICES > 0
+        if (status == 0 && length == 1) {
+            shadowPut(devAddr, regAddr, true, data[0]);
+        } else {
+            shadowForget(devAddr, regAddr, length); // e.g., a burst, perhaps to a FIFO
+        }
+    #endif
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.println(". Done.");
     #endif
     return status == 0;
 }
 
+/** Write a burst of bytes starting at a register, for bursts too long for writeBytes() (more than 255 bytes), e.g., a
+ * whole bank of memory through a data port register. On the Raspberry Pi, or through an I2CdevBus, the burst is
+ * written as one transfer (if the adapter allows); elsewhere it is written in pieces of up to 255 bytes, each to regAddr.
+ * @param devAddr I2C slave device address
+ * @param regAddr First register address to write to
+ * @param length Number of bytes to write
+ * @param data Buffer to copy new data from
+ * @return Status of operation (true = success)
+ */
+bool I2Cdev::writeBurst(uint8_t devAddr, uint8_t regAddr, uint16_t length, const uint8_t *data) {
+    bool success = true;
+
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) {
+            batchFlushPending();
+            success = currentBus->write(devAddr, regAddr, length, data);
+        } else
+    #endif
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        {
+            batchFlushPending();
+            success = RPi2c::bus()->busWrite (devAddr, regAddr, length, data) >= 0;
+        }
+    #else
+        {
+            for (uint16_t i = 0; i < length && success; i += 255) {
+                uint8_t piece = (length - i > 255) ? 255 : (uint8_t)(length - i);
+                success = writeBytes(devAddr, regAddr, piece, (uint8_t *)data + i);
+            }
+            return success; // writeBytes() has shadowed them
+        }
+    #endif
+
+    #if I2CDEV_SHADOW_DEVICES > 0
+        if (success && length == 1) {
+            shadowPut(devAddr, regAddr, false, data[0]);
+        } else {
+            shadowForget(devAddr, regAddr, length);
+        }
+    #endif
+    return success;
+}
+
+/** Get the times at which the calling thread's last read (or write) started and completed on the bus.
+ * Lets drivers return timestamped samples, e.g., for aligning data from several sensors, without any
+ * extra bus traffic or system calls; only the Raspberry Pi implementation keeps these times at present.
+ * If the thread's transfers go through an I2CdevBus, the times are the ones that bus reports (none, unless
+ * it overrides I2CdevBus::getTimestamp(), as I2CdevRPi2c does).
+ * @param timestamp Container for start and end times in nanoseconds (zero if not known)
+ * @return Whether the times are known
+ */
+bool I2Cdev::getTimestamp(I2CdevTimestamp *timestamp) {
+    #if I2CDEV_BUS_INTERFACE
+        if (currentBus) return currentBus->getTimestamp(timestamp);
+    #endif
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        RPi2cStamp stamp = RPi2c::lastStamp();
+        timestamp->start = stamp.start;
+        timestamp->end = stamp.end;
+        return stamp.end != 0;
+    #else
+        timestamp->start = 0;
+        timestamp->end = 0;
+        return false;
+    #endif
+}
+
+/** Shadow the registers of a device, so that writeBit(), writeBits() & co. needn't read them first.
+ * The last value written to, or read from, each single register is remembered and used in place of the read
+ * of a read-modify-write; plain reads still go to the device. Only suitable for registers that the device
+ * doesn't change by itself - declare any that it does with shadowVolatile(), and call shadowInvalidate()
+ * after resetting the device. Devices are told apart by bus as well as address.
+ * @param devAddr I2C slave device address
+ * @param enable True to start shadowing; false to stop and forget the device's registers
+ * @return False if too many devices are shadowed already (see I2CDEV_SHADOW_DEVICES)
+ * @see shadowHits
+ */
+bool I2Cdev::shadowEnable(uint8_t devAddr, bool enable) {
+    #if I2CDEV_SHADOW_DEVICES > 0
+        I2CDEV_SHADOW_LOCK();
+        I2CdevShadow *shadow = shadowFind(devAddr, enable);
+        if (shadow) {
+            shadow->enabled = enable;
+            memset(shadow->known, 0, sizeof(shadow->known));
+        }
+        I2CDEV_SHADOW_UNLOCK();
+        return shadow != 0 || !enable;
+    #else
+        return !enable;
+    #endif
+}
+
+/** Declare a register that the device changes by itself, e.g., with self-clearing reset bits, so is never shadowed.
+ * @param devAddr I2C slave device address
+ * @param regAddr Register regAddr
+ */
+void I2Cdev::shadowVolatile(uint8_t devAddr, uint8_t regAddr) {
+    #if I2CDEV_SHADOW_DEVICES > 0
+        I2CDEV_SHADOW_LOCK();
+        I2CdevShadow *shadow = shadowFind(devAddr, true);
+        if (shadow) {
+            I2CDEV_SHADOW_SET(shadow->volatiles, regAddr);
+            I2CDEV_SHADOW_CLEAR(shadow->known, regAddr);
+        }
+        I2CDEV_SHADOW_UNLOCK();
+    #endif
+}
+
+/** Forget the shadowed values of all of a device's registers, e.g., after a reset.
+ * @param devAddr I2C slave device address
+ */
+void I2Cdev::shadowInvalidate(uint8_t devAddr) {
+    #if I2CDEV_SHADOW_DEVICES > 0
+        shadowForget(devAddr, 0, 256);
+    #endif
+}
+
+/** Forget the shadowed value of one register.
+ * @param devAddr I2C slave device address
+ * @param regAddr Register regAddr
+ */
+void I2Cdev::shadowInvalidate(uint8_t devAddr, uint8_t regAddr) {
+    #if I2CDEV_SHADOW_DEVICES > 0
+        shadowForget(devAddr, regAddr, 1);
+    #endif
+}
+
+/** Fill the shadow of a range of registers with a single multi-byte read.
+ * Relies on the device incrementing its register address as it is read; does nothing unless shadowEnable()
+ * has been called for the device, so drivers can call it unconditionally before a run of bit updates.
+ * @param devAddr I2C slave device address
+ * @param regAddr First register regAddr to read from
+ * @param length Number of registers to read
+ * @param timeout Optional read timeout in milliseconds (0 to disable, leave off to use default class value in I2Cdev::readTimeout)
+ * @return Number of registers read (-1 indicates failure; 0 that the device isn't shadowed)
+ */
+int8_t I2Cdev::shadowLoad(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16_t timeout) {
+    #if I2CDEV_SHADOW_DEVICES > 0
+        I2CDEV_SHADOW_LOCK();
+        I2CdevShadow *shadow = shadowFind(devAddr, false);
+        bool enabled = shadow && shadow->enabled;
+        I2CDEV_SHADOW_UNLOCK();
+        if (!enabled) return 0;
+
+        uint8_t buffer[32];
+        if (length > sizeof(buffer)) length = sizeof(buffer);
+
+        int8_t count = readBytes(devAddr, regAddr, length, buffer, timeout);
+        for (int8_t i = 0; i < count; i++) {
+            shadowPut(devAddr, regAddr + i, false, buffer[i]);
+        }
+        return count;
+    #else
+        return 0;
+    #endif
+}
+
+/** Number of reads that writeBit() & co. have skipped because the register was shadowed.
+ */
+unsigned long I2Cdev::shadowHits = 0;
+
+/** Start collecting writeByte()s to a device, to be sent when the batch is flushed or ended.
+ * Writes are sent in the order they were made; if the device has I2CDEV_AUTO_INCREMENT, each run of
+ * writes to adjacent registers (in ascending order) is merged into a single multi-byte writeBytes().
+ * Any other transfer, on any device, flushes the batch first. Opening a batch ends the current one.
+ * See also I2CdevWriteBatch, which ends the batch when it goes out of scope.
+ * @param devAddr I2C slave device address
+ * @param capabilities Device capabilities, e.g., I2CDEV_AUTO_INCREMENT
+ * @return Status of the previous batch, if one was open (true = success)
+ */
+bool I2Cdev::beginWriteBatch(uint8_t devAddr, uint8_t capabilities) {
+    bool success = endWriteBatch();
+    batch.bus = busKey();
+    batch.devAddr = devAddr;
+    batch.capabilities = capabilities;
+    batch.failed = false;
+    batch.open = true;
+    return success;
+}
+
+/** Send the writes collected so far, keeping the batch open.
+ * @return Status of all writes since the batch was opened (true = success)
+ */
+bool I2Cdev::flushWriteBatch() {
+    batch.flushing = true;
+    uint8_t i = 0;
+    while (i < batch.count) {
+        uint8_t length = 1;
+        if (batch.capabilities & I2CDEV_AUTO_INCREMENT) {
+            while (i + length < batch.count && length < I2CDEV_BATCH_BURST
+                    && batch.regAddr[i + length] == (uint16_t)batch.regAddr[i] + length) length++;
+        }
+        if (!writeBytes(batch.devAddr, batch.regAddr[i], length, batch.data + i)) {
+            batch.failed = true;
+        } else {
+            #if I2CDEV_SHADOW_DEVICES > 0
+                // the values of the registers in a burst are known, just as if written one at a time
+                for (uint8_t r = 0; r < length && length > 1; r++) {
+                    shadowPut(batch.devAddr, batch.regAddr[i + r], false, batch.data[i + r]);
+                }
+            #endif
+        }
+        batchMerged += length - 1;
+        i += length;
+    }
+    batch.count = 0;
+    batch.flushing = false;
+    return !batch.failed;
+}
+
+/** Send the writes collected so far and close the batch.
+ * @return Status of all writes since the batch was opened (true = success; also if no batch was open)
+ */
+bool I2Cdev::endWriteBatch() {
+    if (!batch.open) return true;
+    bool success = flushWriteBatch();
+    batch.open = false;
+    return success;
+}
+
+/** Number of writes that a write batch has merged into a burst, rather than sending on their own.
+ */
+unsigned long I2Cdev::batchMerged = 0;
+
+/** Route the calling thread's I2Cdev calls through a bus of its own, e.g., a simulated bus or a multiplexer channel.
+ * Only has an effect if I2CDEV_BUS_INTERFACE is 1; see also I2CdevBusScope and I2CdevOnBus.
+ * @param bus Bus to use; 0 to go back to the implementation selected at compile time
+ */
+void I2Cdev::setThreadBus(I2CdevBus *bus) {
+    #if I2CDEV_BUS_INTERFACE
+        currentBus = bus;
+    #endif
+}
+
+/** Get the calling thread's bus.
+ * @return Bus set by setThreadBus(); 0 if none
+ */
+I2CdevBus *I2Cdev::threadBus() {
+    #if I2CDEV_BUS_INTERFACE
+        return currentBus;
+    #else
+        return 0;
+    #endif
+}
+
+#if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+
+int16_t I2CdevRPi2c::read(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, uint16_t timeout) {
+    return i2c->busRead(devAddr, regAddr, length, data, true, timeout * 1000UL);
+}
+
+bool I2CdevRPi2c::write(uint8_t devAddr, uint8_t regAddr, uint16_t length, const uint8_t *data) {
+    return i2c->busWrite(devAddr, regAddr, length, data) >= 0;
+}
+
+int16_t I2CdevRPi2c::transfer(uint8_t devAddr, const uint8_t *out, uint16_t outLength, uint8_t *in, uint16_t inLength, uint16_t timeout) {
+    if (!inLength) return i2c->busWriteOnly(devAddr, outLength, out) < 0 ? -1 : 0;
+    if (!outLength) return i2c->busReadOnly(devAddr, inLength, in, timeout * 1000UL);
+
+    RPi2cTransaction transaction;
+    transaction.addWriteOnly(devAddr, outLength, out);
+    int op = transaction.addReadOnly(devAddr, inLength, in);
+    if (op < 0 || !i2c->busTransfer(transaction)) return -1;
+    return transaction.status(op);
+}
+
+uint8_t I2CdevRPi2c::readScatter(I2CdevReadSpan *spans, uint8_t count, uint16_t timeout) {
+    if (i2c->isSMBus()) return I2CdevBus::readScatter(spans, count, timeout);
+
+    RPi2cTransaction transaction;
+    uint8_t complete = 0;
+
+    for (uint8_t i = 0; i < count; ) {
+        uint8_t first = i; // as many spans as the transaction holds
+        while (i < count && transaction.addRead(spans[i].devAddr, spans[i].regAddr, spans[i].length, spans[i].data) >= 0) i++;
+
+        if (i == first) { // doesn't fit even on its own
+            spans[i].count = i2c->busRead(spans[i].devAddr, spans[i].regAddr, spans[i].length, spans[i].data, true, timeout * 1000UL);
+            if (spans[i].count == spans[i].length) complete++;
+            i++;
+            continue;
+        }
+        bool success = i2c->busTransfer(transaction);
+        for (uint8_t j = first; j < i; j++) {
+            spans[j].count = success ? transaction.status(j - first) : -1;
+            if (spans[j].count == spans[j].length) complete++;
+        }
+        transaction.clear();
+    }
+    return complete;
+}
+
+bool I2CdevRPi2c::getTimestamp(I2CdevTimestamp *timestamp) {
+    RPi2cStamp stamp = RPi2c::lastStamp(); // kept per thread, so it is this bus's if the thread's last transfer went here
+    timestamp->start = stamp.start;
+    timestamp->end = stamp.end;
+    return stamp.end != 0;
+}
+
+#endif
+
 /** Default timeout value for read operations.
  * Set this to 0 to disable timeout detection.
  */
@@ -99,6 +99,86 @@ THE SOFTWARE.
 // 1000ms default read timeout (modify with "I2Cdev::readTimeout = [ms];")
 #define I2CDEV_DEFAULT_READ_TIMEOUT     1000
 
+// number of devices whose registers can be shadowed at once (see I2Cdev::shadowEnable()); each takes ~600 bytes of RAM,
+// so the shadow cache is left out of Arduino builds unless asked for
+#ifndef I2CDEV_SHADOW_DEVICES
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        #define I2CDEV_SHADOW_DEVICES   8
+    #else
+        #define I2CDEV_SHADOW_DEVICES   0
+    #endif
+#endif
+
+// device capabilities, declared by each driver (e.g., MPR121_CAPABILITIES) and passed to I2CdevWriteBatch
+#define I2CDEV_AUTO_INCREMENT           0x01 // register address increments across a multi-byte write
+
+// number of single-register writes an I2CdevWriteBatch holds before it has to flush, and the longest burst
+// that a run of adjacent registers is merged into
+#ifndef I2CDEV_BATCH_LENGTH
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        #define I2CDEV_BATCH_LENGTH     64
+    #else
+        #define I2CDEV_BATCH_LENGTH     16
+    #endif
+#endif
+#define I2CDEV_BATCH_BURST              32
+
+// route the static I2Cdev calls through the calling thread's I2CdevBus, if it has one (see I2Cdev::setThreadBus());
+// with 0, every call goes straight to the implementation selected above, at no cost
+#ifndef I2CDEV_BUS_INTERFACE
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        #define I2CDEV_BUS_INTERFACE    1
+    #else
+        #define I2CDEV_BUS_INTERFACE    0
+    #endif
+#endif
+
+// when a read started and completed on the bus, in nanoseconds (CLOCK_MONOTONIC on Linux); see I2Cdev::getTimestamp()
+struct I2CdevTimestamp {
+    uint64_t start;
+    uint64_t end;
+};
+
+// one block of consecutive registers in a scatter-gather read; see I2Cdev::readScatter()
+struct I2CdevReadSpan {
+    uint8_t devAddr;
+    uint8_t regAddr;
+    uint8_t length;
+    uint8_t *data;     // where the bytes land; must stay valid until readScatter() returns
+    int16_t count;     // set to the number of bytes read (-1 indicates failure)
+};
+
+// an I2C bus that I2Cdev can be routed through at run time, e.g., a simulated bus or a channel behind a multiplexer,
+// so that one program can mix them; words are sent MSB first as bytes, so only byte transfers need implementing
+class I2CdevBus {
+    public:
+        virtual ~I2CdevBus() {}
+
+        // read length bytes from consecutive registers; returns number of bytes read (-1 indicates failure)
+        virtual int16_t read(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, uint16_t timeout) = 0;
+        // write length bytes to consecutive registers; returns status of operation (true = success)
+        virtual bool write(uint8_t devAddr, uint8_t regAddr, uint16_t length, const uint8_t *data) = 0;
+        // write out (if outLength > 0) then, after a repeated start, read in (if inLength > 0), without a register
+        // address; returns number of bytes read (-1 indicates failure)
+        virtual int16_t transfer(uint8_t devAddr, const uint8_t *out, uint16_t outLength, uint8_t *in, uint16_t inLength, uint16_t timeout) = 0;
+        // read each span, as one combined transfer if the bus can; returns number of spans read in full
+        virtual uint8_t readScatter(I2CdevReadSpan *spans, uint8_t count, uint16_t timeout) {
+            uint8_t complete = 0;
+            for (uint8_t i = 0; i < count; i++) {
+                spans[i].count = read(spans[i].devAddr, spans[i].regAddr, spans[i].length, spans[i].data, timeout);
+                if (spans[i].count == spans[i].length) complete++;
+            }
+            return complete;
+        }
+        // when the calling thread's last read (or write) on this bus started and completed; returns whether the times
+        // are known (if not, they are set to zero)
+        virtual bool getTimestamp(I2CdevTimestamp *timestamp) {
+            timestamp->start = 0;
+            timestamp->end = 0;
+            return false;
+        }
+};
+
 class I2Cdev {
     public:
         I2Cdev();
@@ -115,6 +195,9 @@ class I2Cdev {
         static int8_t readBytesOnly(uint8_t devAddr, uint8_t length, uint8_t *data, uint16_t timeout=I2Cdev::readTimeout);
         static int8_t readWordsOnly(uint8_t devAddr, uint8_t length, uint16_t *data, uint16_t timeout=I2Cdev::readTimeout);
 
+        static uint8_t readScatter(I2CdevReadSpan *spans, uint8_t count, uint16_t timeout=I2Cdev::readTimeout);
+        static int16_t readBurst(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, uint16_t timeout=I2Cdev::readTimeout);
+
         static bool writeBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t data);
         static bool writeBitW(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint16_t data);
         static bool writeBits(uint8_t devAddr, uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t data);
@@ -123,10 +206,185 @@ class I2Cdev {
         static bool writeWord(uint8_t devAddr, uint8_t regAddr, uint16_t data);
         static bool writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t *data);
         static bool writeWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16_t *data);
+        static bool writeMasked(uint8_t devAddr, uint8_t regAddr, uint8_t mask, uint8_t data);
+        static bool writeBurst(uint8_t devAddr, uint8_t regAddr, uint16_t length, const uint8_t *data);
+
+        static bool getTimestamp(I2CdevTimestamp *timestamp);
+
+        static bool shadowEnable(uint8_t devAddr, bool enable=true);
+        static void shadowVolatile(uint8_t devAddr, uint8_t regAddr);
+        static void shadowInvalidate(uint8_t devAddr);
+        static void shadowInvalidate(uint8_t devAddr, uint8_t regAddr);
+        static int8_t shadowLoad(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16_t timeout=I2Cdev::readTimeout);
+        static unsigned long shadowHits;
+
+        static bool beginWriteBatch(uint8_t devAddr, uint8_t capabilities);
+        static bool flushWriteBatch();
+        static bool endWriteBatch();
+        static unsigned long batchMerged;
+
+        static void setThreadBus(I2CdevBus *bus);
+        static I2CdevBus *threadBus();
 
         static uint16_t readTimeout;
 };
 
+// a bit field of an 8-bit register, described at compile time so that its mask and shift are constants, e.g.:
+//     typedef I2CdevField<MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_CLKSEL_BIT, MPU6050_PWR1_CLKSEL_LENGTH> MPU6050_PWR1_CLKSEL;
+//     MPU6050_PWR1_CLKSEL::write(devAddr, MPU6050_CLOCK_PLL_XGYRO);
+// BitStart is the field's highest bit, as for I2Cdev::readBits() and writeBits()
+template <uint8_t Reg, uint8_t BitStart, uint8_t Length>
+struct I2CdevField {
+    enum {
+        reg = Reg,
+        shift = BitStart - Length + 1,
+        mask = (((1 << Length) - 1) << (BitStart - Length + 1)) & 0xFF
+    };
+
+    // the field's value within a register value, and the reverse
+    static uint8_t get(uint8_t regValue) {
+        return (regValue & mask) >> shift;
+    }
+    static uint8_t put(uint8_t data) {
+        return (data << shift) & mask;
+    }
+
+    static int8_t read(uint8_t devAddr, uint8_t *data, uint16_t timeout=I2Cdev::readTimeout) {
+        uint8_t b = 0;
+        int8_t count = I2Cdev::readByte(devAddr, Reg, &b, timeout);
+        *data = get(b);
+        return count;
+    }
+    static bool write(uint8_t devAddr, uint8_t data) {
+        return I2Cdev::writeMasked(devAddr, Reg, mask, put(data));
+    }
+};
+
+// only fields of the register being updated may be set; anything else fails to compile
+template <bool sameRegister> struct I2CdevFieldCheck;
+template <> struct I2CdevFieldCheck<true> {
+    static void check() {}
+};
+
+// several fields of one register, updated with a single read-modify-write (or a plain write, if between them
+// they cover the whole register), e.g.:
+//     I2CdevFields<MPU6050_RA_PWR_MGMT_1>().set<MPU6050_PWR1_CLKSEL>(MPU6050_CLOCK_PLL_XGYRO).set<MPU6050_PWR1_SLEEP>(0).write(devAddr);
+template <uint8_t Reg>
+class I2CdevFields {
+    public:
+        I2CdevFields() : mask(0), value(0) {}
+
+        template <class Field> I2CdevFields &set(uint8_t data) {
+            I2CdevFieldCheck<(uint8_t)Field::reg == Reg>::check();
+            mask |= Field::mask;
+            value = (value & ~Field::mask) | Field::put(data);
+            return *this;
+        }
+
+        // update the fields set, leaving the register's other bits as they are
+        bool write(uint8_t devAddr) const {
+            return I2Cdev::writeMasked(devAddr, Reg, mask, value);
+        }
+        // write the fields set, with the register's other bits cleared; no read needed
+        bool replace(uint8_t devAddr) const {
+            return I2Cdev::writeByte(devAddr, Reg, value);
+        }
+    private:
+        uint8_t mask;
+        uint8_t value;
+};
+
+// collects the writeByte()s to one device for as long as it is in scope, e.g.:
+//     I2CdevWriteBatch batch(devAddr, MPR121_CAPABILITIES);
+//     I2Cdev::writeByte(devAddr, ...); // x N
+// see I2Cdev::beginWriteBatch()
+class I2CdevWriteBatch {
+    public:
+        I2CdevWriteBatch(uint8_t devAddr, uint8_t capabilities) : open(true) {
+            I2Cdev::beginWriteBatch(devAddr, capabilities);
+        }
+        ~I2CdevWriteBatch() {
+            end();
+        }
+        bool end() {
+            if (!open) return true;
+            open = false;
+            return I2Cdev::endWriteBatch();
+        }
+    private:
+        bool open;
+};
+
+// sets the calling thread's I2CdevBus for as long as it is in scope, then restores the previous one
+class I2CdevBusScope {
+    public:
+        I2CdevBusScope(I2CdevBus *bus) : previous(I2Cdev::threadBus()) {
+            I2Cdev::setThreadBus(bus);
+        }
+        ~I2CdevBusScope() {
+            I2Cdev::setThreadBus(previous);
+        }
+    private:
+        I2CdevBus *previous;
+};
+
+// a driver bound to its own bus, so that drivers on different buses can be used side by side, e.g.:
+//     I2CdevOnBus<ADXL345> accel(&bus1);
+//     I2CdevOnBus<MPU6050> imu(&bus2, MPU6050_ADDRESS_AD0_HIGH);
+//     accel->initialize(); imu->initialize();
+// each call through operator-> runs with the driver's bus as the thread's bus, until the end of the statement
+template <class Driver>
+class I2CdevOnBus {
+    public:
+        class Call {
+            public:
+                Call(I2CdevBus *bus, Driver *device) : bus(bus), device(device), previous(0), selected(false) {}
+                ~Call() {
+                    if (selected) I2Cdev::setThreadBus(previous);
+                }
+                Driver *operator->() {
+                    previous = I2Cdev::threadBus();
+                    I2Cdev::setThreadBus(bus);
+                    selected = true;
+                    return device;
+                }
+            private:
+                I2CdevBus *bus;
+                Driver *device;
+                I2CdevBus *previous;
+                bool selected;
+        };
+
+        I2CdevOnBus(I2CdevBus *bus) : bus(bus) {}
+        template <class Arg> I2CdevOnBus(I2CdevBus *bus, Arg arg) : bus(bus), device(arg) {}
+
+        Call operator->() {
+            return Call(bus, &device);
+        }
+        I2CdevBus *getBus() const {
+            return bus;
+        }
+    private:
+        I2CdevBus *bus;
+        Driver device;
+};
+
+#if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+    // an RPi2c instance as an I2CdevBus, e.g., to give a driver its own bus without changing RPi2c's thread bus
+    class I2CdevRPi2c : public I2CdevBus {
+        public:
+            I2CdevRPi2c(RPi2c *i2c) : i2c(i2c) {}
+
+            virtual int16_t read(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, uint16_t timeout);
+            virtual bool write(uint8_t devAddr, uint8_t regAddr, uint16_t length, const uint8_t *data);
+            virtual int16_t transfer(uint8_t devAddr, const uint8_t *out, uint16_t outLength, uint8_t *in, uint16_t inLength, uint16_t timeout);
+            virtual uint8_t readScatter(I2CdevReadSpan *spans, uint8_t count, uint16_t timeout);
+            virtual bool getTimestamp(I2CdevTimestamp *timestamp);
+        private:
+            RPi2c *i2c;
+    };
+#endif
+
 #if I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
     //////////////////////
     // FastWire 0.24
@@ -49,6 +49,9 @@ void MPR121::initialize()
 {
   // These are the configuration values recommended by app note AN3944
   // along with the description in the app note.
+  // The writes are batched, so that each run of adjacent registers
+  // goes to the device as a single burst, in the same order.
+  I2CdevWriteBatch batch(m_devAddr, MPR121_CAPABILITIES);
 
   // Section A
   // Description:
@@ -41,6 +41,9 @@ THE SOFTWARE.
 // this is the 7-bit I2C address with the ADDR pin grounded
 #define MPR121_DEFAULT_ADDRESS 0x5A
 
+// the register address increments across multi-byte reads and writes
+#define MPR121_CAPABILITIES I2CDEV_AUTO_INCREMENT
+
 // MPR121 Registers (from data sheet)
 #define ELE0_ELE7_TOUCH_STATUS          0x00
 #define ELE8_ELE11_ELEPROX_TOUCH_STATUS 0x01
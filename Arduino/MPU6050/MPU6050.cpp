@@ -41,6 +41,9 @@ THE SOFTWARE.
  */
 MPU6050::MPU6050() {
     devAddr = MPU6050_DEFAULT_ADDRESS;
+    dmpPacketBuffer = 0;
+    dmpPacketSize = 0;
+    dmpPipeline = 0;
 }
 
 /** Specific address constructor.
@@ -51,6 +54,9 @@ MPU6050::MPU6050() {
  */
 MPU6050::MPU6050(uint8_t address) {
     devAddr = address;
+    dmpPacketBuffer = 0;
+    dmpPacketSize = 0;
+    dmpPipeline = 0;
 }
 
 /** Power on and prepare for general usage.
@@ -61,10 +67,14 @@ MPU6050::MPU6050(uint8_t address) {
  * the default internal clock source.
  */
 void MPU6050::initialize() {
-    setClockSource(MPU6050_CLOCK_PLL_XGYRO);
+    I2Cdev::shadowLoad(devAddr, MPU6050_RA_CONFIG, 3); // CONFIG, GYRO_CONFIG & ACCEL_CONFIG in one read, if shadowed
     setFullScaleGyroRange(MPU6050_GYRO_FS_250);
     setFullScaleAccelRange(MPU6050_ACCEL_FS_2);
-    setSleepEnabled(false); // thanks to Jack Elston for pointing this one out!
+    // clock source and wake-up in one write; thanks to Jack Elston for pointing out the wake-up!
+    I2CdevFields<MPU6050_RA_PWR_MGMT_1>()
+        .set<MPU6050_PWR1_CLKSEL>(MPU6050_CLOCK_PLL_XGYRO)
+        .set<MPU6050_PWR1_SLEEP>(0)
+        .write(devAddr);
 }
 
 /** Verify the I2C connection.
@@ -75,6 +85,19 @@ bool MPU6050::testConnection() {
     return getDeviceID() == 0x34;
 }
 
+/** Shadow the configuration registers, so that each bit update is a single write.
+ * USER_CTRL and SIGNAL_PATH_RESET hold self-clearing reset bits, so are never shadowed;
+ * reset() forgets the rest.
+ * @param enabled True to shadow registers, false to stop
+ * @return False if I2Cdev can't shadow another device
+ * @see I2Cdev::shadowEnable()
+ */
+bool MPU6050::setShadowEnabled(bool enabled) {
+    I2Cdev::shadowVolatile(devAddr, MPU6050_RA_USER_CTRL);
+    I2Cdev::shadowVolatile(devAddr, MPU6050_RA_SIGNAL_PATH_RESET);
+    return I2Cdev::shadowEnable(devAddr, enabled);
+}
+
 // AUX_VDDIO register (InvenSense demo code calls this RA_*G_OFFS_TC)
 
 /** Get the auxiliary I2C supply voltage level.
@@ -163,7 +186,7 @@ void MPU6050::setRate(uint8_t rate) {
  * @return FSYNC configuration value
  */
 uint8_t MPU6050::getExternalFrameSync() {
-    I2Cdev::readBits(devAddr, MPU6050_RA_CONFIG, MPU6050_CFG_EXT_SYNC_SET_BIT, MPU6050_CFG_EXT_SYNC_SET_LENGTH, buffer);
+    MPU6050_CFG_EXT_SYNC_SET::read(devAddr, buffer);
     return buffer[0];
 }
 /** Set external FSYNC configuration.
@@ -172,7 +195,7 @@ uint8_t MPU6050::getExternalFrameSync() {
  * @param sync New FSYNC configuration value
  */
 void MPU6050::setExternalFrameSync(uint8_t sync) {
-    I2Cdev::writeBits(devAddr, MPU6050_RA_CONFIG, MPU6050_CFG_EXT_SYNC_SET_BIT, MPU6050_CFG_EXT_SYNC_SET_LENGTH, sync);
+    MPU6050_CFG_EXT_SYNC_SET::write(devAddr, sync);
 }
 /** Get digital low-pass filter configuration.
  * The DLPF_CFG parameter sets the digital low pass filter configuration. It
@@ -203,7 +226,7 @@ void MPU6050::setExternalFrameSync(uint8_t sync) {
  * @see MPU6050_CFG_DLPF_CFG_LENGTH
  */
 uint8_t MPU6050::getDLPFMode() {
-    I2Cdev::readBits(devAddr, MPU6050_RA_CONFIG, MPU6050_CFG_DLPF_CFG_BIT, MPU6050_CFG_DLPF_CFG_LENGTH, buffer);
+    MPU6050_CFG_DLPF_CFG::read(devAddr, buffer);
     return buffer[0];
 }
 /** Set digital low-pass filter configuration.
@@ -215,7 +238,7 @@ uint8_t MPU6050::getDLPFMode() {
  * @see MPU6050_CFG_DLPF_CFG_LENGTH
  */
 void MPU6050::setDLPFMode(uint8_t mode) {
-    I2Cdev::writeBits(devAddr, MPU6050_RA_CONFIG, MPU6050_CFG_DLPF_CFG_BIT, MPU6050_CFG_DLPF_CFG_LENGTH, mode);
+    MPU6050_CFG_DLPF_CFG::write(devAddr, mode);
 }
 
 // GYRO_CONFIG register
@@ -238,7 +261,7 @@ void MPU6050::setDLPFMode(uint8_t mode) {
  * @see MPU6050_GCONFIG_FS_SEL_LENGTH
  */
 uint8_t MPU6050::getFullScaleGyroRange() {
-    I2Cdev::readBits(devAddr, MPU6050_RA_GYRO_CONFIG, MPU6050_GCONFIG_FS_SEL_BIT, MPU6050_GCONFIG_FS_SEL_LENGTH, buffer);
+    MPU6050_GCONFIG_FS_SEL::read(devAddr, buffer);
     return buffer[0];
 }
 /** Set full-scale gyroscope range.
@@ -250,7 +273,7 @@ uint8_t MPU6050::getFullScaleGyroRange() {
  * @see MPU6050_GCONFIG_FS_SEL_LENGTH
  */
 void MPU6050::setFullScaleGyroRange(uint8_t range) {
-    I2Cdev::writeBits(devAddr, MPU6050_RA_GYRO_CONFIG, MPU6050_GCONFIG_FS_SEL_BIT, MPU6050_GCONFIG_FS_SEL_LENGTH, range);
+    MPU6050_GCONFIG_FS_SEL::write(devAddr, range);
 }
 
 // ACCEL_CONFIG register
@@ -318,7 +341,7 @@ void MPU6050::setAccelZSelfTest(bool enabled) {
  * @see MPU6050_ACONFIG_AFS_SEL_LENGTH
  */
 uint8_t MPU6050::getFullScaleAccelRange() {
-    I2Cdev::readBits(devAddr, MPU6050_RA_ACCEL_CONFIG, MPU6050_ACONFIG_AFS_SEL_BIT, MPU6050_ACONFIG_AFS_SEL_LENGTH, buffer);
+    MPU6050_ACONFIG_AFS_SEL::read(devAddr, buffer);
     return buffer[0];
 }
 /** Set full-scale accelerometer range.
@@ -326,7 +349,7 @@ uint8_t MPU6050::getFullScaleAccelRange() {
  * @see getFullScaleAccelRange()
  */
 void MPU6050::setFullScaleAccelRange(uint8_t range) {
-    I2Cdev::writeBits(devAddr, MPU6050_RA_ACCEL_CONFIG, MPU6050_ACONFIG_AFS_SEL_BIT, MPU6050_ACONFIG_AFS_SEL_LENGTH, range);
+    MPU6050_ACONFIG_AFS_SEL::write(devAddr, range);
 }
 /** Get the high-pass filter configuration.
  * The DHPF is a filter module in the path leading to motion detectors (Free
@@ -364,7 +387,7 @@ void MPU6050::setFullScaleAccelRange(uint8_t range) {
  * @see MPU6050_RA_ACCEL_CONFIG
  */
 uint8_t MPU6050::getDHPFMode() {
-    I2Cdev::readBits(devAddr, MPU6050_RA_ACCEL_CONFIG, MPU6050_ACONFIG_ACCEL_HPF_BIT, MPU6050_ACONFIG_ACCEL_HPF_LENGTH, buffer);
+    MPU6050_ACONFIG_ACCEL_HPF::read(devAddr, buffer);
     return buffer[0];
 }
 /** Set the high-pass filter configuration.
@@ -374,7 +397,7 @@ uint8_t MPU6050::getDHPFMode() {
  * @see MPU6050_RA_ACCEL_CONFIG
  */
 void MPU6050::setDHPFMode(uint8_t bandwidth) {
-    I2Cdev::writeBits(devAddr, MPU6050_RA_ACCEL_CONFIG, MPU6050_ACONFIG_ACCEL_HPF_BIT, MPU6050_ACONFIG_ACCEL_HPF_LENGTH, bandwidth);
+    MPU6050_ACONFIG_ACCEL_HPF::write(devAddr, bandwidth);
 }
 
 // FF_THR register
@@ -1740,6 +1763,29 @@ void MPU6050::getMotion6(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int
     *gy = (((int16_t)buffer[10]) << 8) | buffer[11];
     *gz = (((int16_t)buffer[12]) << 8) | buffer[13];
 }
+/** Get raw 6-axis motion sensor readings (accel/gyro), with the time at which they were read.
+ * All 14 bytes come from one read, so the accelerometer and gyroscope values share the timestamp.
+ * @param ax 16-bit signed integer container for accelerometer X-axis value
+ * @param ay 16-bit signed integer container for accelerometer Y-axis value
+ * @param az 16-bit signed integer container for accelerometer Z-axis value
+ * @param gx 16-bit signed integer container for gyroscope X-axis value
+ * @param gy 16-bit signed integer container for gyroscope Y-axis value
+ * @param gz 16-bit signed integer container for gyroscope Z-axis value
+ * @param timestamp Container for the start and end times of the read
+ * @return Whether the read succeeded and its times are known
+ * @see getMotion6()
+ * @see I2Cdev::getTimestamp()
+ */
+bool MPU6050::getMotion6(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz, I2CdevTimestamp* timestamp) {
+    int8_t count = I2Cdev::readBytes(devAddr, MPU6050_RA_ACCEL_XOUT_H, 14, buffer);
+    *ax = (((int16_t)buffer[0]) << 8) | buffer[1];
+    *ay = (((int16_t)buffer[2]) << 8) | buffer[3];
+    *az = (((int16_t)buffer[4]) << 8) | buffer[5];
+    *gx = (((int16_t)buffer[8]) << 8) | buffer[9];
+    *gy = (((int16_t)buffer[10]) << 8) | buffer[11];
+    *gz = (((int16_t)buffer[12]) << 8) | buffer[13];
+    return I2Cdev::getTimestamp(timestamp) && count == 14;
+}
 /** Get 3-axis accelerometer readings.
  * These registers store the most recent accelerometer measurements.
  * Accelerometer measurements are written to these registers at the Sample Rate
@@ -2358,6 +2404,7 @@ void MPU6050::resetSensors() {
  */
 void MPU6050::reset() {
     I2Cdev::writeBit(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_DEVICE_RESET_BIT, true);
+    I2Cdev::shadowInvalidate(devAddr); // every register is back to its default
 }
 /** Get sleep mode status.
  * Setting the SLEEP bit in the register puts the device into very low power
@@ -2371,7 +2418,7 @@ void MPU6050::reset() {
  * @see MPU6050_PWR1_SLEEP_BIT
  */
 bool MPU6050::getSleepEnabled() {
-    I2Cdev::readBit(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_SLEEP_BIT, buffer);
+    MPU6050_PWR1_SLEEP::read(devAddr, buffer);
     return buffer[0];
 }
 /** Set sleep mode status.
@@ -2381,7 +2428,7 @@ bool MPU6050::getSleepEnabled() {
  * @see MPU6050_PWR1_SLEEP_BIT
  */
 void MPU6050::setSleepEnabled(bool enabled) {
-    I2Cdev::writeBit(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_SLEEP_BIT, enabled);
+    MPU6050_PWR1_SLEEP::write(devAddr, enabled);
 }
 /** Get wake cycle enabled status.
  * When this bit is set to 1 and SLEEP is disabled, the MPU-60X0 will cycle
@@ -2392,7 +2439,7 @@ void MPU6050::setSleepEnabled(bool enabled) {
  * @see MPU6050_PWR1_CYCLE_BIT
  */
 bool MPU6050::getWakeCycleEnabled() {
-    I2Cdev::readBit(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_CYCLE_BIT, buffer);
+    MPU6050_PWR1_CYCLE::read(devAddr, buffer);
     return buffer[0];
 }
 /** Set wake cycle enabled status.
@@ -2402,7 +2449,7 @@ bool MPU6050::getWakeCycleEnabled() {
  * @see MPU6050_PWR1_CYCLE_BIT
  */
 void MPU6050::setWakeCycleEnabled(bool enabled) {
-    I2Cdev::writeBit(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_CYCLE_BIT, enabled);
+    MPU6050_PWR1_CYCLE::write(devAddr, enabled);
 }
 /** Get temperature sensor enabled status.
  * Control the usage of the internal temperature sensor.
@@ -2416,7 +2463,7 @@ void MPU6050::setWakeCycleEnabled(bool enabled) {
  * @see MPU6050_PWR1_TEMP_DIS_BIT
  */
 bool MPU6050::getTempSensorEnabled() {
-    I2Cdev::readBit(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_TEMP_DIS_BIT, buffer);
+    MPU6050_PWR1_TEMP_DIS::read(devAddr, buffer);
     return buffer[0] == 0; // 1 is actually disabled here
 }
 /** Set temperature sensor enabled status.
@@ -2431,7 +2478,7 @@ bool MPU6050::getTempSensorEnabled() {
  */
 void MPU6050::setTempSensorEnabled(bool enabled) {
     // 1 is actually disabled here
-    I2Cdev::writeBit(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_TEMP_DIS_BIT, !enabled);
+    MPU6050_PWR1_TEMP_DIS::write(devAddr, !enabled);
 }
 /** Get clock source setting.
  * @return Current clock source setting
@@ -2440,7 +2487,7 @@ void MPU6050::setTempSensorEnabled(bool enabled) {
  * @see MPU6050_PWR1_CLKSEL_LENGTH
  */
 uint8_t MPU6050::getClockSource() {
-    I2Cdev::readBits(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_CLKSEL_BIT, MPU6050_PWR1_CLKSEL_LENGTH, buffer);
+    MPU6050_PWR1_CLKSEL::read(devAddr, buffer);
     return buffer[0];
 }
 /** Set clock source setting.
@@ -2474,7 +2521,7 @@ uint8_t MPU6050::getClockSource() {
  * @see MPU6050_PWR1_CLKSEL_LENGTH
  */
 void MPU6050::setClockSource(uint8_t source) {
-    I2Cdev::writeBits(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_CLKSEL_BIT, MPU6050_PWR1_CLKSEL_LENGTH, source);
+    MPU6050_PWR1_CLKSEL::write(devAddr, source);
 }
 
 // PWR_MGMT_2 register
@@ -2677,6 +2724,216 @@ uint8_t MPU6050::getFIFOByte() {
 void MPU6050::getFIFOBytes(uint8_t *data, uint8_t length) {
     I2Cdev::readBytes(devAddr, MPU6050_RA_FIFO_R_W, length, data);
 }
+
+/** Get interrupt status, FIFO count and (optionally) FIFO data in one go.
+ * The three reads go out as a single combined transfer where I2Cdev supports
+ * it, instead of three separate ones in every loop of a FIFO consumer. The
+ * FIFO count is read before the data, so only ask for as many bytes as an
+ * earlier count says are already there; the bytes left after the call are
+ * then fifoCount - length.
+ * @param intStatus Set to the interrupt status (which clears the bits)
+ * @param fifoCount Set to the FIFO count
+ * @param data Buffer for FIFO bytes (may be 0 if length is 0)
+ * @param length Number of FIFO bytes to read
+ * @return True if all the reads succeeded
+ * @see getIntStatus()
+ * @see getFIFOCount()
+ * @see getFIFOBytes()
+ */
+bool MPU6050::getIntStatusFIFO(uint8_t *intStatus, uint16_t *fifoCount, uint8_t *data, uint8_t length) {
+    I2CdevReadSpan spans[3] = {
+        { devAddr, MPU6050_RA_INT_STATUS,  1,      buffer,     0 },
+        { devAddr, MPU6050_RA_FIFO_COUNTH, 2,      buffer + 1, 0 },
+        { devAddr, MPU6050_RA_FIFO_R_W,    length, data,       0 }
+    };
+    uint8_t count = (length && data) ? 3 : 2;
+    bool success = I2Cdev::readScatter(spans, count) == count;
+    *intStatus = buffer[0];
+    *fifoCount = (((uint16_t)buffer[1]) << 8) | buffer[2];
+    return success;
+}
+
+/** Read everything in the FIFO and split it into whole packets.
+ * The FIFO count is read with the interrupt status, then as much of the FIFO
+ * as fits in the drain's buffer is read with one scatter-gather read (i.e.,
+ * one combined transfer where I2Cdev supports it) of up to 255 bytes per span,
+ * rather than one packet at a time. Bytes of an incomplete packet are kept
+ * for the next call. If the FIFO has overflowed, its contents can no longer be
+ * split into packets reliably, so it is reset and the bytes counted as lost.
+ * @param drain Packet size, partial packet and counters, kept between calls
+ * @return Whole packets read, which stay valid until the next drain
+ * @see getIntStatusFIFO()
+ * @see MPU6050FIFODrain
+ */
+MPU6050FIFOPackets MPU6050::drainFIFO(MPU6050FIFODrain *drain) {
+    MPU6050FIFOPackets packets = { drain->buffer, 0, drain->packetSize };
+    if (!drain->packetSize || drain->packetSize > MPU6050_DRAIN_LENGTH) return packets;
+
+    // keep the partial packet from last time
+    uint16_t partial = drain->used - drain->consumed;
+    if (partial && drain->consumed) memmove(drain->buffer, drain->buffer + drain->consumed, partial);
+    drain->used = partial;
+    drain->consumed = 0;
+
+    uint16_t fifoCount;
+    if (!getIntStatusFIFO(&drain->intStatus, &fifoCount)) {
+        drain->errors++;
+        return packets;
+    }
+    if ((drain->intStatus & (1 << MPU6050_INTERRUPT_FIFO_OFLOW_BIT)) || fifoCount >= MPU6050_FIFO_SIZE) {
+        resetFIFO();
+        drain->overflows++;
+        drain->lostBytes += fifoCount + partial;
+        drain->used = 0;
+        return packets;
+    }
+
+    uint16_t length = MPU6050_DRAIN_LENGTH - partial;
+    if (length > fifoCount) length = fifoCount;
+
+    I2CdevReadSpan spans[MPU6050_DRAIN_SPANS];
+    uint8_t count = 0;
+    for (uint16_t offset = 0; offset < length; offset += 255) {
+        spans[count].devAddr = devAddr;
+        spans[count].regAddr = MPU6050_RA_FIFO_R_W;
+        spans[count].length = (length - offset < 255) ? length - offset : 255;
+        spans[count].data = drain->buffer + partial + offset;
+        spans[count].count = 0;
+        count++;
+    }
+    if (I2Cdev::readScatter(spans, count) != count) {
+        // what was taken from the FIFO is unknown, so start again from empty
+        resetFIFO();
+        drain->errors++;
+        drain->lostBytes += length + partial;
+        drain->used = 0;
+        return packets;
+    }
+    drain->used = partial + length;
+
+    packets.count = drain->used / drain->packetSize;
+    drain->consumed = packets.count * drain->packetSize;
+    drain->packets += packets.count;
+    return packets;
+}
+
+/** Get the DMP pipeline set by dmpSetPipeline().
+ * @return Pipeline, or 0 if none has been set
+ */
+MPU6050DMPPipeline *MPU6050::getDMPPipeline() {
+    return dmpPipeline;
+}
+
+/** Drain DMP packets from the FIFO, decode them and pass them to the consumers.
+ * Packets are drained from the FIFO with drainFIFO(), then decoded a batch
+ * (up to MPU6050_DMP_BATCH packets) at a time into the pipeline's arrays, and
+ * each consumer is called for each packet in turn. Packets not processed
+ * because of maxPackets are kept for the next call, which only reads the FIFO
+ * again once they are done. Each packet is timestamped by counting back one
+ * sample period per packet from the end of the FIFO read.
+ * @param maxPackets Most packets to process
+ * @return Number of packets processed (0 if no pipeline is set)
+ * @see dmpSetPipeline()
+ * @see MPU6050DMPPipeline
+ */
+uint16_t MPU6050::processDMPPackets(uint16_t maxPackets) {
+    MPU6050DMPPipeline *pipeline = dmpPipeline;
+    if (!pipeline) return 0;
+
+    uint16_t processed = 0;
+    bool drained = false;
+    while (processed < maxPackets) {
+        if (pipeline->next == pipeline->pending.count) {
+            if (drained) break; // only read the FIFO once per call
+            pipeline->pending = drainFIFO(&pipeline->drain);
+            pipeline->next = 0;
+            drained = true;
+
+            I2CdevTimestamp timestamp;
+            pipeline->pendingTimestamp = I2Cdev::getTimestamp(&timestamp) ? timestamp.end : 0;
+            if (!pipeline->pending.count) break;
+        }
+        uint16_t count = pipeline->pending.count - pipeline->next;
+        if (count > MPU6050_DMP_BATCH) count = MPU6050_DMP_BATCH;
+        if (count > maxPackets - processed) count = maxPackets - processed;
+
+        uint64_t lastTimestamp = pipeline->pendingTimestamp;
+        if (lastTimestamp) {
+            lastTimestamp -= (uint64_t)(pipeline->pending.count - pipeline->next - count) * pipeline->samplePeriod;
+        }
+        pipeline->decode(pipeline->pending.packet(pipeline->next), count, lastTimestamp);
+        pipeline->next += count;
+        processed += count;
+    }
+    return processed;
+}
+
+/** Default constructor, for MotionApps 2.0 packets until setLayout() says otherwise.
+ */
+MPU6050DMPPipeline::MPU6050DMPPipeline() : drain(42), next(0), pendingTimestamp(0), samplePeriod(10000000UL), processed(0),
+    quaternionOffset(0), gyroOffset(16), accelOffset(28), consumerCount(0) {
+    pending.data = drain.buffer;
+    pending.count = 0;
+    pending.size = drain.packetSize;
+    packets.count = 0;
+}
+
+/** Set the packet size and where the quaternion, gyro and accel words are in each packet; also empties the pipeline.
+ * @param packetSize Bytes per DMP packet
+ * @param quaternionOffset Offset of the quaternion (4 x 32 bits, MSB first, of which the top 16 bits are kept)
+ * @param gyroOffset Offset of the gyro rates (3 x 32 bits)
+ * @param accelOffset Offset of the accelerations (3 x 32 bits)
+ */
+void MPU6050DMPPipeline::setLayout(uint16_t packetSize, uint8_t quaternionOffset, uint8_t gyroOffset, uint8_t accelOffset) {
+    drain.packetSize = packetSize;
+    drain.used = 0;
+    drain.consumed = 0;
+    pending.count = 0;
+    pending.size = packetSize;
+    next = 0;
+    this->quaternionOffset = quaternionOffset;
+    this->gyroOffset = gyroOffset;
+    this->accelOffset = accelOffset;
+}
+
+/** Register a function to be called for every packet decoded.
+ * @param consumer Function to call
+ * @param context Passed to the function as is
+ * @return False if there are MPU6050_DMP_CONSUMERS already
+ */
+bool MPU6050DMPPipeline::addConsumer(MPU6050DMPConsumer consumer, void *context) {
+    if (consumerCount == MPU6050_DMP_CONSUMERS) return false;
+    this->consumer[consumerCount] = consumer;
+    consumerContext[consumerCount] = context;
+    consumerCount++;
+    return true;
+}
+
+/** Decode packets into the arrays, then call the consumers for each packet.
+ * @param data First packet
+ * @param count Number of packets (at most MPU6050_DMP_BATCH)
+ * @param lastTimestamp Time of the last packet in nanoseconds (0 if unknown)
+ */
+void MPU6050DMPPipeline::decode(const uint8_t *data, uint16_t count, uint64_t lastTimestamp) {
+    if (count > MPU6050_DMP_BATCH) count = MPU6050_DMP_BATCH;
+
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t *packet = data + i * drain.packetSize;
+        const uint8_t *q = packet + quaternionOffset;
+        const uint8_t *g = packet + gyroOffset;
+        const uint8_t *a = packet + accelOffset;
+        for (uint8_t c = 0; c < 4; c++) packets.quaternion[c][i] = (int16_t)((q[4 * c] << 8) | q[4 * c + 1]);
+        for (uint8_t c = 0; c < 3; c++) packets.gyro[c][i] = (int16_t)((g[4 * c] << 8) | g[4 * c + 1]);
+        for (uint8_t c = 0; c < 3; c++) packets.accel[c][i] = (int16_t)((a[4 * c] << 8) | a[4 * c + 1]);
+        packets.timestamp[i] = lastTimestamp ? lastTimestamp - (uint64_t)(count - 1 - i) * samplePeriod : 0;
+    }
+    packets.count = count;
+
+    for (uint16_t i = 0; i < count; i++) {
+        for (uint8_t c = 0; c < consumerCount; c++) consumer[c](&packets, i, consumerContext[c]);
+    }
+    processed += count;
+}
 /** Write byte to FIFO buffer.
  * @see getFIFOByte()
  * @see MPU6050_RA_FIFO_R_W
@@ -2932,153 +3189,215 @@ uint8_t MPU6050::readMemoryByte() {
 void MPU6050::writeMemoryByte(uint8_t data) {
     I2Cdev::writeByte(devAddr, MPU6050_RA_MEM_R_W, data);
 }
+/** Select a DMP memory bank and start address with one write; BANK_SEL and MEM_START_ADDR are adjacent registers.
+ * @param bank Memory bank (no prefetch, not a user bank)
+ * @param address Start address within the bank
+ */
+void MPU6050::selectMemory(uint8_t bank, uint8_t address) {
+    buffer[0] = bank & 0x1F;
+    buffer[1] = address;
+    I2Cdev::writeBytes(devAddr, MPU6050_RA_BANK_SEL, 2, buffer);
+}
+/** Read a block of DMP memory, in bursts of up to MPU6050_DMP_MEMORY_BURST_SIZE bytes (a whole bank, on the
+ * Raspberry Pi), each after selecting its bank and start address.
+ * @param data Buffer to store memory contents in
+ * @param dataSize Number of bytes to read
+ * @param bank First memory bank
+ * @param address Start address within the first bank
+ */
 void MPU6050::readMemoryBlock(uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address) {
-    setMemoryBank(bank);
-    setMemoryStartAddress(address);
-    uint8_t chunkSize;
-    for (uint16_t i = 0; i < dataSize;) {
-        // determine correct chunk size according to bank position and data size
-        chunkSize = MPU6050_DMP_MEMORY_CHUNK_SIZE;
+    uint16_t i, burstSize;
+    for (i = 0; i < dataSize; i += burstSize) {
+        // make sure the burst doesn't go past the data size or the bank boundary (256 bytes)
+        burstSize = MPU6050_DMP_MEMORY_BURST_SIZE;
+        if (burstSize > dataSize - i) burstSize = dataSize - i;
+        if (burstSize > MPU6050_DMP_MEMORY_BANK_SIZE - address) burstSize = MPU6050_DMP_MEMORY_BANK_SIZE - address;
 
-        // make sure we don't go past the data size
-        if (i + chunkSize > dataSize) chunkSize = dataSize - i;
-
-        // make sure this chunk doesn't go past the bank boundary (256 bytes)
-        if (chunkSize > 256 - address) chunkSize = 256 - address;
-
-        // read the chunk of data as specified
-        I2Cdev::readBytes(devAddr, MPU6050_RA_MEM_R_W, chunkSize, data + i);
-        
-        // increase byte index by [chunkSize]
-        i += chunkSize;
+        selectMemory(bank, address);
+        I2Cdev::readBurst(devAddr, MPU6050_RA_MEM_R_W, burstSize, data + i);
 
         // uint8_t automatically wraps to 0 at 256
-        address += chunkSize;
-
-        // if we aren't done, update bank (if necessary) and address
-        if (i < dataSize) {
-            if (address == 0) bank++;
-            setMemoryBank(bank);
-            setMemoryStartAddress(address);
-        }
+        address += burstSize;
+        if (address == 0) bank++;
     }
 }
+/** Write a block of DMP memory, in bursts of up to MPU6050_DMP_MEMORY_BURST_SIZE bytes (a whole bank, on the
+ * Raspberry Pi), without allocating any memory. If verifying, the part written to each bank is read back in bursts
+ * once the bank is written, and its CRC compared with that of the data, so no copy of the data need be kept.
+ * @param data Data to write (in program memory, if useProgMem)
+ * @param dataSize Number of bytes to write
+ * @param bank First memory bank
+ * @param address Start address within the first bank
+ * @param verify Whether to read back and check what was written
+ * @param useProgMem Whether data is in program memory (PROGMEM)
+ * @return Status of operation (true = success, and verified if requested)
+ */
 bool MPU6050::writeMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address, bool verify, bool useProgMem) {
-    setMemoryBank(bank);
-    setMemoryStartAddress(address);
-    uint8_t chunkSize;
-    uint8_t *verifyBuffer;
-    uint8_t *progBuffer;
-    uint16_t i;
-    uint8_t j;
-    if (verify) verifyBuffer = (uint8_t *)malloc(MPU6050_DMP_MEMORY_CHUNK_SIZE);
-    if (useProgMem) progBuffer = (uint8_t *)malloc(MPU6050_DMP_MEMORY_CHUNK_SIZE);
-    for (i = 0; i < dataSize;) {
-        // determine correct chunk size according to bank position and data size
-        chunkSize = MPU6050_DMP_MEMORY_CHUNK_SIZE;
-
-        // make sure we don't go past the data size
-        if (i + chunkSize > dataSize) chunkSize = dataSize - i;
-
-        // make sure this chunk doesn't go past the bank boundary (256 bytes)
-        if (chunkSize > 256 - address) chunkSize = 256 - address;
-        
-        if (useProgMem) {
-            // write the chunk of data as specified
-            for (j = 0; j < chunkSize; j++) progBuffer[j] = pgm_read_byte(data + i + j);
-        } else {
-            // write the chunk of data as specified
-            progBuffer = (uint8_t *)data + i;
-        }
-
-        I2Cdev::writeBytes(devAddr, MPU6050_RA_MEM_R_W, chunkSize, progBuffer);
-
-        // verify data if needed
-        if (verify && verifyBuffer) {
-            setMemoryBank(bank);
-            setMemoryStartAddress(address);
-            I2Cdev::readBytes(devAddr, MPU6050_RA_MEM_R_W, chunkSize, verifyBuffer);
-            if (memcmp(progBuffer, verifyBuffer, chunkSize) != 0) {
-                /*Serial.print("Block write verification error, bank ");
-                Serial.print(bank, DEC);
-                Serial.print(", address ");
-                Serial.print(address, DEC);
-                Serial.print("!\nExpected:");
-                for (j = 0; j < chunkSize; j++) {
-                    Serial.print(" 0x");
-                    if (progBuffer[j] < 16) Serial.print("0");
-                    Serial.print(progBuffer[j], HEX);
-                }
-                Serial.print("\nReceived:");
-                for (uint8_t j = 0; j < chunkSize; j++) {
-                    Serial.print(" 0x");
-                    if (verifyBuffer[i + j] < 16) Serial.print("0");
-                    Serial.print(verifyBuffer[i + j], HEX);
-                }
-                Serial.print("\n");*/
-                free(verifyBuffer);
-                if (useProgMem) free(progBuffer);
-                return false; // uh oh.
+    uint8_t burst[MPU6050_DMP_MEMORY_BURST_SIZE];
+    uint16_t i, j, k, bankSize, burstSize, crc, check;
+    for (i = 0; i < dataSize; i += bankSize, bank++, address = 0) {
+        // the part of the block that goes in this bank
+        bankSize = MPU6050_DMP_MEMORY_BANK_SIZE - address;
+        if (bankSize > dataSize - i) bankSize = dataSize - i;
+
+        crc = 0xFFFF;
+        for (j = 0; j < bankSize; j += burstSize) {
+            burstSize = MPU6050_DMP_MEMORY_BURST_SIZE;
+            if (burstSize > bankSize - j) burstSize = bankSize - j;
+
+            const uint8_t *source = data + i + j;
+            if (useProgMem) {
+                for (k = 0; k < burstSize; k++) burst[k] = pgm_read_byte(source + k);
+                source = burst;
             }
-        }
+            if (verify) crc = memoryCRC(source, burstSize, false, crc);
 
-        // increase byte index by [chunkSize]
-        i += chunkSize;
+            selectMemory(bank, address + j);
+            if (!I2Cdev::writeBurst(devAddr, MPU6050_RA_MEM_R_W, burstSize, source)) return false;
+        }
 
-        // uint8_t automatically wraps to 0 at 256
-        address += chunkSize;
+        if (verify) {
+            check = 0xFFFF;
+            for (j = 0; j < bankSize; j += burstSize) {
+                burstSize = MPU6050_DMP_MEMORY_BURST_SIZE;
+                if (burstSize > bankSize - j) burstSize = bankSize - j;
 
-        // if we aren't done, update bank (if necessary) and address
-        if (i < dataSize) {
-            if (address == 0) bank++;
-            setMemoryBank(bank);
-            setMemoryStartAddress(address);
+                selectMemory(bank, address + j);
+                if (I2Cdev::readBurst(devAddr, MPU6050_RA_MEM_R_W, burstSize, burst) != (int16_t)burstSize) return false;
+                check = memoryCRC(burst, burstSize, false, check);
+            }
+            if (check != crc) return false; // uh oh.
         }
     }
-    if (verify) free(verifyBuffer);
-    if (useProgMem) free(progBuffer);
     return true;
 }
 bool MPU6050::writeProgMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address, bool verify) {
     return writeMemoryBlock(data, dataSize, bank, address, verify, true);
 }
-bool MPU6050::writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSize, bool useProgMem) {
-    uint8_t *progBuffer, success, special;
-    uint16_t i, j;
-    if (useProgMem) {
-        progBuffer = (uint8_t *)malloc(8); // assume 8-byte blocks, realloc later if necessary
+/** Calculate the CRC-16 (CCITT: polynomial 0x1021, no reflection) of a block of memory contents, e.g., of the DMP
+ * firmware or of what was read back from a memory bank.
+ * @param data Data to check (in program memory, if useProgMem)
+ * @param dataSize Number of bytes
+ * @param useProgMem Whether data is in program memory (PROGMEM)
+ * @param crc Initial value: 0xFFFF to start, or the result for the preceding data to continue
+ * @return CRC of the data
+ */
+uint16_t MPU6050::memoryCRC(const uint8_t *data, uint16_t dataSize, bool useProgMem, uint16_t crc) {
+    for (uint16_t i = 0; i < dataSize; i++) {
+        crc ^= (uint16_t)(useProgMem ? pgm_read_byte(data + i) : data[i]) << 8;
+        for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
+/** Calculate the fingerprint that DMP memory would have once an image of DMP code has been loaded, followed by a
+ * configuration set: the CRC of the first MPU6050_DMP_FINGERPRINT_LENGTH bytes of each bank of the image from
+ * MPU6050_DMP_FINGERPRINT_BANK on, with any configuration blocks in them applied.
+ * @param image DMP code image (in program memory), as for writeProgMemoryBlock()
+ * @param imageSize Size of the image in bytes
+ * @param config Configuration set (in program memory), as for writeProgDMPConfigurationSet()
+ * @param configSize Size of the configuration set in bytes
+ * @return Fingerprint, to compare with readMemoryFingerprint()
+ */
+uint16_t MPU6050::memoryImageFingerprint(const uint8_t *image, uint16_t imageSize, const uint8_t *config, uint16_t configSize) {
+    uint8_t span[MPU6050_DMP_FINGERPRINT_LENGTH];
+    uint16_t crc = 0xFFFF;
+    for (uint16_t start = MPU6050_DMP_FINGERPRINT_BANK * MPU6050_DMP_MEMORY_BANK_SIZE; start < imageSize; start += MPU6050_DMP_MEMORY_BANK_SIZE) {
+        uint16_t length = MPU6050_DMP_FINGERPRINT_LENGTH;
+        if (length > imageSize - start) length = imageSize - start;
+        for (uint16_t k = 0; k < length; k++) span[k] = pgm_read_byte(image + start + k);
+
+        // config set data is a long string of blocks: [bank] [offset] [length] [byte[0], ..., byte[length]],
+        // or a special instruction: [bank] [offset] [0] [special]
+        for (uint16_t i = 0; i + 3 <= configSize;) {
+            uint16_t address = ((uint16_t)pgm_read_byte(config + i) << 8) | pgm_read_byte(config + i + 1);
+            uint8_t blockLength = pgm_read_byte(config + i + 2);
+            i += 3;
+            if (blockLength == 0) {
+                i++;
+                continue;
+            }
+            for (uint16_t k = 0; k < blockLength && i + k < configSize; k++) {
+                if (address + k >= start && address + k < start + length) span[address + k - start] = pgm_read_byte(config + i + k);
+            }
+            i += blockLength;
+        }
+        crc = memoryCRC(span, length, false, crc);
+    }
+    return crc;
+}
+/** Read the fingerprint of what DMP memory holds now: the CRC of the first MPU6050_DMP_FINGERPRINT_LENGTH bytes of
+ * each bank from MPU6050_DMP_FINGERPRINT_BANK on, as far as an image of the given size would extend (two transfers
+ * a bank, on the Raspberry Pi).
+ * @param imageSize Size of the image of DMP code expected to be loaded
+ * @return Fingerprint, to compare with memoryImageFingerprint()
+ */
+uint16_t MPU6050::readMemoryFingerprint(uint16_t imageSize) {
+    uint8_t span[MPU6050_DMP_FINGERPRINT_LENGTH];
+    uint16_t crc = 0xFFFF;
+    for (uint16_t start = MPU6050_DMP_FINGERPRINT_BANK * MPU6050_DMP_MEMORY_BANK_SIZE; start < imageSize; start += MPU6050_DMP_MEMORY_BANK_SIZE) {
+        uint16_t length = MPU6050_DMP_FINGERPRINT_LENGTH;
+        if (length > imageSize - start) length = imageSize - start;
+        readMemoryBlock(span, length, start / MPU6050_DMP_MEMORY_BANK_SIZE, 0);
+        crc = memoryCRC(span, length, false, crc);
     }
+    return crc;
+}
+/** Write a DMP configuration set: a flat stream of blocks, each [bank] [offset] [length] [byte[0], ..., byte[length]],
+ * or, with a length of 0, a special instruction [bank] [offset] [0] [special]. The whole stream is checked before
+ * anything is written, so a malformed set fails without half-configuring the DMP. Blocks that follow on from each
+ * other in the same bank are merged into bursts of up to MPU6050_DMP_MEMORY_BURST_SIZE bytes (e.g., the nine
+ * 4-byte compass matrix blocks), each written and verified as one block; only a stack buffer is used.
+ * @param data Configuration set (in program memory, if useProgMem)
+ * @param dataSize Size of the configuration set in bytes
+ * @param useProgMem Whether data is in program memory (PROGMEM)
+ * @return Status of operation (true = success, and verified)
+ */
+bool MPU6050::writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSize, bool useProgMem) {
+    uint8_t burst[MPU6050_DMP_MEMORY_BURST_SIZE];
+    uint16_t burstLength = 0, i, j;
+    uint8_t burstBank = 0, burstAddress = 0;
+    uint8_t bank, offset, length, special;
 
-    // config set data is a long string of blocks with the following structure:
-    // [bank] [offset] [length] [byte[0], byte[1], ..., byte[length]]
-    uint8_t bank, offset, length;
+    // check the stream first: every block complete, and only known special instructions
     for (i = 0; i < dataSize;) {
-        if (useProgMem) {
-            bank = pgm_read_byte(data + i++);
-            offset = pgm_read_byte(data + i++);
-            length = pgm_read_byte(data + i++);
+        if (dataSize - i < 4) return false;
+        length = useProgMem ? pgm_read_byte(data + i + 2) : data[i + 2];
+        if (length > 0) {
+            if (dataSize - i - 3 < length) return false;
+            i += 3 + length;
         } else {
-            bank = data[i++];
-            offset = data[i++];
-            length = data[i++];
+            special = useProgMem ? pgm_read_byte(data + i + 3) : data[i + 3];
+            if (special != 0x01) return false; // unknown special command
+            i += 4;
         }
+    }
 
-        // write data or perform special action
-        if (length > 0) {
-            // regular block of data to write
-            /*Serial.print("Writing config block to bank ");
-            Serial.print(bank);
-            Serial.print(", offset ");
-            Serial.print(offset);
-            Serial.print(", length=");
-            Serial.println(length);*/
-            if (useProgMem) {
-                if (sizeof(progBuffer) < length) progBuffer = (uint8_t *)realloc(progBuffer, length);
-                for (j = 0; j < length; j++) progBuffer[j] = pgm_read_byte(data + i + j);
-            } else {
-                progBuffer = (uint8_t *)data + i;
-            }
-            success = writeMemoryBlock(progBuffer, length, bank, offset, true);
+    for (i = 0; i < dataSize;) {
+        bank = useProgMem ? pgm_read_byte(data + i) : data[i];
+        offset = useProgMem ? pgm_read_byte(data + i + 1) : data[i + 1];
+        length = useProgMem ? pgm_read_byte(data + i + 2) : data[i + 2];
+        i += 3;
+
+        // add to the burst if the block follows on from it (a burst never crosses into the next bank)
+        if (length > 0 && burstLength > 0 && bank == burstBank && offset == burstAddress + burstLength && burstLength + length <= MPU6050_DMP_MEMORY_BURST_SIZE) {
+            for (j = 0; j < length; j++) burst[burstLength++] = useProgMem ? pgm_read_byte(data + i + j) : data[i + j];
+            i += length;
+            continue;
+        }
+
+        if (burstLength > 0) {
+            if (!writeMemoryBlock(burst, burstLength, burstBank, burstAddress, true)) return false; // uh oh
+            burstLength = 0;
+        }
+
+        if (length > MPU6050_DMP_MEMORY_BURST_SIZE) {
+            // too long to merge; write it as it is
+            if (!writeMemoryBlock(data + i, length, bank, offset, true, useProgMem)) return false;
+            i += length;
+        } else if (length > 0) {
+            burstBank = bank;
+            burstAddress = offset;
+            for (j = 0; j < length; j++) burst[burstLength++] = useProgMem ? pgm_read_byte(data + i + j) : data[i + j];
             i += length;
         } else {
             // special instruction
@@ -3086,35 +3405,17 @@ bool MPU6050::writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSize, b
             // is totally undocumented. This code is in here based on observed
             // behavior only, and exactly why (or even whether) it has to be here
             // is anybody's guess for now.
-            if (useProgMem) {
-                special = pgm_read_byte(data + i++);
-            } else {
-                special = data[i++];
-            }
-            /*Serial.print("Special command code ");
-            Serial.print(special, HEX);
-            Serial.println(" found...");*/
-            if (special == 0x01) {
-                // enable DMP-related interrupts
-                
-                //setIntZeroMotionEnabled(true);
-                //setIntFIFOBufferOverflowEnabled(true);
-                //setIntDMPEnabled(true);
-                I2Cdev::writeByte(devAddr, MPU6050_RA_INT_ENABLE, 0x32);  // single operation
-
-                success = true;
-            } else {
-                // unknown special command
-                success = false;
-            }
-        }
-        
-        if (!success) {
-            if (useProgMem) free(progBuffer);
-            return false; // uh oh
+            i++; // 0x01, checked above: enable DMP-related interrupts
+
+            //setIntZeroMotionEnabled(true);
+            //setIntFIFOBufferOverflowEnabled(true);
+            //setIntDMPEnabled(true);
+            I2Cdev::writeByte(devAddr, MPU6050_RA_INT_ENABLE, 0x32);  // single operation
         }
     }
-    if (useProgMem) free(progBuffer);
+    if (burstLength > 0) {
+        if (!writeMemoryBlock(burst, burstLength, burstBank, burstAddress, true)) return false;
+    }
     return true;
 }
 bool MPU6050::writeProgDMPConfigurationSet(const uint8_t *data, uint16_t dataSize) {
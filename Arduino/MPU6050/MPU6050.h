@@ -406,8 +406,125 @@ THE SOFTWARE.
 #define MPU6050_DMP_MEMORY_BANK_SIZE    256
 #define MPU6050_DMP_MEMORY_CHUNK_SIZE   16
 
+// longest write to (or read from) DMP memory in one transfer: a whole bank on the Raspberry Pi, or a chunk elsewhere,
+// to fit the Wire library's 32-byte buffer
+#ifndef MPU6050_DMP_MEMORY_BURST_SIZE
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        #define MPU6050_DMP_MEMORY_BURST_SIZE   MPU6050_DMP_MEMORY_BANK_SIZE
+    #else
+        #define MPU6050_DMP_MEMORY_BURST_SIZE   MPU6050_DMP_MEMORY_CHUNK_SIZE
+    #endif
+#endif
+
+// DMP memory checked before a warm start (see MPU6050::readMemoryFingerprint()): the first bytes of each bank from
+// the first bank of DMP code on; the banks below it hold data that the DMP changes as it runs
+#define MPU6050_DMP_FINGERPRINT_BANK    3
+#define MPU6050_DMP_FINGERPRINT_LENGTH  16
+
 // note: DMP code memory blocks defined at end of header file
 
+// register fields, with masks and shifts fixed at compile time; fields of the same register can be updated
+// together with a single write using I2CdevFields<>
+typedef I2CdevField<MPU6050_RA_CONFIG, MPU6050_CFG_EXT_SYNC_SET_BIT, MPU6050_CFG_EXT_SYNC_SET_LENGTH> MPU6050_CFG_EXT_SYNC_SET;
+typedef I2CdevField<MPU6050_RA_CONFIG, MPU6050_CFG_DLPF_CFG_BIT, MPU6050_CFG_DLPF_CFG_LENGTH>         MPU6050_CFG_DLPF_CFG;
+typedef I2CdevField<MPU6050_RA_GYRO_CONFIG, MPU6050_GCONFIG_FS_SEL_BIT, MPU6050_GCONFIG_FS_SEL_LENGTH> MPU6050_GCONFIG_FS_SEL;
+typedef I2CdevField<MPU6050_RA_ACCEL_CONFIG, MPU6050_ACONFIG_AFS_SEL_BIT, MPU6050_ACONFIG_AFS_SEL_LENGTH>     MPU6050_ACONFIG_AFS_SEL;
+typedef I2CdevField<MPU6050_RA_ACCEL_CONFIG, MPU6050_ACONFIG_ACCEL_HPF_BIT, MPU6050_ACONFIG_ACCEL_HPF_LENGTH> MPU6050_ACONFIG_ACCEL_HPF;
+typedef I2CdevField<MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_SLEEP_BIT, 1>    MPU6050_PWR1_SLEEP;
+typedef I2CdevField<MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_CYCLE_BIT, 1>    MPU6050_PWR1_CYCLE;
+typedef I2CdevField<MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_TEMP_DIS_BIT, 1> MPU6050_PWR1_TEMP_DIS;
+typedef I2CdevField<MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_CLKSEL_BIT, MPU6050_PWR1_CLKSEL_LENGTH> MPU6050_PWR1_CLKSEL;
+
+// FIFO size, and the buffer that drainFIFO() reads into: enough for a full FIFO plus a partial packet on the
+// Raspberry Pi, or a few DMP packets at a time elsewhere
+#define MPU6050_FIFO_SIZE               1024
+#ifndef MPU6050_DRAIN_LENGTH
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        #define MPU6050_DRAIN_LENGTH    (MPU6050_FIFO_SIZE + 64)
+    #else
+        #define MPU6050_DRAIN_LENGTH    128
+    #endif
+#endif
+#define MPU6050_DRAIN_SPANS             ((MPU6050_DRAIN_LENGTH + 254) / 255) // reads of at most 255 bytes
+
+// whole packets from MPU6050::drainFIFO(); valid until the next drain with the same MPU6050FIFODrain
+struct MPU6050FIFOPackets {
+    const uint8_t *data;
+    uint16_t count;
+    uint16_t size;
+
+    const uint8_t *packet(uint16_t i) const { return data + i * size; }
+};
+
+// state kept between calls to MPU6050::drainFIFO(), including any partial packet
+class MPU6050FIFODrain {
+    public:
+        MPU6050FIFODrain(uint16_t packetSize) : packetSize(packetSize), used(0), consumed(0), intStatus(0),
+            packets(0), overflows(0), lostBytes(0), errors(0) {}
+
+        uint16_t packetSize;
+        uint16_t used;              // bytes in buffer
+        uint16_t consumed;          // bytes in buffer handed back as whole packets
+        uint8_t intStatus;          // INT_STATUS as of the last drain (reading it clears the bits)
+
+        unsigned long packets;      // whole packets drained
+        unsigned long overflows;    // times the FIFO was found to have overflowed, and was reset
+        unsigned long lostBytes;    // bytes thrown away, to get back into step with the packets
+        unsigned long errors;       // failed reads
+
+        uint8_t buffer[MPU6050_DRAIN_LENGTH];
+};
+
+// DMP packets decoded by MPU6050::processDMPPackets(), a batch at a time, with one array per quantity; quaternion
+// components are w, x, y, z (1.0 = 16384), and timestamps are in nanoseconds (0 if the platform doesn't keep them)
+#ifndef MPU6050_DMP_BATCH
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_RPI
+        #define MPU6050_DMP_BATCH       32
+    #else
+        #define MPU6050_DMP_BATCH       4
+    #endif
+#endif
+#define MPU6050_DMP_CONSUMERS           4
+
+struct MPU6050DMPPackets {
+    uint16_t count;
+    int16_t quaternion[4][MPU6050_DMP_BATCH];
+    int16_t gyro[3][MPU6050_DMP_BATCH];
+    int16_t accel[3][MPU6050_DMP_BATCH];
+    uint64_t timestamp[MPU6050_DMP_BATCH];
+};
+
+// called for each packet i of a decoded batch, in order
+typedef void (*MPU6050DMPConsumer)(const MPU6050DMPPackets *packets, uint16_t i, void *context);
+
+// FIFO drain, decoded batch and registered consumers of a DMP; set up for the firmware by MPU6050::dmpSetPipeline()
+class MPU6050DMPPipeline {
+    public:
+        MPU6050DMPPipeline();
+
+        void setLayout(uint16_t packetSize, uint8_t quaternionOffset, uint8_t gyroOffset, uint8_t accelOffset);
+        bool addConsumer(MPU6050DMPConsumer consumer, void *context=0);
+        void decode(const uint8_t *data, uint16_t count, uint64_t lastTimestamp);
+
+        MPU6050FIFODrain drain;
+        MPU6050FIFOPackets pending;     // drained packets, of which the first next have been processed
+        uint16_t next;
+        uint64_t pendingTimestamp;      // of the last pending packet
+
+        MPU6050DMPPackets packets;
+        uint32_t samplePeriod;          // nanoseconds between packets; 10 ms by default (MotionApps' 100 Hz)
+        unsigned long processed;
+
+    private:
+        uint8_t quaternionOffset;
+        uint8_t gyroOffset;
+        uint8_t accelOffset;
+
+        MPU6050DMPConsumer consumer[MPU6050_DMP_CONSUMERS];
+        void *consumerContext[MPU6050_DMP_CONSUMERS];
+        uint8_t consumerCount;
+};
+
 class MPU6050 {
     public:
         MPU6050();
@@ -415,6 +532,7 @@ class MPU6050 {
 
         void initialize();
         bool testConnection();
+        bool setShadowEnabled(bool enabled);
 
         // AUX_VDDIO register
         uint8_t getAuxVDDIOLevel();
@@ -588,6 +706,7 @@ class MPU6050 {
         // ACCEL_*OUT_* registers
         void getMotion9(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz, int16_t* mx, int16_t* my, int16_t* mz);
         void getMotion6(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz);
+        bool getMotion6(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz, I2CdevTimestamp* timestamp);
         void getAcceleration(int16_t* x, int16_t* y, int16_t* z);
         int16_t getAccelerationX();
         int16_t getAccelerationY();
@@ -683,6 +802,10 @@ class MPU6050 {
         void setFIFOByte(uint8_t data);
         void getFIFOBytes(uint8_t *data, uint8_t length);
 
+        // INT_STATUS, FIFO_COUNT_* and FIFO_R_W registers together
+        bool getIntStatusFIFO(uint8_t *intStatus, uint16_t *fifoCount, uint8_t *data=0, uint8_t length=0);
+        MPU6050FIFOPackets drainFIFO(MPU6050FIFODrain *drain);
+
         // WHO_AM_I register
         uint8_t getDeviceID();
         void setDeviceID(uint8_t id);
@@ -775,6 +898,14 @@ class MPU6050 {
         bool writeMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank=0, uint8_t address=0, bool verify=true, bool useProgMem=false);
         bool writeProgMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank=0, uint8_t address=0, bool verify=true);
 
+        // CRC-16 (CCITT) of a block of memory contents; pass the previous result as crc to continue over several blocks
+        static uint16_t memoryCRC(const uint8_t *data, uint16_t dataSize, bool useProgMem=false, uint16_t crc=0xFFFF);
+
+        // fingerprint of DMP code loaded from a PROGMEM image followed by a configuration set, and of what the DMP
+        // memory holds now; a few short reads, so that a warm start can tell whether the firmware is still loaded
+        static uint16_t memoryImageFingerprint(const uint8_t *image, uint16_t imageSize, const uint8_t *config, uint16_t configSize);
+        uint16_t readMemoryFingerprint(uint16_t imageSize);
+
         bool writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSize, bool useProgMem=false);
         bool writeProgDMPConfigurationSet(const uint8_t *data, uint16_t dataSize);
 
@@ -786,12 +917,20 @@ class MPU6050 {
         uint8_t getDMPConfig2();
         void setDMPConfig2(uint8_t config);
 
+        // DMP packet size and buffer, and the pipeline that DMP packets are decoded into; declared whether or not a
+        // MotionApps header is included, so that the class has the same layout in every file
+        uint8_t *dmpPacketBuffer;
+        uint16_t dmpPacketSize;
+
+        MPU6050DMPPipeline *getDMPPipeline();
+        uint16_t processDMPPackets(uint16_t maxPackets=0xFFFF);
+
         // special methods for MotionApps 2.0 implementation
         #ifdef MPU6050_INCLUDE_DMP_MOTIONAPPS20
-            uint8_t *dmpPacketBuffer;
-            uint16_t dmpPacketSize;
-
+            void dmpSetPipeline(MPU6050DMPPipeline *pipeline);
             uint8_t dmpInitialize();
+            bool dmpFirmwareLoaded();
+            uint8_t dmpWarmStart();
             bool dmpPacketAvailable();
 
             uint8_t dmpSetFIFORate(uint8_t fifoRate);
@@ -889,10 +1028,10 @@ class MPU6050 {
 
         // special methods for MotionApps 4.1 implementation
         #ifdef MPU6050_INCLUDE_DMP_MOTIONAPPS41
-            uint8_t *dmpPacketBuffer;
-            uint16_t dmpPacketSize;
-
+            void dmpSetPipeline(MPU6050DMPPipeline *pipeline);
             uint8_t dmpInitialize();
+            bool dmpFirmwareLoaded();
+            uint8_t dmpWarmStart();
             bool dmpPacketAvailable();
 
             uint8_t dmpSetFIFORate(uint8_t fifoRate);
@@ -992,6 +1131,12 @@ class MPU6050 {
     private:
         uint8_t devAddr;
         uint8_t buffer[14];
+        MPU6050DMPPipeline *dmpPipeline;
+
+        void selectMemory(uint8_t bank, uint8_t address);
+
+        // the DMP set-up once its code is loaded, shared by dmpInitialize() and dmpWarmStart(); defined by the MotionApps headers
+        uint8_t dmpStart(int8_t xgOffset, int8_t ygOffset, int8_t zgOffset, bool waitForFIFO);
 };
 
 #endif /* _MPU6050_H_ */
@@ -383,170 +383,195 @@ uint8_t MPU6050::dmpInitialize() {
     DEBUG_PRINT(F("Writing DMP code to MPU memory banks ("));
     DEBUG_PRINT(MPU6050_DMP_CODE_SIZE);
     DEBUG_PRINTLN(F(" bytes)"));
-    if (writeProgMemoryBlock(dmpMemory, MPU6050_DMP_CODE_SIZE)) {
-        DEBUG_PRINTLN(F("Success! DMP code written and verified."));
+    if (!writeProgMemoryBlock(dmpMemory, MPU6050_DMP_CODE_SIZE)) {
+        DEBUG_PRINTLN(F("ERROR! DMP code verification failed."));
+        return 1; // main binary block loading failed
+    }
+    DEBUG_PRINTLN(F("Success! DMP code written and verified."));
 
-        // write DMP configuration
-        DEBUG_PRINT(F("Writing DMP configuration to MPU memory banks ("));
-        DEBUG_PRINT(MPU6050_DMP_CONFIG_SIZE);
-        DEBUG_PRINTLN(F(" bytes in config def)"));
-        if (writeProgDMPConfigurationSet(dmpConfig, MPU6050_DMP_CONFIG_SIZE)) {
-            DEBUG_PRINTLN(F("Success! DMP configuration written and verified."));
+    return dmpStart(xgOffsetTC, ygOffsetTC, zgOffsetTC, true);
+}
 
-            DEBUG_PRINTLN(F("Setting clock source to Z Gyro..."));
-            setClockSource(MPU6050_CLOCK_PLL_ZGYRO);
+uint8_t MPU6050::dmpStart(int8_t xgOffsetTC, int8_t ygOffsetTC, int8_t zgOffsetTC, bool waitForFIFO) {
+    // write DMP configuration
+    DEBUG_PRINT(F("Writing DMP configuration to MPU memory banks ("));
+    DEBUG_PRINT(MPU6050_DMP_CONFIG_SIZE);
+    DEBUG_PRINTLN(F(" bytes in config def)"));
+    if (!writeProgDMPConfigurationSet(dmpConfig, MPU6050_DMP_CONFIG_SIZE)) {
+        DEBUG_PRINTLN(F("ERROR! DMP configuration verification failed."));
+        return 2; // configuration block loading failed
+    }
+    DEBUG_PRINTLN(F("Success! DMP configuration written and verified."));
 
-            DEBUG_PRINTLN(F("Setting DMP and FIFO_OFLOW interrupts enabled..."));
-            setIntEnabled(0x12);
+    DEBUG_PRINTLN(F("Setting clock source to Z Gyro..."));
+    setClockSource(MPU6050_CLOCK_PLL_ZGYRO);
 
-            DEBUG_PRINTLN(F("Setting sample rate to 200Hz..."));
-            setRate(4); // 1khz / (1 + 4) = 200 Hz
+    DEBUG_PRINTLN(F("Setting DMP and FIFO_OFLOW interrupts enabled..."));
+    setIntEnabled(0x12);
 
-            DEBUG_PRINTLN(F("Setting external frame sync to TEMP_OUT_L[0]..."));
-            setExternalFrameSync(MPU6050_EXT_SYNC_TEMP_OUT_L);
+    DEBUG_PRINTLN(F("Setting sample rate to 200Hz..."));
+    setRate(4); // 1khz / (1 + 4) = 200 Hz
 
-            DEBUG_PRINTLN(F("Setting DLPF bandwidth to 42Hz..."));
-            setDLPFMode(MPU6050_DLPF_BW_42);
+    DEBUG_PRINTLN(F("Setting external frame sync to TEMP_OUT_L[0]..."));
+    setExternalFrameSync(MPU6050_EXT_SYNC_TEMP_OUT_L);
 
-            DEBUG_PRINTLN(F("Setting gyro sensitivity to +/- 2000 deg/sec..."));
-            setFullScaleGyroRange(MPU6050_GYRO_FS_2000);
+    DEBUG_PRINTLN(F("Setting DLPF bandwidth to 42Hz..."));
+    setDLPFMode(MPU6050_DLPF_BW_42);
 
-            DEBUG_PRINTLN(F("Setting DMP configuration bytes (function unknown)..."));
-            setDMPConfig1(0x03);
-            setDMPConfig2(0x00);
+    DEBUG_PRINTLN(F("Setting gyro sensitivity to +/- 2000 deg/sec..."));
+    setFullScaleGyroRange(MPU6050_GYRO_FS_2000);
 
-            DEBUG_PRINTLN(F("Clearing OTP Bank flag..."));
-            setOTPBankValid(false);
+    DEBUG_PRINTLN(F("Setting DMP configuration bytes (function unknown)..."));
+    setDMPConfig1(0x03);
+    setDMPConfig2(0x00);
 
-            DEBUG_PRINTLN(F("Setting X/Y/Z gyro offset TCs to previous values..."));
-            setXGyroOffsetTC(xgOffsetTC);
-            setYGyroOffsetTC(ygOffsetTC);
-            setZGyroOffsetTC(zgOffsetTC);
+    DEBUG_PRINTLN(F("Clearing OTP Bank flag..."));
+    setOTPBankValid(false);
 
-            //DEBUG_PRINTLN(F("Setting X/Y/Z gyro user offsets to zero..."));
-            //setXGyroOffset(0);
-            //setYGyroOffset(0);
-            //setZGyroOffset(0);
+    DEBUG_PRINTLN(F("Setting X/Y/Z gyro offset TCs to previous values..."));
+    setXGyroOffsetTC(xgOffsetTC);
+    setYGyroOffsetTC(ygOffsetTC);
+    setZGyroOffsetTC(zgOffsetTC);
 
-            DEBUG_PRINTLN(F("Writing final memory update 1/7 (function unknown)..."));
-            uint8_t dmpUpdate[16], j;
-            uint16_t pos = 0;
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    //DEBUG_PRINTLN(F("Setting X/Y/Z gyro user offsets to zero..."));
+    //setXGyroOffset(0);
+    //setYGyroOffset(0);
+    //setZGyroOffset(0);
 
-            DEBUG_PRINTLN(F("Writing final memory update 2/7 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 1/7 (function unknown)..."));
+    uint8_t dmpUpdate[16], j;
+    uint16_t pos = 0;
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
 
-            DEBUG_PRINTLN(F("Resetting FIFO..."));
-            resetFIFO();
+    DEBUG_PRINTLN(F("Writing final memory update 2/7 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
 
-            DEBUG_PRINTLN(F("Reading FIFO count..."));
-            uint16_t fifoCount = getFIFOCount();
-            uint8_t fifoBuffer[128];
+    DEBUG_PRINTLN(F("Resetting FIFO..."));
+    resetFIFO();
 
-            DEBUG_PRINT(F("Current FIFO count="));
-            DEBUG_PRINTLN(fifoCount);
-            getFIFOBytes(fifoBuffer, fifoCount);
+    DEBUG_PRINTLN(F("Reading FIFO count..."));
+    uint16_t fifoCount = getFIFOCount();
+    uint8_t fifoBuffer[128];
 
-            DEBUG_PRINTLN(F("Setting motion detection threshold to 2..."));
-            setMotionDetectionThreshold(2);
+    DEBUG_PRINT(F("Current FIFO count="));
+    DEBUG_PRINTLN(fifoCount);
+    getFIFOBytes(fifoBuffer, fifoCount);
 
-            DEBUG_PRINTLN(F("Setting zero-motion detection threshold to 156..."));
-            setZeroMotionDetectionThreshold(156);
+    DEBUG_PRINTLN(F("Setting motion detection threshold to 2..."));
+    setMotionDetectionThreshold(2);
 
-            DEBUG_PRINTLN(F("Setting motion detection duration to 80..."));
-            setMotionDetectionDuration(80);
+    DEBUG_PRINTLN(F("Setting zero-motion detection threshold to 156..."));
+    setZeroMotionDetectionThreshold(156);
 
-            DEBUG_PRINTLN(F("Setting zero-motion detection duration to 0..."));
-            setZeroMotionDetectionDuration(0);
+    DEBUG_PRINTLN(F("Setting motion detection duration to 80..."));
+    setMotionDetectionDuration(80);
 
-            DEBUG_PRINTLN(F("Resetting FIFO..."));
-            resetFIFO();
+    DEBUG_PRINTLN(F("Setting zero-motion detection duration to 0..."));
+    setZeroMotionDetectionDuration(0);
 
-            DEBUG_PRINTLN(F("Enabling FIFO..."));
-            setFIFOEnabled(true);
+    DEBUG_PRINTLN(F("Resetting FIFO..."));
+    resetFIFO();
 
-            DEBUG_PRINTLN(F("Enabling DMP..."));
-            setDMPEnabled(true);
+    DEBUG_PRINTLN(F("Enabling FIFO..."));
+    setFIFOEnabled(true);
 
-            DEBUG_PRINTLN(F("Resetting DMP..."));
-            resetDMP();
+    DEBUG_PRINTLN(F("Enabling DMP..."));
+    setDMPEnabled(true);
 
-            DEBUG_PRINTLN(F("Writing final memory update 3/7 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Resetting DMP..."));
+    resetDMP();
 
-            DEBUG_PRINTLN(F("Writing final memory update 4/7 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 3/7 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
 
-            DEBUG_PRINTLN(F("Writing final memory update 5/7 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 4/7 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
 
-            DEBUG_PRINTLN(F("Waiting for FIFO count > 2..."));
-            while ((fifoCount = getFIFOCount()) < 3);
+    DEBUG_PRINTLN(F("Writing final memory update 5/7 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
 
-            DEBUG_PRINT(F("Current FIFO count="));
-            DEBUG_PRINTLN(fifoCount);
-            DEBUG_PRINTLN(F("Reading FIFO data..."));
-            getFIFOBytes(fifoBuffer, fifoCount);
+    DEBUG_PRINTLN(F("Waiting for FIFO count > 2..."));
+    while ((fifoCount = getFIFOCount()) < 3 && waitForFIFO);
 
-            DEBUG_PRINTLN(F("Reading interrupt status..."));
-            uint8_t mpuIntStatus = getIntStatus();
+    DEBUG_PRINT(F("Current FIFO count="));
+    DEBUG_PRINTLN(fifoCount);
+    DEBUG_PRINTLN(F("Reading FIFO data..."));
+    getFIFOBytes(fifoBuffer, fifoCount);
 
-            DEBUG_PRINT(F("Current interrupt status="));
-            DEBUG_PRINTLNF(mpuIntStatus, HEX);
+    DEBUG_PRINTLN(F("Reading interrupt status..."));
+    uint8_t mpuIntStatus = getIntStatus();
 
-            DEBUG_PRINTLN(F("Reading final memory update 6/7 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            readMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINT(F("Current interrupt status="));
+    DEBUG_PRINTLNF(mpuIntStatus, HEX);
 
-            DEBUG_PRINTLN(F("Waiting for FIFO count > 2..."));
-            while ((fifoCount = getFIFOCount()) < 3);
+    DEBUG_PRINTLN(F("Reading final memory update 6/7 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    readMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
 
-            DEBUG_PRINT(F("Current FIFO count="));
-            DEBUG_PRINTLN(fifoCount);
+    DEBUG_PRINTLN(F("Waiting for FIFO count > 2..."));
+    while ((fifoCount = getFIFOCount()) < 3 && waitForFIFO);
 
-            DEBUG_PRINTLN(F("Reading FIFO data..."));
-            getFIFOBytes(fifoBuffer, fifoCount);
+    DEBUG_PRINT(F("Current FIFO count="));
+    DEBUG_PRINTLN(fifoCount);
 
-            DEBUG_PRINTLN(F("Reading interrupt status..."));
-            mpuIntStatus = getIntStatus();
+    DEBUG_PRINTLN(F("Reading FIFO data..."));
+    getFIFOBytes(fifoBuffer, fifoCount);
 
-            DEBUG_PRINT(F("Current interrupt status="));
-            DEBUG_PRINTLNF(mpuIntStatus, HEX);
+    DEBUG_PRINTLN(F("Reading interrupt status..."));
+    mpuIntStatus = getIntStatus();
 
-            DEBUG_PRINTLN(F("Writing final memory update 7/7 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINT(F("Current interrupt status="));
+    DEBUG_PRINTLNF(mpuIntStatus, HEX);
 
-            DEBUG_PRINTLN(F("DMP is good to go! Finally."));
+    DEBUG_PRINTLN(F("Writing final memory update 7/7 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
 
-            DEBUG_PRINTLN(F("Disabling DMP (you turn it on later)..."));
-            setDMPEnabled(false);
+    DEBUG_PRINTLN(F("DMP is good to go! Finally."));
 
-            DEBUG_PRINTLN(F("Setting up internal 42-byte (default) DMP packet buffer..."));
-            dmpPacketSize = 42;
-            /*if ((dmpPacketBuffer = (uint8_t *)malloc(42)) == 0) {
-                return 3; // TODO: proper error code for no memory
-            }*/
+    DEBUG_PRINTLN(F("Disabling DMP (you turn it on later)..."));
+    setDMPEnabled(false);
 
-            DEBUG_PRINTLN(F("Resetting FIFO and clearing INT status one last time..."));
-            resetFIFO();
-            getIntStatus();
-        } else {
-            DEBUG_PRINTLN(F("ERROR! DMP configuration verification failed."));
-            return 2; // configuration block loading failed
-        }
-    } else {
-        DEBUG_PRINTLN(F("ERROR! DMP code verification failed."));
-        return 1; // main binary block loading failed
-    }
+    DEBUG_PRINTLN(F("Setting up internal 42-byte (default) DMP packet buffer..."));
+    dmpPacketSize = 42;
+    /*if ((dmpPacketBuffer = (uint8_t *)malloc(42)) == 0) {
+        return 3; // TODO: proper error code for no memory
+    }*/
+
+    DEBUG_PRINTLN(F("Resetting FIFO and clearing INT status one last time..."));
+    resetFIFO();
+    getIntStatus();
     return 0; // success
 }
 
+bool MPU6050::dmpFirmwareLoaded() {
+    // the image's fingerprint is worked out from flash once, rather than at compile time
+    static uint16_t imageFingerprint = memoryImageFingerprint(dmpMemory, MPU6050_DMP_CODE_SIZE, dmpConfig, MPU6050_DMP_CONFIG_SIZE);
+    return readMemoryFingerprint(MPU6050_DMP_CODE_SIZE) == imageFingerprint;
+}
+
+uint8_t MPU6050::dmpWarmStart() {
+    // the DMP keeps its memory for as long as it has power, e.g., across a restart of the program
+    DEBUG_PRINTLN(F("Checking DMP memory fingerprint..."));
+    if (!dmpFirmwareLoaded()) {
+        DEBUG_PRINTLN(F("DMP code not loaded; initializing from scratch..."));
+        return dmpInitialize();
+    }
+
+    DEBUG_PRINTLN(F("DMP code already loaded; setting registers only..."));
+    setDMPEnabled(false);
+    setSleepEnabled(false);
+    setI2CMasterModeEnabled(false);
+
+    // the same set-up as after loading the code, but without waiting for the FIFO to fill between updates
+    return dmpStart(getXGyroOffsetTC(), getYGyroOffsetTC(), getZGyroOffsetTC(), false);
+}
+
 bool MPU6050::dmpPacketAvailable() {
     return getFIFOCount() >= dmpGetFIFOPacketSize();
 }
@@ -699,30 +724,34 @@ uint8_t MPU6050::dmpGetYawPitchRoll(float *data, Quaternion *q, VectorFloat *gra
 // uint8_t MPU6050::dmpGetAccelFloat(float *data, const uint8_t* packet);
 // uint8_t MPU6050::dmpGetQuaternionFloat(float *data, const uint8_t* packet);
 
+/** Decode a packet through the pipeline (see dmpSetPipeline()) and pass it to the consumers.
+ * @return 0 on success; 1 if no pipeline is set
+ */
 uint8_t MPU6050::dmpProcessFIFOPacket(const unsigned char *dmpData) {
-    /*for (uint8_t k = 0; k < dmpPacketSize; k++) {
-        if (dmpData[k] < 0x10) Serial.print("0");
-        Serial.print(dmpData[k], HEX);
-        Serial.print(" ");
-    }
-    Serial.print("\n");*/
-    //Serial.println((uint16_t)dmpPacketBuffer);
+    if (!dmpPipeline) return 1;
+    I2CdevTimestamp timestamp;
+    dmpPipeline->decode(dmpData, 1, I2Cdev::getTimestamp(&timestamp) ? timestamp.end : 0);
     return 0;
 }
+/** Read up to numPackets packets from the FIFO, in as few transfers as possible, and process them (see processDMPPackets()).
+ * @param processed Set, if given, to the number of packets processed
+ * @return 0 on success; 1 if no pipeline is set, or the FIFO couldn't be read
+ */
 uint8_t MPU6050::dmpReadAndProcessFIFOPacket(uint8_t numPackets, uint8_t *processed) {
-    uint8_t status;
-    uint8_t buf[dmpPacketSize];
-    for (uint8_t i = 0; i < numPackets; i++) {
-        // read packet from FIFO
-        getFIFOBytes(buf, dmpPacketSize);
-
-        // process packet
-        if ((status = dmpProcessFIFOPacket(buf)) > 0) return status;
-        
-        // increment external process count variable, if supplied
-        if (processed != 0) *processed++;
-    }
-    return 0;
+    if (processed != 0) *processed = 0;
+    if (!dmpPipeline) return 1;
+
+    unsigned long errors = dmpPipeline->drain.errors;
+    uint16_t count = processDMPPackets(numPackets);
+    if (processed != 0) *processed = (uint8_t)count;
+    return dmpPipeline->drain.errors == errors ? 0 : 1;
+}
+/** Decode this firmware's packets with the pipeline, which must remain valid while it is set.
+ * @param pipeline Pipeline to use, or 0 for none
+ */
+void MPU6050::dmpSetPipeline(MPU6050DMPPipeline *pipeline) {
+    if (pipeline) pipeline->setLayout(42, 0, 16, 28);
+    dmpPipeline = pipeline;
 }
 
 // uint8_t MPU6050::dmpSetFIFOProcessedCallback(void (*func) (void));
@@ -419,237 +419,263 @@ uint8_t MPU6050::dmpInitialize() {
     DEBUG_PRINT(F("Writing DMP code to MPU memory banks ("));
     DEBUG_PRINT(MPU6050_DMP_CODE_SIZE);
     DEBUG_PRINTLN(F(" bytes)"));
-    if (writeProgMemoryBlock(dmpMemory, MPU6050_DMP_CODE_SIZE)) {
-        DEBUG_PRINTLN(F("Success! DMP code written and verified."));
+    if (!writeProgMemoryBlock(dmpMemory, MPU6050_DMP_CODE_SIZE)) {
+        DEBUG_PRINTLN(F("ERROR! DMP code verification failed."));
+        return 1; // main binary block loading failed
+    }
+    DEBUG_PRINTLN(F("Success! DMP code written and verified."));
 
-        DEBUG_PRINTLN(F("Configuring DMP and related settings..."));
+    DEBUG_PRINTLN(F("Configuring DMP and related settings..."));
 
-        // write DMP configuration
-        DEBUG_PRINT(F("Writing DMP configuration to MPU memory banks ("));
-        DEBUG_PRINT(MPU6050_DMP_CONFIG_SIZE);
-        DEBUG_PRINTLN(F(" bytes in config def)"));
-        if (writeProgDMPConfigurationSet(dmpConfig, MPU6050_DMP_CONFIG_SIZE)) {
-            DEBUG_PRINTLN(F("Success! DMP configuration written and verified."));
+    return dmpStart(xgOffset, ygOffset, zgOffset, true);
+}
 
-            DEBUG_PRINTLN(F("Setting DMP and FIFO_OFLOW interrupts enabled..."));
-            setIntEnabled(0x12);
+uint8_t MPU6050::dmpStart(int8_t xgOffset, int8_t ygOffset, int8_t zgOffset, bool waitForFIFO) {
+    // write DMP configuration
+    DEBUG_PRINT(F("Writing DMP configuration to MPU memory banks ("));
+    DEBUG_PRINT(MPU6050_DMP_CONFIG_SIZE);
+    DEBUG_PRINTLN(F(" bytes in config def)"));
+    if (!writeProgDMPConfigurationSet(dmpConfig, MPU6050_DMP_CONFIG_SIZE)) {
+        DEBUG_PRINTLN(F("ERROR! DMP configuration verification failed."));
+        return 2; // configuration block loading failed
+    }
+    DEBUG_PRINTLN(F("Success! DMP configuration written and verified."));
+
+    DEBUG_PRINTLN(F("Setting DMP and FIFO_OFLOW interrupts enabled..."));
+    setIntEnabled(0x12);
 
-            DEBUG_PRINTLN(F("Setting sample rate to 200Hz..."));
-            setRate(4); // 1khz / (1 + 4) = 200 Hz
+    DEBUG_PRINTLN(F("Setting sample rate to 200Hz..."));
+    setRate(4); // 1khz / (1 + 4) = 200 Hz
 
-            DEBUG_PRINTLN(F("Setting clock source to Z Gyro..."));
-            setClockSource(MPU6050_CLOCK_PLL_ZGYRO);
+    DEBUG_PRINTLN(F("Setting clock source to Z Gyro..."));
+    setClockSource(MPU6050_CLOCK_PLL_ZGYRO);
 
-            DEBUG_PRINTLN(F("Setting DLPF bandwidth to 42Hz..."));
-            setDLPFMode(MPU6050_DLPF_BW_42);
+    DEBUG_PRINTLN(F("Setting DLPF bandwidth to 42Hz..."));
+    setDLPFMode(MPU6050_DLPF_BW_42);
 
-            DEBUG_PRINTLN(F("Setting external frame sync to TEMP_OUT_L[0]..."));
-            setExternalFrameSync(MPU6050_EXT_SYNC_TEMP_OUT_L);
+    DEBUG_PRINTLN(F("Setting external frame sync to TEMP_OUT_L[0]..."));
+    setExternalFrameSync(MPU6050_EXT_SYNC_TEMP_OUT_L);
 
-            DEBUG_PRINTLN(F("Setting gyro sensitivity to +/- 2000 deg/sec..."));
-            setFullScaleGyroRange(MPU6050_GYRO_FS_2000);
+    DEBUG_PRINTLN(F("Setting gyro sensitivity to +/- 2000 deg/sec..."));
+    setFullScaleGyroRange(MPU6050_GYRO_FS_2000);
 
-            DEBUG_PRINTLN(F("Setting DMP configuration bytes (function unknown)..."));
-            setDMPConfig1(0x03);
-            setDMPConfig2(0x00);
-
-            DEBUG_PRINTLN(F("Clearing OTP Bank flag..."));
-            setOTPBankValid(false);
-
-            DEBUG_PRINTLN(F("Setting X/Y/Z gyro offsets to previous values..."));
-            setXGyroOffset(xgOffset);
-            setYGyroOffset(ygOffset);
-            setZGyroOffset(zgOffset);
-
-            DEBUG_PRINTLN(F("Setting X/Y/Z gyro user offsets to zero..."));
-            setXGyroOffsetUser(0);
-            setYGyroOffsetUser(0);
-            setZGyroOffsetUser(0);
-
-            DEBUG_PRINTLN(F("Writing final memory update 1/19 (function unknown)..."));
-            uint8_t dmpUpdate[16], j;
-            uint16_t pos = 0;
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-
-            DEBUG_PRINTLN(F("Writing final memory update 2/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-
-            DEBUG_PRINTLN(F("Resetting FIFO..."));
-            resetFIFO();
-
-            DEBUG_PRINTLN(F("Reading FIFO count..."));
-            uint8_t fifoCount = getFIFOCount();
-
-            DEBUG_PRINT(F("Current FIFO count="));
-            DEBUG_PRINTLN(fifoCount);
-            uint8_t fifoBuffer[128];
-            //getFIFOBytes(fifoBuffer, fifoCount);
-
-            DEBUG_PRINTLN(F("Writing final memory update 3/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-
-            DEBUG_PRINTLN(F("Writing final memory update 4/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-
-            DEBUG_PRINTLN(F("Disabling all standby flags..."));
-            I2Cdev::writeByte(0x68, MPU6050_RA_PWR_MGMT_2, 0x00);
-
-            DEBUG_PRINTLN(F("Setting accelerometer sensitivity to +/- 2g..."));
-            I2Cdev::writeByte(0x68, MPU6050_RA_ACCEL_CONFIG, 0x00);
-
-            DEBUG_PRINTLN(F("Setting motion detection threshold to 2..."));
-            setMotionDetectionThreshold(2);
-
-            DEBUG_PRINTLN(F("Setting zero-motion detection threshold to 156..."));
-            setZeroMotionDetectionThreshold(156);
-
-            DEBUG_PRINTLN(F("Setting motion detection duration to 80..."));
-            setMotionDetectionDuration(80);
-
-            DEBUG_PRINTLN(F("Setting zero-motion detection duration to 0..."));
-            setZeroMotionDetectionDuration(0);
-
-            DEBUG_PRINTLN(F("Setting AK8975 to single measurement mode..."));
-            //mag -> setMode(1);
-            I2Cdev::writeByte(0x0E, 0x0A, 0x01);
-
-            // setup AK8975 (0x0E) as Slave 0 in read mode
-            DEBUG_PRINTLN(F("Setting up AK8975 read slave 0..."));
-            I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV0_ADDR, 0x8E);
-            I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV0_REG,  0x01);
-            I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV0_CTRL, 0xDA);
-
-            // setup AK8975 (0x0E) as Slave 2 in write mode
-            DEBUG_PRINTLN(F("Setting up AK8975 write slave 2..."));
-            I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV2_ADDR, 0x0E);
-            I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV2_REG,  0x0A);
-            I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV2_CTRL, 0x81);
-            I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV2_DO,   0x01);
-
-            // setup I2C timing/delay control
-            DEBUG_PRINTLN(F("Setting up slave access delay..."));
-            I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV4_CTRL, 0x18);
-            I2Cdev::writeByte(0x68, MPU6050_RA_I2C_MST_DELAY_CTRL, 0x05);
-
-            // enable interrupts
-            DEBUG_PRINTLN(F("Enabling default interrupt behavior/no bypass..."));
-            I2Cdev::writeByte(0x68, MPU6050_RA_INT_PIN_CFG, 0x00);
-
-            // enable I2C master mode and reset DMP/FIFO
-            DEBUG_PRINTLN(F("Enabling I2C master mode..."));
-            I2Cdev::writeByte(0x68, MPU6050_RA_USER_CTRL, 0x20);
-            DEBUG_PRINTLN(F("Resetting FIFO..."));
-            I2Cdev::writeByte(0x68, MPU6050_RA_USER_CTRL, 0x24);
-            DEBUG_PRINTLN(F("Rewriting I2C master mode enabled because...I don't know"));
-            I2Cdev::writeByte(0x68, MPU6050_RA_USER_CTRL, 0x20);
-            DEBUG_PRINTLN(F("Enabling and resetting DMP/FIFO..."));
-            I2Cdev::writeByte(0x68, MPU6050_RA_USER_CTRL, 0xE8);
-
-            DEBUG_PRINTLN(F("Writing final memory update 5/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            DEBUG_PRINTLN(F("Writing final memory update 6/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            DEBUG_PRINTLN(F("Writing final memory update 7/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            DEBUG_PRINTLN(F("Writing final memory update 8/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            DEBUG_PRINTLN(F("Writing final memory update 9/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            DEBUG_PRINTLN(F("Writing final memory update 10/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            DEBUG_PRINTLN(F("Writing final memory update 11/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            
-            DEBUG_PRINTLN(F("Reading final memory update 12/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            readMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            #ifdef DEBUG
-                DEBUG_PRINT(F("Read bytes: "));
-                for (j = 0; j < 4; j++) {
-                    DEBUG_PRINTF(dmpUpdate[3 + j], HEX);
-                    DEBUG_PRINT(" ");
-                }
-                DEBUG_PRINTLN("");
-            #endif
-
-            DEBUG_PRINTLN(F("Writing final memory update 13/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            DEBUG_PRINTLN(F("Writing final memory update 14/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            DEBUG_PRINTLN(F("Writing final memory update 15/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            DEBUG_PRINTLN(F("Writing final memory update 16/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-            DEBUG_PRINTLN(F("Writing final memory update 17/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-
-            DEBUG_PRINTLN(F("Waiting for FIRO count >= 46..."));
-            while ((fifoCount = getFIFOCount()) < 46);
-            DEBUG_PRINTLN(F("Reading FIFO..."));
-            getFIFOBytes(fifoBuffer, min(fifoCount, 128)); // safeguard only 128 bytes
-            DEBUG_PRINTLN(F("Reading interrupt status..."));
-            getIntStatus();
-
-            DEBUG_PRINTLN(F("Writing final memory update 18/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-
-            DEBUG_PRINTLN(F("Waiting for FIRO count >= 48..."));
-            while ((fifoCount = getFIFOCount()) < 48);
-            DEBUG_PRINTLN(F("Reading FIFO..."));
-            getFIFOBytes(fifoBuffer, min(fifoCount, 128)); // safeguard only 128 bytes
-            DEBUG_PRINTLN(F("Reading interrupt status..."));
-            getIntStatus();
-            DEBUG_PRINTLN(F("Waiting for FIRO count >= 48..."));
-            while ((fifoCount = getFIFOCount()) < 48);
-            DEBUG_PRINTLN(F("Reading FIFO..."));
-            getFIFOBytes(fifoBuffer, min(fifoCount, 128)); // safeguard only 128 bytes
-            DEBUG_PRINTLN(F("Reading interrupt status..."));
-            getIntStatus();
-
-            DEBUG_PRINTLN(F("Writing final memory update 19/19 (function unknown)..."));
-            for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
-            writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
-
-            DEBUG_PRINTLN(F("Disabling DMP (you turn it on later)..."));
-            setDMPEnabled(false);
-
-            DEBUG_PRINTLN(F("Setting up internal 48-byte (default) DMP packet buffer..."));
-            dmpPacketSize = 48;
-            /*if ((dmpPacketBuffer = (uint8_t *)malloc(42)) == 0) {
-                return 3; // TODO: proper error code for no memory
-            }*/
-
-            DEBUG_PRINTLN(F("Resetting FIFO and clearing INT status one last time..."));
-            resetFIFO();
-            getIntStatus();
-        } else {
-            DEBUG_PRINTLN(F("ERROR! DMP configuration verification failed."));
-            return 2; // configuration block loading failed
+    DEBUG_PRINTLN(F("Setting DMP configuration bytes (function unknown)..."));
+    setDMPConfig1(0x03);
+    setDMPConfig2(0x00);
+
+    DEBUG_PRINTLN(F("Clearing OTP Bank flag..."));
+    setOTPBankValid(false);
+
+    DEBUG_PRINTLN(F("Setting X/Y/Z gyro offsets to previous values..."));
+    setXGyroOffset(xgOffset);
+    setYGyroOffset(ygOffset);
+    setZGyroOffset(zgOffset);
+
+    DEBUG_PRINTLN(F("Setting X/Y/Z gyro user offsets to zero..."));
+    setXGyroOffsetUser(0);
+    setYGyroOffsetUser(0);
+    setZGyroOffsetUser(0);
+
+    DEBUG_PRINTLN(F("Writing final memory update 1/19 (function unknown)..."));
+    uint8_t dmpUpdate[16], j;
+    uint16_t pos = 0;
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+
+    DEBUG_PRINTLN(F("Writing final memory update 2/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+
+    DEBUG_PRINTLN(F("Resetting FIFO..."));
+    resetFIFO();
+
+    DEBUG_PRINTLN(F("Reading FIFO count..."));
+    uint8_t fifoCount = getFIFOCount();
+
+    DEBUG_PRINT(F("Current FIFO count="));
+    DEBUG_PRINTLN(fifoCount);
+    uint8_t fifoBuffer[128];
+    //getFIFOBytes(fifoBuffer, fifoCount);
+
+    DEBUG_PRINTLN(F("Writing final memory update 3/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+
+    DEBUG_PRINTLN(F("Writing final memory update 4/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+
+    DEBUG_PRINTLN(F("Disabling all standby flags..."));
+    I2Cdev::writeByte(0x68, MPU6050_RA_PWR_MGMT_2, 0x00);
+
+    DEBUG_PRINTLN(F("Setting accelerometer sensitivity to +/- 2g..."));
+    I2Cdev::writeByte(0x68, MPU6050_RA_ACCEL_CONFIG, 0x00);
+
+    DEBUG_PRINTLN(F("Setting motion detection threshold to 2..."));
+    setMotionDetectionThreshold(2);
+
+    DEBUG_PRINTLN(F("Setting zero-motion detection threshold to 156..."));
+    setZeroMotionDetectionThreshold(156);
+
+    DEBUG_PRINTLN(F("Setting motion detection duration to 80..."));
+    setMotionDetectionDuration(80);
+
+    DEBUG_PRINTLN(F("Setting zero-motion detection duration to 0..."));
+    setZeroMotionDetectionDuration(0);
+
+    DEBUG_PRINTLN(F("Setting AK8975 to single measurement mode..."));
+    //mag -> setMode(1);
+    I2Cdev::writeByte(0x0E, 0x0A, 0x01);
+
+    // setup AK8975 (0x0E) as Slave 0 in read mode
+    DEBUG_PRINTLN(F("Setting up AK8975 read slave 0..."));
+    I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV0_ADDR, 0x8E);
+    I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV0_REG,  0x01);
+    I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV0_CTRL, 0xDA);
+
+    // setup AK8975 (0x0E) as Slave 2 in write mode
+    DEBUG_PRINTLN(F("Setting up AK8975 write slave 2..."));
+    I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV2_ADDR, 0x0E);
+    I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV2_REG,  0x0A);
+    I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV2_CTRL, 0x81);
+    I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV2_DO,   0x01);
+
+    // setup I2C timing/delay control
+    DEBUG_PRINTLN(F("Setting up slave access delay..."));
+    I2Cdev::writeByte(0x68, MPU6050_RA_I2C_SLV4_CTRL, 0x18);
+    I2Cdev::writeByte(0x68, MPU6050_RA_I2C_MST_DELAY_CTRL, 0x05);
+
+    // enable interrupts
+    DEBUG_PRINTLN(F("Enabling default interrupt behavior/no bypass..."));
+    I2Cdev::writeByte(0x68, MPU6050_RA_INT_PIN_CFG, 0x00);
+
+    // enable I2C master mode and reset DMP/FIFO
+    DEBUG_PRINTLN(F("Enabling I2C master mode..."));
+    I2Cdev::writeByte(0x68, MPU6050_RA_USER_CTRL, 0x20);
+    DEBUG_PRINTLN(F("Resetting FIFO..."));
+    I2Cdev::writeByte(0x68, MPU6050_RA_USER_CTRL, 0x24);
+    DEBUG_PRINTLN(F("Rewriting I2C master mode enabled because...I don't know"));
+    I2Cdev::writeByte(0x68, MPU6050_RA_USER_CTRL, 0x20);
+    DEBUG_PRINTLN(F("Enabling and resetting DMP/FIFO..."));
+    I2Cdev::writeByte(0x68, MPU6050_RA_USER_CTRL, 0xE8);
+
+    DEBUG_PRINTLN(F("Writing final memory update 5/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 6/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 7/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 8/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 9/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 10/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 11/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    
+    DEBUG_PRINTLN(F("Reading final memory update 12/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    readMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    #ifdef DEBUG
+        DEBUG_PRINT(F("Read bytes: "));
+        for (j = 0; j < 4; j++) {
+            DEBUG_PRINTF(dmpUpdate[3 + j], HEX);
+            DEBUG_PRINT(" ");
         }
-    } else {
-        DEBUG_PRINTLN(F("ERROR! DMP code verification failed."));
-        return 1; // main binary block loading failed
-    }
+        DEBUG_PRINTLN("");
+    #endif
+
+    DEBUG_PRINTLN(F("Writing final memory update 13/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 14/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 15/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 16/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+    DEBUG_PRINTLN(F("Writing final memory update 17/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+
+    DEBUG_PRINTLN(F("Waiting for FIRO count >= 46..."));
+    while ((fifoCount = getFIFOCount()) < 46 && waitForFIFO);
+    DEBUG_PRINTLN(F("Reading FIFO..."));
+    getFIFOBytes(fifoBuffer, min(fifoCount, 128)); // safeguard only 128 bytes
+    DEBUG_PRINTLN(F("Reading interrupt status..."));
+    getIntStatus();
+
+    DEBUG_PRINTLN(F("Writing final memory update 18/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+
+    DEBUG_PRINTLN(F("Waiting for FIRO count >= 48..."));
+    while ((fifoCount = getFIFOCount()) < 48 && waitForFIFO);
+    DEBUG_PRINTLN(F("Reading FIFO..."));
+    getFIFOBytes(fifoBuffer, min(fifoCount, 128)); // safeguard only 128 bytes
+    DEBUG_PRINTLN(F("Reading interrupt status..."));
+    getIntStatus();
+    DEBUG_PRINTLN(F("Waiting for FIRO count >= 48..."));
+    while ((fifoCount = getFIFOCount()) < 48 && waitForFIFO);
+    DEBUG_PRINTLN(F("Reading FIFO..."));
+    getFIFOBytes(fifoBuffer, min(fifoCount, 128)); // safeguard only 128 bytes
+    DEBUG_PRINTLN(F("Reading interrupt status..."));
+    getIntStatus();
+
+    DEBUG_PRINTLN(F("Writing final memory update 19/19 (function unknown)..."));
+    for (j = 0; j < 4 || j < dmpUpdate[2] + 3; j++, pos++) dmpUpdate[j] = pgm_read_byte(&dmpUpdates[pos]);
+    writeMemoryBlock(dmpUpdate + 3, dmpUpdate[2], dmpUpdate[0], dmpUpdate[1]);
+
+    DEBUG_PRINTLN(F("Disabling DMP (you turn it on later)..."));
+    setDMPEnabled(false);
+
+    DEBUG_PRINTLN(F("Setting up internal 48-byte (default) DMP packet buffer..."));
+    dmpPacketSize = 48;
+    /*if ((dmpPacketBuffer = (uint8_t *)malloc(42)) == 0) {
+        return 3; // TODO: proper error code for no memory
+    }*/
+
+    DEBUG_PRINTLN(F("Resetting FIFO and clearing INT status one last time..."));
+    resetFIFO();
+    getIntStatus();
     return 0; // success
 }
 
+bool MPU6050::dmpFirmwareLoaded() {
+    // the image's fingerprint is worked out from flash once, rather than at compile time
+    static uint16_t imageFingerprint = memoryImageFingerprint(dmpMemory, MPU6050_DMP_CODE_SIZE, dmpConfig, MPU6050_DMP_CONFIG_SIZE);
+    return readMemoryFingerprint(MPU6050_DMP_CODE_SIZE) == imageFingerprint;
+}
+
+uint8_t MPU6050::dmpWarmStart() {
+    // the DMP keeps its memory for as long as it has power, e.g., across a restart of the program
+    DEBUG_PRINTLN(F("Checking DMP memory fingerprint..."));
+    if (!dmpFirmwareLoaded()) {
+        DEBUG_PRINTLN(F("DMP code not loaded; initializing from scratch..."));
+        return dmpInitialize();
+    }
+
+    DEBUG_PRINTLN(F("DMP code already loaded; setting registers only..."));
+    setDMPEnabled(false);
+    setSleepEnabled(false);
+    setI2CMasterModeEnabled(false); // the AK8975 is reached directly, as after the reset in dmpInitialize()
+    setI2CBypassEnabled(true);
+
+    // the same set-up as after loading the code, but without waiting for the FIFO to fill between updates
+    return dmpStart(getXGyroOffset(), getYGyroOffset(), getZGyroOffset(), false);
+}
+
 bool MPU6050::dmpPacketAvailable() {
     return getFIFOCount() >= dmpGetFIFOPacketSize();
 }
@@ -810,30 +836,34 @@ uint8_t MPU6050::dmpGetYawPitchRoll(float *data, Quaternion *q, VectorFloat *gra
 // uint8_t MPU6050::dmpGetAccelFloat(float *data, const uint8_t* packet);
 // uint8_t MPU6050::dmpGetQuaternionFloat(float *data, const uint8_t* packet);
 
+/** Decode a packet through the pipeline (see dmpSetPipeline()) and pass it to the consumers.
+ * @return 0 on success; 1 if no pipeline is set
+ */
 uint8_t MPU6050::dmpProcessFIFOPacket(const unsigned char *dmpData) {
-    /*for (uint8_t k = 0; k < dmpPacketSize; k++) {
-        if (dmpData[k] < 0x10) Serial.print("0");
-        Serial.print(dmpData[k], HEX);
-        Serial.print(" ");
-    }
-    Serial.print("\n");*/
-    //Serial.println((uint16_t)dmpPacketBuffer);
+    if (!dmpPipeline) return 1;
+    I2CdevTimestamp timestamp;
+    dmpPipeline->decode(dmpData, 1, I2Cdev::getTimestamp(&timestamp) ? timestamp.end : 0);
     return 0;
 }
+/** Read up to numPackets packets from the FIFO, in as few transfers as possible, and process them (see processDMPPackets()).
+ * @param processed Set, if given, to the number of packets processed
+ * @return 0 on success; 1 if no pipeline is set, or the FIFO couldn't be read
+ */
 uint8_t MPU6050::dmpReadAndProcessFIFOPacket(uint8_t numPackets, uint8_t *processed) {
-    uint8_t status;
-    uint8_t buf[dmpPacketSize];
-    for (uint8_t i = 0; i < numPackets; i++) {
-        // read packet from FIFO
-        getFIFOBytes(buf, dmpPacketSize);
-
-        // process packet
-        if ((status = dmpProcessFIFOPacket(buf)) > 0) return status;
-        
-        // increment external process count variable, if supplied
-        if (processed != 0) *processed++;
-    }
-    return 0;
+    if (processed != 0) *processed = 0;
+    if (!dmpPipeline) return 1;
+
+    unsigned long errors = dmpPipeline->drain.errors;
+    uint16_t count = processDMPPackets(numPackets);
+    if (processed != 0) *processed = (uint8_t)count;
+    return dmpPipeline->drain.errors == errors ? 0 : 1;
+}
+/** Decode this firmware's packets with the pipeline, which must remain valid while it is set.
+ * @param pipeline Pipeline to use, or 0 for none
+ */
+void MPU6050::dmpSetPipeline(MPU6050DMPPipeline *pipeline) {
+    if (pipeline) pipeline->setLayout(48, 0, 16, 34);
+    dmpPipeline = pipeline;
 }
 
 // uint8_t MPU6050::dmpSetFIFOProcessedCallback(void (*func) (void));
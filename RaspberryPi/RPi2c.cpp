@@ -23,7 +23,7 @@ THE SOFTWARE.
 ===============================================
 */
 
-// #include <stdio.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -32,11 +32,18 @@ THE SOFTWARE.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
-#include <sys/time.h>
+#include <sys/eventfd.h>
 
-#include <linux/i2c-dev.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
 
 #include "RPi2c.h"
+#include "RPi2cAdapter.h"
+#include "RPi2cCapture.h"
+#include "RPi2cSwap.h"
+#include "RPi2cTrace.h"
+#include "RPi2cTransaction.h"
 
 static const char * s_error_none    = "(none)";
 static const char * s_error_reopen  = "RPi2c::bus_open: error: The I2C bus already open.";
@@ -44,48 +51,194 @@ static const char * s_error_busname = "RPi2c::bus_open: error: Invalid bus name.
 static const char * s_error_noopen  = "RPi2c::bus_open: error: Unable to open I2C bus.";
 static const char * s_error_rddata  = "RPi2c::bus_read: error: Invalid pointer to data.";
 static const char * s_error_nobusr  = "RPi2c::bus_bread: error: No open I2C bus.";
-static const char * s_error_slaver  = "RPi2c::bus_bread: error: Failed to put device into slave mode.";
 static const char * s_error_rderr   = "RPi2c::bus_bread: error: Failed to transfer data.";
 static const char * s_error_wrdata  = "RPi2c::bus_write: error: Invalid pointer to data.";
 static const char * s_error_nobusw  = "RPi2c::bus_bwrite: error: No open I2C bus.";
-static const char * s_error_slavew  = "RPi2c::bus_bwrite: error: Failed to put device into slave mode.";
 static const char * s_error_wrerr   = "RPi2c::bus_bwrite: error: Failed to transfer data.";
+static const char * s_error_slave   = "RPi2c::bus_smbus: error: Failed to put device into slave mode.";
+static const char * s_error_smbreg  = "RPi2c::bus_smbus: error: SMBus does not support 16-bit register addresses.";
+static const char * s_error_smberr  = "RPi2c::bus_smbus: error: Failed to transfer data.";
+static const char * s_error_nobust  = "RPi2c::bus_transfer: error: No open I2C bus.";
+static const char * s_error_trerr   = "RPi2c::bus_transfer: error: Failed to transfer data.";
+static const char * s_error_trsmb   = "RPi2c::bus_transfer: error: Adapter supports SMBus only.";
+static const char * s_error_adapter = "RPi2c::bus_open: error: Invalid adapter.";
+static const char * s_error_asopen  = "RPi2c::async_start: error: No open I2C bus.";
+static const char * s_error_aseventfd = "RPi2c::async_start: error: Unable to create eventfd.";
+static const char * s_error_asthread  = "RPi2c::async_start: error: Unable to create bus thread.";
+static const char * s_error_timeout = "RPi2c::bus_execute: error: Timed out.";
+static const char * s_error_recover = "RPi2c::bus_recover: error: Unable to re-open I2C bus.";
 
 static RPi2c * s_default_bus = 0;
 
-static struct timeval s_tval_Initial;
+static __thread RPi2c * s_thread_bus = 0;
 
-static void timerStart ()
+static __thread RPi2cStamp s_thread_stamp = { 0, 0 };
+
+static pthread_mutex_t s_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+	char *  name;
+	RPi2c * i2c;
+	bool    bOwned;
+} s_registry[RPI2C_MAX_BUSES];
+
+static int s_registry_count = 0;
+
+/* Nanoseconds from CLOCK_MONOTONIC, which never jumps, is read through the vDSO without a system call, and is the clock
+ * of GPIO event timestamps; so transfer times double as sample times.
+ */
+static uint64_t s_now_ns ()
 {
-	gettimeofday (&s_tval_Initial, 0);
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
 }
 
-static unsigned long timerStop () // this will work for about 24 days; don't really want to use millis at all!
+static uint64_t s_now_us ()
 {
-	unsigned long us = 0;
+	return s_now_ns () / 1000;
+}
 
-	struct timeval tval_Current;
+static void s_request (RPi2cRequest & request, RPi2cRequestType type, uint16_t device_address, uint16_t register_address,
+					   uint16_t count, void * data, bool bSpecifyRegister, bool data_lsb_1st = false)
+{
+	request.type             = type;
+	request.device_address   = device_address;
+	request.register_address = register_address;
+	request.count            = count;
+	request.bSpecifyRegister = bSpecifyRegister;
+	request.data_lsb_1st     = data_lsb_1st;
+	request.data             = data;
+	request.timeout          = 0;
+	request.user             = 0;
+	request.status           = -1;
+	request.error            = s_error_none;
+	request.latency          = 0;
+	request.stamp.start      = 0;
+	request.stamp.end        = 0;
+	request.submitted        = 0;
+	request.deadline         = 0;
+	request.reply            = 0;
+}
 
-	gettimeofday (&tval_Current, 0);
+void RPi2c::setDefaultBus (RPi2c * i2c)
+{
+	__atomic_store_n (&s_default_bus, i2c, __ATOMIC_RELEASE);
+}
 
-	if (tval_Current.tv_usec < s_tval_Initial.tv_usec) {
-		us = (1000000 + tval_Current.tv_usec) - s_tval_Initial.tv_usec;
-		us = (tval_Current.tv_sec - s_tval_Initial.tv_sec - 1) * 1000000 + us;
-	} else {
-		us = tval_Current.tv_usec - s_tval_Initial.tv_usec;
-		us = (tval_Current.tv_sec - s_tval_Initial.tv_sec) * 1000000 + us;
+RPi2c * RPi2c::bus ()
+{
+	return s_thread_bus ? s_thread_bus : __atomic_load_n (&s_default_bus, __ATOMIC_ACQUIRE);
+}
+
+void RPi2c::setThreadBus (RPi2c * i2c)
+{
+	s_thread_bus = i2c;
+}
+
+RPi2cStamp RPi2c::lastStamp ()
+{
+	return s_thread_stamp;
+}
+
+RPi2c * RPi2c::threadBus ()
+{
+	return s_thread_bus;
+}
+
+/* Call with s_registry_lock held; returns index, or -1 if not found.
+ */
+static int s_registry_find (const char * bus_name)
+{
+	for (int i = 0; i < s_registry_count; i++) {
+		if (strcmp (s_registry[i].name, bus_name) == 0) {
+			return i;
+		}
 	}
-	return us;
+	return -1;
 }
 
-void RPi2c::setDefaultBus (RPi2c * i2c)
+RPi2c * RPi2c::lookup (int bus_number)
 {
-	s_default_bus = i2c;
+	char bus_name[32];
+
+	snprintf (bus_name, sizeof (bus_name), "/dev/i2c-%d", bus_number);
+
+	return lookup (bus_name);
 }
 
-RPi2c * RPi2c::bus ()
+RPi2c * RPi2c::lookup (const char * bus_name)
+{
+	if (!bus_name) {
+		return 0;
+	}
+
+	RPi2c * i2c = 0;
+
+	pthread_mutex_lock (&s_registry_lock);
+
+	int i = s_registry_find (bus_name);
+
+	if (i >= 0) {
+		i2c = s_registry[i].i2c;
+	} else if (s_registry_count < RPI2C_MAX_BUSES) {
+		i2c = new RPi2c;
+
+		if (i2c->busOpen (bus_name)) {
+			s_registry[s_registry_count].name   = strdup (bus_name);
+			s_registry[s_registry_count].i2c    = i2c;
+			s_registry[s_registry_count].bOwned = true;
+			++s_registry_count;
+		} else {
+			delete i2c;
+			i2c = 0;
+		}
+	}
+
+	pthread_mutex_unlock (&s_registry_lock);
+
+	return i2c;
+}
+
+bool RPi2c::registerBus (const char * bus_name, RPi2c * i2c)
 {
-	return s_default_bus;
+	if (!bus_name || !i2c) {
+		return false;
+	}
+
+	bool bRegistered = false;
+
+	pthread_mutex_lock (&s_registry_lock);
+
+	if (s_registry_find (bus_name) < 0 && s_registry_count < RPI2C_MAX_BUSES) {
+		s_registry[s_registry_count].name   = strdup (bus_name);
+		s_registry[s_registry_count].i2c    = i2c;
+		s_registry[s_registry_count].bOwned = false;
+		++s_registry_count;
+
+		bRegistered = true;
+	}
+
+	pthread_mutex_unlock (&s_registry_lock);
+
+	return bRegistered;
+}
+
+void RPi2c::registryClear ()
+{
+	pthread_mutex_lock (&s_registry_lock);
+
+	for (int i = 0; i < s_registry_count; i++) {
+		if (s_registry[i].bOwned) {
+			delete s_registry[i].i2c;
+		}
+		free (s_registry[i].name);
+	}
+	s_registry_count = 0;
+
+	pthread_mutex_unlock (&s_registry_lock);
 }
 
 void RPi2c::setError (const char * error_message)
@@ -96,24 +249,65 @@ void RPi2c::setError (const char * error_message)
 RPi2c::RPi2c () :
 	m_error(s_error_none),
 	m_fd (-1),
+	m_busName(0),
+	m_adapter(0),
+	m_capture(0),
+	m_functionality(0),
+	m_chunkSize(RPI2C_BUFLEN),
+	m_chunkSizeMax(RPI2C_BUFLEN),
+	m_bSMBus(false),
+	m_slaveAddress(-1),
+	m_smbusFunctionality(0),
+	m_smbusFast(RPI2C_SMBUS_FAST),
+	m_smbusLast(-1),
+	m_smbusCount(0),
+	m_ioctlCount(0),
+	m_copyCount(0),
 	m_transferTime(0),
 	m_bTransferTime(false),
+	m_timeout(0),
+	m_retries(0),
+	m_backoff(RPI2C_BACKOFF),
+	m_deadline(0),
+	m_kernelTimeout(-1),
+	m_kernelRetries(-1),
+	m_retryCount(0),
+	m_recoveryCount(0),
+	m_bStats(true),
 	m_bEnableRS(true),
-	m_bSpecifyRegister(true)
+	m_bSpecifyRegister(true),
+	m_bAsync(false),
+	m_bWaiting(false),
+	m_asyncPending(0),
+	m_submitFD(-1),
+	m_completeFD(-1)
 {
-	//
+	pthread_mutex_init (&m_lock, 0);
+	pthread_mutex_init (&m_submitLock, 0);
+	pthread_mutex_init (&m_statsLock, 0);
+
+	memset (m_stats, 0, sizeof (m_stats));
+	memset (m_smbusDenied, 0, sizeof (m_smbusDenied));
 }
 
 RPi2c::~RPi2c ()
 {
 	busClose ();
+
+	for (int a = 0; a < 128; a++) {
+		delete m_stats[a];
+	}
+
+	pthread_mutex_destroy (&m_statsLock);
+	pthread_mutex_destroy (&m_submitLock);
+	pthread_mutex_destroy (&m_lock);
 }
 
 bool RPi2c::busOpen (const char * bus_name)
 {
 	m_error = s_error_none;
 
-	if (m_fd >= 0) {
+	if (isOpen ()) {
 		m_error = s_error_reopen;
 		return false;
 	}
@@ -128,34 +322,429 @@ bool RPi2c::busOpen (const char * bus_name)
 		m_error = s_error_noopen;
 		return false;
 	}
+	m_busName = strdup (bus_name);
+
+	m_slaveAddress = -1;
+
+	m_kernelTimeout = -1;
+	m_kernelRetries = -1;
+
+	/* Plain I2C adapters (e.g., bcm2835) accept messages of any length up to the i2c-dev limit; SMBus-only adapters
+	 * are limited to 32-byte blocks. If the adapter won't say, assume plain I2C but keep to the cautious 32 bytes.
+	 */
+	++m_ioctlCount;
+	if (ioctl (m_fd, I2C_FUNCS, &m_functionality) < 0) {
+		m_functionality = I2C_FUNC_I2C;
+		m_chunkSizeMax = RPI2C_BUFLEN;
+		m_bSMBus = false;
+	} else if (m_functionality & I2C_FUNC_I2C) {
+		m_chunkSizeMax = RPI2C_MAXLEN;
+		m_bSMBus = false;
+	} else {
+		m_chunkSizeMax = RPI2C_BUFLEN;
+		m_bSMBus = true;
+	}
+	m_chunkSize = m_chunkSizeMax;
+
+	m_smbusFunctionality = m_functionality;
+	m_smbusLast = -1;
+	memset (m_smbusDenied, 0, sizeof (m_smbusDenied));
+
+	return true;
+}
+
+bool RPi2c::busOpen (RPi2cAdapter * adapter)
+{
+	m_error = s_error_none;
+
+	if (isOpen ()) {
+		m_error = s_error_reopen;
+		return false;
+	}
+
+	if (!adapter) {
+		m_error = s_error_adapter;
+		return false;
+	}
+
+	m_adapter = adapter;
+
+	m_slaveAddress = -1;
+
+	m_functionality = m_adapter->functionality ();
+
+	if (m_functionality & I2C_FUNC_I2C) {
+		m_chunkSizeMax = RPI2C_MAXLEN;
+		m_bSMBus = false;
+	} else {
+		m_chunkSizeMax = RPI2C_BUFLEN;
+		m_bSMBus = true;
+	}
+	m_chunkSize = m_chunkSizeMax;
+
+	m_smbusFunctionality = m_functionality;
+	m_smbusLast = -1;
+	memset (m_smbusDenied, 0, sizeof (m_smbusDenied));
 
 	return true;
 }
 
 void RPi2c::busClose ()
 {
+	asyncStop ();
+
 	m_error = s_error_none;
 
 	if (m_fd >= 0) {
 		close (m_fd);
 		m_fd = -1;
 	}
+	if (m_busName) {
+		free (m_busName);
+		m_busName = 0;
+	}
+	m_adapter = 0;
 }
 
-/* Returns number of bytes read; returns -1 on failure - use last_error() to see why.
+bool RPi2c::setKernelTimeout (unsigned long timeout_ms)
+{
+	if (m_fd < 0) {
+		return false;
+	}
+	int timeout = static_cast<int>((timeout_ms + 9) / 10); // in units of 10ms
+
+	++m_ioctlCount;
+	if (ioctl (m_fd, I2C_TIMEOUT, timeout) < 0) {
+		return false;
+	}
+	m_kernelTimeout = timeout;
+	return true;
+}
+
+bool RPi2c::setKernelRetries (int retries)
+{
+	if (m_fd < 0) {
+		return false;
+	}
+
+	++m_ioctlCount;
+	if (ioctl (m_fd, I2C_RETRIES, retries) < 0) {
+		return false;
+	}
+	m_kernelRetries = retries;
+	return true;
+}
+
+/* Returns false on failure - use last_error() to see why.
+ * 
+ * Re-opening the bus device resets the kernel's state for the adapter; a user-space adapter decides for itself.
  */
-int RPi2c::busBRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count)
+bool RPi2c::busRecover ()
 {
+	++m_recoveryCount;
+
+	m_slaveAddress = -1;
+
+	if (m_adapter) {
+		return m_adapter->recover ();
+	}
+	if (!m_busName) {
+		m_error = s_error_recover;
+		return false;
+	}
+
+	if (m_fd >= 0) {
+		close (m_fd);
+	}
+	m_fd = open (m_busName, O_RDWR);
 	if (m_fd < 0) {
-		m_error = s_error_nobusr;
+		m_error = s_error_recover;
+		return false;
+	}
+
+	int kernel_timeout = m_kernelTimeout;
+	int kernel_retries = m_kernelRetries;
+
+	if (kernel_timeout >= 0) {
+		setKernelTimeout (kernel_timeout * 10);
+	}
+	if (kernel_retries >= 0) {
+		setKernelRetries (kernel_retries);
+	}
+	return true;
+}
+
+void RPi2c::setChunkSize (uint16_t chunk_size)
+{
+	m_chunkSize = (chunk_size && chunk_size < m_chunkSizeMax) ? chunk_size : m_chunkSizeMax;
+}
+
+void RPi2c::setSMBusFast (uint16_t max_bytes)
+{
+	m_smbusFast = (max_bytes < RPI2C_BUFLEN) ? max_bytes : RPI2C_BUFLEN;
+}
+
+/* Returns false on failure.
+ */
+bool RPi2c::busSlave (uint16_t device_address)
+{
+	if (m_slaveAddress == device_address) {
+		return true;
+	}
+
+	if (!m_adapter) {
+		++m_ioctlCount;
+		if (ioctl (m_fd, I2C_SLAVE, device_address) < 0) {
+			m_slaveAddress = -1;
+			return false;
+		}
+	}
+	m_slaveAddress = device_address;
+
+	return true;
+}
+
+/* Returns ioctl status; negative on failure.
+ */
+int RPi2c::busSMBus (char read_write, uint8_t command, int size, union i2c_smbus_data * data)
+{
+	int status;
+
+	++m_ioctlCount;
+
+	if (m_adapter) {
+		status = m_adapter->smbus (static_cast<uint16_t>(m_slaveAddress), read_write, command, size, data);
+	} else {
+		struct i2c_smbus_ioctl_data args;
+
+		args.read_write = read_write;
+		args.command    = command;
+		args.size       = size;
+		args.data       = data;
+
+		status = ioctl (m_fd, I2C_SMBUS, &args);
+	}
+	if (m_capture) {
+		m_capture->recordSMBus (static_cast<uint16_t>(m_slaveAddress), read_write, command, size, data, status);
+	}
+	return status;
+}
+
+/* Returns number of messages transferred; negative on failure.
+ */
+int RPi2c::busRDWR (struct i2c_msg * messages, int count)
+{
+	int status;
+
+	++m_ioctlCount;
+
+	if (m_adapter) {
+		status = m_adapter->transfer (messages, count);
+	} else {
+		struct i2c_rdwr_ioctl_data data = { messages, static_cast<__u32>(count) };
+
+		status = ioctl (m_fd, I2C_RDWR, &data);
+	}
+	if (m_capture) {
+		m_capture->recordMessages (messages, count, status);
+	}
+	return status;
+}
+
+/* Returns number of bytes read; returns -1 on failure - use last_error() to see why.
+ * 
+ * Reads which specify the register use the SMBus "I2C block" command; reads which continue from the current register
+ * have to be done a byte at a time.
+ */
+int RPi2c::busSMBusRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes)
+{
+	if (!busSlave (device_address)) {
+		m_error = s_error_slave;
+		return -1;
+	}
+
+	union i2c_smbus_data data;
+
+	if (m_bSpecifyRegister) {
+		if (register_address & 0xFF00) {
+			m_error = s_error_smbreg;
+			return -1;
+		}
+
+		data.block[0] = static_cast<uint8_t>(byte_count);
+
+		if (busSMBus (I2C_SMBUS_READ, static_cast<uint8_t>(register_address), I2C_SMBUS_I2C_BLOCK_DATA, &data) < 0) {
+			m_error = s_error_smberr;
+			return -1;
+		}
+		memcpy (bytes, data.block + 1, byte_count);
+		++m_copyCount;
+	} else {
+		for (uint16_t ib = 0; ib < byte_count; ib++) {
+			if (busSMBus (I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &data) < 0) {
+				m_error = s_error_smberr;
+				return -1;
+			}
+			bytes[ib] = data.byte;
+		}
+	}
+	return byte_count;
+}
+
+/* Returns number of bytes written; returns -1 on failure - use last_error() to see why.
+ * 
+ * The data to write is in m_buffer + 2.
+ */
+int RPi2c::busSMBusWrite (uint16_t device_address, uint16_t register_address, uint16_t byte_count)
+{
+	if (!busSlave (device_address)) {
+		m_error = s_error_slave;
 		return -1;
 	}
 
-	if (ioctl (m_fd, I2C_SLAVE, device_address) < 0) {
-		m_error = s_error_slaver;
+	if (m_bSpecifyRegister) {
+		if (register_address & 0xFF00) {
+			m_error = s_error_smbreg;
+			return -1;
+		}
+
+		union i2c_smbus_data data;
+
+		data.block[0] = static_cast<uint8_t>(byte_count);
+		memcpy (data.block + 1, m_buffer + 2, byte_count);
+		++m_copyCount;
+
+		if (busSMBus (I2C_SMBUS_WRITE, static_cast<uint8_t>(register_address), I2C_SMBUS_I2C_BLOCK_DATA, &data) < 0) {
+			m_error = s_error_smberr;
+			return -1;
+		}
+	} else {
+		for (uint16_t ib = 0; ib < byte_count; ib++) {
+			if (busSMBus (I2C_SMBUS_WRITE, m_buffer[2+ib], I2C_SMBUS_BYTE, 0) < 0) {
+				m_error = s_error_smberr;
+				return -1;
+			}
+		}
+	}
+	return byte_count;
+}
+
+/* Returns true if the transfer was done (or attempted) with an SMBus command, setting status to the number of bytes
+ * transferred or to -1 on failure; returns false if the caller should use I2C_RDWR instead.
+ * 
+ * The data to write, or the buffer to read into, is bytes.
+ */
+bool RPi2c::busSMBusFast (char read_write, uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes, int & status)
+{
+	if (!m_bSpecifyRegister || (register_address & 0xFF00) || !byte_count || byte_count > m_smbusFast) {
+		return false;
+	}
+	if (read_write == I2C_SMBUS_READ && !m_bEnableRS) {
+		return false; // SMBus reads always use a repeated start
+	}
+
+	int size;
+	unsigned long functionality;
+
+	if (byte_count == 1) {
+		size = I2C_SMBUS_BYTE_DATA;
+		functionality = (read_write == I2C_SMBUS_READ) ? I2C_FUNC_SMBUS_READ_BYTE_DATA : I2C_FUNC_SMBUS_WRITE_BYTE_DATA;
+	} else if (byte_count == 2) {
+		size = I2C_SMBUS_WORD_DATA;
+		functionality = (read_write == I2C_SMBUS_READ) ? I2C_FUNC_SMBUS_READ_WORD_DATA : I2C_FUNC_SMBUS_WRITE_WORD_DATA;
+	} else {
+		size = I2C_SMBUS_I2C_BLOCK_DATA;
+		functionality = (read_write == I2C_SMBUS_READ) ? I2C_FUNC_SMBUS_READ_I2C_BLOCK : I2C_FUNC_SMBUS_WRITE_I2C_BLOCK;
+	}
+	if (!(m_smbusFunctionality & functionality)) {
+		return false;
+	}
+
+	/* I2C_RDWR carries the device address in each message, whereas switching the SMBus device address costs an extra
+	 * I2C_SLAVE ioctl; only switch when the same device is addressed twice in a row.
+	 */
+	if (m_slaveAddress != device_address) {
+		if (device_address & ~0x7F) {
+			return false;
+		}
+		if (m_smbusDenied[device_address >> 5] & (1U << (device_address & 0x1F))) {
+			return false;
+		}
+		if (!m_adapter && m_smbusLast != device_address) {
+			m_smbusLast = device_address;
+			return false;
+		}
+		if (!busSlave (device_address)) {
+			m_smbusDenied[device_address >> 5] |= (1U << (device_address & 0x1F)); // e.g., EBUSY: in use by a kernel driver
+			return false;
+		}
+	}
+	m_smbusLast = device_address;
+
+	union i2c_smbus_data data;
+
+	if (read_write == I2C_SMBUS_WRITE) {
+		if (size == I2C_SMBUS_BYTE_DATA) {
+			data.byte = bytes[0];
+		} else if (size == I2C_SMBUS_WORD_DATA) {
+			data.word = static_cast<uint16_t>(bytes[0]) | (static_cast<uint16_t>(bytes[1]) << 8); // SMBus words are LSB first
+		} else {
+			data.block[0] = static_cast<uint8_t>(byte_count);
+			memcpy (data.block + 1, bytes, byte_count);
+			++m_copyCount;
+		}
+	} else if (size == I2C_SMBUS_I2C_BLOCK_DATA) {
+		data.block[0] = static_cast<uint8_t>(byte_count);
+	}
+
+	if (busSMBus (read_write, static_cast<uint8_t>(register_address), size, &data) < 0) {
+		if (errno == EOPNOTSUPP) {
+			m_smbusFunctionality &= ~functionality; // not after all; don't ask again
+			return false;
+		}
+		m_error = (read_write == I2C_SMBUS_READ) ? s_error_rderr : s_error_wrerr;
+		status = -1;
+		return true;
+	}
+	++m_smbusCount;
+
+	if (read_write == I2C_SMBUS_READ) {
+		if (size == I2C_SMBUS_BYTE_DATA) {
+			bytes[0] = data.byte;
+		} else if (size == I2C_SMBUS_WORD_DATA) {
+			bytes[0] = static_cast<uint8_t>(data.word & 0xFF);
+			bytes[1] = static_cast<uint8_t>((data.word >> 8) & 0xFF);
+		} else {
+			memcpy (bytes, data.block + 1, byte_count);
+			++m_copyCount;
+		}
+	}
+	status = byte_count;
+	return true;
+}
+
+/* Returns number of bytes read; returns -1 on failure - use last_error() to see why.
+ * 
+ * The I2C_RDWR messages carry the device address, so there is no need to set it first with I2C_SLAVE,
+ * and the data is read directly into the destination buffer.
+ */
+int RPi2c::busBRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes)
+{
+	if (!isOpen ()) {
+		m_error = s_error_nobusr;
 		return -1;
 	}
 
+	if (m_bSMBus) {
+		return busSMBusRead (device_address, register_address, byte_count, bytes);
+	}
+
+	int status = 0;
+
+	if (m_smbusFast && busSMBusFast (I2C_SMBUS_READ, device_address, register_address, byte_count, bytes, status)) {
+		return status;
+	}
+
 	uint8_t * register_byte_ptr = m_buffer;
 	uint16_t register_byte_count = 2;
 
@@ -169,24 +758,19 @@ int RPi2c::busBRead (uint16_t device_address, uint16_t register_address, uint16_
 		m_buffer[1] = static_cast<uint8_t>(register_address & 0x00FF);
 	}
 
-	struct i2c_msg message[2] = {
-		{ device_address, 0, register_byte_count, reinterpret_cast<char *>(register_byte_ptr) },
-		{ device_address, I2C_M_RD, byte_count, reinterpret_cast<char *>(m_buffer + 2) }
-	};
+	struct i2c_msg message[2];
 
-	int status = 0;
+	rpi2c_message (message[0], device_address, 0, register_byte_count, register_byte_ptr);
+	rpi2c_message (message[1], device_address, I2C_M_RD, byte_count, bytes);
 
 	if (m_bEnableRS && m_bSpecifyRegister) {
-		struct i2c_rdwr_ioctl_data data = { message, 2 };
-		status = ioctl (m_fd, I2C_RDWR, &data);
+		status = busRDWR (message, 2);
 	} else {
 		if (m_bSpecifyRegister) {
-			struct i2c_rdwr_ioctl_data data = { message, 1 };
-			status = ioctl (m_fd, I2C_RDWR, &data);
+			status = busRDWR (message, 1);
 		}
 		if (status >= 0) {
-			struct i2c_rdwr_ioctl_data data = { message + 1, 1 };
-			status = ioctl (m_fd, I2C_RDWR, &data);
+			status = busRDWR (message + 1, 1);
 		}
 	}
 
@@ -199,13 +783,8 @@ int RPi2c::busBRead (uint16_t device_address, uint16_t register_address, uint16_
 
 /* Returns number of bytes read; returns -1 on failure - use last_error() to see why.
  */
-int RPi2c::busRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes, bool bSpecifyRegister)
+int RPi2c::busReadBytes (uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes, bool bSpecifyRegister)
 {
-	if (m_bTransferTime) {
-		m_transferTime = 0;
-		timerStart ();
-	}
-
 	m_bSpecifyRegister = bSpecifyRegister;
 
 	m_error = s_error_none;
@@ -220,15 +799,17 @@ int RPi2c::busRead (uint16_t device_address, uint16_t register_address, uint16_t
 	uint16_t byte_count_total = 0;
 
 	while (byte_count > 0) {
-		uint16_t byte_count_this = (byte_count > RPI2C_BUFLEN) ? RPI2C_BUFLEN : byte_count;
+		uint16_t byte_count_this = (byte_count > m_chunkSize) ? m_chunkSize : byte_count;
 
-		status = busBRead (device_address, register_address, byte_count);
+		status = busBRead (device_address, register_address, byte_count_this, bytes);
 
 		if (status < 0) break;
 
-		memcpy (bytes, m_buffer + 2, byte_count);
-
-		// logically, this is the only place to add a time-out // TODO ??
+		if (byte_count > byte_count_this && m_deadline && s_now_ns () >= m_deadline) {
+			m_error = s_error_timeout;
+			status = -1;
+			break;
+		}
 
 		byte_count_total += byte_count_this;
 		byte_count -= byte_count_this;
@@ -237,21 +818,13 @@ int RPi2c::busRead (uint16_t device_address, uint16_t register_address, uint16_t
 		m_bSpecifyRegister = false;
 	}
 
-	if (m_bTransferTime) {
-		m_transferTime = timerStop ();
-	}
 	return (status < 0) ? status : byte_count_total;
 }
 
 /* Returns number of words read; returns -1 on failure - use last_error() to see why.
  */
-int RPi2c::busRead (uint16_t device_address, uint16_t register_address, uint16_t word_count, uint16_t * words, bool data_lsb_1st, bool bSpecifyRegister)
+int RPi2c::busReadWords (uint16_t device_address, uint16_t register_address, uint16_t word_count, uint16_t * words, bool data_lsb_1st, bool bSpecifyRegister)
 {
-	if (m_bTransferTime) {
-		m_transferTime = 0;
-		timerStart ();
-	}
-
 	m_bSpecifyRegister = bSpecifyRegister;
 
 	m_error = s_error_none;
@@ -265,27 +838,26 @@ int RPi2c::busRead (uint16_t device_address, uint16_t register_address, uint16_t
 
 	uint16_t word_count_total = 0;
 
-	while (word_count > 0) {
-		uint16_t word_count_this = (2 * word_count > RPI2C_BUFLEN) ? (RPI2C_BUFLEN / 2) : word_count;
-		uint16_t byte_count = word_count * 2;
+	/* Read straight into the caller's buffer, then convert the byte order in place, if necessary, over the whole chunk
+	 */
+	uint16_t word_count_max = (m_chunkSize > 1) ? (m_chunkSize / 2) : 1;
 
-		uint8_t * byte = m_buffer + 2;
+	while (word_count > 0) {
+		uint16_t word_count_this = (word_count > word_count_max) ? word_count_max : word_count;
 
-		status = busBRead (device_address, register_address, byte_count);
+		status = busBRead (device_address, register_address, word_count_this * 2, reinterpret_cast<uint8_t *>(words));
 
 		if (status < 0) break;
 
-		for (int iw = 0; iw < word_count_this; iw++) {
-			if (data_lsb_1st) {
-				words[iw]  = static_cast<uint16_t>(*byte++);
-				words[iw] |= static_cast<uint16_t>(*byte++) << 8;
-			} else {
-				words[iw]  = static_cast<uint16_t>(*byte++) << 8;
-				words[iw] |= static_cast<uint16_t>(*byte++);
-			}
+		if (data_lsb_1st != RPI2C_HOST_LSB_1ST) {
+			rpi2c_bswap16 (words, word_count_this);
 		}
 
-		// logically, this is the only place to add a time-out // TODO ??
+		if (word_count > word_count_this && m_deadline && s_now_ns () >= m_deadline) {
+			m_error = s_error_timeout;
+			status = -1;
+			break;
+		}
 
 		word_count_total += word_count_this;
 		word_count -= word_count_this;
@@ -294,9 +866,6 @@ int RPi2c::busRead (uint16_t device_address, uint16_t register_address, uint16_t
 		m_bSpecifyRegister = false;
 	}
 
-	if (m_bTransferTime) {
-		m_transferTime = timerStop ();
-	}
 	return (status < 0) ? status : word_count_total;
 }
 
@@ -304,14 +873,19 @@ int RPi2c::busRead (uint16_t device_address, uint16_t register_address, uint16_t
  */
 int RPi2c::busBWrite (uint16_t device_address, uint16_t register_address, uint16_t byte_count)
 {
-	if (m_fd < 0) {
+	if (!isOpen ()) {
 		m_error = s_error_nobusw;
 		return -1;
 	}
 
-	if (ioctl (m_fd, I2C_SLAVE, device_address) < 0) {
-		m_error = s_error_slavew;
-		return -1;
+	if (m_bSMBus) {
+		return busSMBusWrite (device_address, register_address, byte_count);
+	}
+
+	int status = 0;
+
+	if (m_smbusFast && busSMBusFast (I2C_SMBUS_WRITE, device_address, register_address, byte_count, m_buffer + 2, status)) {
+		return status;
 	}
 
 	uint8_t * register_byte_ptr = m_buffer + 2;
@@ -326,12 +900,11 @@ int RPi2c::busBWrite (uint16_t device_address, uint16_t register_address, uint16
 			++register_byte_count;
 		}
 	}
-	struct i2c_msg message[1] = {
-		{ device_address, 0, register_byte_count + byte_count, reinterpret_cast<char *>(register_byte_ptr) }
-	};
-	struct i2c_rdwr_ioctl_data data = { message, 1 };
+	struct i2c_msg message[1];
+
+	rpi2c_message (message[0], device_address, 0, register_byte_count + byte_count, register_byte_ptr);
 
-	int status = ioctl (m_fd, I2C_RDWR, &data);
+	status = busRDWR (message, 1);
 
 	if (status < 0) {
 		m_error = s_error_wrerr;
@@ -342,13 +915,8 @@ int RPi2c::busBWrite (uint16_t device_address, uint16_t register_address, uint16
 
 /* Returns number of bytes written; returns -1 on failure - use last_error() to see why.
  */
-int RPi2c::busWrite (uint16_t device_address, uint16_t register_address, uint16_t byte_count, const uint8_t * bytes, bool bSpecifyRegister)
+int RPi2c::busWriteBytes (uint16_t device_address, uint16_t register_address, uint16_t byte_count, const uint8_t * bytes, bool bSpecifyRegister)
 {
-	if (m_bTransferTime) {
-		m_transferTime = 0;
-		timerStart ();
-	}
-
 	m_bSpecifyRegister = bSpecifyRegister;
 
 	m_error = s_error_none;
@@ -363,15 +931,20 @@ int RPi2c::busWrite (uint16_t device_address, uint16_t register_address, uint16_
 	uint16_t byte_count_total = 0;
 
 	while (byte_count > 0) {
-		uint16_t byte_count_this = (byte_count > RPI2C_BUFLEN) ? RPI2C_BUFLEN : byte_count;
+		uint16_t byte_count_this = (byte_count > m_chunkSize) ? m_chunkSize : byte_count;
 
 		memcpy (m_buffer + 2, bytes, byte_count_this);
+		++m_copyCount;
 
 		status = busBWrite (device_address, register_address, byte_count_this);
 
 		if (status < 0) break;
 
-		// logically, this is the only place to add a time-out // TODO ??
+		if (byte_count > byte_count_this && m_deadline && s_now_ns () >= m_deadline) {
+			m_error = s_error_timeout;
+			status = -1;
+			break;
+		}
 
 		byte_count_total += byte_count_this;
 		byte_count -= byte_count_this;
@@ -380,21 +953,13 @@ int RPi2c::busWrite (uint16_t device_address, uint16_t register_address, uint16_
 		m_bSpecifyRegister = false;
 	}
 
-	if (m_bTransferTime) {
-		m_transferTime = timerStop ();
-	}
 	return (status < 0) ? status : byte_count_total;
 }
 
 /* Returns number of words written; returns -1 on failure - use last_error() to see why.
  */
-int RPi2c::busWrite (uint16_t device_address, uint16_t register_address, uint16_t word_count, const uint16_t * words, bool data_lsb_1st, bool bSpecifyRegister)
+int RPi2c::busWriteWords (uint16_t device_address, uint16_t register_address, uint16_t word_count, const uint16_t * words, bool data_lsb_1st, bool bSpecifyRegister)
 {
-	if (m_bTransferTime) {
-		m_transferTime = 0;
-		timerStart ();
-	}
-
 	m_bSpecifyRegister = bSpecifyRegister;
 
 	m_error = s_error_none;
@@ -408,27 +973,29 @@ int RPi2c::busWrite (uint16_t device_address, uint16_t register_address, uint16_
 
 	uint16_t word_count_total = 0;
 
+	/* Stage each chunk after the register address, converting the byte order on the way, if necessary
+	 */
+	uint16_t word_count_max = (m_chunkSize > 1) ? (m_chunkSize / 2) : 1;
+
 	while (word_count > 0) {
-		uint16_t word_count_this = (2 * word_count > RPI2C_BUFLEN) ? (RPI2C_BUFLEN / 2) : word_count;
-		uint16_t byte_count = word_count * 2;
-
-		uint8_t * byte = m_buffer + 2;
-
-		for (int iw = 0; iw < word_count_this; iw++) {
-			if (data_lsb_1st) {
-				*byte++ = static_cast<uint8_t>(words[iw] & 0xFF);
-				*byte++ = static_cast<uint8_t>((words[iw] >> 8) & 0xFF);
-			} else {
-				*byte++ = static_cast<uint8_t>((words[iw] >> 8) & 0xFF);
-				*byte++ = static_cast<uint8_t>(words[iw] & 0xFF);
-			}
+		uint16_t word_count_this = (word_count > word_count_max) ? word_count_max : word_count;
+
+		if (data_lsb_1st != RPI2C_HOST_LSB_1ST) {
+			rpi2c_bswap16_copy (m_buffer + 2, words, word_count_this);
+		} else {
+			memcpy (m_buffer + 2, words, word_count_this * 2);
 		}
+		++m_copyCount;
 
-		status = busBWrite (device_address, register_address, byte_count);
+		status = busBWrite (device_address, register_address, word_count_this * 2);
 
 		if (status < 0) break;
 
-		// logically, this is the only place to add a time-out // TODO ??
+		if (word_count > word_count_this && m_deadline && s_now_ns () >= m_deadline) {
+			m_error = s_error_timeout;
+			status = -1;
+			break;
+		}
 
 		word_count_total += word_count_this;
 		word_count -= word_count_this;
@@ -437,8 +1004,500 @@ int RPi2c::busWrite (uint16_t device_address, uint16_t register_address, uint16_
 		m_bSpecifyRegister = false;
 	}
 
+	return (status < 0) ? status : word_count_total;
+}
+
+/* Returns false on failure - use last_error() to see why.
+ */
+bool RPi2c::busTransferNow (RPi2cTransaction & transaction)
+{
+	m_error = s_error_none;
+
+	if (!isOpen ()) {
+		m_error = s_error_nobust;
+		return false;
+	}
+	if (m_bSMBus) {
+		m_error = s_error_trsmb;
+		return false;
+	}
+
+	int status = 0;
+
+	if (transaction.m_messageCount) {
+		status = busRDWR (transaction.m_message, transaction.m_messageCount);
+	}
+
+	for (int op = 0; op < transaction.m_opCount; op++) {
+		transaction.m_op[op].status = (status < 0) ? -1 : transaction.m_op[op].byte_count;
+	}
+
+	if (status < 0) {
+		m_error = s_error_trerr;
+		return false;
+	}
+	return true;
+}
+
+/* Returns number of bytes read; returns -1 on failure - use last_error() to see why.
+ */
+int RPi2c::busRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes, bool bSpecifyRegister,
+					 unsigned long timeout)
+{
+	RPi2cRequest request;
+	s_request (request, RPI2C_REQUEST_READ, device_address, register_address, byte_count, bytes, bSpecifyRegister);
+	request.timeout = timeout;
+	return busRequest (request);
+}
+
+/* Returns number of words read; returns -1 on failure - use last_error() to see why.
+ */
+int RPi2c::busRead (uint16_t device_address, uint16_t register_address, uint16_t word_count, uint16_t * words, bool data_lsb_1st, bool bSpecifyRegister,
+					 unsigned long timeout)
+{
+	RPi2cRequest request;
+	s_request (request, RPI2C_REQUEST_READ_WORDS, device_address, register_address, word_count, words, bSpecifyRegister, data_lsb_1st);
+	request.timeout = timeout;
+	return busRequest (request);
+}
+
+/* Returns number of bytes written; returns -1 on failure - use last_error() to see why.
+ */
+int RPi2c::busWrite (uint16_t device_address, uint16_t register_address, uint16_t byte_count, const uint8_t * bytes, bool bSpecifyRegister)
+{
+	RPi2cRequest request;
+	s_request (request, RPI2C_REQUEST_WRITE, device_address, register_address, byte_count, const_cast<uint8_t *>(bytes), bSpecifyRegister);
+	return busRequest (request);
+}
+
+/* Returns number of words written; returns -1 on failure - use last_error() to see why.
+ */
+int RPi2c::busWrite (uint16_t device_address, uint16_t register_address, uint16_t word_count, const uint16_t * words, bool data_lsb_1st, bool bSpecifyRegister)
+{
+	RPi2cRequest request;
+	s_request (request, RPI2C_REQUEST_WRITE_WORDS, device_address, register_address, word_count, const_cast<uint16_t *>(words), bSpecifyRegister, data_lsb_1st);
+	return busRequest (request);
+}
+
+/* Returns false on failure - use last_error() to see why.
+ */
+bool RPi2c::busTransfer (RPi2cTransaction & transaction)
+{
+	RPi2cRequest request;
+	s_request (request, RPI2C_REQUEST_TRANSFER, 0, 0, 0, &transaction, false);
+	return busRequest (request) >= 0;
+}
+
+/* Returns as the equivalent synchronous call; returns -1 on failure - use last_error() to see why.
+ */
+int RPi2c::busAttempt (RPi2cRequest & request)
+{
+	switch (request.type) {
+	case RPI2C_REQUEST_READ:
+		return busReadBytes (request.device_address, request.register_address, request.count,
+							 static_cast<uint8_t *>(request.data), request.bSpecifyRegister);
+	case RPI2C_REQUEST_READ_WORDS:
+		return busReadWords (request.device_address, request.register_address, request.count,
+							 static_cast<uint16_t *>(request.data), request.data_lsb_1st, request.bSpecifyRegister);
+	case RPI2C_REQUEST_WRITE:
+		return busWriteBytes (request.device_address, request.register_address, request.count,
+							  static_cast<const uint8_t *>(request.data), request.bSpecifyRegister);
+	case RPI2C_REQUEST_WRITE_WORDS:
+		return busWriteWords (request.device_address, request.register_address, request.count,
+							  static_cast<const uint16_t *>(request.data), request.data_lsb_1st, request.bSpecifyRegister);
+	case RPI2C_REQUEST_TRANSFER:
+		return busTransferNow (*static_cast<RPi2cTransaction *>(request.data)) ? 0 : -1;
+	default:
+		break;
+	}
+	return 0;
+}
+
+void RPi2c::busExecute (RPi2cRequest & request)
+{
+	if (request.type == RPI2C_REQUEST_STOP) {
+		request.status = 0;
+		request.error = s_error_none;
+		return;
+	}
+
+	uint64_t start = s_now_ns ();
+
+	unsigned long timeout = request.timeout ? request.timeout : m_timeout;
+
+	if (timeout) {
+		m_deadline = start + static_cast<uint64_t>(timeout) * 1000;
+	}
+
+	/* Retry failures with exponential backoff, within the deadline; if the kernel timed out, e.g., because a device
+	 * is holding the clock low, recover the bus first.
+	 */
+	unsigned long backoff = m_backoff;
+
+	for (unsigned attempt = 0; ; attempt++) {
+		errno = 0; // so that a failure without a system call (or an adapter's) isn't taken for an earlier time-out
+
+		request.status = busAttempt (request);
+
+		if (request.status >= 0 || attempt == m_retries) {
+			break;
+		}
+		bool bTimedOut = (errno == ETIMEDOUT);
+
+		if (m_deadline && s_now_ns () + static_cast<uint64_t>(backoff) * 1000 >= m_deadline) {
+			m_error = s_error_timeout;
+			break;
+		}
+		if (bTimedOut && !busRecover ()) {
+			break;
+		}
+		++m_retryCount;
+
+		usleep (backoff);
+		backoff *= 2;
+	}
+	m_deadline = 0;
+
+	request.error = m_error;
+
+	request.stamp.start = start;
+	request.stamp.end   = s_now_ns ();
+
+	uint64_t ns = request.stamp.end - start;
+
 	if (m_bTransferTime) {
-		m_transferTime = timerStop ();
+		m_transferTime = static_cast<unsigned long>(ns / 1000);
+	}
+	if (request.type == RPI2C_REQUEST_TRANSFER) {
+		RPi2cTransaction & transaction = *static_cast<RPi2cTransaction *>(request.data);
+
+		transaction.m_latency = static_cast<unsigned long>(ns / 1000);
+		transaction.m_stamp   = request.stamp;
+
+		if (m_bStats) {
+			statsRecord (transaction, ns);
+		}
+	} else if (m_bStats) {
+		uint32_t byte_count = 0;
+
+		if (request.status > 0) {
+			byte_count = request.status;
+
+			if (request.type == RPI2C_REQUEST_READ_WORDS || request.type == RPI2C_REQUEST_WRITE_WORDS) {
+				byte_count *= 2;
+			}
+		}
+		statsRecord (request.device_address, ns, byte_count, request.status < 0);
+	}
+	if (RPi2cTrace::enabled ()) {
+		RPi2cTrace::record (request);
+	}
+}
+
+void RPi2c::statsRecord (uint16_t device_address, uint64_t ns, uint32_t byte_count, bool bError)
+{
+	pthread_mutex_lock (&m_statsLock);
+
+	RPi2cDeviceStats *& stats = m_stats[device_address & 0x7F];
+
+	if (!stats) {
+		stats = new RPi2cDeviceStats;
+		stats->clear (device_address & 0x7F);
+	}
+	stats->record (ns, byte_count, bError);
+
+	pthread_mutex_unlock (&m_statsLock);
+}
+
+/* The bus time of a transaction is shared between its operations in proportion to the bytes that each puts on the bus,
+ * counting one address byte per message.
+ */
+void RPi2c::statsRecord (const RPi2cTransaction & transaction, uint64_t ns)
+{
+	uint32_t weight_total = 0;
+
+	for (int m = 0; m < transaction.m_messageCount; m++) {
+		weight_total += 1 + transaction.m_message[m].len;
+	}
+	if (!weight_total) {
+		return;
+	}
+
+	for (int op = 0; op < transaction.m_opCount; op++) {
+		int m_begin = transaction.m_op[op].message;
+		int m_end   = (op + 1 < transaction.m_opCount) ? transaction.m_op[op+1].message : transaction.m_messageCount;
+
+		uint32_t weight = 0;
+
+		for (int m = m_begin; m < m_end; m++) {
+			weight += 1 + transaction.m_message[m].len;
+		}
+
+		int status = transaction.m_op[op].status;
+
+		statsRecord (transaction.m_message[m_begin].addr, (ns * weight) / weight_total, (status > 0) ? status : 0, status < 0);
+	}
+}
+
+bool RPi2c::stats (uint16_t device_address, RPi2cDeviceStats & snapshot)
+{
+	bool bRecorded = false;
+
+	pthread_mutex_lock (&m_statsLock);
+
+	if (m_stats[device_address & 0x7F]) {
+		snapshot = *m_stats[device_address & 0x7F];
+		bRecorded = true;
+	}
+
+	pthread_mutex_unlock (&m_statsLock);
+
+	return bRecorded;
+}
+
+void RPi2c::statsBus (RPi2cDeviceStats & snapshot)
+{
+	snapshot.clear (0xFFFF);
+
+	pthread_mutex_lock (&m_statsLock);
+
+	for (int a = 0; a < 128; a++) {
+		if (m_stats[a]) {
+			snapshot.add (*m_stats[a]);
+		}
+	}
+
+	pthread_mutex_unlock (&m_statsLock);
+}
+
+int RPi2c::statsDevices (uint16_t * device_addresses, int max_count)
+{
+	int count = 0;
+
+	pthread_mutex_lock (&m_statsLock);
+
+	for (int a = 0; a < 128 && count < max_count; a++) {
+		if (m_stats[a]) {
+			device_addresses[count++] = a;
+		}
+	}
+
+	pthread_mutex_unlock (&m_statsLock);
+
+	return count;
+}
+
+void RPi2c::statsReset ()
+{
+	pthread_mutex_lock (&m_statsLock);
+
+	for (int a = 0; a < 128; a++) {
+		delete m_stats[a];
+		m_stats[a] = 0;
+	}
+
+	pthread_mutex_unlock (&m_statsLock);
+}
+
+/* Returns request status.
+ */
+int RPi2c::busRequest (RPi2cRequest & request)
+{
+	pthread_mutex_lock (&m_lock);
+
+	if (!m_bAsync) {
+		busExecute (request);
+	} else {
+		/* Queue the request behind any others and wait for the bus thread to reply
+		 */
+		request.reply = &request;
+
+		while (!asyncSubmit (request)) {
+			sched_yield (); // queue full
+		}
+		while (sem_wait (&m_replySem) < 0 && errno == EINTR) {
+			// interrupted; keep waiting
+		}
+
+		m_error = request.error;
+	}
+	s_thread_stamp = request.stamp;
+
+	pthread_mutex_unlock (&m_lock);
+
+	return request.status;
+}
+
+bool RPi2c::asyncStart ()
+{
+	m_error = s_error_none;
+
+	if (m_bAsync) {
+		return true;
+	}
+	if (!isOpen ()) {
+		m_error = s_error_asopen;
+		return false;
+	}
+
+	m_submitFD = eventfd (0, 0);
+	m_completeFD = eventfd (0, EFD_NONBLOCK);
+
+	if (m_submitFD < 0 || m_completeFD < 0) {
+		m_error = s_error_aseventfd;
+	} else if (sem_init (&m_replySem, 0, 0) < 0) {
+		m_error = s_error_aseventfd;
+	} else if (pthread_create (&m_thread, 0, asyncThread, this)) {
+		sem_destroy (&m_replySem);
+		m_error = s_error_asthread;
+	} else {
+		m_bAsync = true;
+		return true;
+	}
+
+	if (m_submitFD >= 0) {
+		close (m_submitFD);
+		m_submitFD = -1;
+	}
+	if (m_completeFD >= 0) {
+		close (m_completeFD);
+		m_completeFD = -1;
+	}
+	return false;
+}
+
+void RPi2c::asyncStop ()
+{
+	if (!m_bAsync) {
+		return;
+	}
+
+	RPi2cRequest request;
+	s_request (request, RPI2C_REQUEST_STOP, 0, 0, 0, 0, false);
+
+	while (!asyncSubmit (request)) {
+		sched_yield (); // queue full
+	}
+	pthread_join (m_thread, 0);
+
+	m_bAsync = false;
+
+	sem_destroy (&m_replySem);
+
+	close (m_submitFD);
+	m_submitFD = -1;
+
+	/* m_completeFD stays open while there are completed requests to collect
+	 */
+	if (m_completeRing.empty ()) {
+		close (m_completeFD);
+		m_completeFD = -1;
+	}
+}
+
+bool RPi2c::asyncSubmit (const RPi2cRequest & request)
+{
+	if (!m_bAsync) {
+		return false;
+	}
+
+	RPi2cRequest entry = request;
+
+	entry.submitted = s_now_us ();
+
+	/* busRequest(), asyncStop() and any number of threads calling asyncSubmit() all push to the single-producer ring
+	 */
+	pthread_mutex_lock (&m_submitLock);
+
+	/* Keep room for every completion, so that the bus thread never has to wait for asyncComplete()
+	 */
+	bool bCompletes = !entry.reply && (entry.type != RPI2C_REQUEST_STOP);
+
+	bool bPushed = false;
+
+	if (!bCompletes || (__atomic_load_n (&m_asyncPending, __ATOMIC_ACQUIRE) < RPI2C_RING_SIZE)) {
+		bPushed = m_submitRing.push (entry);
+	}
+	if (bPushed && bCompletes) {
+		__atomic_add_fetch (&m_asyncPending, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock (&m_submitLock);
+
+	if (!bPushed) {
+		return false;
+	}
+
+	/* Only wake the bus thread if it has gone, or is about to go, to sleep
+	 */
+	if (__atomic_load_n (&m_bWaiting, __ATOMIC_SEQ_CST)) {
+		eventfd_write (m_submitFD, 1);
+	}
+	return true;
+}
+
+bool RPi2c::asyncComplete (RPi2cRequest & request)
+{
+	if (m_completeFD < 0) {
+		return false;
+	}
+	if (m_completeRing.pop (request)) {
+		__atomic_sub_fetch (&m_asyncPending, 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	/* Ring is empty: reset the eventfd, then check again in case a request completed in the meantime
+	 */
+	eventfd_t value;
+	eventfd_read (m_completeFD, &value);
+
+	if (m_completeRing.pop (request)) {
+		__atomic_sub_fetch (&m_asyncPending, 1, __ATOMIC_RELEASE);
+		return true;
+	}
+	if (!m_bAsync) {
+		close (m_completeFD);
+		m_completeFD = -1;
+	}
+	return false;
+}
+
+void * RPi2c::asyncThread (void * i2c)
+{
+	static_cast<RPi2c *>(i2c)->asyncRun ();
+	return 0;
+}
+
+void RPi2c::asyncRun ()
+{
+	while (true) {
+		RPi2cRequest request;
+
+		if (!m_submitRing.pop (request)) {
+			__atomic_store_n (&m_bWaiting, true, __ATOMIC_SEQ_CST);
+
+			if (!m_submitRing.pop (request)) {
+				eventfd_t value;
+				eventfd_read (m_submitFD, &value); // sleep until woken by asyncSubmit()
+
+				__atomic_store_n (&m_bWaiting, false, __ATOMIC_SEQ_CST);
+				continue;
+			}
+			__atomic_store_n (&m_bWaiting, false, __ATOMIC_SEQ_CST);
+		}
+
+		if (request.type == RPI2C_REQUEST_STOP) {
+			break;
+		}
+
+		busExecute (request);
+
+		request.latency = static_cast<unsigned long>(s_now_us () - request.submitted);
+
+		if (request.reply) {
+			*request.reply = request;
+			sem_post (&m_replySem);
+		} else if (m_completeRing.push (request)) { // never full: asyncSubmit() keeps room for every completion
+			eventfd_write (m_completeFD, 1);
+		}
 	}
-	return (status < 0) ? status : word_count_total;
 }
@@ -27,29 +27,167 @@ THE SOFTWARE.
 #define RPI2C_HH
 
 #include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "RPi2cRing.h"
+#include "RPi2cStats.h"
 
 #ifdef RPI2C_BUFLEN
 #undef RPI2C_BUFLEN
 #endif
 /* This limits data reads/writes to 32 bytes; SMBus protocol and some implementations may prevent blocks larger than 32.
  * Bear in mind that 32 bytes even at 400 kHz will take nearly a millisecond to transfer.
+ * Only used if the adapter does not support plain I2C transfers - see busOpen().
  */
 #define RPI2C_BUFLEN 32
 
+#ifdef RPI2C_MAXLEN
+#undef RPI2C_MAXLEN
+#endif
+/* The i2c-dev driver refuses I2C_RDWR messages longer than 8192 bytes.
+ */
+#define RPI2C_MAXLEN 8192
+
+#ifndef RPI2C_SMBUS_FAST
+/* Register reads and writes of up to this many bytes use the SMBus byte-data, word-data and I2C-block commands
+ * where the adapter supports them; see setSMBusFast(). Off by default: on the loopback adapter (RPi2cBench --smbus)
+ * an SMBus read took 0.15-0.44 us against 0.15-0.22 us for I2C_RDWR, and block reads cost an extra copy out of
+ * i2c_smbus_data, so there is no gain to show until it has been measured on hardware.
+ */
+#define RPI2C_SMBUS_FAST 0
+#endif
+
 #define RPI2C_DEFAULT_BUS "/dev/i2c-1" // default bus for newer Raspberry Pi
 
+/* Maximum number of buses in the registry; see RPi2c::lookup()
+ */
+#define RPI2C_MAX_BUSES 16
+
+/* Number of requests that may be queued for, or waiting to be collected from, the asynchronous bus thread.
+ */
+#define RPI2C_RING_SIZE 64
+
+/* Initial delay in microseconds before retrying a failed transfer; doubled for each further retry
+ */
+#define RPI2C_BACKOFF 1000
+
+class RPi2cAdapter;
+class RPi2cCapture;
+class RPi2cTransaction;
+
+/** Times in nanoseconds (CLOCK_MONOTONIC) at which a read or write started and completed, including any retries.
+ * 
+ * The same clock is used for GPIO event timestamps (see RPi2cNotifier) and by RPi2cScheduler, so samples from several
+ * devices and buses can be aligned in time.
+ */
+struct RPi2cStamp {
+	uint64_t start;
+	uint64_t end;
+};
+
+enum RPi2cRequestType {
+	RPI2C_REQUEST_READ = 0,    // busRead() of bytes; data is uint8_t *
+	RPI2C_REQUEST_READ_WORDS,  // busRead() of words; data is uint16_t *
+	RPI2C_REQUEST_WRITE,       // busWrite() of bytes; data is const uint8_t *
+	RPI2C_REQUEST_WRITE_WORDS, // busWrite() of words; data is const uint16_t *
+	RPI2C_REQUEST_TRANSFER,    // busTransfer(); data is RPi2cTransaction *
+	RPI2C_REQUEST_STOP         // internal: stops the bus thread
+};
+
+/** Transfer descriptor for RPi2c's asynchronous mode.
+ * 
+ * Describes a busRead(), busWrite() or busTransfer() to be carried out by the bus thread; the data buffer (or transaction)
+ * must remain valid until the request is returned by asyncComplete().
+ * 
+ * @see RPi2c::asyncSubmit()
+ */
+struct RPi2cRequest {
+	RPi2cRequestType type;
+
+	uint16_t         device_address;
+	uint16_t         register_address;
+	uint16_t         count;            // number of bytes or words
+	bool             bSpecifyRegister;
+	bool             data_lsb_1st;     // word requests only
+	void *           data;
+	unsigned long    timeout;          // time in microseconds allowed, including retries; 0 for the bus default
+
+	void *           user;             // for the caller's use; returned unchanged
+
+	/* results, set by the bus thread:
+	 */
+	int              status;           // as returned by the equivalent synchronous call
+	const char *     error;            // as would be returned by lastError()
+	unsigned long    latency;          // time in microseconds from submission to completion
+	RPi2cStamp       stamp;            // when the bus thread started and completed the transfer
+
+	/* internal:
+	 */
+	uint64_t         submitted;
+	uint64_t         deadline;
+	RPi2cRequest *   reply;
+};
+
+union i2c_smbus_data;
+
 class RPi2c {
 private:
 	const char *  m_error;
 	int           m_fd;
-	uint8_t       m_buffer[RPI2C_BUFLEN+2];
+	char *        m_busName;          // kept for re-opening the bus during recovery
+	RPi2cAdapter * m_adapter;
+	RPi2cCapture * m_capture;
+	uint8_t       m_buffer[RPI2C_MAXLEN+2];
+
+	unsigned long m_functionality;
+	uint16_t      m_chunkSize;
+	uint16_t      m_chunkSizeMax;
+	bool          m_bSMBus;
+	int           m_slaveAddress;
+
+	unsigned long m_smbusFunctionality; // SMBus commands usable for the fast path; cleared if the adapter refuses one
+	uint16_t      m_smbusFast;        // largest transfer to send as an SMBus command; 0 for none
+	int           m_smbusLast;        // device address of the last transfer that could have used the fast path
+	uint32_t      m_smbusDenied[4];   // device addresses for which I2C_SLAVE failed, e.g., claimed by a kernel driver
+	unsigned long m_smbusCount;
+
+	unsigned long m_ioctlCount;
+	unsigned long m_copyCount;
 
 	unsigned long m_transferTime;
 	bool          m_bTransferTime;
 
+	unsigned long m_timeout;          // default time allowed per request, in microseconds; 0 for no limit
+	unsigned      m_retries;
+	unsigned long m_backoff;
+	uint64_t      m_deadline;         // deadline of the request being executed; 0 for none
+	int           m_kernelTimeout;    // as last set with I2C_TIMEOUT, in units of 10ms; -1 if not set
+	int           m_kernelRetries;    // as last set with I2C_RETRIES; -1 if not set
+	unsigned long m_retryCount;
+	unsigned long m_recoveryCount;
+
+	bool          m_bStats;
+	pthread_mutex_t m_statsLock;
+	RPi2cDeviceStats * m_stats[128]; // per 7-bit device address; allocated on first use
+
 	bool          m_bEnableRS;
 	bool          m_bSpecifyRegister; // internal flag
 
+	bool          m_bAsync;
+	bool          m_bWaiting;         // set by the bus thread when it is about to sleep
+	pthread_t     m_thread;
+	int           m_submitFD;         // eventfd used to wake the bus thread
+	int           m_completeFD;       // eventfd signalled by the bus thread on completion
+	sem_t         m_replySem;         // posted by the bus thread on completion of a synchronous request
+
+	RPi2cRing<RPi2cRequest,RPI2C_RING_SIZE> m_submitRing;
+	RPi2cRing<RPi2cRequest,RPI2C_RING_SIZE> m_completeRing;
+
+	pthread_mutex_t m_lock;           // serializes busRead(), busWrite() & busTransfer() from different threads
+	pthread_mutex_t m_submitLock;     // serializes pushes to m_submitRing, which has a single producer
+	unsigned        m_asyncPending;   // requests submitted with asyncSubmit() whose completions haven't been collected
+
 public:
 	/** Set the default I2C bus.
 	 * 
@@ -71,7 +209,73 @@ public:
 	 * 
 	 * @return Pointer to the default instance of the RPi2c class.
 	 */
-	static RPi2c * bus (); // returns whatever was last set using setDefaultBus()
+	static RPi2c * bus (); // returns whatever was last set using setThreadBus() or, failing that, setDefaultBus()
+
+	/** Set the I2C bus for the calling thread.
+	 * 
+	 * This overrides the default bus for the calling thread only, so that, e.g., one thread can drive /dev/i2c-0 while
+	 * another drives /dev/i2c-1, with each thread's I2Cdev calls going to its own bus.
+	 * 
+	 * @see bus()
+	 * @see RPi2cScope
+	 * 
+	 * @param i2c Pointer to an instance of the RPi2c class; 0 to revert to the default bus.
+	 */
+	static void setThreadBus (RPi2c * i2c);
+
+	/** Get the I2C bus set for the calling thread.
+	 * 
+	 * @return Pointer to the instance of the RPi2c class set by setThreadBus(); 0 if none.
+	 */
+	static RPi2c * threadBus ();
+
+	/** When the calling thread's last busRead(), busWrite() or busTransfer() started and completed on the bus.
+	 * 
+	 * The times are those the bus measures anyway, kept per thread, so this costs no system call and is unaffected by
+	 * other threads' use of the bus; in asynchronous mode they are the times at which the bus thread carried out the request.
+	 * 
+	 * @return Times in nanoseconds (CLOCK_MONOTONIC); zero if the thread hasn't used a bus yet.
+	 */
+	static RPi2cStamp lastStamp ();
+
+	/** Find a bus in the registry, opening it if necessary.
+	 * 
+	 * The registry holds one RPi2c instance per bus, so that every part of a program that asks for, e.g., bus 1 shares
+	 * the same instance, with its lock and (optional) bus thread. Buses opened this way stay open until registryClear().
+	 * 
+	 * @see registerBus()
+	 * 
+	 * @param bus_number Bus number N, for the bus device /dev/i2c-N.
+	 * 
+	 * @return Pointer to the bus; 0 on failure.
+	 */
+	static RPi2c * lookup (int bus_number);
+
+	/** Find a bus in the registry, opening it if necessary.
+	 * 
+	 * @param bus_name Name under which the bus was registered, or the device name of the I2C bus.
+	 * 
+	 * @return Pointer to the bus; 0 on failure.
+	 */
+	static RPi2c * lookup (const char * bus_name);
+
+	/** Add a bus to the registry under the specified name.
+	 * 
+	 * This is useful for buses that lookup() can't open by itself, e.g., ones opened on an RPi2cAdapter.
+	 * The registry does not take ownership of the instance.
+	 * 
+	 * @param bus_name Name to register the bus under; it is copied.
+	 * @param i2c      Pointer to an instance of the RPi2c class.
+	 * 
+	 * @return false if the name is in use or the registry is full.
+	 */
+	static bool registerBus (const char * bus_name, RPi2c * i2c);
+
+	/** Remove all buses from the registry, closing and deleting those that lookup() opened.
+	 * 
+	 * No other thread should be using the buses at the time.
+	 */
+	static void registryClear ();
 
 	/** Class constructor.
 	 * 
@@ -95,6 +299,8 @@ public:
 	inline void setTransferTime (bool bEnable) { m_bTransferTime = bEnable; }
 
 	/** Whether to calculate the time in microseconds during read/write commands.
+	 * 
+	 * Times are measured with CLOCK_MONOTONIC, so are unaffected by changes to the system clock.
 	 * 
 	 * @see setTransferTime()
 	 * 
@@ -102,6 +308,136 @@ public:
 	 */
 	inline unsigned long transferTime () const { return m_transferTime; }
 
+	/** Number of ioctl system calls made on the bus so far.
+	 * 
+	 * Useful for comparing the cost of the per-call busRead()/busWrite() path with busTransfer().
+	 * 
+	 * @see resetCounts()
+	 * 
+	 * @return Number of ioctl calls since the bus was opened or the counts were last reset.
+	 */
+	inline unsigned long ioctlCount () const { return m_ioctlCount; }
+
+	/** Number of times data has been copied through the internal staging buffer.
+	 * 
+	 * Reads go straight into the caller's buffer, with any byte-order conversion of words done in place, except for SMBus
+	 * block reads; writes are staged.
+	 * 
+	 * @see resetCounts()
+	 * 
+	 * @return Number of staging copies since the bus was opened or the counts were last reset.
+	 */
+	inline unsigned long copyCount () const { return m_copyCount; }
+
+	/** Number of reads and writes carried out with an SMBus command rather than I2C_RDWR.
+	 * 
+	 * @see setSMBusFast()
+	 * @see resetCounts()
+	 * 
+	 * @return Number of SMBus transfers since the bus was opened or the counts were last reset.
+	 */
+	inline unsigned long smbusCount () const { return m_smbusCount; }
+
+	/** Reset the counts of ioctl system calls, staging copies and SMBus transfers.
+	 * 
+	 * @see ioctlCount()
+	 * @see copyCount()
+	 * @see smbusCount()
+	 */
+	inline void resetCounts () { m_ioctlCount = 0; m_copyCount = 0; m_smbusCount = 0; }
+
+	/** Set the time allowed for each read, write or transfer, including any retries.
+	 * 
+	 * A request that runs out of time fails with a time-out error; a chunked read or write stops between chunks, and
+	 * retries stop at the deadline. A single transfer in the kernel is limited only by the adapter's own time-out, which
+	 * this leaves alone; use setKernelTimeout() to change that. Reads may also specify their own time allowed.
+	 * 
+	 * @see setRetries()
+	 * @see setKernelTimeout()
+	 * 
+	 * @param timeout_us Time in microseconds; 0 for no limit (the default).
+	 */
+	inline void setTimeout (unsigned long timeout_us) { m_timeout = timeout_us; }
+
+	inline unsigned long timeout () const { return m_timeout; }
+
+	/** Set how many times to retry a failed read, write or transfer.
+	 * 
+	 * Retries wait for the backoff time, doubling each time, but not beyond the request's deadline. If a transfer times
+	 * out in the kernel, the bus is re-opened (or the adapter's recover() called) before retrying. By default there are
+	 * no retries.
+	 * 
+	 * @param retries    Maximum number of retries.
+	 * @param backoff_us Delay in microseconds before the first retry.
+	 */
+	inline void setRetries (unsigned retries, unsigned long backoff_us = RPI2C_BACKOFF) { m_retries = retries; m_backoff = backoff_us; }
+
+	/** Number of retries, and of bus recoveries, since the bus was opened.
+	 */
+	inline unsigned long retryCount () const { return m_retryCount; }
+	inline unsigned long recoveryCount () const { return m_recoveryCount; }
+
+	/** Set the adapter's time-out for a single transfer, using the I2C_TIMEOUT ioctl.
+	 * 
+	 * The setting is the adapter's, not the file descriptor's: it applies to every driver and process using the bus,
+	 * and lasts after the bus is closed, so RPi2c only ever changes it when asked to (and re-applies it after
+	 * re-opening the bus to recover).
+	 * 
+	 * @param timeout_ms Time in milliseconds; rounded up to the kernel's units of 10ms.
+	 * 
+	 * @return false if the bus is not a kernel bus or the ioctl fails.
+	 */
+	bool setKernelTimeout (unsigned long timeout_ms);
+
+	/** Set the number of times the adapter retries a transfer that loses arbitration, using the I2C_RETRIES ioctl.
+	 * 
+	 * @return false if the bus is not a kernel bus or the ioctl fails.
+	 */
+	bool setKernelRetries (int retries);
+
+	/** Whether to record per-device transfer statistics; enabled by default.
+	 * 
+	 * @see stats()
+	 * 
+	 * @param bEnable true to record statistics.
+	 */
+	inline void setStats (bool bEnable) { m_bStats = bEnable; }
+
+	/** Snapshot of the transfer statistics for one device.
+	 * 
+	 * Every request is timed with CLOCK_MONOTONIC and recorded against its device address: number of transfers,
+	 * bytes, errors, and a latency histogram from which RPi2cDeviceStats::p50(), p99() etc. can be found. The time of a
+	 * transaction is shared between its operations in proportion to the bytes each puts on the bus. Safe to call from
+	 * any thread while the bus is in use.
+	 * 
+	 * @see statsDevices()
+	 * 
+	 * @param device_address The 7-bit address of the i2c device.
+	 * @param snapshot       Set to a copy of the statistics.
+	 * 
+	 * @return false if nothing has been recorded for the device.
+	 */
+	bool stats (uint16_t device_address, RPi2cDeviceStats & snapshot);
+
+	/** Snapshot of the transfer statistics for all devices on the bus combined.
+	 * 
+	 * @param snapshot Set to the totals; device_address is set to 0xFFFF.
+	 */
+	void statsBus (RPi2cDeviceStats & snapshot);
+
+	/** List the devices for which statistics have been recorded.
+	 * 
+	 * @param device_addresses Array to fill with device addresses, in ascending order.
+	 * @param max_count        Size of the array.
+	 * 
+	 * @return Number of devices listed.
+	 */
+	int statsDevices (uint16_t * device_addresses, int max_count);
+
+	/** Discard all recorded statistics.
+	 */
+	void statsReset ();
+
 	/** Whether to use repeat-start I2C transfers
 	 *
 	 * Repeat-start transfers during reading may be faster, but may not be supported by Raspberry Pi!
@@ -127,6 +463,12 @@ public:
 	void setError (const char * error_message);
 
 	/** Open the I2C for reading/writing.
+	 * 
+	 * The adapter's capabilities are queried with I2C_FUNCS. If it supports plain I2C transfers, reads and writes are split
+	 * into chunks of up to RPI2C_MAXLEN bytes; if it only supports SMBus, the SMBus block commands are used instead,
+	 * with chunks of up to RPI2C_BUFLEN bytes.
+	 * 
+	 * @see chunkSize()
 	 * 
 	 * @param bus_name The device name of the I2C bus; you can specify RPI2C_DEFAULT_BUS, which is defined as "/dev/i2c-1".
 	 * 
@@ -134,16 +476,213 @@ public:
 	 */
 	bool busOpen (const char * bus_name); // use this before trying to use busRead/Write
 
+	/** Use an adapter implemented in user space instead of an I2C bus device.
+	 * 
+	 * The adapter is not owned by the RPi2c instance, and must remain valid until busClose().
+	 * 
+	 * @see RPi2cAdapter
+	 * 
+	 * @param adapter The adapter to use, e.g., an instance of RPi2cLoopback.
+	 * 
+	 * @return false on failure - use lastError() to see why.
+	 */
+	bool busOpen (RPi2cAdapter * adapter);
+
 	/** Closes the I2C bus.
+	 * 
+	 * Also stops the bus thread, if asynchronous mode is on.
 	 */
 	void busClose ();
 
+	/** Record every transfer on this bus.
+	 * 
+	 * The capture is not owned by the RPi2c instance; set it (or clear it) while the bus is idle.
+	 * 
+	 * @see RPi2cCapture
+	 * 
+	 * @param capture An open capture, or 0 to stop recording.
+	 */
+	inline void setCapture (RPi2cCapture * capture) { m_capture = capture; }
+
+	inline RPi2cCapture * capture () const { return m_capture; }
+
+	/** Whether the bus is open.
+	 */
+	inline bool isOpen () const { return (m_fd >= 0) || m_adapter; }
+
+	/** Adapter functionality, as reported by the I2C_FUNCS ioctl when the bus was opened.
+	 * 
+	 * @return Bit mask of I2C_FUNC_* flags (see <linux/i2c.h>).
+	 */
+	inline unsigned long functionality () const { return m_functionality; }
+
+	/** Whether the adapter only supports SMBus commands, so that transfers are limited to RPI2C_BUFLEN bytes.
+	 */
+	inline bool isSMBus () const { return m_bSMBus; }
+
+	/** Use SMBus commands for short register reads and writes on an adapter that supports plain I2C.
+	 * 
+	 * A read or write of 1, 2 or up to 32 bytes that specifies an 8-bit register is sent as an SMBus byte-data,
+	 * word-data or I2C-block command instead of an I2C_RDWR transfer, if I2C_FUNCS reported the command as supported;
+	 * the bus traffic is identical. SMBus commands need the device address set with I2C_SLAVE, which costs an ioctl
+	 * of its own, so I2C_RDWR is still used for a device that wasn't also the target of the previous transfer.
+	 * Anything the adapter refuses, or an address already claimed by a kernel driver, falls back to I2C_RDWR.
+	 * Reads without a repeated start (see setEnableRS()) always use I2C_RDWR.
+	 * Block reads are copied once more, out of the SMBus data buffer.
+	 * 
+	 * @see smbusCount()
+	 * 
+	 * @param max_bytes Largest transfer to send as an SMBus command, up to RPI2C_BUFLEN; 0 to always use I2C_RDWR.
+	 */
+	void setSMBusFast (uint16_t max_bytes);
+
+	/** The largest transfer sent as an SMBus command; the default is RPI2C_SMBUS_FAST (0, i.e., off).
+	 * 
+	 * @see setSMBusFast()
+	 */
+	inline uint16_t smbusFast () const { return m_smbusFast; }
+
+	/** The largest number of data bytes transferred in a single message.
+	 * 
+	 * Longer reads and writes are split into chunks of this size; each chunk costs one ioctl.
+	 * 
+	 * @see setChunkSize()
+	 * 
+	 * @return Chunk size in bytes.
+	 */
+	inline uint16_t chunkSize () const { return m_chunkSize; }
+
+	/** Limit the number of data bytes transferred in a single message.
+	 * 
+	 * Some devices may need smaller chunks than the adapter allows; the chunk size can't exceed what the adapter supports.
+	 * 
+	 * @see chunkSize()
+	 * 
+	 * @param chunk_size Chunk size in bytes; 0 to use the largest size the adapter supports.
+	 */
+	void setChunkSize (uint16_t chunk_size);
+
+	/** Start asynchronous mode.
+	 * 
+	 * A dedicated bus thread takes over all transfers: requests are queued with asyncSubmit() and collected, once complete,
+	 * with asyncComplete(). busRead(), busWrite() and busTransfer() still work as before, but they queue a request
+	 * and wait for the bus thread to carry it out.
+	 * 
+	 * @see asyncStop()
+	 * 
+	 * @return false on failure - use lastError() to see why.
+	 */
+	bool asyncStart ();
+
+	/** Stop asynchronous mode.
+	 * 
+	 * Waits for the bus thread to finish any queued requests; completed requests can still be collected with asyncComplete().
+	 */
+	void asyncStop ();
+
+	/** Whether asynchronous mode is on.
+	 */
+	inline bool isAsync () const { return m_bAsync; }
+
+	/** Queue a request for the bus thread; asynchronous mode only.
+	 * 
+	 * May be called from any thread, including while other threads are in busRead(), busWrite(), etc.; submissions are
+	 * serialized, since the queue itself allows only one producer at a time.
+	 * 
+	 * @param request Description of the transfer; it is copied, but the data buffer must remain valid until completion.
+	 * 
+	 * @return false if the queue is full, if as many completed requests as the completion queue holds are waiting to be
+	 * collected with asyncComplete(), or if asynchronous mode is off.
+	 */
+	bool asyncSubmit (const RPi2cRequest & request);
+
+	/** Collect a completed request; asynchronous mode only.
+	 * 
+	 * Requests complete in the order they were submitted. This never blocks; wait for asyncEventFD() to become readable
+	 * (e.g., with poll() or epoll) and then call this until it returns false. Call from one thread at a time only: the
+	 * completion queue has a single consumer.
+	 * 
+	 * @param request Set to a copy of the completed request, with status, error and latency filled in.
+	 * 
+	 * @return false if no request has completed.
+	 */
+	bool asyncComplete (RPi2cRequest & request);
+
+	/** An eventfd that becomes readable when a request completes; for use with poll(), select() or epoll.
+	 * 
+	 * @return File descriptor; -1 if asynchronous mode is off.
+	 */
+	inline int asyncEventFD () const { return m_completeFD; }
+
 private:
+	/** Internal method: queue a request and wait for the bus thread to complete it (asynchronous mode),
+	 * or else carry it out directly.
+	 * 
+	 * @return Request status.
+	 */
+	int busRequest (RPi2cRequest & request);
+
+	/** Internal method: carry out a request and set its status and error.
+	 */
+	void busExecute (RPi2cRequest & request);
+	int busAttempt (RPi2cRequest & request);
+	bool busRecover ();
+	void statsRecord (uint16_t device_address, uint64_t ns, uint32_t byte_count, bool bError);
+	void statsRecord (const RPi2cTransaction & transaction, uint64_t ns);
+
+	/** Internal method: the bus thread's main loop.
+	 */
+	void asyncRun ();
+
+	static void * asyncThread (void * i2c);
+
+	/** Internal method: performs a combined transfer, through the I2C_RDWR ioctl or the adapter.
+	 * 
+	 * @return Number of messages transferred; negative on failure.
+	 */
+	int busRDWR (struct i2c_msg * messages, int count);
+
+	int busReadBytes (uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes,
+					  bool bSpecifyRegister);
+	int busReadWords (uint16_t device_address, uint16_t register_address, uint16_t word_count, uint16_t * words,
+					  bool data_lsb_1st, bool bSpecifyRegister);
+	int busWriteBytes (uint16_t device_address, uint16_t register_address, uint16_t byte_count, const uint8_t * bytes,
+					   bool bSpecifyRegister);
+	int busWriteWords (uint16_t device_address, uint16_t register_address, uint16_t word_count, const uint16_t * words,
+					   bool data_lsb_1st, bool bSpecifyRegister);
+	bool busTransferNow (RPi2cTransaction & transaction);
+
 	/** Internal method used by busRead(); responsible for actual i2c data transmission.
 	 * 
 	 * @return Number of bytes read; returns -1 on failure - use lastError() to see why.
 	 */
-	int busBRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count /* max. RPI2C_BUFLEN */);
+	int busBRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count /* max. chunkSize() */, uint8_t * bytes);
+
+	/** Internal method used by busBRead() if the adapter only supports SMBus.
+	 * 
+	 * @return Number of bytes read; returns -1 on failure - use lastError() to see why.
+	 */
+	int busSMBusRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count /* max. RPI2C_BUFLEN */, uint8_t * bytes);
+
+	/** Internal method: sets the device address for subsequent SMBus commands, unless it is already set.
+	 * 
+	 * @return false on failure.
+	 */
+	bool busSlave (uint16_t device_address);
+
+	/** Internal method: performs an I2C_SMBUS ioctl.
+	 * 
+	 * @return ioctl status; negative on failure.
+	 */
+	int busSMBus (char read_write, uint8_t command, int size, union i2c_smbus_data * data);
+
+	/** Internal method used by busBRead() and busBWrite() for short register transfers; see setSMBusFast().
+	 * 
+	 * @param status Set, if the transfer was attempted, to the number of bytes transferred, or to -1 on failure.
+	 * 
+	 * @return false if the transfer isn't suitable, or the SMBus command isn't supported, and I2C_RDWR should be used.
+	 */
+	bool busSMBusFast (char read_write, uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes, int & status);
 public:
 	/** Read byte-data from device.
 	 * 
@@ -154,11 +693,12 @@ public:
 	 * @param byte_count       Number of bytes to read
 	 * @param bytes            Pointer to 8-bit word data.
 	 * @param bSpecifyRegister Whether to specify the register address on the target device.
+	 * @param timeout          Time in microseconds allowed, including retries; 0 for the bus default.
 	 * 
 	 * @return Number of bytes read; returns -1 on failure - use lastError() to see why.
 	 */
 	int busRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes,
-				 bool bSpecifyRegister = true);
+				 bool bSpecifyRegister = true, unsigned long timeout = 0);
 
 	/** Read byte-data from device without first specifying the register address.
 	 * 
@@ -167,11 +707,12 @@ public:
 	 * @param device_address   The 7-bit address of the i2c device (unmodified with read/write bit)
 	 * @param byte_count       Number of bytes to read
 	 * @param bytes            Pointer to 8-bit word data.
+	 * @param timeout          Time in microseconds allowed, including retries; 0 for the bus default.
 	 * 
 	 * @return Number of bytes read; returns -1 on failure - use lastError() to see why.
 	 */
-	inline int busReadOnly (uint16_t device_address, uint16_t byte_count, uint8_t * bytes) {
-		return busRead (device_address, 0, byte_count, bytes, false);
+	inline int busReadOnly (uint16_t device_address, uint16_t byte_count, uint8_t * bytes, unsigned long timeout = 0) {
+		return busRead (device_address, 0, byte_count, bytes, false, timeout);
 	}
 
 	/** Read word-data from device.
@@ -184,11 +725,12 @@ public:
 	 * @param words            Pointer to 16-bit word data.
 	 * @param data_lsb_1st     true if data is coverted to bytes least-significant-byte first
 	 * @param bSpecifyRegister Whether to specify the register address on the target device.
+	 * @param timeout          Time in microseconds allowed, including retries; 0 for the bus default.
 	 * 
 	 * @return Number of words read; returns -1 on failure - use lastError() to see why.
 	 */
 	int busRead (uint16_t device_address, uint16_t register_address, uint16_t word_count, uint16_t * words,
-				 bool data_lsb_1st, bool bSpecifyRegister = true);
+				 bool data_lsb_1st, bool bSpecifyRegister = true, unsigned long timeout = 0);
 
 	/** Read word-data from device without first specifying the register address.
 	 * 
@@ -198,11 +740,12 @@ public:
 	 * @param word_count       Number of words to read
 	 * @param words            Pointer to 16-bit word data.
 	 * @param data_lsb_1st     true if data is coverted to bytes least-significant-byte first
+	 * @param timeout          Time in microseconds allowed, including retries; 0 for the bus default.
 	 * 
 	 * @return Number of words read; returns -1 on failure - use lastError() to see why.
 	 */
-	inline int busReadOnly (uint16_t device_address, uint16_t word_count, uint16_t * words, bool data_lsb_1st) {
-		return busRead (device_address, 0, word_count, words, data_lsb_1st, false);
+	inline int busReadOnly (uint16_t device_address, uint16_t word_count, uint16_t * words, bool data_lsb_1st, unsigned long timeout = 0) {
+		return busRead (device_address, 0, word_count, words, data_lsb_1st, false, timeout);
 	}
 
 private:
@@ -210,7 +753,13 @@ private:
 	 *
 	 * @return Number of bytes written; returns -1 on failure - use lastError() to see why.
 	 */
-	int busBWrite (uint16_t device_address, uint16_t register_address, uint16_t byte_count /* max. RPI2C_BUFLEN */);
+	int busBWrite (uint16_t device_address, uint16_t register_address, uint16_t byte_count /* max. chunkSize() */);
+
+	/** Internal method used by busBWrite() if the adapter only supports SMBus.
+	 *
+	 * @return Number of bytes written; returns -1 on failure - use lastError() to see why.
+	 */
+	int busSMBusWrite (uint16_t device_address, uint16_t register_address, uint16_t byte_count /* max. RPI2C_BUFLEN */);
 public:
 	/** Write word-data to device.
 	 * 
@@ -272,6 +821,40 @@ public:
 		return busWrite (device_address, 0, word_count, words, data_lsb_1st, false);
 	}
 
+	/** Send a batch of queued reads and writes as a single transfer.
+	 * 
+	 * All the messages in the transaction, possibly addressed to several devices, are passed to the kernel in one I2C_RDWR
+	 * ioctl, with a repeated start between messages. Use the transaction's status() and latency() to see the results.
+	 * 
+	 * @see RPi2cTransaction
+	 * 
+	 * @param transaction Reads and writes to perform.
+	 * 
+	 * @return false on failure - use lastError() to see why.
+	 */
+	bool busTransfer (RPi2cTransaction & transaction);
+
+};
+
+/** Sets the calling thread's I2C bus for the lifetime of the instance, then restores the previous setting.
+ * 
+ * @see RPi2c::setThreadBus()
+ */
+class RPi2cScope {
+private:
+	RPi2c * m_previous;
+
+public:
+	RPi2cScope (RPi2c * i2c) :
+		m_previous(RPi2c::threadBus ())
+	{
+		RPi2c::setThreadBus (i2c);
+	}
+
+	~RPi2cScope ()
+	{
+		RPi2c::setThreadBus (m_previous);
+	}
 };
 
 #endif /* ! RPI2C_HH */
@@ -0,0 +1,117 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#include <errno.h>
+#include <string.h>
+
+#include "RPi2cAdapter.h"
+#include "RPi2cTransaction.h"
+
+RPi2cAdapter::~RPi2cAdapter ()
+{
+	//
+}
+
+unsigned long RPi2cAdapter::functionality ()
+{
+	return I2C_FUNC_I2C | I2C_FUNC_SMBUS_BYTE | I2C_FUNC_SMBUS_BYTE_DATA | I2C_FUNC_SMBUS_WORD_DATA | I2C_FUNC_SMBUS_I2C_BLOCK;
+}
+
+bool RPi2cAdapter::recover ()
+{
+	return true;
+}
+
+/* Returns 0 on success; returns -1 on failure.
+ */
+int RPi2cAdapter::smbus (uint16_t device_address, char read_write, uint8_t command, int size, union i2c_smbus_data * data)
+{
+	struct i2c_msg message[2];
+
+	uint8_t buffer[I2C_SMBUS_BLOCK_MAX+1];
+
+	int message_count = 0;
+
+	switch (size) {
+	case I2C_SMBUS_BYTE:
+		if (read_write == I2C_SMBUS_READ) {
+			rpi2c_message (message[message_count++], device_address, I2C_M_RD, 1, &data->byte);
+		} else {
+			buffer[0] = command;
+			rpi2c_message (message[message_count++], device_address, 0, 1, buffer);
+		}
+		break;
+
+	case I2C_SMBUS_BYTE_DATA:
+	case I2C_SMBUS_WORD_DATA:
+	case I2C_SMBUS_I2C_BLOCK_DATA:
+		{
+			uint16_t byte_count = (size == I2C_SMBUS_BYTE_DATA) ? 1 : ((size == I2C_SMBUS_WORD_DATA) ? 2 : data->block[0]);
+
+			if (byte_count > I2C_SMBUS_BLOCK_MAX) {
+				errno = EINVAL;
+				return -1;
+			}
+
+			buffer[0] = command;
+
+			if (read_write == I2C_SMBUS_READ) {
+				rpi2c_message (message[message_count++], device_address, 0, 1, buffer);
+				rpi2c_message (message[message_count++], device_address, I2C_M_RD, byte_count, buffer + 1);
+			} else {
+				if (size == I2C_SMBUS_BYTE_DATA) {
+					buffer[1] = data->byte;
+				} else if (size == I2C_SMBUS_WORD_DATA) {
+					buffer[1] = static_cast<uint8_t>(data->word & 0xFF); // SMBus words are LSB first
+					buffer[2] = static_cast<uint8_t>((data->word >> 8) & 0xFF);
+				} else {
+					memcpy (buffer + 1, data->block + 1, byte_count);
+				}
+				rpi2c_message (message[message_count++], device_address, 0, 1 + byte_count, buffer);
+			}
+
+			if (transfer (message, message_count) < 0) {
+				return -1; // errno set by transfer()
+			}
+
+			if (read_write == I2C_SMBUS_READ) {
+				if (size == I2C_SMBUS_BYTE_DATA) {
+					data->byte = buffer[1];
+				} else if (size == I2C_SMBUS_WORD_DATA) {
+					data->word = static_cast<uint16_t>(buffer[1]) | (static_cast<uint16_t>(buffer[2]) << 8);
+				} else {
+					memcpy (data->block + 1, buffer + 1, byte_count);
+				}
+			}
+			return 0;
+		}
+
+	default:
+		errno = EOPNOTSUPP; // not supported
+		return -1;
+	}
+
+	return (transfer (message, message_count) < 0) ? -1 : 0;
+}
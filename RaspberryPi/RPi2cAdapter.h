@@ -0,0 +1,78 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_ADAPTER_HH
+#define RPI2C_ADAPTER_HH
+
+#include <stdint.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+/** Interface for an I2C adapter implemented in user space.
+ *
+ * Normally RPi2c talks to the kernel's i2c-dev driver; an RPi2cAdapter passed to RPi2c::busOpen() takes its place,
+ * e.g., to run drivers and benchmarks without hardware. The interface mirrors the I2C_FUNCS, I2C_RDWR and I2C_SMBUS ioctls.
+ */
+class RPi2cAdapter {
+public:
+	virtual ~RPi2cAdapter ();
+
+	/** Adapter functionality, as would be reported by the I2C_FUNCS ioctl.
+	 *
+	 * @return Bit mask of I2C_FUNC_* flags; the default is plain I2C with emulated SMBus.
+	 */
+	virtual unsigned long functionality ();
+
+	/** Perform a combined transfer, as would the I2C_RDWR ioctl.
+	 *
+	 * @param messages Messages to transfer, with a repeated start between each.
+	 * @param count    Number of messages.
+	 *
+	 * @return Number of messages transferred; returns -1 on failure, with errno set as the ioctl would set it, e.g.,
+	 *         ETIMEDOUT if a device held the clock low (which RPi2c recovers from) or EREMOTEIO for a NACK.
+	 */
+	virtual int transfer (struct i2c_msg * messages, int count) = 0;
+
+	/** Perform an SMBus command, as would the I2C_SMBUS ioctl.
+	 *
+	 * The default implementation emulates the byte, byte-data, word-data and I2C-block commands using transfer().
+	 *
+	 * @param device_address The 7-bit address of the i2c device, as would have been set by the I2C_SLAVE ioctl.
+	 *
+	 * @return 0 on success; returns -1 on failure, with errno set, e.g., EOPNOTSUPP for a command not supported.
+	 */
+	virtual int smbus (uint16_t device_address, char read_write, uint8_t command, int size, union i2c_smbus_data * data);
+
+	/** Recover after a transfer has timed out, as RPi2c would by re-opening a kernel bus.
+	 *
+	 * The default implementation does nothing.
+	 *
+	 * @return false if the adapter is unusable.
+	 */
+	virtual bool recover ();
+};
+
+#endif /* ! RPI2C_ADAPTER_HH */
@@ -0,0 +1,244 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "RPi2cCapture.h"
+
+static const char * s_error_none    = "RPi2cCapture: no error";
+static const char * s_error_reopen  = "RPi2cCapture::open: error: Already open.";
+static const char * s_error_size    = "RPi2cCapture::open: error: Invalid size.";
+static const char * s_error_open    = "RPi2cCapture::open: error: Unable to create capture file.";
+static const char * s_error_map     = "RPi2cCapture::open: error: Unable to map capture file.";
+
+static uint64_t s_now_ns ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+RPi2cCapture::RPi2cCapture () :
+	m_error(s_error_none),
+	m_fd(-1),
+	m_map(0),
+	m_size(0),
+	m_used(0),
+	m_transfer(0),
+	m_droppedCount(0)
+{
+	pthread_mutex_init (&m_lock, 0);
+}
+
+RPi2cCapture::~RPi2cCapture ()
+{
+	close ();
+
+	pthread_mutex_destroy (&m_lock);
+}
+
+bool RPi2cCapture::open (const char * filename, size_t size)
+{
+	m_error = s_error_none;
+
+	if (isOpen ()) {
+		m_error = s_error_reopen;
+		return false;
+	}
+	if (size < sizeof (RPi2cCaptureHeader) + sizeof (RPi2cCaptureRecord)) {
+		m_error = s_error_size;
+		return false;
+	}
+
+	m_fd = ::open (filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (m_fd < 0) {
+		m_error = s_error_open;
+		return false;
+	}
+	if (ftruncate (m_fd, size) < 0) {
+		m_error = s_error_open;
+	} else {
+		void * map = mmap (0, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+		if (map == MAP_FAILED) {
+			m_error = s_error_map;
+		} else {
+			m_map  = static_cast<uint8_t *>(map);
+			m_size = size;
+		}
+	}
+	if (!m_map) {
+		::close (m_fd);
+		m_fd = -1;
+		return false;
+	}
+
+	RPi2cCaptureHeader * header = reinterpret_cast<RPi2cCaptureHeader *>(m_map);
+
+	memcpy (header->magic, RPI2C_CAPTURE_MAGIC, sizeof (header->magic));
+	header->version     = RPI2C_CAPTURE_VERSION;
+	header->header_size = sizeof (RPi2cCaptureHeader);
+	header->used        = 0;
+
+	m_used = 0;
+	m_transfer = 0;
+	m_droppedCount = 0;
+
+	return true;
+}
+
+void RPi2cCapture::close ()
+{
+	pthread_mutex_lock (&m_lock);
+
+	if (m_map) {
+		munmap (m_map, m_size);
+		m_map = 0;
+
+		if (ftruncate (m_fd, sizeof (RPi2cCaptureHeader) + m_used) < 0) {
+			// leave it full size; the header says how much is used
+		}
+		::close (m_fd);
+		m_fd = -1;
+	}
+	pthread_mutex_unlock (&m_lock);
+}
+
+/* Call with the lock held.
+ */
+void RPi2cCapture::append (uint64_t timestamp, uint16_t device_address, uint16_t flags, uint16_t length, const uint8_t * payload, int status, int error)
+{
+	RPi2cCaptureRecord record;
+
+	record.timestamp      = timestamp;
+	record.transfer       = m_transfer;
+	record.device_address = device_address;
+	record.flags          = flags;
+	record.length         = length;
+	record.status         = (status < 0) ? -1 : 0;
+	record.error          = (status < 0) ? error : 0;
+
+	size_t byte_count = rpi2c_capture_size (record);
+
+	if (sizeof (RPi2cCaptureHeader) + m_used + byte_count > m_size) {
+		++m_droppedCount;
+		return;
+	}
+	uint8_t * ptr = m_map + sizeof (RPi2cCaptureHeader) + m_used;
+
+	memcpy (ptr, &record, sizeof (record));
+
+	if (length) {
+		memcpy (ptr + sizeof (record), payload, length);
+	}
+	m_used += byte_count;
+
+	reinterpret_cast<RPi2cCaptureHeader *>(m_map)->used = m_used;
+}
+
+void RPi2cCapture::recordMessages (const struct i2c_msg * messages, int count, int status)
+{
+	int error = errno; // before anything else can change it
+
+	uint64_t timestamp = s_now_ns ();
+
+	pthread_mutex_lock (&m_lock);
+
+	if (m_map) {
+		for (int m = 0; m < count; m++) {
+			append (timestamp, messages[m].addr, messages[m].flags, messages[m].len, reinterpret_cast<const uint8_t *>(messages[m].buf), status, error);
+		}
+		++m_transfer;
+	}
+	pthread_mutex_unlock (&m_lock);
+}
+
+void RPi2cCapture::recordSMBus (uint16_t device_address, char read_write, uint8_t command, int size, const union i2c_smbus_data * data, int status)
+{
+	int error = errno; // before anything else can change it
+
+	uint64_t timestamp = s_now_ns ();
+
+	uint8_t buffer[I2C_SMBUS_BLOCK_MAX+1];
+
+	bool bRead = (read_write == I2C_SMBUS_READ);
+
+	uint16_t byte_count = 0;
+
+	switch (size) {
+	case I2C_SMBUS_BYTE:
+		break;
+	case I2C_SMBUS_BYTE_DATA:
+		byte_count = 1;
+		break;
+	case I2C_SMBUS_WORD_DATA:
+		byte_count = 2;
+		break;
+	case I2C_SMBUS_I2C_BLOCK_DATA:
+		byte_count = (data->block[0] <= I2C_SMBUS_BLOCK_MAX) ? data->block[0] : I2C_SMBUS_BLOCK_MAX;
+		break;
+	default:
+		return; // not used by RPi2c
+	}
+
+	/* The same messages as RPi2cAdapter::smbus() would send; SMBus words are LSB first
+	 */
+	if (byte_count == 1) {
+		buffer[1] = data->byte;
+	} else if (size == I2C_SMBUS_WORD_DATA) {
+		buffer[1] = static_cast<uint8_t>(data->word & 0xFF);
+		buffer[2] = static_cast<uint8_t>((data->word >> 8) & 0xFF);
+	} else if (byte_count) {
+		memcpy (buffer + 1, data->block + 1, byte_count);
+	}
+	buffer[0] = command;
+
+	pthread_mutex_lock (&m_lock);
+
+	if (m_map) {
+		if (size == I2C_SMBUS_BYTE) {
+			if (bRead) {
+				append (timestamp, device_address, I2C_M_RD, 1, &data->byte, status, error);
+			} else {
+				append (timestamp, device_address, 0, 1, buffer, status, error);
+			}
+		} else if (bRead) {
+			append (timestamp, device_address, 0, 1, buffer, status, error);
+			append (timestamp, device_address, I2C_M_RD, byte_count, buffer + 1, status, error);
+		} else {
+			append (timestamp, device_address, 0, 1 + byte_count, buffer, status, error);
+		}
+		++m_transfer;
+	}
+	pthread_mutex_unlock (&m_lock);
+}
@@ -0,0 +1,138 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_CAPTURE_HH
+#define RPI2C_CAPTURE_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+/* Default size of the capture file, which is fixed when it is opened
+ */
+#define RPI2C_CAPTURE_SIZE    (16UL << 20)
+
+/* The capture file is a header, then records, each followed by its payload padded to a multiple of 8 bytes;
+ * all in host byte order
+ */
+#define RPI2C_CAPTURE_MAGIC   "RPi2cCAP"
+#define RPI2C_CAPTURE_VERSION 1
+
+struct RPi2cCaptureHeader {
+	char     magic[8];         // RPI2C_CAPTURE_MAGIC
+	uint32_t version;          // RPI2C_CAPTURE_VERSION
+	uint32_t header_size;      // sizeof (RPi2cCaptureHeader), i.e., offset of the first record
+	uint64_t used;             // bytes of records, from the end of the header
+};
+
+/** One I2C message, as sent to the bus; a read from a register is a 1-byte write (the register address) then a read.
+ */
+struct RPi2cCaptureRecord {
+	uint64_t timestamp;        // when the transfer completed, in nanoseconds (CLOCK_MONOTONIC)
+	uint32_t transfer;         // sequence number of the transfer (I2C_RDWR or SMBus command) the message was part of
+	uint16_t device_address;
+	uint16_t flags;            // i2c_msg flags, e.g., I2C_M_RD
+	uint16_t length;           // payload bytes
+	int16_t  status;           // 0 if the transfer succeeded; -1 if it failed (and the payload of a read is undefined)
+	int32_t  error;            // errno if the transfer failed (0 if not known); 0 if it succeeded
+};
+
+/** Size of a record including its padded payload.
+ */
+inline size_t rpi2c_capture_size (const RPi2cCaptureRecord & record)
+{
+	return sizeof (RPi2cCaptureRecord) + ((record.length + 7) & ~7);
+}
+
+/** Capture of every message to and from the bus, to a memory-mapped file, for Linux.
+ *
+ * Attach a capture to one or more buses with RPi2c::setCapture(); every I2C_RDWR transfer and SMBus command is then
+ * recorded, with its payload, as the equivalent I2C messages. Appending costs a copy into the mapped file, which the
+ * kernel writes back in its own time; buses on different threads may share a capture.
+ * The file is sized when opened and records that don't fit are dropped (and counted); the header's count of bytes used
+ * is kept up to date, so the file is readable even if the program doesn't close it.
+ *
+ * A capture can be played back, without the hardware, by RPi2cReplay.
+ */
+class RPi2cCapture {
+private:
+	const char *  m_error;
+	int           m_fd;
+	uint8_t *     m_map;
+	size_t        m_size;          // of the mapping
+	uint64_t      m_used;          // bytes of records written
+	uint32_t      m_transfer;      // next transfer sequence number
+	unsigned long m_droppedCount;
+
+	pthread_mutex_t m_lock;        // serializes recording from buses on different threads
+
+	void append (uint64_t timestamp, uint16_t device_address, uint16_t flags, uint16_t length, const uint8_t * payload, int status, int error);
+
+public:
+	RPi2cCapture ();
+
+	~RPi2cCapture ();
+
+	inline const char * lastError () const { return m_error; }
+
+	/** Create (or replace) a capture file and map it.
+	 *
+	 * @param size Size of the file; recording stops when it is full.
+	 *
+	 * @return false on failure - use lastError() to see why.
+	 */
+	bool open (const char * filename, size_t size = RPI2C_CAPTURE_SIZE);
+
+	/** Unmap the file and truncate it to the records captured.
+	 */
+	void close ();
+
+	inline bool isOpen () const { return m_map != 0; }
+
+	/** Bytes of records captured, not counting the header.
+	 */
+	inline uint64_t used () const { return m_used; }
+
+	/** Number of messages dropped because the file was full.
+	 */
+	inline unsigned long droppedCount () const { return m_droppedCount; }
+
+	/** Record an I2C_RDWR transfer; called by RPi2c.
+	 *
+	 * @param status As returned by the ioctl; negative on failure, when errno is recorded too.
+	 */
+	void recordMessages (const struct i2c_msg * messages, int count, int status);
+
+	/** Record an SMBus command as the equivalent I2C messages; called by RPi2c.
+	 *
+	 * @param status As returned by the ioctl; negative on failure, when errno is recorded too.
+	 */
+	void recordSMBus (uint16_t device_address, char read_write, uint8_t command, int size, const union i2c_smbus_data * data, int status);
+};
+
+#endif /* ! RPI2C_CAPTURE_HH */
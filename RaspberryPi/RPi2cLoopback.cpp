@@ -0,0 +1,76 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "RPi2cLoopback.h"
+
+RPi2cLoopback::RPi2cLoopback (unsigned long delay) :
+	m_delay(delay)
+{
+	memset (m_memory, 0, sizeof (m_memory));
+	memset (m_pointer, 0, sizeof (m_pointer));
+}
+
+RPi2cLoopback::~RPi2cLoopback ()
+{
+	//
+}
+
+/* Returns number of messages transferred; returns -1 on failure.
+ */
+int RPi2cLoopback::transfer (struct i2c_msg * messages, int count)
+{
+	for (int m = 0; m < count; m++) {
+		if (messages[m].addr & ~0x7F) {
+			errno = EINVAL; // 10-bit addresses not supported
+			return -1;
+		}
+
+		uint8_t * memory  = m_memory[messages[m].addr];
+		uint8_t & pointer = m_pointer[messages[m].addr];
+
+		uint8_t * buffer = reinterpret_cast<uint8_t *>(messages[m].buf);
+
+		if (messages[m].flags & I2C_M_RD) {
+			for (int ib = 0; ib < messages[m].len; ib++) {
+				buffer[ib] = memory[pointer++];
+			}
+		} else if (messages[m].len) {
+			pointer = buffer[0];
+
+			for (int ib = 1; ib < messages[m].len; ib++) {
+				memory[pointer++] = buffer[ib];
+			}
+		}
+	}
+
+	if (m_delay) {
+		usleep (m_delay);
+	}
+	return count;
+}
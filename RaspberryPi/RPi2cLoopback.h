@@ -0,0 +1,70 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_LOOPBACK_HH
+#define RPI2C_LOOPBACK_HH
+
+#include "RPi2cAdapter.h"
+
+/** A fake I2C adapter with 256 bytes of memory behind every 7-bit address.
+ *
+ * Each device behaves like a simple register file (or a small EEPROM): the first byte written sets the register pointer,
+ * subsequent bytes are stored from there; reads return bytes from the register pointer; the pointer increments and wraps.
+ * An optional delay per transfer stands in for a slow device, which is useful for exercising RPi2c's asynchronous mode.
+ */
+class RPi2cLoopback : public RPi2cAdapter {
+private:
+	uint8_t       m_memory[128][256];
+	uint8_t       m_pointer[128];
+
+	unsigned long m_delay;
+
+public:
+	/** Class constructor.
+	 *
+	 * All memory is initially zero.
+	 *
+	 * @param delay Time in microseconds that each transfer should take.
+	 */
+	RPi2cLoopback (unsigned long delay = 0);
+
+	virtual ~RPi2cLoopback ();
+
+	/** Set the time in microseconds that each transfer should take.
+	 */
+	inline void setDelay (unsigned long delay) { m_delay = delay; }
+
+	/** Direct access to a device's memory, e.g., to preset or check register values.
+	 *
+	 * @param device_address The 7-bit address of the i2c device.
+	 *
+	 * @return Pointer to the 256 bytes of memory of the device.
+	 */
+	inline uint8_t * memory (uint16_t device_address) { return m_memory[device_address & 0x7F]; }
+
+	virtual int transfer (struct i2c_msg * messages, int count);
+};
+
+#endif /* ! RPI2C_LOOPBACK_HH */
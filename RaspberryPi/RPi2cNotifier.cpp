@@ -0,0 +1,257 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <linux/gpio.h>
+
+#include "RPi2cNotifier.h"
+
+static const char * s_error_none    = "RPi2cNotifier: no error";
+static const char * s_error_reopen  = "RPi2cNotifier::open: error: Already open.";
+static const char * s_error_nochip  = "RPi2cNotifier::open: error: Failed to open GPIO chip.";
+static const char * s_error_line    = "RPi2cNotifier::open: error: Failed to request line events.";
+static const char * s_error_badfd   = "RPi2cNotifier::openFD: error: Invalid file descriptor.";
+static const char * s_error_pipe    = "RPi2cNotifier::openFake: error: Failed to create pipe.";
+static const char * s_error_closed  = "RPi2cNotifier::wait: error: Not open.";
+static const char * s_error_poll    = "RPi2cNotifier::wait: error: poll() failed.";
+static const char * s_error_read    = "RPi2cNotifier::wait: error: Failed to read event.";
+
+uint64_t RPi2cNotifier::now ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+RPi2cNotifier::RPi2cNotifier () :
+	m_error(s_error_none),
+	m_fd(-1),
+	m_triggerFD(-1),
+	m_bOwned(false),
+	m_timestamp(0),
+	m_eventCount(0),
+	m_timeoutCount(0)
+{
+	//
+}
+
+RPi2cNotifier::~RPi2cNotifier ()
+{
+	close ();
+}
+
+bool RPi2cNotifier::open (const char * chip_name, unsigned line, int edges, const char * consumer)
+{
+	m_error = s_error_none;
+
+	if (isOpen ()) {
+		m_error = s_error_reopen;
+		return false;
+	}
+
+	int chip_fd = ::open (chip_name ? chip_name : RPI2C_NOTIFIER_CHIP, O_RDONLY | O_CLOEXEC);
+	if (chip_fd < 0) {
+		m_error = s_error_nochip;
+		return false;
+	}
+
+	struct gpioevent_request request;
+
+	memset (&request, 0, sizeof (request));
+
+	request.lineoffset  = line;
+	request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	request.eventflags  = ((edges & RPI2C_NOTIFIER_RISING)  ? GPIOEVENT_REQUEST_RISING_EDGE  : 0)
+						| ((edges & RPI2C_NOTIFIER_FALLING) ? GPIOEVENT_REQUEST_FALLING_EDGE : 0);
+
+	if (consumer) {
+		strncpy (request.consumer_label, consumer, sizeof (request.consumer_label) - 1);
+	}
+
+	int status = ioctl (chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request);
+
+	::close (chip_fd); // the line stays requested for as long as its event fd is open
+
+	if (status < 0) {
+		m_error = s_error_line;
+		return false;
+	}
+	m_fd = request.fd;
+	m_bOwned = true;
+
+	return true;
+}
+
+bool RPi2cNotifier::openFD (int fd, bool bOwned)
+{
+	m_error = s_error_none;
+
+	if (isOpen ()) {
+		m_error = s_error_reopen;
+		return false;
+	}
+	if (fd < 0) {
+		m_error = s_error_badfd;
+		return false;
+	}
+	m_fd = fd;
+	m_bOwned = bOwned;
+
+	return true;
+}
+
+bool RPi2cNotifier::openFake ()
+{
+	m_error = s_error_none;
+
+	if (isOpen ()) {
+		m_error = s_error_reopen;
+		return false;
+	}
+
+	int fds[2];
+
+	if (pipe (fds) < 0) {
+		m_error = s_error_pipe;
+		return false;
+	}
+	m_fd = fds[0];
+	m_triggerFD = fds[1];
+	m_bOwned = true;
+
+	return true;
+}
+
+bool RPi2cNotifier::trigger (uint64_t timestamp)
+{
+	if (m_triggerFD < 0) {
+		return false;
+	}
+
+	struct gpioevent_data event;
+
+	memset (&event, 0, sizeof (event));
+
+	event.timestamp = timestamp ? timestamp : now ();
+	event.id        = GPIOEVENT_EVENT_RISING_EDGE;
+
+	return write (m_triggerFD, &event, sizeof (event)) == static_cast<ssize_t>(sizeof (event)); // atomic, being < PIPE_BUF
+}
+
+void RPi2cNotifier::close ()
+{
+	if (m_fd >= 0 && m_bOwned) {
+		::close (m_fd);
+	}
+	if (m_triggerFD >= 0) {
+		::close (m_triggerFD);
+	}
+	m_fd = -1;
+	m_triggerFD = -1;
+	m_bOwned = false;
+}
+
+/* Returns number of events consumed; 0 on time-out; returns -1 on failure - use lastError() to see why.
+ */
+int RPi2cNotifier::wait (long timeout_us, uint64_t * timestamp)
+{
+	m_error = s_error_none;
+
+	if (!isOpen ()) {
+		m_error = s_error_closed;
+		return -1;
+	}
+
+	struct pollfd pfd;
+
+	pfd.fd      = m_fd;
+	pfd.events  = POLLIN;
+	pfd.revents = 0;
+
+	/* Round the time-out up to whole milliseconds; a short wait is better than a spin
+	 */
+	int timeout_ms = (timeout_us < 0) ? -1 : static_cast<int>((timeout_us + 999) / 1000);
+
+	uint64_t deadline = (timeout_us < 0) ? 0 : now () + static_cast<uint64_t>(timeout_us) * 1000;
+
+	int status;
+
+	while ((status = poll (&pfd, 1, timeout_ms)) < 0 && errno == EINTR) {
+		if (timeout_us >= 0) { // interrupted; wait for the rest of the time-out only
+			uint64_t t = now ();
+
+			timeout_ms = (t < deadline) ? static_cast<int>((deadline - t + 999999) / 1000000) : 0;
+		}
+	}
+	if (status < 0) {
+		m_error = s_error_poll;
+		return -1;
+	}
+	if (status == 0) {
+		++m_timeoutCount;
+		return 0;
+	}
+
+	/* A GPIO line event or a pipe gives a whole struct gpioevent_data per event; an eventfd gives an 8-byte count
+	 */
+	union {
+		struct gpioevent_data event;
+		uint64_t              count;
+	} data;
+
+	ssize_t length;
+
+	while ((length = read (m_fd, &data, sizeof (data))) < 0 && errno == EINTR) {
+		// interrupted; read again
+	}
+
+	int event_count = 0;
+
+	if (length == static_cast<ssize_t>(sizeof (data.event))) {
+		m_timestamp = data.event.timestamp;
+		event_count = 1;
+	} else if (length == static_cast<ssize_t>(sizeof (data.count))) {
+		m_timestamp = now ();
+		event_count = static_cast<int>(data.count);
+	} else {
+		m_error = s_error_read;
+		return -1;
+	}
+	m_eventCount += event_count;
+
+	if (timestamp) {
+		*timestamp = m_timestamp;
+	}
+	return event_count;
+}
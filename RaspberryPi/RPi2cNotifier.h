@@ -0,0 +1,132 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_NOTIFIER_HH
+#define RPI2C_NOTIFIER_HH
+
+#include <stdint.h>
+
+#define RPI2C_NOTIFIER_CHIP "/dev/gpiochip0"
+
+/* Edges that signal an event; see RPi2cNotifier::open()
+ */
+#define RPI2C_NOTIFIER_RISING  1
+#define RPI2C_NOTIFIER_FALLING 2
+#define RPI2C_NOTIFIER_BOTH    3
+
+/** Data-ready notification from a device's interrupt pin, for Linux.
+ *
+ * The pin is requested as a line event through the GPIO character device (GPIO_GET_LINEEVENT_IOCTL on /dev/gpiochipN),
+ * and wait() sleeps in poll() until the kernel reports an edge, so the reading thread uses no CPU between samples.
+ * Each event carries the kernel's timestamp of the edge, in nanoseconds (CLOCK_MONOTONIC, as for now()), which is a
+ * better time for the sample than the time the thread got round to reading it.
+ *
+ * Without the hardware, any readable file descriptor can stand in for the line: a pipe, to which struct gpioevent_data
+ * records are written (see openFake() and trigger()), or an eventfd, each write to which counts as events timestamped
+ * on wake-up.
+ */
+class RPi2cNotifier {
+private:
+	const char *  m_error;
+	int           m_fd;
+	int           m_triggerFD;       // write end of the pipe created by openFake(); -1 otherwise
+	bool          m_bOwned;          // whether close() should close m_fd
+
+	uint64_t      m_timestamp;       // of the last event
+	unsigned long m_eventCount;
+	unsigned long m_timeoutCount;
+
+public:
+	RPi2cNotifier ();
+
+	~RPi2cNotifier ();
+
+	inline const char * lastError () const { return m_error; }
+
+	/** Request a GPIO line for edge events.
+	 *
+	 * @param chip_name The GPIO chip device, e.g., RPI2C_NOTIFIER_CHIP; on the Raspberry Pi, line numbers are BCM GPIO numbers.
+	 * @param line      Line offset on the chip.
+	 * @param edges     RPI2C_NOTIFIER_RISING, RPI2C_NOTIFIER_FALLING or RPI2C_NOTIFIER_BOTH.
+	 * @param consumer  Label shown against the line by, e.g., gpioinfo.
+	 *
+	 * @return false on failure - use lastError() to see why.
+	 */
+	bool open (const char * chip_name, unsigned line, int edges = RPI2C_NOTIFIER_RISING, const char * consumer = "RPi2c");
+
+	/** Use a file descriptor as the event source instead, e.g., an eventfd or the read end of a pipe.
+	 *
+	 * @param fd     The file descriptor; reads of struct gpioevent_data give timestamped events, 8-byte reads event counts.
+	 * @param bOwned Whether close() should close the file descriptor.
+	 *
+	 * @return false on failure - use lastError() to see why.
+	 */
+	bool openFD (int fd, bool bOwned = false);
+
+	/** Use a pipe as the event source, for testing; events are then generated with trigger().
+	 *
+	 * @return false on failure - use lastError() to see why.
+	 */
+	bool openFake ();
+
+	/** Generate an event on the pipe created by openFake(); may be called from any thread.
+	 *
+	 * @param timestamp Time of the event in nanoseconds (CLOCK_MONOTONIC); 0 for now().
+	 *
+	 * @return false on failure.
+	 */
+	bool trigger (uint64_t timestamp = 0);
+
+	void close ();
+
+	inline bool isOpen () const { return m_fd >= 0; }
+
+	/** The file descriptor to wait on, e.g., with epoll, alongside other sources; readable when an event is pending.
+	 */
+	inline int fd () const { return m_fd; }
+
+	/** Wait for the next event.
+	 *
+	 * @param timeout_us Time in microseconds to wait; 0 to return at once if no event is pending, -1 to wait indefinitely.
+	 * @param timestamp  If not 0, set to the time of the event in nanoseconds (CLOCK_MONOTONIC).
+	 *
+	 * @return Number of events consumed, normally 1; 0 if the wait timed out; returns -1 on failure - use lastError() to see why.
+	 */
+	int wait (long timeout_us, uint64_t * timestamp = 0);
+
+	/** Time of the last event in nanoseconds (CLOCK_MONOTONIC).
+	 */
+	inline uint64_t timestamp () const { return m_timestamp; }
+
+	inline unsigned long eventCount () const { return m_eventCount; }
+
+	inline unsigned long timeoutCount () const { return m_timeoutCount; }
+
+	/** Current time in nanoseconds, on the same clock as event timestamps.
+	 */
+	static uint64_t now ();
+};
+
+#endif /* ! RPI2C_NOTIFIER_HH */
@@ -0,0 +1,203 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "RPi2cReplay.h"
+
+static const char * s_error_none    = "RPi2cReplay: no error";
+static const char * s_error_open    = "RPi2cReplay::open: error: Unable to open capture file.";
+static const char * s_error_map     = "RPi2cReplay::open: error: Unable to map capture file.";
+static const char * s_error_format  = "RPi2cReplay::open: error: Not a capture file, or an unsupported version.";
+
+RPi2cReplay::RPi2cReplay () :
+	m_error(s_error_none),
+	m_map(0),
+	m_size(0),
+	m_end(0)
+{
+	rewind ();
+}
+
+RPi2cReplay::~RPi2cReplay ()
+{
+	close ();
+}
+
+bool RPi2cReplay::open (const char * filename)
+{
+	m_error = s_error_none;
+
+	close ();
+
+	int fd = ::open (filename, O_RDONLY);
+
+	if (fd < 0) {
+		m_error = s_error_open;
+		return false;
+	}
+
+	struct stat st;
+
+	if (fstat (fd, &st) < 0) {
+		m_error = s_error_open;
+		::close (fd);
+		return false;
+	}
+	if (static_cast<size_t>(st.st_size) < sizeof (RPi2cCaptureHeader)) {
+		m_error = s_error_format;
+		::close (fd);
+		return false;
+	}
+
+	void * map = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	::close (fd); // the mapping keeps the file
+
+	if (map == MAP_FAILED) {
+		m_error = s_error_map;
+		return false;
+	}
+	m_map  = static_cast<uint8_t *>(map);
+	m_size = st.st_size;
+
+	const RPi2cCaptureHeader * header = reinterpret_cast<const RPi2cCaptureHeader *>(m_map);
+
+	if (memcmp (header->magic, RPI2C_CAPTURE_MAGIC, sizeof (header->magic)) || (header->version != RPI2C_CAPTURE_VERSION) ||
+		(header->header_size < sizeof (RPi2cCaptureHeader)) || (header->header_size + header->used > m_size)) {
+		m_error = s_error_format;
+		close ();
+		return false;
+	}
+	m_end = header->header_size + header->used;
+
+	rewind ();
+
+	return true;
+}
+
+void RPi2cReplay::close ()
+{
+	if (m_map) {
+		munmap (m_map, m_size);
+		m_map  = 0;
+		m_size = 0;
+		m_end  = 0;
+	}
+}
+
+void RPi2cReplay::rewind ()
+{
+	size_t start = m_map ? reinterpret_cast<const RPi2cCaptureHeader *>(m_map)->header_size : 0;
+
+	for (int a = 0; a < 128; a++) {
+		m_cursor[a] = start;
+	}
+	m_replayedCount = 0;
+	m_mismatchCount = 0;
+	m_missCount = 0;
+}
+
+/* Returns the device's next record, and moves past it; returns 0 at the end of the recording.
+ */
+const RPi2cCaptureRecord * RPi2cReplay::next (uint16_t device_address)
+{
+	size_t & cursor = m_cursor[device_address];
+
+	while (cursor + sizeof (RPi2cCaptureRecord) <= m_end) {
+		const RPi2cCaptureRecord * record = reinterpret_cast<const RPi2cCaptureRecord *>(m_map + cursor);
+
+		size_t byte_count = rpi2c_capture_size (*record);
+
+		if (cursor + byte_count > m_end) {
+			break; // truncated
+		}
+		cursor += byte_count;
+
+		if (record->device_address == device_address) {
+			return record;
+		}
+	}
+	return 0;
+}
+
+/* Returns number of messages transferred; returns -1 on failure.
+ */
+int RPi2cReplay::transfer (struct i2c_msg * messages, int count)
+{
+	if (!m_map) {
+		errno = ENODEV; // no capture open
+		return -1;
+	}
+
+	int result = count;
+	int error  = 0;
+
+	for (int m = 0; m < count; m++) {
+		if (messages[m].addr & ~0x7F) {
+			errno = EINVAL; // 10-bit addresses not supported
+			return -1;
+		}
+
+		const RPi2cCaptureRecord * record = next (messages[m].addr);
+
+		if (!record || ((record->flags ^ messages[m].flags) & I2C_M_RD)) {
+			++m_missCount;
+			errno = EIO;
+			return -1;
+		}
+		++m_replayedCount;
+
+		const uint8_t * payload = reinterpret_cast<const uint8_t *>(record + 1);
+
+		uint8_t * buffer = reinterpret_cast<uint8_t *>(messages[m].buf);
+
+		if (messages[m].flags & I2C_M_RD) {
+			uint16_t byte_count = (record->length < messages[m].len) ? record->length : messages[m].len;
+
+			memcpy (buffer, payload, byte_count);
+
+			if (byte_count < messages[m].len) {
+				memset (buffer + byte_count, 0, messages[m].len - byte_count);
+				++m_mismatchCount;
+			}
+		} else if ((record->length != messages[m].len) || memcmp (buffer, payload, record->length)) {
+			++m_mismatchCount;
+		}
+		if (record->status < 0) {
+			result = -1;
+			error = record->error ? record->error : EIO;
+		}
+	}
+	if (result < 0) {
+		errno = error; // as the transfer failed when captured
+	}
+	return result;
+}
@@ -0,0 +1,92 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_REPLAY_HH
+#define RPI2C_REPLAY_HH
+
+#include <stddef.h>
+
+#include "RPi2cAdapter.h"
+#include "RPi2cCapture.h"
+
+/** A fake I2C adapter that plays back a file recorded by RPi2cCapture.
+ *
+ * Each device address has its own place in the recording, so devices polled in a different order, or at a different
+ * rate, still see their own traffic in sequence. A read is served with the next recorded read for the device (and fails
+ * if the recorded transfer failed); a write is checked against the next recorded write, and a mismatch counted, but
+ * otherwise accepted. A transfer that goes beyond the end of the recording, or finds a read where a write was recorded
+ * (or vice versa), fails.
+ */
+class RPi2cReplay : public RPi2cAdapter {
+private:
+	const char *  m_error;
+	uint8_t *     m_map;
+	size_t        m_size;          // of the mapping
+	size_t        m_end;           // offset of the end of the records
+	size_t        m_cursor[128];   // offset of the next record to consider, for each device address
+
+	unsigned long m_replayedCount;
+	unsigned long m_mismatchCount;
+	unsigned long m_missCount;
+
+	const RPi2cCaptureRecord * next (uint16_t device_address);
+
+public:
+	RPi2cReplay ();
+
+	virtual ~RPi2cReplay ();
+
+	inline const char * lastError () const { return m_error; }
+
+	/** Map a capture file for playback.
+	 *
+	 * @return false on failure - use lastError() to see why.
+	 */
+	bool open (const char * filename);
+
+	void close ();
+
+	inline bool isOpen () const { return m_map != 0; }
+
+	/** Start playback again from the beginning of the recording.
+	 */
+	void rewind ();
+
+	/** Number of messages served from the recording.
+	 */
+	inline unsigned long replayedCount () const { return m_replayedCount; }
+
+	/** Number of writes that differed from the recording.
+	 */
+	inline unsigned long mismatchCount () const { return m_mismatchCount; }
+
+	/** Number of messages with no counterpart in the recording.
+	 */
+	inline unsigned long missCount () const { return m_missCount; }
+
+	virtual int transfer (struct i2c_msg * messages, int count);
+};
+
+#endif /* ! RPI2C_REPLAY_HH */
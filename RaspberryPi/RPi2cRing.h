@@ -0,0 +1,95 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_RING_HH
+#define RPI2C_RING_HH
+
+/* Keep the producer's and the consumer's indices in separate cache lines.
+ */
+#define RPI2C_RING_CACHELINE 64
+
+/** Lock-free single-producer/single-consumer ring buffer.
+ *
+ * One thread may push() and one (other) thread may pop() without any locking; the capacity N must be a power of two.
+ * The indices are free-running and wrap naturally, so the ring distinguishes full from empty without a spare slot.
+ */
+template <class T, unsigned N>
+class RPi2cRing {
+private:
+	T        m_entry[N];
+
+	unsigned m_head __attribute__ ((aligned (RPI2C_RING_CACHELINE))); // written by producer
+	unsigned m_tail __attribute__ ((aligned (RPI2C_RING_CACHELINE))); // written by consumer
+
+public:
+	RPi2cRing () :
+		m_head(0),
+		m_tail(0)
+	{
+		//
+	}
+
+	/** Add an entry to the ring; producer only.
+	 *
+	 * @return false if the ring is full.
+	 */
+	inline bool push (const T & entry) {
+		unsigned head = __atomic_load_n (&m_head, __ATOMIC_RELAXED);
+		unsigned tail = __atomic_load_n (&m_tail, __ATOMIC_ACQUIRE);
+
+		if (head - tail == N) {
+			return false;
+		}
+		m_entry[head & (N - 1)] = entry;
+
+		__atomic_store_n (&m_head, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	/** Remove the oldest entry from the ring; consumer only.
+	 *
+	 * @return false if the ring is empty.
+	 */
+	inline bool pop (T & entry) {
+		unsigned tail = __atomic_load_n (&m_tail, __ATOMIC_RELAXED);
+		unsigned head = __atomic_load_n (&m_head, __ATOMIC_ACQUIRE);
+
+		if (head == tail) {
+			return false;
+		}
+		entry = m_entry[tail & (N - 1)];
+
+		__atomic_store_n (&m_tail, tail + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	/** Whether the ring is empty; only a hint, unless called by the consumer.
+	 */
+	inline bool empty () const {
+		return __atomic_load_n (&m_head, __ATOMIC_ACQUIRE) == __atomic_load_n (&m_tail, __ATOMIC_ACQUIRE);
+	}
+};
+
+#endif /* ! RPI2C_RING_HH */
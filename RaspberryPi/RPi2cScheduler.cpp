@@ -0,0 +1,202 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#include <errno.h>
+#include <time.h>
+
+#include "RPi2cScheduler.h"
+
+static const char * s_error_none   = "RPi2cScheduler: no error";
+static const char * s_error_full   = "RPi2cScheduler::addPoll: error: too many polls";
+static const char * s_error_length = "RPi2cScheduler::addPoll: error: invalid byte count";
+static const char * s_error_period = "RPi2cScheduler::addPoll: error: invalid period";
+static const char * s_error_budget = "RPi2cScheduler::addPoll: error: bus would be over-subscribed";
+
+static uint64_t s_now_ns ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static void s_sleep_until (uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec  = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+
+	while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR) {
+		// interrupted; keep sleeping
+	}
+}
+
+RPi2cScheduler::RPi2cScheduler (RPi2c & i2c, unsigned long clock_hz) :
+	m_i2c(i2c),
+	m_error(s_error_none),
+	m_clock(clock_hz ? clock_hz : RPI2C_SCHEDULER_CLOCK),
+	m_occupancyLimit(RPI2C_SCHEDULER_OCCUPANCY),
+	m_occupancy(0),
+	m_bStop(false),
+	m_pollCount(0)
+{
+	//
+}
+
+RPi2cScheduler::~RPi2cScheduler ()
+{
+	//
+}
+
+uint64_t RPi2cScheduler::readTime (unsigned long clock_hz, uint16_t byte_count)
+{
+	uint64_t clocks = 1 + 9 + 9 + 1 + 9 + 9 * static_cast<uint64_t>(byte_count) + 1;
+
+	return (clocks * 1000000000ULL + clock_hz - 1) / clock_hz;
+}
+
+int RPi2cScheduler::addPoll (uint16_t device_address, uint16_t register_address, uint16_t byte_count, unsigned long period_us, int priority,
+							 RPi2cPollCallback callback, void * user)
+{
+	m_error = s_error_none;
+
+	if (m_pollCount == RPI2C_SCHEDULER_MAXPOLLS) {
+		m_error = s_error_full;
+		return -1;
+	}
+	if (!byte_count || byte_count > RPI2C_SCHEDULER_MAXLEN) {
+		m_error = s_error_length;
+		return -1;
+	}
+	if (!period_us) {
+		m_error = s_error_period;
+		return -1;
+	}
+
+	double occupancy = m_occupancy + static_cast<double>(readTime (m_clock, byte_count)) / (period_us * 1000.0);
+
+	if (occupancy > m_occupancyLimit) {
+		m_error = s_error_budget;
+		return -1;
+	}
+	m_occupancy = occupancy;
+
+	int poll = m_pollCount++;
+
+	m_poll[poll].device_address   = device_address;
+	m_poll[poll].register_address = register_address;
+	m_poll[poll].byte_count       = byte_count;
+	m_poll[poll].priority         = priority;
+	m_poll[poll].period           = static_cast<uint64_t>(period_us) * 1000;
+	m_poll[poll].release          = 0;
+	m_poll[poll].callback         = callback;
+	m_poll[poll].user             = user;
+	m_poll[poll].missed           = 0;
+	m_poll[poll].jitter.clear (device_address);
+
+	return poll;
+}
+
+void RPi2cScheduler::run (unsigned long duration_us)
+{
+	if (!m_pollCount) {
+		__atomic_store_n (&m_bStop, false, __ATOMIC_RELEASE);
+		return;
+	}
+
+	uint64_t now = s_now_ns ();
+	uint64_t end = now + static_cast<uint64_t>(duration_us) * 1000;
+
+	/* Stagger the first releases by the bus time of each read, so that polls with the same period don't collide
+	 */
+	uint64_t offset = 0;
+
+	for (int p = 0; p < m_pollCount; p++) {
+		m_poll[p].release = now + offset;
+		offset += readTime (m_clock, m_poll[p].byte_count);
+	}
+
+	while (!__atomic_load_n (&m_bStop, __ATOMIC_ACQUIRE)) {
+		/* Find the most important poll that is due, and the next release time
+		 */
+		int      due = -1;
+		uint64_t next_release = m_poll[0].release;
+
+		for (int p = 0; p < m_pollCount; p++) {
+			if (next_release > m_poll[p].release) {
+				next_release = m_poll[p].release;
+			}
+			if (m_poll[p].release > now) {
+				continue;
+			}
+			if (due < 0 || m_poll[p].priority > m_poll[due].priority ||
+				(m_poll[p].priority == m_poll[due].priority && m_poll[p].release < m_poll[due].release)) {
+				due = p;
+			}
+		}
+
+		if (due < 0) {
+			if (next_release >= end) {
+				break;
+			}
+			s_sleep_until (next_release);
+			now = s_now_ns ();
+			continue;
+		}
+
+		uint64_t start = s_now_ns ();
+
+		int status = m_i2c.busRead (m_poll[due].device_address, m_poll[due].register_address, m_poll[due].byte_count, m_poll[due].data);
+
+		m_poll[due].jitter.record (start - m_poll[due].release, (status > 0) ? status : 0, status < 0);
+
+		if (m_poll[due].callback) {
+			(*m_poll[due].callback) (due, m_poll[due].data, status, start, m_poll[due].user);
+		}
+
+		now = s_now_ns ();
+
+		/* Next release is one period on; if that has already passed, skip to the next one still to come
+		 */
+		m_poll[due].release += m_poll[due].period;
+
+		if (m_poll[due].release + m_poll[due].period <= now) {
+			uint64_t behind = (now - m_poll[due].release) / m_poll[due].period;
+
+			m_poll[due].missed  += behind;
+			m_poll[due].release += behind * m_poll[due].period;
+		}
+
+		if (now >= end) {
+			break;
+		}
+	}
+
+	/* Cleared on the way out rather than on the way in, so that a stop() from another thread just before run() isn't lost
+	 */
+	__atomic_store_n (&m_bStop, false, __ATOMIC_RELEASE);
+}
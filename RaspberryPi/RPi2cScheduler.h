@@ -0,0 +1,158 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_SCHEDULER_HH
+#define RPI2C_SCHEDULER_HH
+
+#include "RPi2c.h"
+
+/* Bus clock rate to plan for, if not specified; the Raspberry Pi's default is 100kHz
+ */
+#define RPI2C_SCHEDULER_CLOCK 100000
+
+/* Fraction of bus time that the polls may occupy, if not specified; leaves room for other traffic and for jitter
+ */
+#define RPI2C_SCHEDULER_OCCUPANCY 0.8
+
+#define RPI2C_SCHEDULER_MAXPOLLS 32
+#define RPI2C_SCHEDULER_MAXLEN   64
+
+/** Called by RPi2cScheduler::run() after each read.
+ *
+ * @param poll      Index of the poll, as returned by RPi2cScheduler::addPoll().
+ * @param data      Bytes read.
+ * @param status    Number of bytes read; -1 on failure.
+ * @param timestamp Time in nanoseconds (CLOCK_MONOTONIC) at which the read started.
+ * @param user      As passed to RPi2cScheduler::addPoll().
+ */
+typedef void (*RPi2cPollCallback) (int poll, const uint8_t * data, int status, uint64_t timestamp, void * user);
+
+/** Periodic polling of devices on a bus, within a bus-time budget.
+ *
+ * Each poll reads a block of registers from a device at a fixed period. The bus time each read takes at the specified
+ * clock rate is known in advance, so the scheduler can calculate how much of the bus the polls occupy and refuse any
+ * poll that would take it over the limit. When several polls are due at once, the one with the highest priority goes
+ * first; reads are not pre-empted. Release times do not drift: a late read does not delay the next, and a poll that
+ * falls more than a period behind skips the reads it has missed, which are counted.
+ */
+class RPi2cScheduler {
+private:
+	RPi2c &       m_i2c;
+	const char *  m_error;
+
+	unsigned long m_clock;
+	double        m_occupancyLimit;
+	double        m_occupancy;
+
+	bool          m_bStop;
+
+	struct {
+		uint16_t          device_address;
+		uint16_t          register_address;
+		uint16_t          byte_count;
+		int               priority;
+		uint64_t          period;      // in nanoseconds
+		uint64_t          release;     // next release time, in nanoseconds
+		RPi2cPollCallback callback;
+		void *            user;
+
+		unsigned long     missed;
+		RPi2cDeviceStats  jitter;      // time from release to start of read; transfers & errors count the reads
+		uint8_t           data[RPI2C_SCHEDULER_MAXLEN];
+	}             m_poll[RPI2C_SCHEDULER_MAXPOLLS];
+	int           m_pollCount;
+
+public:
+	/** Class constructor.
+	 *
+	 * @param i2c      An open bus.
+	 * @param clock_hz Bus clock rate in Hz, for calculating bus occupancy.
+	 */
+	RPi2cScheduler (RPi2c & i2c, unsigned long clock_hz = RPI2C_SCHEDULER_CLOCK);
+
+	~RPi2cScheduler ();
+
+	/** Bus time in nanoseconds to read from a device register, i.e., start, address and register bytes, repeated start,
+	 * address and data bytes, and stop, at nine clocks per byte.
+	 *
+	 * @param clock_hz   Bus clock rate in Hz.
+	 * @param byte_count Number of bytes to read.
+	 */
+	static uint64_t readTime (unsigned long clock_hz, uint16_t byte_count);
+
+	/** Set the fraction of bus time that the polls may occupy; the default is RPI2C_SCHEDULER_OCCUPANCY.
+	 */
+	inline void setOccupancyLimit (double limit) { m_occupancyLimit = limit; }
+
+	/** Fraction of bus time occupied by the polls added so far.
+	 */
+	inline double occupancy () const { return m_occupancy; }
+
+	inline const char * lastError () const { return m_error; }
+
+	/** Add a poll.
+	 *
+	 * @param device_address   The 7-bit address of the i2c device.
+	 * @param register_address The register to read from.
+	 * @param byte_count       Number of bytes to read; up to RPI2C_SCHEDULER_MAXLEN.
+	 * @param period_us        Poll period in microseconds.
+	 * @param priority         Higher values go first when several polls are due at once.
+	 * @param callback         Called with the data after each read.
+	 * @param user             Passed to the callback.
+	 *
+	 * @return Index of the poll; returns -1 on failure, e.g., if the bus would be over-subscribed - use lastError() to see why.
+	 */
+	int addPoll (uint16_t device_address, uint16_t register_address, uint16_t byte_count, unsigned long period_us, int priority,
+				 RPi2cPollCallback callback, void * user = 0);
+
+	/** Dispatch reads, on time, until the specified time has passed or stop() is called.
+	 *
+	 * The first reads are due at once, one after the other in the order the polls were added, so that polls with the
+	 * same period are spread out rather than all due together.
+	 *
+	 * @param duration_us Time in microseconds to run for.
+	 */
+	void run (unsigned long duration_us);
+
+	/** Make run() return after the current read; may be called from a callback or from another thread.
+	 * If run() isn't in progress, the next run() returns at once.
+	 */
+	inline void stop () { __atomic_store_n (&m_bStop, true, __ATOMIC_RELEASE); }
+
+	/** Number of reads made for a poll, and how many of these failed.
+	 */
+	inline unsigned long count (int poll) const { return m_poll[poll].jitter.transfers; }
+	inline unsigned long errors (int poll) const { return m_poll[poll].jitter.errors; }
+
+	/** Number of reads skipped because the poll fell more than a period behind.
+	 */
+	inline unsigned long missed (int poll) const { return m_poll[poll].missed; }
+
+	/** Release jitter for a poll, i.e., the time from when each read was due to when it started.
+	 */
+	inline const RPi2cDeviceStats & jitter (int poll) const { return m_poll[poll].jitter; }
+};
+
+#endif /* ! RPI2C_SCHEDULER_HH */
@@ -0,0 +1,345 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "RPi2cSim.h"
+
+RPi2cSimDevice::RPi2cSimDevice () :
+	m_pointer(0),
+	m_bAutoIncrement(true)
+{
+	memset (m_register, 0, sizeof (m_register));
+}
+
+RPi2cSimDevice::~RPi2cSimDevice ()
+{
+	//
+}
+
+uint8_t RPi2cSimDevice::readRegister (uint8_t register_address)
+{
+	return m_register[register_address];
+}
+
+void RPi2cSimDevice::writeRegister (uint8_t register_address, uint8_t value)
+{
+	m_register[register_address] = value;
+}
+
+bool RPi2cSimDevice::autoIncrement (uint8_t /* register_address */)
+{
+	return m_bAutoIncrement;
+}
+
+uint8_t RPi2cSimDevice::readNext ()
+{
+	uint8_t value = readRegister (m_pointer);
+
+	if (autoIncrement (m_pointer)) {
+		++m_pointer;
+	}
+	return value;
+}
+
+void RPi2cSimDevice::writeNext (uint8_t value)
+{
+	writeRegister (m_pointer, value);
+
+	if (autoIncrement (m_pointer)) {
+		++m_pointer;
+	}
+}
+
+RPi2cSimFIFO::RPi2cSimFIFO (uint8_t data_register, uint8_t count_register, uint8_t status_register, uint8_t overflow_mask, uint16_t capacity) :
+	m_capacity((capacity && capacity <= RPI2C_SIM_FIFO_MAX) ? capacity : RPI2C_SIM_FIFO_MAX),
+	m_head(0),
+	m_level(0),
+	m_latched(0),
+	m_last(0),
+	m_dataRegister(data_register),
+	m_countRegister(count_register),
+	m_statusRegister(status_register),
+	m_overflowMask(overflow_mask),
+	m_resetRegister(0),
+	m_resetMask(0),
+	m_overflowCount(0)
+{
+	//
+}
+
+RPi2cSimFIFO::~RPi2cSimFIFO ()
+{
+	//
+}
+
+void RPi2cSimFIFO::push (const uint8_t * bytes, uint16_t byte_count)
+{
+	for (uint16_t ib = 0; ib < byte_count; ib++) {
+		if (m_level == m_capacity) { // lose the oldest
+			m_head = (m_head + 1) % m_capacity;
+			--m_level;
+			++m_overflowCount;
+			registers ()[m_statusRegister] |= m_overflowMask;
+		}
+		m_fifo[(m_head + m_level) % m_capacity] = bytes[ib];
+		++m_level;
+	}
+}
+
+void RPi2cSimFIFO::reset ()
+{
+	m_head = 0;
+	m_level = 0;
+}
+
+uint8_t RPi2cSimFIFO::readRegister (uint8_t register_address)
+{
+	if (register_address == m_dataRegister) {
+		if (m_level) {
+			m_last = m_fifo[m_head];
+			m_head = (m_head + 1) % m_capacity;
+			--m_level;
+		}
+		return m_last;
+	}
+	if (register_address == m_countRegister) {
+		m_latched = m_level;
+		return static_cast<uint8_t>(m_latched >> 8);
+	}
+	if (register_address == static_cast<uint8_t>(m_countRegister + 1)) {
+		return static_cast<uint8_t>(m_latched & 0xFF);
+	}
+	if (register_address == m_statusRegister) {
+		uint8_t status = registers ()[m_statusRegister];
+		registers ()[m_statusRegister] = 0;
+		return status;
+	}
+	return RPi2cSimDevice::readRegister (register_address);
+}
+
+void RPi2cSimFIFO::writeRegister (uint8_t register_address, uint8_t value)
+{
+	if (register_address == m_dataRegister) {
+		push (&value, 1);
+	} else if (m_resetMask && (register_address == m_resetRegister) && (value & m_resetMask)) {
+		reset ();
+		RPi2cSimDevice::writeRegister (register_address, value & ~m_resetMask);
+	} else {
+		RPi2cSimDevice::writeRegister (register_address, value);
+	}
+}
+
+bool RPi2cSimFIFO::autoIncrement (uint8_t register_address)
+{
+	return (register_address != m_dataRegister) && RPi2cSimDevice::autoIncrement (register_address);
+}
+
+RPi2cSimMemory::RPi2cSimMemory (uint8_t bank_register, uint8_t address_register, uint16_t bank_count,
+								uint8_t data_register, uint8_t count_register, uint8_t status_register, uint8_t overflow_mask, uint16_t capacity) :
+	RPi2cSimFIFO(data_register, count_register, status_register, overflow_mask, capacity),
+	m_bankCount((bank_count && bank_count <= RPI2C_SIM_MEMORY_BANKS) ? bank_count : RPI2C_SIM_MEMORY_BANKS),
+	m_bankRegister(bank_register),
+	m_addressRegister(address_register),
+	m_memoryRegister(address_register + 1),
+	m_stuck(-1)
+{
+	memset (m_memory, 0, sizeof (m_memory));
+}
+
+RPi2cSimMemory::~RPi2cSimMemory ()
+{
+	//
+}
+
+uint8_t RPi2cSimMemory::readRegister (uint8_t register_address)
+{
+	if (register_address == m_memoryRegister) {
+		uint8_t   bank    = registers ()[m_bankRegister] & 0x1F;
+		uint8_t & address = registers ()[m_addressRegister];
+
+		uint8_t value = (bank < m_bankCount) ? m_memory[bank * 256 + address] : 0;
+		++address;
+		return value;
+	}
+	return RPi2cSimFIFO::readRegister (register_address);
+}
+
+void RPi2cSimMemory::writeRegister (uint8_t register_address, uint8_t value)
+{
+	if (register_address == m_memoryRegister) {
+		uint8_t   bank    = registers ()[m_bankRegister] & 0x1F;
+		uint8_t & address = registers ()[m_addressRegister];
+
+		long offset = bank * 256 + address;
+
+		if (bank < m_bankCount && offset != m_stuck) {
+			m_memory[offset] = value;
+		}
+		++address;
+	} else {
+		RPi2cSimFIFO::writeRegister (register_address, value);
+	}
+}
+
+bool RPi2cSimMemory::autoIncrement (uint8_t register_address)
+{
+	return (register_address != m_memoryRegister) && RPi2cSimFIFO::autoIncrement (register_address);
+}
+
+RPi2cSim::RPi2cSim (unsigned long clock_hz) :
+	m_stallTime(0),
+	m_clock(clock_hz ? clock_hz : RPI2C_SIM_STANDARD),
+	m_bPaced(false),
+	m_busTime(0),
+	m_transferCount(0),
+	m_nackCount(0),
+	m_timeoutCount(0),
+	m_recoverCount(0)
+{
+	memset (m_device, 0, sizeof (m_device));
+	memset (m_nack, 0, sizeof (m_nack));
+	memset (m_stall, 0, sizeof (m_stall));
+}
+
+RPi2cSim::~RPi2cSim ()
+{
+	//
+}
+
+void RPi2cSim::attach (uint16_t device_address, RPi2cSimDevice * device)
+{
+	m_device[device_address & 0x7F] = device;
+	m_nack[device_address & 0x7F] = 0;
+	m_stall[device_address & 0x7F] = 0;
+}
+
+bool RPi2cSim::recover ()
+{
+	++m_recoverCount;
+	return true;
+}
+
+uint64_t RPi2cSim::transferTime (const struct i2c_msg * messages, int count, int nack_index) const
+{
+	uint64_t clocks = 1; // stop
+
+	for (int m = 0; m < count; m++) {
+		clocks += 1 + 9; // (repeated) start + address byte
+
+		if (m == nack_index) {
+			break;
+		}
+		clocks += 9 * static_cast<uint64_t>(messages[m].len);
+	}
+	return (clocks * 1000000000ULL + m_clock - 1) / m_clock;
+}
+
+/* Returns number of messages transferred; returns -1 on failure, with errno set.
+ */
+int RPi2cSim::transfer (struct i2c_msg * messages, int count)
+{
+	int nack_index = -1;
+
+	for (int m = 0; m < count; m++) {
+		if (messages[m].addr & ~0x7F) {
+			errno = EINVAL; // 10-bit addresses not supported
+			return -1;
+		}
+
+		uint16_t address = messages[m].addr;
+
+		if (m_stall[address]) {
+			--m_stall[address];
+
+			m_busTime += static_cast<uint64_t>(m_stallTime) * 1000;
+			++m_transferCount;
+			++m_timeoutCount;
+
+			struct timespec ts;
+
+			ts.tv_sec  = m_stallTime / 1000000;
+			ts.tv_nsec = (m_stallTime % 1000000) * 1000;
+
+			while (nanosleep (&ts, &ts) < 0 && errno == EINTR) {
+				// interrupted; keep sleeping
+			}
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		RPi2cSimDevice * device = m_device[address];
+
+		if (!device || m_nack[address]) {
+			if (m_nack[address]) {
+				--m_nack[address];
+			}
+			nack_index = m;
+			break;
+		}
+
+		uint8_t * buffer = reinterpret_cast<uint8_t *>(messages[m].buf);
+
+		if (messages[m].flags & I2C_M_RD) {
+			for (int ib = 0; ib < messages[m].len; ib++) {
+				buffer[ib] = device->readNext ();
+			}
+		} else if (messages[m].len) {
+			device->setPointer (buffer[0]);
+
+			for (int ib = 1; ib < messages[m].len; ib++) {
+				device->writeNext (buffer[ib]);
+			}
+		}
+	}
+
+	uint64_t ns = transferTime (messages, count, nack_index);
+
+	m_busTime += ns;
+	++m_transferCount;
+
+	if (m_bPaced) {
+		struct timespec ts;
+
+		clock_gettime (CLOCK_MONOTONIC, &ts);
+
+		ns += ts.tv_nsec;
+		ts.tv_sec  += ns / 1000000000;
+		ts.tv_nsec  = ns % 1000000000;
+
+		while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR) {
+			// interrupted; keep sleeping
+		}
+	}
+
+	if (nack_index >= 0) {
+		++m_nackCount;
+		errno = EREMOTEIO;
+		return -1;
+	}
+	return count;
+}
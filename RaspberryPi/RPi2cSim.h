@@ -0,0 +1,317 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_SIM_HH
+#define RPI2C_SIM_HH
+
+#include "RPi2cAdapter.h"
+
+/* Standard I2C clock rates in Hz
+ */
+#define RPI2C_SIM_STANDARD   100000 // Standard-mode
+#define RPI2C_SIM_FAST       400000 // Fast-mode
+#define RPI2C_SIM_FAST_PLUS 1000000 // Fast-mode Plus
+
+/** A simulated I2C device with a 256-byte register map.
+ *
+ * The first byte of a write sets the register pointer and subsequent bytes are written from there; reads start at the
+ * register pointer; by default the pointer increments after every byte. Override readRegister() and writeRegister()
+ * to model registers with side effects, e.g., FIFOs or status flags that clear on read.
+ */
+class RPi2cSimDevice {
+private:
+	uint8_t m_register[256];
+	uint8_t m_pointer;
+	bool    m_bAutoIncrement;
+
+public:
+	/** Class constructor.
+	 *
+	 * All registers are initially zero.
+	 */
+	RPi2cSimDevice ();
+
+	virtual ~RPi2cSimDevice ();
+
+	/** Direct access to the register map, e.g., to preset or check register values.
+	 */
+	inline uint8_t * registers () { return m_register; }
+
+	/** Whether the register pointer increments after each byte read or written; true by default.
+	 */
+	inline void setAutoIncrement (bool bEnable) { m_bAutoIncrement = bEnable; }
+
+	inline uint8_t pointer () const { return m_pointer; }
+
+	/** Read a register, as the bus master would see it.
+	 */
+	virtual uint8_t readRegister (uint8_t register_address);
+
+	/** Write a register, as the bus master would.
+	 */
+	virtual void writeRegister (uint8_t register_address, uint8_t value);
+
+	/** Whether the register pointer should move on from this register after a byte is read or written.
+	 */
+	virtual bool autoIncrement (uint8_t register_address);
+
+	/* The simulated bus calls these during a transfer.
+	 */
+	void setPointer (uint8_t register_address) { m_pointer = register_address; }
+
+	uint8_t readNext ();
+
+	void writeNext (uint8_t value);
+};
+
+/* Largest FIFO an RPi2cSimFIFO can model
+ */
+#define RPI2C_SIM_FIFO_MAX   4096
+
+/** A simulated device with a FIFO behind one register, e.g., an MPU-6050.
+ *
+ * Reading the data register takes the oldest byte from the FIFO (and doesn't move the register pointer, so a burst
+ * read drains the FIFO); the count register and the one after it give the FIFO level, MSB first. Bytes pushed into
+ * a full FIFO overwrite the oldest, and set the overflow bits in the status register, which clears when read.
+ * Reading an empty FIFO returns the last byte read. Optionally, a bit in a control register resets the FIFO.
+ */
+class RPi2cSimFIFO : public RPi2cSimDevice {
+private:
+	uint8_t       m_fifo[RPI2C_SIM_FIFO_MAX];
+	uint16_t      m_capacity;
+	uint16_t      m_head;            // index of the oldest byte
+	uint16_t      m_level;
+	uint16_t      m_latched;         // level as seen by the count registers, latched when the MSB is read
+	uint8_t       m_last;
+
+	uint8_t       m_dataRegister;
+	uint8_t       m_countRegister;
+	uint8_t       m_statusRegister;
+	uint8_t       m_overflowMask;
+	uint8_t       m_resetRegister;
+	uint8_t       m_resetMask;
+
+	unsigned long m_overflowCount;
+
+public:
+	/** Class constructor.
+	 *
+	 * @param data_register   Register through which the FIFO is read (and written).
+	 * @param count_register  First of the two registers that give the FIFO level, MSB first.
+	 * @param status_register Status register, which clears when read.
+	 * @param overflow_mask   Bits to set in the status register when the FIFO overflows.
+	 * @param capacity        FIFO size in bytes; at most RPI2C_SIM_FIFO_MAX.
+	 */
+	RPi2cSimFIFO (uint8_t data_register, uint8_t count_register, uint8_t status_register, uint8_t overflow_mask, uint16_t capacity);
+
+	virtual ~RPi2cSimFIFO ();
+
+	/** Add bytes to the FIFO, as the device would when it has new data.
+	 */
+	void push (const uint8_t * bytes, uint16_t byte_count);
+
+	/** Empty the FIFO, as the device would on a FIFO reset.
+	 */
+	void reset ();
+
+	/** Make writing the bits in mask to a control register reset the FIFO; the bits then clear themselves.
+	 */
+	inline void setResetBits (uint8_t register_address, uint8_t mask) { m_resetRegister = register_address; m_resetMask = mask; }
+
+	inline uint16_t level () const { return m_level; }
+
+	/** Number of bytes lost because the FIFO was full.
+	 */
+	inline unsigned long overflowCount () const { return m_overflowCount; }
+
+	virtual uint8_t readRegister (uint8_t register_address);
+
+	virtual void writeRegister (uint8_t register_address, uint8_t value);
+
+	virtual bool autoIncrement (uint8_t register_address);
+};
+
+/* Most memory an RPi2cSimMemory can model, in 256-byte banks
+ */
+#define RPI2C_SIM_MEMORY_BANKS 32
+
+/** A simulated device with banked memory behind three registers, as well as a FIFO, e.g., an MPU-6050 with its DMP.
+ *
+ * The bank register selects a 256-byte bank (its low five bits) and the address register the address within it;
+ * reading or writing the memory register, which follows the address register, reads or writes memory there and increments the address register, wrapping
+ * within the bank (and doesn't move the register pointer, so a burst reads or writes consecutive memory). Memory
+ * outside the banks modelled reads as zero. Optionally, one byte of memory ignores writes, as a faulty device's might.
+ */
+class RPi2cSimMemory : public RPi2cSimFIFO {
+private:
+	uint8_t  m_memory[RPI2C_SIM_MEMORY_BANKS * 256];
+	uint16_t m_bankCount;
+
+	uint8_t  m_bankRegister;
+	uint8_t  m_addressRegister;
+	uint8_t  m_memoryRegister;
+
+	long     m_stuck;
+
+public:
+	/** Class constructor.
+	 *
+	 * All memory is initially zero. The FIFO is as RPi2cSimFIFO's, e.g., for an MPU-6050 that also streams DMP packets.
+	 *
+	 * @param bank_register    Register that selects the memory bank.
+	 * @param address_register Register that holds the address within the bank; the memory register follows it.
+	 * @param bank_count       Number of banks modelled; at most RPI2C_SIM_MEMORY_BANKS.
+	 */
+	RPi2cSimMemory (uint8_t bank_register, uint8_t address_register, uint16_t bank_count,
+					uint8_t data_register, uint8_t count_register, uint8_t status_register, uint8_t overflow_mask, uint16_t capacity);
+
+	virtual ~RPi2cSimMemory ();
+
+	/** Direct access to the memory, e.g., to preset or check contents; bank b starts at offset 256 * b.
+	 */
+	inline uint8_t * memory () { return m_memory; }
+
+	/** Make one byte of memory ignore writes.
+	 *
+	 * @param offset Offset of the byte in memory; -1 for none (the default).
+	 */
+	inline void setStuck (long offset) { m_stuck = offset; }
+
+	virtual uint8_t readRegister (uint8_t register_address);
+
+	virtual void writeRegister (uint8_t register_address, uint8_t value);
+
+	virtual bool autoIncrement (uint8_t register_address);
+};
+
+/** A simulated I2C adapter with register-map device models and bus timing.
+ *
+ * Each transfer is timed as if on a real bus at the specified clock rate: nine clocks (eight bits and an ACK) per byte,
+ * including each message's address byte, plus one clock for each start and for the stop. The simulated bus time is
+ * accumulated, so throughput and latency can be calculated deterministically; optionally, transfers can also be paced
+ * in real time, so that timings measured by RPi2c are realistic.
+ *
+ * A transfer to an address with no device attached is not acknowledged (NACK), as are the next few transfers to an
+ * address after injectNACK(); the transfer then fails with EREMOTEIO, as the i2c-dev driver would, but messages before
+ * the NACK still take effect. After injectTimeout(), the device instead holds the clock low until the adapter gives up,
+ * and the transfer fails with ETIMEDOUT.
+ */
+class RPi2cSim : public RPi2cAdapter {
+private:
+	RPi2cSimDevice * m_device[128];
+	unsigned         m_nack[128];
+	unsigned         m_stall[128];
+
+	unsigned long    m_stallTime;
+
+	unsigned long    m_clock;
+	bool             m_bPaced;
+
+	uint64_t         m_busTime;
+	unsigned long    m_transferCount;
+	unsigned long    m_nackCount;
+	unsigned long    m_timeoutCount;
+	unsigned long    m_recoverCount;
+
+public:
+	/** Class constructor.
+	 *
+	 * @param clock_hz Bus clock rate in Hz, e.g., RPI2C_SIM_FAST.
+	 */
+	RPi2cSim (unsigned long clock_hz = RPI2C_SIM_FAST);
+
+	virtual ~RPi2cSim ();
+
+	/** Attach a device model at the specified address; the simulator does not take ownership of the model.
+	 *
+	 * @param device_address The 7-bit address of the i2c device.
+	 * @param device         Device model; 0 to remove any device at the address.
+	 */
+	void attach (uint16_t device_address, RPi2cSimDevice * device);
+
+	inline RPi2cSimDevice * device (uint16_t device_address) { return m_device[device_address & 0x7F]; }
+
+	/** Set the bus clock rate in Hz.
+	 */
+	inline void setClock (unsigned long clock_hz) { m_clock = clock_hz ? clock_hz : RPI2C_SIM_STANDARD; }
+
+	inline unsigned long clock () const { return m_clock; }
+
+	/** Whether each transfer should take as long in real time as it would on a real bus; false by default.
+	 */
+	inline void setPaced (bool bPaced) { m_bPaced = bPaced; }
+
+	/** Make the next transfers to a device fail with a NACK of the address byte.
+	 *
+	 * @param device_address The 7-bit address of the i2c device.
+	 * @param count          Number of transfers to fail.
+	 */
+	inline void injectNACK (uint16_t device_address, unsigned count = 1) { m_nack[device_address & 0x7F] += count; }
+
+	/** Make the next transfers to a device stall, holding the clock low, and time out.
+	 *
+	 * Each stalled transfer takes the specified time, in real time as well as simulated bus time, as it would take the
+	 * kernel to give up.
+	 *
+	 * @param device_address The 7-bit address of the i2c device.
+	 * @param count          Number of transfers to stall.
+	 * @param stall_us       Time in microseconds before the transfer times out.
+	 */
+	inline void injectTimeout (uint16_t device_address, unsigned count = 1, unsigned long stall_us = 10000) {
+		m_stall[device_address & 0x7F] += count;
+		m_stallTime = stall_us;
+	}
+
+	/** Simulated bus time in nanoseconds since construction or resetCounts().
+	 */
+	inline uint64_t busTime () const { return m_busTime; }
+
+	inline unsigned long transferCount () const { return m_transferCount; }
+
+	inline unsigned long nackCount () const { return m_nackCount; }
+
+	inline unsigned long timeoutCount () const { return m_timeoutCount; }
+
+	/** Number of times recover() has been called.
+	 */
+	inline unsigned long recoverCount () const { return m_recoverCount; }
+
+	inline void resetCounts () { m_busTime = 0; m_transferCount = 0; m_nackCount = 0; m_timeoutCount = 0; m_recoverCount = 0; }
+
+	/** Simulated time in nanoseconds for a transfer; for messages up to and including one that is not acknowledged,
+	 * only its address byte is counted.
+	 *
+	 * @param messages   Messages to transfer, with a repeated start between each.
+	 * @param count      Number of messages.
+	 * @param nack_index Index of the message that is not acknowledged; -1 if none.
+	 */
+	uint64_t transferTime (const struct i2c_msg * messages, int count, int nack_index = -1) const;
+
+	virtual int transfer (struct i2c_msg * messages, int count);
+
+	virtual bool recover ();
+};
+
+#endif /* ! RPI2C_SIM_HH */
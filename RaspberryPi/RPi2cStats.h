@@ -0,0 +1,148 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_STATS_HH
+#define RPI2C_STATS_HH
+
+#include <stdint.h>
+#include <string.h>
+
+/* Latency histogram: times in nanoseconds, with RPI2C_STATS_SUBBINS bins per power of two from 2^RPI2C_STATS_MIN_SHIFT
+ * (about 1 us) up to 2^RPI2C_STATS_MAX_SHIFT (about 34 s), plus one bin for anything faster; percentiles are accurate
+ * to within one bin, i.e., 12.5%.
+ */
+#define RPI2C_STATS_MIN_SHIFT 10
+#define RPI2C_STATS_MAX_SHIFT 35
+#define RPI2C_STATS_SUBBITS    3
+#define RPI2C_STATS_SUBBINS   (1 << RPI2C_STATS_SUBBITS)
+#define RPI2C_STATS_BINS      (1 + (RPI2C_STATS_MAX_SHIFT - RPI2C_STATS_MIN_SHIFT + 1) * RPI2C_STATS_SUBBINS)
+
+/** Transfer statistics for one device address on a bus (or for the bus as a whole).
+ *
+ * @see RPi2c::stats()
+ */
+struct RPi2cDeviceStats {
+	uint16_t      device_address;
+	unsigned long transfers;                  // number of requests, or of operations in a transaction
+	unsigned long errors;                     // number of these that failed
+	uint64_t      bytes;                      // number of data bytes read or written
+	uint64_t      time_total;                 // total time in nanoseconds
+	uint64_t      time_max;                   // longest time in nanoseconds
+	uint32_t      histogram[RPI2C_STATS_BINS];
+
+	inline void clear (uint16_t address) {
+		memset (this, 0, sizeof (*this));
+		device_address = address;
+	}
+
+	static inline int bin (uint64_t ns) {
+		if (ns < (static_cast<uint64_t>(1) << RPI2C_STATS_MIN_SHIFT)) {
+			return 0;
+		}
+		int shift = 63 - __builtin_clzll (ns);
+
+		if (shift > RPI2C_STATS_MAX_SHIFT) {
+			return RPI2C_STATS_BINS - 1;
+		}
+		int sub = static_cast<int>(ns >> (shift - RPI2C_STATS_SUBBITS)) & (RPI2C_STATS_SUBBINS - 1);
+
+		return 1 + (shift - RPI2C_STATS_MIN_SHIFT) * RPI2C_STATS_SUBBINS + sub;
+	}
+
+	/* Upper limit in nanoseconds of the times in a bin.
+	 */
+	static inline uint64_t binLimit (int b) {
+		if (b == 0) {
+			return static_cast<uint64_t>(1) << RPI2C_STATS_MIN_SHIFT;
+		}
+		int shift = RPI2C_STATS_MIN_SHIFT + (b - 1) / RPI2C_STATS_SUBBINS;
+		int sub   = (b - 1) % RPI2C_STATS_SUBBINS;
+
+		return (static_cast<uint64_t>(RPI2C_STATS_SUBBINS + sub + 1) << shift) >> RPI2C_STATS_SUBBITS;
+	}
+
+	inline void record (uint64_t ns, uint32_t byte_count, bool bError) {
+		++transfers;
+		if (bError) {
+			++errors;
+		}
+		bytes      += byte_count;
+		time_total += ns;
+		if (time_max < ns) {
+			time_max = ns;
+		}
+		++histogram[bin (ns)];
+	}
+
+	inline void add (const RPi2cDeviceStats & other) {
+		transfers  += other.transfers;
+		errors     += other.errors;
+		bytes      += other.bytes;
+		time_total += other.time_total;
+		if (time_max < other.time_max) {
+			time_max = other.time_max;
+		}
+		for (int b = 0; b < RPI2C_STATS_BINS; b++) {
+			histogram[b] += other.histogram[b];
+		}
+	}
+
+	/** Latency percentile.
+	 *
+	 * @param fraction E.g., 0.5 for the median, 0.99 for the 99th percentile.
+	 *
+	 * @return Time in nanoseconds within which that fraction of the transfers completed; 0 if there were none.
+	 */
+	inline uint64_t percentile (double fraction) const {
+		if (!transfers) {
+			return 0;
+		}
+		uint64_t rank = static_cast<uint64_t>(fraction * transfers + 0.5);
+
+		if (rank < 1) {
+			rank = 1;
+		}
+		uint64_t count = 0;
+
+		for (int b = 0; b < RPI2C_STATS_BINS; b++) {
+			count += histogram[b];
+
+			if (count >= rank) {
+				uint64_t limit = binLimit (b);
+				return (limit < time_max) ? limit : time_max;
+			}
+		}
+		return time_max;
+	}
+
+	inline uint64_t p50 () const { return percentile (0.50); }
+	inline uint64_t p99 () const { return percentile (0.99); }
+
+	/** Mean time per transfer in nanoseconds.
+	 */
+	inline uint64_t mean () const { return transfers ? time_total / transfers : 0; }
+};
+
+#endif /* ! RPI2C_STATS_HH */
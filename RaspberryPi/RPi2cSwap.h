@@ -0,0 +1,95 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_SWAP_HH
+#define RPI2C_SWAP_HH
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RPI2C_SWAP_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define RPI2C_SWAP_SSE2 1
+#endif
+
+/* Whether 16-bit words in memory are least-significant-byte first, i.e., need no conversion for LSB-first devices
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define RPI2C_HOST_LSB_1ST false
+#else
+#define RPI2C_HOST_LSB_1ST true
+#endif
+
+/** Swap the bytes of each of a block of 16-bit words, in place.
+ *
+ * Eight words at a time with NEON or SSE2 where available, then __builtin_bswap16 for the rest.
+ */
+static inline void rpi2c_bswap16 (uint16_t * words, unsigned count)
+{
+	unsigned iw = 0;
+
+#if defined(RPI2C_SWAP_NEON)
+	for ( ; iw + 8 <= count; iw += 8) {
+		uint8_t * bytes = reinterpret_cast<uint8_t *>(words + iw);
+		vst1q_u8 (bytes, vrev16q_u8 (vld1q_u8 (bytes)));
+	}
+#elif defined(RPI2C_SWAP_SSE2)
+	for ( ; iw + 8 <= count; iw += 8) {
+		__m128i * block = reinterpret_cast<__m128i *>(words + iw);
+		__m128i   w = _mm_loadu_si128 (block);
+		_mm_storeu_si128 (block, _mm_or_si128 (_mm_slli_epi16 (w, 8), _mm_srli_epi16 (w, 8)));
+	}
+#endif
+	for ( ; iw < count; iw++) {
+		words[iw] = __builtin_bswap16 (words[iw]);
+	}
+}
+
+/** Copy a block of 16-bit words to a byte buffer (which need not be aligned), swapping the bytes of each.
+ */
+static inline void rpi2c_bswap16_copy (uint8_t * bytes, const uint16_t * words, unsigned count)
+{
+	unsigned iw = 0;
+
+#if defined(RPI2C_SWAP_NEON)
+	for ( ; iw + 8 <= count; iw += 8) {
+		vst1q_u8 (bytes + 2 * iw, vrev16q_u8 (vld1q_u8 (reinterpret_cast<const uint8_t *>(words + iw))));
+	}
+#elif defined(RPI2C_SWAP_SSE2)
+	for ( ; iw + 8 <= count; iw += 8) {
+		__m128i w = _mm_loadu_si128 (reinterpret_cast<const __m128i *>(words + iw));
+		_mm_storeu_si128 (reinterpret_cast<__m128i *>(bytes + 2 * iw), _mm_or_si128 (_mm_slli_epi16 (w, 8), _mm_srli_epi16 (w, 8)));
+	}
+#endif
+	for ( ; iw < count; iw++) {
+		uint16_t w = __builtin_bswap16 (words[iw]);
+		memcpy (bytes + 2 * iw, &w, 2);
+	}
+}
+
+#endif /* ! RPI2C_SWAP_HH */
@@ -0,0 +1,383 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "RPi2c.h"
+#include "RPi2cTrace.h"
+#include "RPi2cTransaction.h"
+
+static const char * s_error_none    = "RPi2cTrace: no error";
+static const char * s_error_open    = "RPi2cTrace::start: error: Unable to open trace file.";
+static const char * s_error_write   = "RPi2cTrace::start: error: Unable to write trace file.";
+static const char * s_error_thread  = "RPi2cTrace::start: error: Unable to create drain thread.";
+
+static const char * s_error = s_error_none;
+
+/* Bounded multi-producer ring: each slot has a sequence number, so producers claim slots by advancing the head with
+ * compare-and-swap and publish them by advancing the slot's sequence; the drain thread is the only consumer.
+ */
+static struct {
+	unsigned         sequence;
+	RPi2cTraceRecord record;
+} s_slot[RPI2C_TRACE_SIZE];
+
+static unsigned      s_head __attribute__ ((aligned (64))) = 0; // next slot to claim; producers
+static unsigned      s_tail __attribute__ ((aligned (64))) = 0; // next slot to drain; consumer only
+
+static unsigned long s_recordCount  = 0;
+static unsigned long s_droppedCount = 0;
+
+static unsigned      s_inFlight = 0; // producers inside record(); stop() waits for none before the ring can be reset
+
+static pthread_mutex_t s_control = PTHREAD_MUTEX_INITIALIZER; // serializes start() & stop()
+
+static FILE *    s_file = 0;
+static pthread_t s_thread;
+static bool      s_bRunning = false;
+static bool      s_bStopping = false;
+static bool      s_bAtExit = false;
+
+static void s_stop_at_exit ()
+{
+	RPi2cTrace::stop ();
+}
+
+bool RPi2cTrace::s_bEnabled = false;
+
+static bool s_push (const RPi2cTraceRecord & record)
+{
+	unsigned head = __atomic_load_n (&s_head, __ATOMIC_RELAXED);
+
+	while (true) {
+		unsigned sequence = __atomic_load_n (&s_slot[head & (RPI2C_TRACE_SIZE - 1)].sequence, __ATOMIC_ACQUIRE);
+
+		int diff = static_cast<int>(sequence - head);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n (&s_head, &head, head + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			} // else head has been updated; try again
+		} else if (diff < 0) {
+			return false; // full
+		} else {
+			head = __atomic_load_n (&s_head, __ATOMIC_RELAXED);
+		}
+	}
+	s_slot[head & (RPI2C_TRACE_SIZE - 1)].record = record;
+
+	__atomic_store_n (&s_slot[head & (RPI2C_TRACE_SIZE - 1)].sequence, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+static bool s_pop (RPi2cTraceRecord & record)
+{
+	unsigned tail = s_tail;
+	unsigned sequence = __atomic_load_n (&s_slot[tail & (RPI2C_TRACE_SIZE - 1)].sequence, __ATOMIC_ACQUIRE);
+
+	if (static_cast<int>(sequence - (tail + 1)) < 0) {
+		return false; // empty, or the next slot is still being written
+	}
+	record = s_slot[tail & (RPI2C_TRACE_SIZE - 1)].record;
+
+	__atomic_store_n (&s_slot[tail & (RPI2C_TRACE_SIZE - 1)].sequence, tail + RPI2C_TRACE_SIZE, __ATOMIC_RELEASE);
+	s_tail = tail + 1;
+	return true;
+}
+
+static void s_drain ()
+{
+	RPi2cTraceRecord record[64];
+
+	while (true) {
+		int count = 0;
+
+		while (count < 64 && s_pop (record[count])) {
+			++count;
+		}
+		if (!count) {
+			break;
+		}
+		fwrite (record, sizeof (RPi2cTraceRecord), count, s_file);
+	}
+	fflush (s_file);
+}
+
+static void * s_drain_thread (void * /* arg */)
+{
+	while (!__atomic_load_n (&s_bStopping, __ATOMIC_ACQUIRE)) {
+		s_drain ();
+
+		struct timespec ts = { 0, RPI2C_TRACE_DRAIN_US * 1000L };
+		while (nanosleep (&ts, &ts) < 0 && errno == EINTR) {
+			// interrupted; sleep for the rest
+		}
+	}
+	s_drain ();
+
+	return 0;
+}
+
+static uint32_t s_fnv1a (uint32_t hash, const uint8_t * bytes, unsigned byte_count)
+{
+	for (unsigned i = 0; i < byte_count; i++) {
+		hash = (hash ^ bytes[i]) * 16777619U;
+	}
+	return hash;
+}
+
+bool RPi2cTrace::start (const char * filename)
+{
+	stop ();
+
+	pthread_mutex_lock (&s_control);
+
+	s_error = s_error_none;
+
+	s_file = fopen (filename, "wb");
+
+	if (!s_file) {
+		s_error = s_error_open;
+	} else {
+		RPi2cTraceHeader header;
+
+		memcpy (header.magic, RPI2C_TRACE_MAGIC, sizeof (header.magic));
+		header.version     = RPI2C_TRACE_VERSION;
+		header.record_size = sizeof (RPi2cTraceRecord);
+
+		if (fwrite (&header, sizeof (header), 1, s_file) != 1) {
+			s_error = s_error_write;
+		} else {
+			for (unsigned s = 0; s < RPI2C_TRACE_SIZE; s++) {
+				s_slot[s].sequence = s;
+			}
+			s_head = 0;
+			s_tail = 0;
+
+			__atomic_store_n (&s_recordCount,  0, __ATOMIC_RELAXED);
+			__atomic_store_n (&s_droppedCount, 0, __ATOMIC_RELAXED);
+
+			s_bStopping = false;
+
+			if (pthread_create (&s_thread, 0, s_drain_thread, 0) == 0) {
+				s_bRunning = true;
+			} else {
+				s_error = s_error_thread;
+			}
+		}
+		if (!s_bRunning) {
+			fclose (s_file);
+			s_file = 0;
+		}
+	}
+	if (s_bRunning) {
+		if (!s_bAtExit) { // so that the last records reach the file
+			atexit (s_stop_at_exit);
+			s_bAtExit = true;
+		}
+		__atomic_store_n (&s_bEnabled, true, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock (&s_control);
+
+	return s_bRunning;
+}
+
+bool RPi2cTrace::startFromEnvironment ()
+{
+	const char * filename = getenv (RPI2C_TRACE_ENV);
+
+	if (!filename || !*filename) {
+		return true;
+	}
+	return start (filename);
+}
+
+void RPi2cTrace::stop ()
+{
+	pthread_mutex_lock (&s_control);
+
+	if (s_bRunning) {
+		__atomic_store_n (&s_bEnabled, false, __ATOMIC_SEQ_CST);
+
+		/* A producer that saw tracing enabled may still be adding a record; any that come later see it disabled
+		 */
+		while (__atomic_load_n (&s_inFlight, __ATOMIC_SEQ_CST)) {
+			sched_yield ();
+		}
+		__atomic_store_n (&s_bStopping, true, __ATOMIC_RELEASE);
+
+		pthread_join (s_thread, 0);
+
+		fclose (s_file);
+		s_file = 0;
+
+		s_bRunning = false;
+	}
+	pthread_mutex_unlock (&s_control);
+}
+
+void RPi2cTrace::setEnabled (bool bEnabled)
+{
+	pthread_mutex_lock (&s_control);
+
+	__atomic_store_n (&s_bEnabled, bEnabled && s_bRunning, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock (&s_control);
+}
+
+const char * RPi2cTrace::lastError ()
+{
+	return s_error;
+}
+
+unsigned long RPi2cTrace::recordCount ()
+{
+	return __atomic_load_n (&s_recordCount, __ATOMIC_RELAXED);
+}
+
+unsigned long RPi2cTrace::droppedCount ()
+{
+	return __atomic_load_n (&s_droppedCount, __ATOMIC_RELAXED);
+}
+
+void RPi2cTrace::record (const RPi2cRequest & request)
+{
+	__atomic_add_fetch (&s_inFlight, 1, __ATOMIC_SEQ_CST);
+
+	if (!__atomic_load_n (&s_bEnabled, __ATOMIC_SEQ_CST)) { // stopped since the caller checked
+		__atomic_sub_fetch (&s_inFlight, 1, __ATOMIC_RELEASE);
+		return;
+	}
+	RPi2cTraceRecord record;
+
+	record.timestamp        = request.stamp.start;
+	record.duration         = static_cast<uint32_t>(request.stamp.end - request.stamp.start);
+	record.digest           = 0;
+	record.status           = request.status;
+	record.device_address   = request.device_address;
+	record.register_address = request.register_address;
+	record.count            = request.count;
+	record.type             = static_cast<uint8_t>(request.type);
+	record.flags            = (request.bSpecifyRegister ? RPI2C_TRACE_FLAG_REGISTER : 0)
+							| (request.data_lsb_1st ? RPI2C_TRACE_FLAG_LSB_1ST : 0);
+	record.reserved         = 0;
+
+	/* Digest the data as it went over the bus: bytes read (status) or written (count)
+	 */
+	unsigned count = 0;
+
+	switch (request.type) {
+	case RPI2C_REQUEST_READ:
+	case RPI2C_REQUEST_READ_WORDS:
+		count = (request.status > 0) ? request.status : 0;
+		break;
+	case RPI2C_REQUEST_WRITE:
+	case RPI2C_REQUEST_WRITE_WORDS:
+		count = (request.status >= 0) ? request.count : 0;
+		break;
+	case RPI2C_REQUEST_TRANSFER:
+		record.device_address = 0;
+		record.count = static_cast<uint16_t>(static_cast<const RPi2cTransaction *>(request.data)->count ());
+		break;
+	default:
+		break;
+	}
+	if (count && request.data) {
+		uint32_t hash = 2166136261U;
+
+		if (request.type == RPI2C_REQUEST_READ || request.type == RPI2C_REQUEST_WRITE) {
+			hash = s_fnv1a (hash, static_cast<const uint8_t *>(request.data), count);
+		} else {
+			const uint16_t * words = static_cast<const uint16_t *>(request.data);
+
+			for (unsigned w = 0; w < count; w++) {
+				uint8_t bytes[2];
+
+				bytes[request.data_lsb_1st ? 0 : 1] = static_cast<uint8_t>(words[w] & 0xFF);
+				bytes[request.data_lsb_1st ? 1 : 0] = static_cast<uint8_t>(words[w] >> 8);
+
+				hash = s_fnv1a (hash, bytes, 2);
+			}
+		}
+		record.digest = hash;
+	}
+
+	if (s_push (record)) {
+		__atomic_add_fetch (&s_recordCount, 1, __ATOMIC_RELAXED);
+	} else {
+		__atomic_add_fetch (&s_droppedCount, 1, __ATOMIC_RELAXED);
+	}
+	__atomic_sub_fetch (&s_inFlight, 1, __ATOMIC_RELEASE);
+}
+
+long RPi2cTrace::dump (const char * filename, FILE * out, long max_count)
+{
+	static const char * s_type[] = { "read", "read-w", "write", "write-w", "xfer", "stop" };
+
+	FILE * in = fopen (filename, "rb");
+
+	if (!in) {
+		return -1;
+	}
+	RPi2cTraceHeader header;
+
+	if (fread (&header, sizeof (header), 1, in) != 1 || memcmp (header.magic, RPI2C_TRACE_MAGIC, sizeof (header.magic))
+		|| header.version != RPI2C_TRACE_VERSION || header.record_size != sizeof (RPi2cTraceRecord)) {
+		fclose (in);
+		return -1;
+	}
+	long count = 0;
+
+	uint64_t t0 = 0;
+
+	RPi2cTraceRecord record;
+
+	while (count != max_count && fread (&record, sizeof (record), 1, in) == 1) {
+		if (!count) {
+			t0 = record.timestamp;
+		}
+		const char * type = (record.type < sizeof (s_type) / sizeof (s_type[0])) ? s_type[record.type] : "?";
+
+		fprintf (out, "%12.3f us %8.1f us  %-7s 0x%02x", (record.timestamp - t0) * 1E-3, record.duration * 1E-3, type,
+				 static_cast<unsigned>(record.device_address));
+
+		if (record.flags & RPI2C_TRACE_FLAG_REGISTER) {
+			fprintf (out, ":0x%02x", static_cast<unsigned>(record.register_address));
+		} else {
+			fprintf (out, "     ");
+		}
+		fprintf (out, " %5u -> %5d  %08x\n", static_cast<unsigned>(record.count), static_cast<int>(record.status),
+				 static_cast<unsigned>(record.digest));
+		++count;
+	}
+	fclose (in);
+
+	return count;
+}
@@ -0,0 +1,136 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_TRACE_HH
+#define RPI2C_TRACE_HH
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Number of records the trace holds between drains; must be a power of two
+ */
+#define RPI2C_TRACE_SIZE     4096
+
+/* How often, in microseconds, the drain thread empties the trace into the file
+ */
+#define RPI2C_TRACE_DRAIN_US 10000
+
+/* The trace file is a header, then records, in host byte order
+ */
+#define RPI2C_TRACE_MAGIC    "RPi2cTRC"
+#define RPI2C_TRACE_VERSION  1
+
+/* Environment variable naming a trace file for RPi2cTrace::startFromEnvironment()
+ */
+#define RPI2C_TRACE_ENV      "RPI2C_TRACE"
+
+struct RPi2cTraceHeader {
+	char     magic[8];         // RPI2C_TRACE_MAGIC
+	uint32_t version;          // RPI2C_TRACE_VERSION
+	uint32_t record_size;      // sizeof (RPi2cTraceRecord)
+};
+
+/** One transfer, as recorded by RPi2c.
+ */
+struct RPi2cTraceRecord {
+	uint64_t timestamp;        // when the transfer started, in nanoseconds (CLOCK_MONOTONIC)
+	uint32_t duration;         // time taken, including any retries, in nanoseconds
+	uint32_t digest;           // FNV-1a hash of the data bytes transferred, as sent on the bus; 0 if none
+	int32_t  status;           // as returned by busRead(), busWrite() or busTransfer()
+	uint16_t device_address;   // 0 for busTransfer()
+	uint16_t register_address;
+	uint16_t count;            // bytes or words; operations for busTransfer()
+	uint8_t  type;             // RPi2cRequestType
+	uint8_t  flags;            // RPI2C_TRACE_FLAG_*
+	uint32_t reserved;         // 0
+};
+
+#define RPI2C_TRACE_FLAG_REGISTER 1 // the register address was specified
+#define RPI2C_TRACE_FLAG_LSB_1ST  2 // words were LSB first
+
+struct RPi2cRequest;
+
+/** Binary trace of every transfer on every bus, for Linux.
+ *
+ * Instead of formatting each transfer as text on the calling thread (as I2CDEV_SERIAL_DEBUG does), RPi2c adds a fixed-size
+ * record to a lock-free in-memory ring, which any number of threads may add to at once; a drain thread empties the ring
+ * into a file every RPI2C_TRACE_DRAIN_US. Tracing is switched on and off at run time: while off, the cost to each transfer
+ * is a single load. If the drain thread falls behind, records are dropped (and counted) rather than blocking the bus.
+ *
+ * Use dump() to print a trace file as text.
+ */
+class RPi2cTrace {
+private:
+	static bool s_bEnabled;
+
+public:
+	/** Start tracing to a file, replacing its contents; stops any trace already running. The trace is stopped at exit.
+	 *
+	 * @return false on failure - use lastError() to see why.
+	 */
+	static bool start (const char * filename);
+
+	/** Start tracing to the file named by the environment variable RPI2C_TRACE, if set.
+	 *
+	 * @return false if the variable is set but tracing failed to start.
+	 */
+	static bool startFromEnvironment ();
+
+	/** Stop tracing; the drain thread writes any records still held and the file is closed.
+	 */
+	static void stop ();
+
+	/** Pause or resume tracing without closing the file.
+	 */
+	static void setEnabled (bool bEnabled);
+
+	/** Whether transfers are being traced.
+	 */
+	static inline bool enabled () { return __atomic_load_n (&s_bEnabled, __ATOMIC_RELAXED); }
+
+	static const char * lastError ();
+
+	/** Number of records added since start().
+	 */
+	static unsigned long recordCount ();
+
+	/** Number of records dropped since start() because the ring was full.
+	 */
+	static unsigned long droppedCount ();
+
+	/** Record a completed transfer; called by RPi2c when enabled() is true, and does nothing if tracing has stopped since.
+	 */
+	static void record (const RPi2cRequest & request);
+
+	/** Print a trace file as text, one line per record.
+	 *
+	 * @param max_count Maximum number of records to print; -1 for all.
+	 *
+	 * @return Number of records printed; returns -1 if the file can't be read or isn't a trace.
+	 */
+	static long dump (const char * filename, FILE * out, long max_count = -1);
+};
+
+#endif /* ! RPI2C_TRACE_HH */
@@ -0,0 +1,144 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#include <string.h>
+
+#include "RPi2cTransaction.h"
+
+RPi2cTransaction::RPi2cTransaction ()
+{
+	clear ();
+}
+
+RPi2cTransaction::~RPi2cTransaction ()
+{
+	//
+}
+
+void RPi2cTransaction::clear ()
+{
+	m_messageCount = 0;
+	m_bufferCount = 0;
+	m_opCount = 0;
+	m_latency = 0;
+	m_stamp.start = 0;
+	m_stamp.end = 0;
+}
+
+int RPi2cTransaction::addOp (uint16_t message, uint16_t byte_count)
+{
+	m_op[m_opCount].message    = message;
+	m_op[m_opCount].byte_count = byte_count;
+	m_op[m_opCount].status     = -1;
+
+	return m_opCount++;
+}
+
+/* Returns index of operation; returns -1 if the transaction is full.
+ */
+int RPi2cTransaction::addRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes,
+							   bool bSpecifyRegister)
+{
+	if (m_opCount == RPI2C_TRANSACTION_MAXOPS) {
+		return -1;
+	}
+
+	uint16_t register_byte_count = 0;
+
+	if (bSpecifyRegister) {
+		register_byte_count = (register_address & 0xFF00) ? 2 : 1;
+	}
+
+	if (m_messageCount + (register_byte_count ? 2 : 1) > RPI2C_TRANSACTION_MAXMSGS) {
+		return -1;
+	}
+	if (m_bufferCount + register_byte_count > RPI2C_TRANSACTION_BUFLEN) {
+		return -1;
+	}
+
+	uint16_t first_message = m_messageCount;
+
+	if (register_byte_count) {
+		uint8_t * register_byte_ptr = m_buffer + m_bufferCount;
+
+		if (register_byte_count == 2) {
+			*register_byte_ptr++ = static_cast<uint8_t>((register_address >> 8) & 0x00FF);
+		}
+		*register_byte_ptr = static_cast<uint8_t>(register_address & 0x00FF);
+
+		rpi2c_message (m_message[m_messageCount++], device_address, 0, register_byte_count, m_buffer + m_bufferCount);
+
+		m_bufferCount += register_byte_count;
+	}
+	rpi2c_message (m_message[m_messageCount++], device_address, I2C_M_RD, byte_count, bytes);
+
+	return addOp (first_message, byte_count);
+}
+
+/* Returns index of operation; returns -1 if the transaction is full.
+ */
+int RPi2cTransaction::addWrite (uint16_t device_address, uint16_t register_address, uint16_t byte_count, const uint8_t * bytes,
+								bool bSpecifyRegister)
+{
+	if (m_opCount == RPI2C_TRANSACTION_MAXOPS) {
+		return -1;
+	}
+	if (m_messageCount == RPI2C_TRANSACTION_MAXMSGS) {
+		return -1;
+	}
+
+	uint16_t register_byte_count = 0;
+
+	if (bSpecifyRegister) {
+		register_byte_count = (register_address & 0xFF00) ? 2 : 1;
+	}
+
+	if (m_bufferCount + register_byte_count + byte_count > RPI2C_TRANSACTION_BUFLEN) {
+		return -1;
+	}
+
+	/* register address and data have to go out in the same message, so they are staged together
+	 */
+	uint8_t * message_ptr = m_buffer + m_bufferCount;
+	uint8_t * byte_ptr = message_ptr;
+
+	if (register_byte_count == 2) {
+		*byte_ptr++ = static_cast<uint8_t>((register_address >> 8) & 0x00FF);
+	}
+	if (register_byte_count) {
+		*byte_ptr++ = static_cast<uint8_t>(register_address & 0x00FF);
+	}
+	if (byte_count) {
+		memcpy (byte_ptr, bytes, byte_count);
+	}
+
+	uint16_t first_message = m_messageCount;
+
+	rpi2c_message (m_message[m_messageCount++], device_address, 0, register_byte_count + byte_count, message_ptr);
+
+	m_bufferCount += register_byte_count + byte_count;
+
+	return addOp (first_message, byte_count);
+}
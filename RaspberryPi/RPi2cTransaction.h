@@ -0,0 +1,179 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+#ifndef RPI2C_TRANSACTION_HH
+#define RPI2C_TRANSACTION_HH
+
+#include <stdint.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "RPi2c.h"
+
+/* Staging space for register addresses and write payloads; reads go straight into the caller's buffers.
+ */
+#define RPI2C_TRANSACTION_BUFLEN 256
+
+/* Each queued read or write uses at most two messages, and the kernel accepts at most I2C_RDWR_IOCTL_MAX_MSGS per ioctl.
+ */
+#define RPI2C_TRANSACTION_MAXMSGS I2C_RDWR_IOCTL_MAX_MSGS
+#define RPI2C_TRANSACTION_MAXOPS  I2C_RDWR_IOCTL_MAX_MSGS
+
+/** Fill in an i2c_msg.
+ *
+ * Older versions of <linux/i2c-dev.h> declare the message buffer as char *, newer ones as __u8 *; this hides the difference.
+ */
+static inline void rpi2c_message (struct i2c_msg & message, uint16_t device_address, uint16_t flags, uint16_t length, uint8_t * buffer)
+{
+	message.addr  = device_address;
+	message.flags = flags;
+	message.len   = length;
+	message.buf   = reinterpret_cast<__typeof__(message.buf)>(buffer);
+}
+
+class RPi2cTransaction {
+private:
+	struct i2c_msg m_message[RPI2C_TRANSACTION_MAXMSGS];
+	uint16_t       m_messageCount;
+
+	uint8_t        m_buffer[RPI2C_TRANSACTION_BUFLEN];
+	uint16_t       m_bufferCount;
+
+	struct {
+		uint16_t      message;      // index of first message
+		uint16_t      byte_count;   // number of data bytes to read/write
+		int           status;       // number of bytes read/written; -1 on failure
+	}              m_op[RPI2C_TRANSACTION_MAXOPS];
+	uint16_t       m_opCount;
+
+	unsigned long  m_latency;
+	RPi2cStamp     m_stamp;
+
+public:
+	/** Class constructor.
+	 *
+	 * A transaction collects reads and writes, possibly to several devices, so that RPi2c::busTransfer() can send them
+	 * to the kernel as a single I2C_RDWR ioctl with a repeated start between messages.
+	 *
+	 * @see RPi2c::busTransfer()
+	 */
+	RPi2cTransaction ();
+
+	/** Class destructor.
+	 */
+	~RPi2cTransaction ();
+
+	/** Empty the transaction so that it can be reused.
+	 */
+	void clear ();
+
+	/** Queue a read of byte-data from a device.
+	 *
+	 * The data is read directly into the caller's buffer, which must remain valid until RPi2c::busTransfer() returns.
+	 *
+	 * @param device_address   The 7-bit address of the i2c device (unmodified with read/write bit)
+	 * @param register_address Register on device to read from
+	 * @param byte_count       Number of bytes to read
+	 * @param bytes            Pointer to 8-bit byte data.
+	 * @param bSpecifyRegister Whether to specify the register address on the target device.
+	 *
+	 * @return Index of the queued operation, for use with status(); returns -1 if the transaction is full.
+	 */
+	int addRead (uint16_t device_address, uint16_t register_address, uint16_t byte_count, uint8_t * bytes,
+				 bool bSpecifyRegister = true);
+
+	/** Queue a read of byte-data from a device without first specifying the register address.
+	 *
+	 * @return Index of the queued operation, for use with status(); returns -1 if the transaction is full.
+	 */
+	inline int addReadOnly (uint16_t device_address, uint16_t byte_count, uint8_t * bytes) {
+		return addRead (device_address, 0, byte_count, bytes, false);
+	}
+
+	/** Queue a write of byte-data to a device.
+	 *
+	 * The data is copied into the transaction, so the caller's buffer may be reused immediately.
+	 *
+	 * @param device_address   The 7-bit address of the i2c device (unmodified with read/write bit)
+	 * @param register_address Register on device to write to
+	 * @param byte_count       Number of bytes to write
+	 * @param bytes            Pointer to 8-bit byte data.
+	 * @param bSpecifyRegister Whether to specify the register address on the target device.
+	 *
+	 * @return Index of the queued operation, for use with status(); returns -1 if the transaction is full.
+	 */
+	int addWrite (uint16_t device_address, uint16_t register_address, uint16_t byte_count, const uint8_t * bytes,
+				  bool bSpecifyRegister = true);
+
+	/** Queue a write of byte-data to a device without first specifying the register address.
+	 *
+	 * @return Index of the queued operation, for use with status(); returns -1 if the transaction is full.
+	 */
+	inline int addWriteOnly (uint16_t device_address, uint16_t byte_count, const uint8_t * bytes) {
+		return addWrite (device_address, 0, byte_count, bytes, false);
+	}
+
+	/** Number of queued read/write operations.
+	 */
+	inline int count () const { return m_opCount; }
+
+	/** Number of i2c messages the queued operations need.
+	 */
+	inline int messageCount () const { return m_messageCount; }
+
+	/** Result of a queued operation after RPi2c::busTransfer().
+	 *
+	 * The kernel completes or fails the whole I2C_RDWR ioctl, so either every operation succeeds or every operation fails.
+	 *
+	 * @param op Index returned by addRead() or addWrite().
+	 *
+	 * @return Number of bytes read/written; returns -1 on failure - use RPi2c::lastError() to see why.
+	 */
+	inline int status (int op) const { return (op >= 0 && op < m_opCount) ? m_op[op].status : -1; }
+
+	/** Time in microseconds from submission of the operation to its completion.
+	 *
+	 * All operations in a transaction complete together, so this is the same for every operation.
+	 *
+	 * @param op Index returned by addRead() or addWrite().
+	 */
+	inline unsigned long latency (int op) const { return (op >= 0 && op < m_opCount) ? m_latency : 0; }
+
+	/** Time in microseconds taken by the last RPi2c::busTransfer() of this transaction.
+	 */
+	inline unsigned long latency () const { return m_latency; }
+
+	/** When the last RPi2c::busTransfer() of this transaction started and completed on the bus; all operations share it.
+	 */
+	inline const RPi2cStamp & stamp () const { return m_stamp; }
+
+private:
+	int addOp (uint16_t message, uint16_t byte_count);
+
+	friend class RPi2c;
+};
+
+#endif /* ! RPI2C_TRANSACTION_HH */
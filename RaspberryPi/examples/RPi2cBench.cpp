@@ -0,0 +1,1183 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+/* Micro-benchmarks for the RPi2c bus class.
+ *
+ * Usage: RPi2cBench [--bus=/dev/i2c-1|--loopback[=delay]|--sim[=clock]] [--cycles=1000] [--stats] --batch|--read|--chunk|--async|--parallel|--schedule[=period]|--words|--smbus|--notify[=period]|--trace[=file]|--dmp [address:register:count ...]
+ *
+ *   --loopback  Use an RPi2cLoopback adapter instead of a real bus, optionally with a delay in microseconds per transfer;
+ *               the loopback devices are preset with a test pattern which is checked by --async.
+ *
+ *   --sim       Use an RPi2cSim simulated bus instead, at the specified clock rate in Hz (default 400000), with transfers
+ *               paced in real time; devices are preset as for --loopback, and the simulated bus time is reported at the end.
+ *
+ *   --stats     After the benchmarks, print the bus's per-device statistics: transfers, errors, bytes, and latency
+ *               percentiles from RPi2c::stats().
+ *
+ *   --batch  Each cycle reads a block from each listed device, once with one busRead() per device and once as a single
+ *            busTransfer(); reports ioctl calls and time per cycle for both. The default device list matches the
+ *            SensorStick (ADXL345, ITG-3200 & HMC5883L).
+ *
+ *   --read   Repeated busRead() of each listed device; reports ioctl calls and staging copies per busRead().
+ *
+ *   --chunk  Repeated busRead() of each listed device, first in RPI2C_BUFLEN chunks and then in the largest chunks the
+ *            adapter supports; reports the time per read and estimates the fixed overhead per chunk. Use a large count,
+ *            e.g., 0x68:0x74:1024 to drain an MPU-6050 FIFO.
+ *
+ *   --async  Each cycle reads from each listed device, first with blocking busRead() calls, then by submitting requests
+ *            to the bus thread and waiting on its eventfd with epoll; reports how long the caller is blocked per cycle
+ *            and the request latency.
+ *
+ *   --parallel  Two threads each read from each listed device, with RPi2c::bus() bound per thread using RPi2cScope,
+ *               first with both threads sharing one loopback bus and then with each thread on a loopback bus of its own
+ *               (found through the bus registry); reports time per cycle for both. Loopback only; use a delay to see
+ *               the effect, e.g., --loopback=100.
+ *
+ *   --schedule  Poll each listed device with RPi2cScheduler for one second, every period microseconds (default 10000),
+ *               with priority in the order listed; reports bus occupancy (at the --sim clock rate, or 100kHz), reads,
+ *               missed reads and release jitter for each. Devices that would over-subscribe the bus are refused.
+ *
+ *   --words     Repeated big-endian (MSB-first) word reads of 16, 128 and 1024 words from the first listed device, as
+ *               from a FIFO; reports words per second. Also times the byte-order conversion alone, byte by byte versus
+ *               the bulk swap that RPi2c uses.
+ *
+ *   --smbus     Repeated single-register reads of 1 byte, 2 bytes and the listed count (up to 32) from each listed device,
+ *               then the same reads taking turns between the devices, first as I2C_RDWR transfers and then as SMBus
+ *               byte-data, word-data or I2C-block commands (see RPi2c::setSMBusFast()); reports ioctl calls, SMBus
+ *               commands and time per read for both.
+ *
+ *   --notify    Data-ready every period microseconds (default 5000) for one second, from a thread standing in for a
+ *               device's interrupt pin, with the first listed device read on each; first by spinning on the bus, as a
+ *               loop on getFIFOCount() would, then by sleeping in RPi2cNotifier::wait() on a fake event source;
+ *               reports samples, CPU time of the reading thread, and the delay from data-ready to the read.
+ *
+ *   --trace     Repeated busRead() of each listed device, first untraced and then with RPi2cTrace recording every transfer
+ *               to a file (default RPi2cBench.trace); reports time per read for both, and records written and dropped,
+ *               then prints the first few records of the file.
+ *
+ *   --dmp       DMP packets through a simulated MPU-6050 FIFO, 24 at a time (on a bus of its own, at the --sim clock rate),
+ *               first read and decoded a packet at a time, as the MotionApps examples do, then drained and decoded in
+ *               batches by MPU6050::processDMPPackets(); reports transfers and bus time per packet, and packets per second
+ *               that the bus and the CPU could handle.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#include "RPi2c.h"
+#include "RPi2cLoopback.h"
+#include "RPi2cNotifier.h"
+#include "RPi2cScheduler.h"
+#include "RPi2cSim.h"
+#include "RPi2cSwap.h"
+#include "RPi2cTrace.h"
+#include "RPi2cTransaction.h"
+
+#include "MPU6050/MPU6050_6Axis_MotionApps20.h"
+
+#define BENCH_MAX_DEVICES 16
+#define BENCH_MAX_BYTES   1024
+
+struct bench_device {
+	uint16_t device_address;
+	uint16_t register_address;
+	uint16_t byte_count;
+	uint8_t  bytes[BENCH_MAX_BYTES];
+};
+
+static double elapsed_us (const struct timespec & t0, const struct timespec & t1)
+{
+	return (t1.tv_sec - t0.tv_sec) * 1E6 + (t1.tv_nsec - t0.tv_nsec) * 1E-3;
+}
+
+static void report (const char * label, RPi2c & i2c, long cycles, const struct timespec & t0, const struct timespec & t1)
+{
+	fprintf (stdout, "%-12s %8.2f ioctl/cycle %8.2f copies/cycle %10.1f us/cycle\n",
+			 label, (double) i2c.ioctlCount () / cycles, (double) i2c.copyCount () / cycles, elapsed_us (t0, t1) / cycles);
+}
+
+static int bench_batch (RPi2c & i2c, long cycles, struct bench_device * device, int device_count)
+{
+	struct timespec t0;
+	struct timespec t1;
+
+	/* one busRead() per device per cycle
+	 */
+	i2c.resetCounts ();
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+
+	for (long c = 0; c < cycles; c++) {
+		for (int d = 0; d < device_count; d++) {
+			if (i2c.busRead (device[d].device_address, device[d].register_address, device[d].byte_count, device[d].bytes) < 0) {
+				fprintf (stderr, "RPi2cBench: busRead: %s\n", i2c.lastError ());
+				return -1;
+			}
+		}
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	report ("per-call", i2c, cycles, t0, t1);
+
+	/* one busTransfer() per cycle
+	 */
+	RPi2cTransaction transaction;
+
+	for (int d = 0; d < device_count; d++) {
+		if (transaction.addRead (device[d].device_address, device[d].register_address, device[d].byte_count, device[d].bytes) < 0) {
+			fprintf (stderr, "RPi2cBench: too many devices for one transaction\n");
+			return -1;
+		}
+	}
+
+	unsigned long latency_max = 0;
+
+	i2c.resetCounts ();
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+
+	for (long c = 0; c < cycles; c++) {
+		if (!i2c.busTransfer (transaction)) {
+			fprintf (stderr, "RPi2cBench: busTransfer: %s\n", i2c.lastError ());
+			return -1;
+		}
+		if (latency_max < transaction.latency ())
+			latency_max = transaction.latency ();
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	report ("transaction", i2c, cycles, t0, t1);
+
+	fprintf (stdout, "transaction: %d operations in %d messages; max. latency %lu us\n",
+			 transaction.count (), transaction.messageCount (), latency_max);
+	return 0;
+}
+
+static int bench_read (RPi2c & i2c, long cycles, struct bench_device * device, int device_count)
+{
+	struct timespec t0;
+	struct timespec t1;
+
+	for (int d = 0; d < device_count; d++) {
+		i2c.resetCounts ();
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+
+		for (long c = 0; c < cycles; c++) {
+			if (i2c.busRead (device[d].device_address, device[d].register_address, device[d].byte_count, device[d].bytes) < 0) {
+				fprintf (stderr, "RPi2cBench: busRead: %s\n", i2c.lastError ());
+				return -1;
+			}
+		}
+
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+
+		char label[32];
+		snprintf (label, sizeof (label), "0x%02x:%u", (unsigned) device[d].device_address, (unsigned) device[d].byte_count);
+		report (label, i2c, cycles, t0, t1);
+	}
+	return 0;
+}
+
+static int bench_trace_run (const char * label, RPi2c & i2c, long cycles, struct bench_device * device, int device_count)
+{
+	struct timespec t0;
+	struct timespec t1;
+
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+
+	for (long c = 0; c < cycles; c++) {
+		for (int d = 0; d < device_count; d++) {
+			if (i2c.busRead (device[d].device_address, device[d].register_address, device[d].byte_count, device[d].bytes) < 0) {
+				fprintf (stderr, "RPi2cBench: busRead: %s\n", i2c.lastError ());
+				return -1;
+			}
+		}
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+
+	fprintf (stdout, "%-12s %10.2f us/read\n", label, elapsed_us (t0, t1) / (cycles * device_count));
+	return 0;
+}
+
+static int bench_trace (RPi2c & i2c, long cycles, struct bench_device * device, int device_count, const char * filename)
+{
+	if (bench_trace_run ("untraced", i2c, cycles, device, device_count) < 0) {
+		return -1;
+	}
+	if (!RPi2cTrace::start (filename)) {
+		fprintf (stderr, "RPi2cBench: %s\n", RPi2cTrace::lastError ());
+		return -1;
+	}
+	if (bench_trace_run ("traced", i2c, cycles, device, device_count) < 0) {
+		return -1;
+	}
+	unsigned long records = RPi2cTrace::recordCount ();
+	unsigned long dropped = RPi2cTrace::droppedCount ();
+
+	RPi2cTrace::stop ();
+
+	fprintf (stdout, "%lu records written to %s, %lu dropped; the first few:\n", records, filename, dropped);
+
+	return (RPi2cTrace::dump (filename, stdout, 5) < 0) ? -1 : 0;
+}
+
+static int bench_chunk (RPi2c & i2c, long cycles, struct bench_device * device, int device_count)
+{
+	struct timespec t0;
+	struct timespec t1;
+
+	fprintf (stdout, "adapter: functionality 0x%08lx, %s, chunk size %u bytes\n",
+			 i2c.functionality (), i2c.isSMBus () ? "SMBus only" : "I2C", (unsigned) i2c.chunkSize ());
+
+	for (int d = 0; d < device_count; d++) {
+		double us[2];
+		double chunks[2];
+
+		for (int pass = 0; pass < 2; pass++) {
+			i2c.setChunkSize (pass ? 0 : RPI2C_BUFLEN);
+			i2c.resetCounts ();
+			clock_gettime (CLOCK_MONOTONIC, &t0);
+
+			for (long c = 0; c < cycles; c++) {
+				if (i2c.busRead (device[d].device_address, device[d].register_address, device[d].byte_count, device[d].bytes) < 0) {
+					fprintf (stderr, "RPi2cBench: busRead: %s\n", i2c.lastError ());
+					i2c.setChunkSize (0);
+					return -1;
+				}
+			}
+
+			clock_gettime (CLOCK_MONOTONIC, &t1);
+
+			us[pass] = elapsed_us (t0, t1) / cycles;
+			chunks[pass] = (double) i2c.ioctlCount () / cycles;
+
+			fprintf (stdout, "0x%02x:%-5u chunk %4u: %8.2f chunks/read %10.1f us/read %8.3f MB/s\n",
+					 (unsigned) device[d].device_address, (unsigned) device[d].byte_count, (unsigned) i2c.chunkSize (),
+					 chunks[pass], us[pass], device[d].byte_count / us[pass]);
+		}
+		if (chunks[0] > chunks[1]) {
+			fprintf (stdout, "0x%02x:%-5u overhead per chunk: %.1f us\n",
+					 (unsigned) device[d].device_address, (unsigned) device[d].byte_count, (us[0] - us[1]) / (chunks[0] - chunks[1]));
+		}
+	}
+	return 0;
+}
+
+static bool check_pattern (struct bench_device & device, uint8_t * bytes)
+{
+	for (int ib = 0; ib < device.byte_count; ib++) {
+		if (bytes[ib] != static_cast<uint8_t>(device.device_address + device.register_address + ib)) {
+			fprintf (stderr, "RPi2cBench: data mismatch reading device 0x%02x\n", (unsigned) device.device_address);
+			return false;
+		}
+	}
+	return true;
+}
+
+static int bench_async (RPi2c & i2c, long cycles, struct bench_device * device, int device_count, bool bCheck)
+{
+	struct timespec t0;
+	struct timespec t1;
+
+	/* blocking: the caller waits for every read
+	 */
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+
+	for (long c = 0; c < cycles; c++) {
+		for (int d = 0; d < device_count; d++) {
+			if (i2c.busRead (device[d].device_address, device[d].register_address, device[d].byte_count, device[d].bytes) < 0) {
+				fprintf (stderr, "RPi2cBench: busRead: %s\n", i2c.lastError ());
+				return -1;
+			}
+			if (bCheck && !check_pattern (device[d], device[d].bytes))
+				return -1;
+		}
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	fprintf (stdout, "%-12s %10.1f us/cycle blocked\n", "blocking", elapsed_us (t0, t1) / cycles);
+
+	/* asynchronous: the caller only submits and collects
+	 */
+	if (!i2c.asyncStart ()) {
+		fprintf (stderr, "RPi2cBench: asyncStart: %s\n", i2c.lastError ());
+		return -1;
+	}
+
+	int epfd = epoll_create1 (0);
+
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.fd = i2c.asyncEventFD ();
+	epoll_ctl (epfd, EPOLL_CTL_ADD, i2c.asyncEventFD (), &event);
+
+	static uint8_t bytes[BENCH_MAX_DEVICES][BENCH_MAX_BYTES];
+
+	double blocked = 0;
+	double latency_sum = 0;
+
+	unsigned long latency_max = 0;
+
+	int status = 0;
+
+	for (long c = 0; c < cycles && status == 0; c++) {
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+
+		for (int d = 0; d < device_count; d++) {
+			RPi2cRequest request;
+
+			memset (&request, 0, sizeof (request));
+			request.type             = RPI2C_REQUEST_READ;
+			request.device_address   = device[d].device_address;
+			request.register_address = device[d].register_address;
+			request.count            = device[d].byte_count;
+			request.bSpecifyRegister = true;
+			request.data             = bytes[d];
+			request.user             = &device[d];
+
+			if (!i2c.asyncSubmit (request)) {
+				fprintf (stderr, "RPi2cBench: asyncSubmit: queue full\n");
+				status = -1;
+				break;
+			}
+		}
+
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		blocked += elapsed_us (t0, t1);
+
+		/* the caller is free to do other work here; this one just waits
+		 */
+		int outstanding = device_count;
+
+		while (outstanding && status == 0) {
+			struct epoll_event ready;
+
+			if (epoll_wait (epfd, &ready, 1, 1000) < 1) {
+				fprintf (stderr, "RPi2cBench: timed out waiting for completion\n");
+				status = -1;
+				break;
+			}
+
+			RPi2cRequest request;
+
+			while (i2c.asyncComplete (request)) {
+				--outstanding;
+
+				if (request.status < 0) {
+					fprintf (stderr, "RPi2cBench: async read: %s\n", request.error);
+					status = -1;
+				} else if (bCheck && !check_pattern (*static_cast<struct bench_device *>(request.user), static_cast<uint8_t *>(request.data))) {
+					status = -1;
+				}
+				latency_sum += request.latency;
+				if (latency_max < request.latency)
+					latency_max = request.latency;
+			}
+		}
+	}
+
+	close (epfd);
+	i2c.asyncStop ();
+
+	if (status == 0) {
+		fprintf (stdout, "%-12s %10.1f us/cycle blocked; latency %.1f us mean, %lu us max\n",
+				 "async", blocked / cycles, latency_sum / (cycles * device_count), latency_max);
+	}
+	return status;
+}
+
+static void print_stats_line (const char * label, const RPi2cDeviceStats & stats)
+{
+	fprintf (stdout, "%-8s %10lu %8lu %12llu %10.1f %10.1f %10.1f %10.1f\n", label, stats.transfers, stats.errors,
+			 (unsigned long long) stats.bytes, stats.mean () * 1E-3, stats.p50 () * 1E-3, stats.p99 () * 1E-3, stats.time_max * 1E-3);
+}
+
+static void print_stats (RPi2c & i2c)
+{
+	fprintf (stdout, "\n* * * Stats (times in us)\n%-8s %10s %8s %12s %10s %10s %10s %10s\n",
+			 "device", "transfers", "errors", "bytes", "mean", "p50", "p99", "max");
+
+	uint16_t address[128];
+
+	int count = i2c.statsDevices (address, 128);
+
+	RPi2cDeviceStats stats;
+
+	for (int d = 0; d < count; d++) {
+		if (i2c.stats (address[d], stats)) {
+			char label[8];
+			snprintf (label, sizeof (label), "0x%02x", (unsigned) address[d]);
+			print_stats_line (label, stats);
+		}
+	}
+	i2c.statsBus (stats);
+	print_stats_line ("bus", stats);
+}
+
+static int bench_schedule (RPi2c & i2c, unsigned long clock_hz, unsigned long period, struct bench_device * device, int device_count)
+{
+	RPi2cScheduler scheduler (i2c, clock_hz);
+
+	int poll[BENCH_MAX_DEVICES];
+
+	for (int d = 0; d < device_count; d++) {
+		poll[d] = scheduler.addPoll (device[d].device_address, device[d].register_address, device[d].byte_count, period, device_count - d, 0);
+
+		if (poll[d] < 0) {
+			fprintf (stdout, "0x%02x:%-5u refused: %s\n", (unsigned) device[d].device_address, (unsigned) device[d].byte_count, scheduler.lastError ());
+		}
+	}
+	fprintf (stdout, "bus occupancy %.1f%% at %lu Hz\n", scheduler.occupancy () * 100, clock_hz);
+
+	scheduler.run (1000000);
+
+	fprintf (stdout, "%-12s %8s %8s %8s %10s %10s %10s\n", "device", "reads", "errors", "missed", "jitter p50", "p99", "max (us)");
+
+	for (int d = 0; d < device_count; d++) {
+		if (poll[d] < 0) continue;
+
+		const RPi2cDeviceStats & jitter = scheduler.jitter (poll[d]);
+
+		char label[32];
+		snprintf (label, sizeof (label), "0x%02x:%u", (unsigned) device[d].device_address, (unsigned) device[d].byte_count);
+
+		fprintf (stdout, "%-12s %8lu %8lu %8lu %10.1f %10.1f %10.1f\n", label, scheduler.count (poll[d]), scheduler.errors (poll[d]),
+				 scheduler.missed (poll[d]), jitter.p50 () * 1E-3, jitter.p99 () * 1E-3, jitter.time_max * 1E-3);
+	}
+	return 0;
+}
+
+static int bench_words (RPi2c & i2c, long cycles, struct bench_device & device)
+{
+	static uint16_t words[1024];
+	static uint16_t check[1024];
+	static uint8_t  bytes[2048];
+
+	static const uint16_t word_counts[3] = { 16, 128, 1024 };
+
+	struct timespec t0;
+	struct timespec t1;
+
+	for (int w = 0; w < 3; w++) {
+		i2c.resetCounts ();
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+
+		for (long c = 0; c < cycles; c++) {
+			if (i2c.busRead (device.device_address, device.register_address, word_counts[w], words, false /* MSB first */) < 0) {
+				fprintf (stderr, "RPi2cBench: busRead: %s\n", i2c.lastError ());
+				return -1;
+			}
+		}
+
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+
+		char label[32];
+		snprintf (label, sizeof (label), "%u words", (unsigned) word_counts[w]);
+
+		double us = elapsed_us (t0, t1);
+
+		fprintf (stdout, "%-12s %8.2f ioctl/read %10.1f us/read %12.0f words/s\n",
+				 label, (double) i2c.ioctlCount () / cycles, us / cycles, word_counts[w] * cycles / (us * 1E-6));
+	}
+
+	/* Conversion alone, 1024 words at a time: the former byte-by-byte loop, then the bulk swap
+	 */
+	long repeats = 10000;
+
+	for (int ib = 0; ib < 2048; ib++) {
+		bytes[ib] = static_cast<uint8_t>(ib);
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+
+	for (long r = 0; r < repeats; r++) {
+		const uint8_t * byte = bytes;
+
+		for (int iw = 0; iw < 1024; iw++) {
+			words[iw]  = static_cast<uint16_t>(*byte++) << 8;
+			words[iw] |= static_cast<uint16_t>(*byte++);
+		}
+		__asm__ __volatile__ ("" : : "r" (words) : "memory"); // keep the loop
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+
+	memcpy (check, words, sizeof (check));
+
+	fprintf (stdout, "%-12s %10.3f ns/word\n", "per-byte", elapsed_us (t0, t1) * 1E3 / (repeats * 1024.0));
+
+	memcpy (words, bytes, 2048); // as read from the bus, straight into the words
+
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+
+	for (long r = 0; r < repeats; r++) {
+		rpi2c_bswap16 (words, 1024); // in place, so alternately swapped and not; the cost is the same
+		__asm__ __volatile__ ("" : : "r" (words) : "memory");
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+
+	memcpy (words, bytes, 2048);
+	rpi2c_bswap16 (words, 1024);
+
+	fprintf (stdout, "%-12s %10.3f ns/word%s\n", "bulk", elapsed_us (t0, t1) * 1E3 / (repeats * 1024.0),
+			 memcmp (check, words, sizeof (check)) ? " - MISMATCH" : "");
+
+	return 0;
+}
+
+struct bench_dmp_sum {
+	long packets;
+	long checksum;
+};
+
+static void bench_dmp_consume (const MPU6050DMPPackets * packets, uint16_t i, void * context)
+{
+	struct bench_dmp_sum * sum = static_cast<struct bench_dmp_sum *>(context);
+
+	sum->checksum += packets->quaternion[0][i] + packets->gyro[2][i] + packets->accel[1][i];
+	sum->packets++;
+}
+
+static int bench_dmp (unsigned long clock_hz, long cycles)
+{
+	static const int packets_per_cycle = 24; // as many 42-byte packets as fit in the 1024-byte FIFO
+
+	RPi2cSim sim (clock_hz); // unpaced, so that the time is CPU time; bus time is simulated
+
+	RPi2cSimFIFO model (MPU6050_RA_FIFO_R_W, MPU6050_RA_FIFO_COUNTH, MPU6050_RA_INT_STATUS, 1 << MPU6050_INTERRUPT_FIFO_OFLOW_BIT, MPU6050_FIFO_SIZE);
+	model.setResetBits (MPU6050_RA_USER_CTRL, 1 << MPU6050_USERCTRL_FIFO_RESET_BIT);
+
+	sim.attach (MPU6050_DEFAULT_ADDRESS, &model);
+
+	RPi2c i2c;
+	i2c.busOpen (&sim);
+
+	RPi2cScope scope(&i2c);
+
+	MPU6050 mpu;
+
+	uint8_t packet[42];
+
+	for (int ib = 0; ib < 42; ib++) {
+		packet[ib] = static_cast<uint8_t>(ib * 13);
+	}
+
+	long checksum[2];
+
+	for (int bPipeline = 0; bPipeline < 2; bPipeline++) {
+		MPU6050DMPPipeline pipeline;
+
+		struct bench_dmp_sum sum = { 0, 0 };
+
+		if (bPipeline) {
+			mpu.dmpSetPipeline (&pipeline);
+			pipeline.addConsumer (bench_dmp_consume, &sum);
+		}
+
+		unsigned long transfers = sim.transferCount ();
+		uint64_t      bus_time  = sim.busTime ();
+
+		struct timespec t0;
+		struct timespec t1;
+
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+
+		for (long c = 0; c < cycles; c++) {
+			for (int p = 0; p < packets_per_cycle; p++) {
+				model.push (packet, sizeof (packet));
+			}
+			if (bPipeline) {
+				mpu.processDMPPackets ();
+			} else { // as the MotionApps examples do, a packet at a time
+				uint8_t  buffer[42];
+				int16_t  q[4];
+				int16_t  g[3];
+				int16_t  a[3];
+
+				while (mpu.getFIFOCount () >= 42) {
+					mpu.getFIFOBytes (buffer, 42);
+					mpu.dmpGetQuaternion (q, buffer);
+					mpu.dmpGetGyro (g, buffer);
+					mpu.dmpGetAccel (a, buffer);
+
+					sum.checksum += q[0] + g[2] + a[1];
+					sum.packets++;
+				}
+			}
+		}
+
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+
+		mpu.dmpSetPipeline (0);
+
+		checksum[bPipeline] = sum.checksum;
+
+		double packets = static_cast<double>(sum.packets);
+		double bus_us  = (sim.busTime () - bus_time) * 1E-3;
+
+		fprintf (stdout, "%-12s %8.2f transfers/packet %8.1f us bus time/packet (%6.0f packets/s at %lu Hz) %10.0f packets/s CPU\n",
+				 bPipeline ? "pipeline" : "per packet", (sim.transferCount () - transfers) / packets, bus_us / packets,
+				 packets / (bus_us * 1E-6), clock_hz, packets / (elapsed_us (t0, t1) * 1E-6));
+
+		if (sum.packets != cycles * packets_per_cycle) {
+			fprintf (stderr, "RPi2cBench: %ld packets processed; expected %ld\n", sum.packets, cycles * packets_per_cycle);
+			return -1;
+		}
+	}
+	if (checksum[0] != checksum[1]) {
+		fprintf (stderr, "RPi2cBench: decoded packets differ\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int bench_smbus_run (RPi2c & i2c, long cycles, struct bench_device * device, int device_count, uint16_t byte_count, bool bTurns)
+{
+	struct timespec t0;
+	struct timespec t1;
+
+	static const char * path[2] = { "I2C_RDWR", "SMBus" };
+
+	for (int p = 0; p < 2; p++) {
+		i2c.setSMBusFast (p ? RPI2C_BUFLEN : 0);
+
+		long reads = 0;
+
+		i2c.resetCounts ();
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+
+		for (int d = 0; d < (bTurns ? 1 : device_count); d++) {
+			for (long c = 0; c < cycles; c++) {
+				for (int dt = (bTurns ? 0 : d); dt < (bTurns ? device_count : d + 1); dt++) {
+					uint16_t count = byte_count ? byte_count : device[dt].byte_count;
+
+					if (count > RPI2C_BUFLEN) {
+						count = RPI2C_BUFLEN;
+					}
+					if (i2c.busRead (device[dt].device_address, device[dt].register_address, count, device[dt].bytes) < 0) {
+						fprintf (stderr, "RPi2cBench: busRead: %s\n", i2c.lastError ());
+						return -1;
+					}
+					++reads;
+				}
+			}
+		}
+
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+
+		char label[32];
+		if (byte_count) {
+			snprintf (label, sizeof (label), "%s %u", bTurns ? "turns" : "same", (unsigned) byte_count);
+		} else {
+			snprintf (label, sizeof (label), "%s N", bTurns ? "turns" : "same");
+		}
+
+		fprintf (stdout, "%-12s %-8s %8.2f ioctl/read %8.2f smbus/read %10.2f us/read\n", label, path[p],
+				 (double) i2c.ioctlCount () / reads, (double) i2c.smbusCount () / reads, elapsed_us (t0, t1) / reads);
+	}
+	i2c.setSMBusFast (RPI2C_SMBUS_FAST);
+
+	return 0;
+}
+
+static int bench_smbus (RPi2c & i2c, long cycles, struct bench_device * device, int device_count)
+{
+	static const uint16_t byte_counts[3] = { 1, 2, 0 /* as listed */ };
+
+	for (int t = 0; t < 2; t++) {
+		for (int b = 0; b < 3; b++) {
+			if (bench_smbus_run (i2c, cycles, device, device_count, byte_counts[b], t == 1) < 0)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+struct bench_ready {
+	RPi2cNotifier * notifier;     // 0 to flag data-ready in memory, for spinning on
+	unsigned long   period;       // in microseconds
+	uint64_t        end;
+	uint64_t        ready;        // time of the last data-ready
+	unsigned long   count;
+};
+
+static void * bench_ready_thread (void * arg)
+{
+	struct bench_ready * ready = static_cast<struct bench_ready *>(arg);
+
+	uint64_t release = RPi2cNotifier::now ();
+
+	while (true) {
+		release += static_cast<uint64_t>(ready->period) * 1000;
+
+		if (release >= ready->end) {
+			break;
+		}
+
+		struct timespec ts;
+
+		ts.tv_sec  = release / 1000000000;
+		ts.tv_nsec = release % 1000000000;
+
+		while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR) {
+			// keep sleeping
+		}
+
+		if (ready->notifier) {
+			ready->notifier->trigger (release);
+		} else {
+			__atomic_store_n (&ready->ready, release, __ATOMIC_RELEASE);
+		}
+		__atomic_add_fetch (&ready->count, 1, __ATOMIC_RELAXED);
+	}
+	return 0;
+}
+
+static uint64_t thread_cpu_ns ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static int bench_notify_run (const char * label, RPi2c & i2c, unsigned long period, struct bench_device & device, RPi2cNotifier * notifier)
+{
+	struct bench_ready ready;
+
+	ready.notifier = notifier;
+	ready.period   = period;
+	ready.end      = RPi2cNotifier::now () + 1000000000ULL;
+	ready.ready    = 0;
+	ready.count    = 0;
+
+	RPi2cDeviceStats delay;
+	delay.clear (device.device_address);
+
+	unsigned long polls = 0;
+
+	uint64_t cpu = thread_cpu_ns ();
+
+	pthread_t thread;
+
+	if (pthread_create (&thread, 0, bench_ready_thread, &ready)) {
+		fprintf (stderr, "RPi2cBench: failed to create thread\n");
+		return -1;
+	}
+
+	uint64_t last = 0;
+
+	while (RPi2cNotifier::now () < ready.end) {
+		uint64_t timestamp = 0;
+
+		if (notifier) {
+			int events = notifier->wait (10000, &timestamp);
+
+			if (events < 0) {
+				fprintf (stderr, "RPi2cBench: wait: %s\n", notifier->lastError ());
+				break;
+			}
+			if (!events) {
+				continue;
+			}
+		} else {
+			++polls; // the read below stands in for polling the device's status
+
+			timestamp = __atomic_load_n (&ready.ready, __ATOMIC_ACQUIRE);
+
+			if (timestamp == last) {
+				if (i2c.busRead (device.device_address, device.register_address, 1, device.bytes) < 0) {
+					fprintf (stderr, "RPi2cBench: busRead: %s\n", i2c.lastError ());
+					break;
+				}
+				continue;
+			}
+			last = timestamp;
+		}
+
+		if (i2c.busRead (device.device_address, device.register_address, device.byte_count, device.bytes) < 0) {
+			fprintf (stderr, "RPi2cBench: busRead: %s\n", i2c.lastError ());
+			break;
+		}
+		delay.record (RPi2cNotifier::now () - timestamp, device.byte_count, false);
+	}
+
+	cpu = thread_cpu_ns () - cpu;
+
+	pthread_join (thread, 0);
+
+	fprintf (stdout, "%-8s %6lu ready %6lu samples %10lu polls %8.1f ms CPU (%5.1f%%)   delay: p50 %8.1f us, p99 %8.1f us, max %8.1f us\n",
+			 label, ready.count, (unsigned long) delay.transfers, polls, cpu * 1E-6, cpu * 1E-7,
+			 delay.p50 () * 1E-3, delay.p99 () * 1E-3, delay.time_max * 1E-3);
+	return 0;
+}
+
+static int bench_notify (RPi2c & i2c, unsigned long period, struct bench_device & device)
+{
+	RPi2cNotifier notifier;
+
+	if (!notifier.openFake ()) {
+		fprintf (stderr, "RPi2cBench: %s\n", notifier.lastError ());
+		return -1;
+	}
+	if (bench_notify_run ("spin", i2c, period, device, 0) < 0)
+		return -1;
+	if (bench_notify_run ("notify", i2c, period, device, &notifier) < 0)
+		return -1;
+	return 0;
+}
+
+struct bench_thread {
+	RPi2c *               i2c;
+	long                  cycles;
+	struct bench_device * device;
+	int                   device_count;
+	int                   status;
+	uint8_t               bytes[BENCH_MAX_BYTES]; // each thread needs its own buffer
+};
+
+static void * bench_parallel_thread (void * arg)
+{
+	struct bench_thread * thread = reinterpret_cast<struct bench_thread *>(arg);
+
+	RPi2cScope scope(thread->i2c); // every RPi2c::bus() call in this thread now refers to thread->i2c
+
+	thread->status = 0;
+
+	for (long c = 0; c < thread->cycles; c++) {
+		for (int d = 0; d < thread->device_count; d++) {
+			if (RPi2c::bus()->busRead (thread->device[d].device_address, thread->device[d].register_address, thread->device[d].byte_count, thread->bytes) < 0) {
+				thread->status = -1;
+				return 0;
+			}
+		}
+	}
+	return 0;
+}
+
+static int bench_parallel_run (const char * label, RPi2c * bus_1, RPi2c * bus_2, long cycles, struct bench_device * device, int device_count)
+{
+	struct bench_thread thread[2];
+
+	thread[0].i2c = bus_1;
+	thread[1].i2c = bus_2;
+
+	struct timespec t0;
+	struct timespec t1;
+
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+
+	pthread_t id[2];
+
+	for (int t = 0; t < 2; t++) {
+		thread[t].cycles       = cycles;
+		thread[t].device       = device;
+		thread[t].device_count = device_count;
+
+		if (pthread_create (&id[t], 0, bench_parallel_thread, &thread[t])) {
+			fprintf (stderr, "RPi2cBench: pthread_create failed\n");
+			return -1;
+		}
+	}
+	for (int t = 0; t < 2; t++) {
+		pthread_join (id[t], 0);
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+
+	if (thread[0].status < 0 || thread[1].status < 0) {
+		fprintf (stderr, "RPi2cBench: busRead failed in thread\n");
+		return -1;
+	}
+	fprintf (stdout, "%-12s %10.1f us/cycle\n", label, elapsed_us (t0, t1) / cycles);
+	return 0;
+}
+
+static int bench_parallel (RPi2cLoopback & loopback, long cycles, struct bench_device * device, int device_count)
+{
+	RPi2cLoopback loopback_2 (loopback);
+
+	RPi2c i2c_1;
+	RPi2c i2c_2;
+
+	if (!i2c_1.busOpen (&loopback) || !i2c_2.busOpen (&loopback_2)) {
+		fprintf (stderr, "RPi2cBench: Failed to open loopback\n");
+		return -1;
+	}
+	if (!RPi2c::registerBus ("loopback-1", &i2c_1) || !RPi2c::registerBus ("loopback-2", &i2c_2)) {
+		fprintf (stderr, "RPi2cBench: Failed to register loopback\n");
+		return -1;
+	}
+
+	int status = bench_parallel_run ("shared", RPi2c::lookup ("loopback-1"), RPi2c::lookup ("loopback-1"), cycles, device, device_count);
+
+	if (status == 0) {
+		status = bench_parallel_run ("per-bus", RPi2c::lookup ("loopback-1"), RPi2c::lookup ("loopback-2"), cycles, device, device_count);
+	}
+	RPi2c::registryClear ();
+
+	return status;
+}
+
+int main (int argc, char ** argv)
+{
+	const char * bus_name = RPI2C_DEFAULT_BUS;
+
+	bool bLoopback = false;
+
+	unsigned long loopback_delay = 0;
+
+	bool bSim = false;
+
+	unsigned long sim_clock = RPI2C_SIM_FAST;
+
+	long cycles = 1000;
+
+	bool bBatch = false;
+	bool bRead  = false;
+	bool bChunk = false;
+	bool bAsync = false;
+	bool bParallel = false;
+	bool bStats = false;
+	bool bSchedule = false;
+	bool bWords = false;
+	bool bSMBus = false;
+	bool bNotify = false;
+	bool bTrace = false;
+	bool bDMP = false;
+
+	const char * trace_file = "RPi2cBench.trace";
+
+	unsigned long notify_period = 5000;
+
+	unsigned long schedule_period = 10000;
+
+	struct bench_device device[BENCH_MAX_DEVICES] = {
+		{ 0x53, 0x32, 6 }, // ADXL345 (ALT_LOW) DATAX0
+		{ 0x68, 0x1D, 6 }, // ITG-3200 (AD0_LOW) GYRO_XOUT_H
+		{ 0x1E, 0x03, 6 }  // HMC5883L DATAX_H
+	};
+	int device_count = 3;
+	int device_user  = 0;
+
+	for (int argi = 1; argi < argc; argi++) {
+		if (strncmp (argv[argi], "--bus=", 6) == 0) {
+			bus_name = argv[argi] + 6;
+		} else if (strcmp (argv[argi], "--loopback") == 0) {
+			bLoopback = true;
+		} else if (strncmp (argv[argi], "--loopback=", 11) == 0) {
+			bLoopback = true;
+			loopback_delay = atol (argv[argi] + 11);
+		} else if (strcmp (argv[argi], "--sim") == 0) {
+			bSim = true;
+		} else if (strncmp (argv[argi], "--sim=", 6) == 0) {
+			bSim = true;
+			sim_clock = atol (argv[argi] + 6);
+		} else if (strcmp (argv[argi], "--async") == 0) {
+			bAsync = true;
+		} else if (strcmp (argv[argi], "--notify") == 0) {
+			bNotify = true;
+		} else if (strncmp (argv[argi], "--notify=", 9) == 0) {
+			bNotify = true;
+			notify_period = atol (argv[argi] + 9);
+		} else if (strcmp (argv[argi], "--trace") == 0) {
+			bTrace = true;
+		} else if (strncmp (argv[argi], "--trace=", 8) == 0) {
+			bTrace = true;
+			trace_file = argv[argi] + 8;
+		} else if (strcmp (argv[argi], "--dmp") == 0) {
+			bDMP = true;
+		} else if (strcmp (argv[argi], "--smbus") == 0) {
+			bSMBus = true;
+		} else if (strcmp (argv[argi], "--words") == 0) {
+			bWords = true;
+		} else if (strcmp (argv[argi], "--schedule") == 0) {
+			bSchedule = true;
+		} else if (strncmp (argv[argi], "--schedule=", 11) == 0) {
+			bSchedule = true;
+			schedule_period = atol (argv[argi] + 11);
+		} else if (strcmp (argv[argi], "--stats") == 0) {
+			bStats = true;
+		} else if (strcmp (argv[argi], "--parallel") == 0) {
+			bParallel = true;
+		} else if (strncmp (argv[argi], "--cycles=", 9) == 0) {
+			cycles = atol (argv[argi] + 9);
+		} else if (strcmp (argv[argi], "--batch") == 0) {
+			bBatch = true;
+		} else if (strcmp (argv[argi], "--read") == 0) {
+			bRead = true;
+		} else if (strcmp (argv[argi], "--chunk") == 0) {
+			bChunk = true;
+		} else {
+			unsigned address;
+			unsigned reg;
+			unsigned count;
+
+			if (sscanf (argv[argi], "%i:%i:%i", &address, &reg, &count) != 3 || !count || count > BENCH_MAX_BYTES) {
+				fprintf (stderr, "error in argument \"%s\"!\n", argv[argi]);
+				return -1;
+			}
+			if (device_user == BENCH_MAX_DEVICES) {
+				fprintf (stderr, "error: too many devices!\n");
+				return -1;
+			}
+			device[device_user].device_address   = address;
+			device[device_user].register_address = reg;
+			device[device_user].byte_count       = count;
+			device_count = ++device_user;
+		}
+	}
+	if (cycles < 1) {
+		cycles = 1;
+	}
+	bool bBus = bBatch || bRead || bChunk || bAsync || bParallel || bSchedule || bWords || bSMBus || bNotify || bTrace;
+
+	if (!bBus && !bDMP) {
+		fprintf (stderr, "usage: RPi2cBench [--bus=%s|--loopback[=delay]|--sim[=clock]] [--cycles=N] [--stats] --batch|--read|--chunk|--async|--parallel|--schedule[=period]|--words|--smbus|--notify[=period]|--trace[=file]|--dmp [address:register:count ...]\n", RPI2C_DEFAULT_BUS);
+		return -1;
+	}
+
+	if (bDMP) { // has a bus of its own
+		fprintf (stdout, "\n* * * DMP: MPU6050 on a simulated bus at %lu Hz, %ld cycles of 24 packets\n", sim_clock, cycles);
+		if (bench_dmp (sim_clock, cycles) < 0)
+			return -1;
+	}
+	if (!bBus) {
+		return 0;
+	}
+
+	RPi2c i2c;
+
+	RPi2cLoopback loopback (loopback_delay);
+
+	RPi2cSim sim (sim_clock);
+
+	RPi2cSimDevice sim_device[BENCH_MAX_DEVICES];
+
+	if (bSim) {
+		sim.setPaced (true);
+
+		for (int d = 0; d < device_count; d++) {
+			uint8_t * memory = sim_device[d].registers ();
+
+			for (int ib = 0; ib < device[d].byte_count; ib++) {
+				memory[(device[d].register_address + ib) & 0xFF] = static_cast<uint8_t>(device[d].device_address + device[d].register_address + ib);
+			}
+			sim.attach (device[d].device_address, &sim_device[d]);
+		}
+		if (!i2c.busOpen (&sim)) {
+			fprintf (stderr, "RPi2cBench: Failed to open simulated bus, because:\n    %s\n", i2c.lastError ());
+			return -1;
+		}
+	} else if (bLoopback) {
+		for (int d = 0; d < device_count; d++) {
+			uint8_t * memory = loopback.memory (device[d].device_address);
+
+			for (int ib = 0; ib < device[d].byte_count; ib++) {
+				memory[(device[d].register_address + ib) & 0xFF] = static_cast<uint8_t>(device[d].device_address + device[d].register_address + ib);
+			}
+		}
+		if (!i2c.busOpen (&loopback)) {
+			fprintf (stderr, "RPi2cBench: Failed to open loopback, because:\n    %s\n", i2c.lastError ());
+			return -1;
+		}
+	} else if (!i2c.busOpen (bus_name)) {
+		fprintf (stderr, "RPi2cBench: Failed to open bus '%s', because:\n    %s\n", bus_name, i2c.lastError ());
+		return -1;
+	}
+
+	if (bBatch) {
+		fprintf (stdout, "\n* * * Batch: %d devices, %ld cycles\n", device_count, cycles);
+		if (bench_batch (i2c, cycles, device, device_count) < 0)
+			return -1;
+	}
+	if (bRead) {
+		fprintf (stdout, "\n* * * Read: %d devices, %ld cycles (per busRead)\n", device_count, cycles);
+		if (bench_read (i2c, cycles, device, device_count) < 0)
+			return -1;
+	}
+	if (bChunk) {
+		fprintf (stdout, "\n* * * Chunk: %d devices, %ld cycles\n", device_count, cycles);
+		if (bench_chunk (i2c, cycles, device, device_count) < 0)
+			return -1;
+	}
+	if (bAsync) {
+		fprintf (stdout, "\n* * * Async: %d devices, %ld cycles\n", device_count, cycles);
+		if (bench_async (i2c, cycles, device, device_count, bLoopback || bSim) < 0)
+			return -1;
+	}
+	if (bParallel) {
+		if (!bLoopback) {
+			fprintf (stderr, "RPi2cBench: --parallel requires --loopback\n");
+			return -1;
+		}
+		fprintf (stdout, "\n* * * Parallel: 2 threads, %d devices, %ld cycles\n", device_count, cycles);
+		if (bench_parallel (loopback, cycles, device, device_count) < 0)
+			return -1;
+	}
+	if (bNotify) {
+		if (notify_period < 100) {
+			notify_period = 100;
+		}
+		fprintf (stdout, "\n* * * Notify: device 0x%02x, data-ready every %lu us\n", (unsigned) device[0].device_address, notify_period);
+		if (bench_notify (i2c, notify_period, device[0]) < 0)
+			return -1;
+	}
+	if (bSMBus) {
+		fprintf (stdout, "\n* * * SMBus: %d devices, %ld cycles (per read; N is the listed count)\n", device_count, cycles);
+		if (bench_smbus (i2c, cycles, device, device_count) < 0)
+			return -1;
+	}
+	if (bWords) {
+		fprintf (stdout, "\n* * * Words: device 0x%02x, %ld cycles\n", (unsigned) device[0].device_address, cycles);
+		if (bench_words (i2c, cycles, device[0]) < 0)
+			return -1;
+	}
+	if (bTrace) {
+		fprintf (stdout, "\n* * * Trace: %d devices, %ld cycles\n", device_count, cycles);
+		if (bench_trace (i2c, cycles, device, device_count, trace_file) < 0)
+			return -1;
+	}
+	if (bSchedule) {
+		fprintf (stdout, "\n* * * Schedule: %d devices, every %lu us\n", device_count, schedule_period);
+		if (bench_schedule (i2c, bSim ? sim_clock : RPI2C_SCHEDULER_CLOCK, schedule_period, device, device_count) < 0)
+			return -1;
+	}
+	if (bStats) {
+		print_stats (i2c);
+	}
+	if (bSim) {
+		fprintf (stdout, "\nsimulated bus at %lu Hz: %lu transfers, %lu NACKs, %.1f us bus time\n",
+				 sim.clock (), sim.transferCount (), sim.nackCount (), sim.busTime () * 1E-3);
+	}
+	return 0;
+}
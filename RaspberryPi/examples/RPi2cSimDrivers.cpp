@@ -0,0 +1,996 @@
+/* -*- mode: C++; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* ============================================
+Copyright (c) 2014 Francis James Franklin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+===============================================
+*/
+
+/* Runs each of the device drivers built by the Makefile against a simulated bus (RPi2cSim) with a register-map model
+ * of the device, so that the drivers can be checked without hardware.
+ *
+ * Usage: RPi2cSimDrivers [--clock=400000] [--paced]
+ *
+ * Each driver gets a fresh bus with a single device model, preset with whatever the driver's testConnection() checks;
+ * the driver is initialized, tested and, where it has one, asked for a reading. The simulated bus time and number of
+ * transfers for each driver are reported, and are the same on every run. Finally a NACK is injected, and a device is
+ * removed, to check that the failures are reported, and a device is made to stall, to check that a transient stall
+ * is retried (with bus recovery) and that a hung device times out within I2Cdev's read time-out. Two drivers are given
+ * buses of their own (I2CdevOnBus) and used side by side. Typical set-ups are run with and without shadowed registers
+ * (or batched writes), which must leave the same register values. An MPU6050's interrupt status, FIFO count and FIFO
+ * data are read with one scatter-gather transfer instead of three, its FIFO is drained in whole packets, DMP packets
+ * are decoded and passed to consumers, and the DMP firmware is uploaded a bank at a time, configured in merged bursts
+ * and then found intact by a warm start. Last, a driver's traffic is captured (RPi2cCapture) and played back
+ * (RPi2cReplay) without the device model, which must give the same reading.
+ *
+ *   --clock  Bus clock rate in Hz, e.g., 100000, 400000 or 1000000.
+ *   --paced  Make each transfer take as long in real time as on a real bus.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "RPi2c.h"
+#include "RPi2cCapture.h"
+#include "RPi2cReplay.h"
+#include "RPi2cSim.h"
+
+#include "I2Cdev.h"
+
+#include "AD7746/AD7746.h"
+#include "ADS1115/ADS1115.h"
+#include "ADXL345/ADXL345.h"
+#include "AK8975/AK8975.h"
+#include "BMA150/BMA150.h"
+#include "BMP085/BMP085.h"
+#include "DS1307/DS1307.h"
+#include "HMC5843/HMC5843.h"
+#include "HMC5883L/HMC5883L.h"
+#include "IAQ2000/IAQ2000.h"
+#include "ITG3200/ITG3200.h"
+#include "L3G4200D/L3G4200D.h"
+#include "LM73/LM73.h"
+#include "MPR121/MPR121.h"
+#include "MPU6050/MPU6050_6Axis_MotionApps20.h"
+#include "SSD1308/SSD1308.h"
+#include "TCA6424A/TCA6424A.h"
+
+static bool run_AD7746 ()
+{
+	AD7746 device;
+	device.initialize ();
+	return device.testConnection ();
+}
+
+static bool run_ADS1115 ()
+{
+	ADS1115 device;
+	device.initialize ();
+	return device.testConnection ();
+}
+
+static bool run_ADXL345 ()
+{
+	ADXL345 device;
+	device.initialize ();
+	if (!device.testConnection ()) return false;
+
+	int16_t x, y, z;
+	device.getAcceleration (&x, &y, &z);
+
+	I2CdevTimestamp timestamp;
+	if (!device.getAcceleration (&x, &y, &z, &timestamp)) return false;
+	return timestamp.start && timestamp.start <= timestamp.end;
+}
+
+static bool run_AK8975 ()
+{
+	AK8975 device;
+	device.initialize ();
+	return device.testConnection ();
+}
+
+static bool run_BMA150 ()
+{
+	BMA150 device;
+	device.initialize ();
+	if (!device.testConnection ()) return false;
+
+	int16_t x, y, z;
+	device.getAcceleration (&x, &y, &z);
+	return true;
+}
+
+static bool run_BMP085 ()
+{
+	BMP085 device;
+	device.initialize ();
+	return device.testConnection ();
+}
+
+static bool run_DS1307 ()
+{
+	DS1307 device;
+	device.initialize ();
+	if (!device.testConnection ()) return false;
+
+	uint8_t hours, minutes, seconds;
+	device.getTime24 (&hours, &minutes, &seconds);
+	return true;
+}
+
+static bool run_HMC5843 ()
+{
+	HMC5843 device;
+	device.initialize ();
+	if (!device.testConnection ()) return false;
+
+	int16_t x, y, z;
+	device.getHeading (&x, &y, &z);
+	return true;
+}
+
+static bool run_HMC5883L ()
+{
+	HMC5883L device;
+	device.initialize ();
+	if (!device.testConnection ()) return false;
+
+	int16_t x, y, z;
+	device.getHeading (&x, &y, &z);
+	return true;
+}
+
+static bool run_IAQ2000 ()
+{
+	IAQ2000 device;
+	device.initialize ();
+	return device.testConnection ();
+}
+
+static bool run_ITG3200 ()
+{
+	ITG3200 device;
+	device.initialize ();
+	if (!device.testConnection ()) return false;
+
+	int16_t x, y, z;
+	device.getRotation (&x, &y, &z);
+	return true;
+}
+
+static bool run_L3G4200D ()
+{
+	L3G4200D device;
+	device.initialize ();
+	if (!device.testConnection ()) return false;
+
+	int16_t x, y, z;
+	device.getAngularVelocity (&x, &y, &z);
+	return true;
+}
+
+static bool run_LM73 ()
+{
+	LM73 device;
+	device.initialize ();
+	return device.testConnection ();
+}
+
+static bool run_MPR121 ()
+{
+	MPR121 device;
+	device.initialize ();
+	return device.testConnection ();
+}
+
+static bool run_MPU6050 ()
+{
+	MPU6050 device;
+	device.initialize ();
+	if (!device.testConnection ()) return false;
+
+	int16_t ax, ay, az, gx, gy, gz;
+	device.getMotion6 (&ax, &ay, &az, &gx, &gy, &gz);
+
+	I2CdevTimestamp timestamp;
+	if (!device.getMotion6 (&ax, &ay, &az, &gx, &gy, &gz, &timestamp)) return false;
+	return timestamp.start && timestamp.start <= timestamp.end;
+}
+
+static bool run_SSD1308 ()
+{
+	SSD1308 device;
+	device.initialize ();
+	return true; // no testConnection()
+}
+
+static bool run_TCA6424A ()
+{
+	TCA6424A device;
+	device.initialize ();
+	return device.testConnection ();
+}
+
+struct sim_driver {
+	const char * name;
+	uint16_t     device_address;
+	uint8_t      preset_register;     // preset the registers that testConnection() checks
+	uint8_t      preset_count;
+	uint8_t      preset[3];
+	bool         (*run) ();
+};
+
+static struct sim_driver s_driver[] = {
+	{ "AD7746",   AD7746_DEFAULT_ADDRESS,   AD7746_RA_STATUS,      0, { 0 },                   run_AD7746   },
+	{ "ADS1115",  ADS1115_DEFAULT_ADDRESS,  ADS1115_RA_CONVERSION, 0, { 0 },                   run_ADS1115  },
+	{ "ADXL345",  ADXL345_DEFAULT_ADDRESS,  ADXL345_RA_DEVID,      1, { 0xE5 },                run_ADXL345  },
+	{ "AK8975",   AK8975_DEFAULT_ADDRESS,   AK8975_RA_WIA,         1, { 0x48 },                run_AK8975   },
+	{ "BMA150",   BMA150_DEFAULT_ADDRESS,   BMA150_RA_CHIP_ID,     1, { 0x02 },                run_BMA150   },
+	{ "BMP085",   BMP085_DEFAULT_ADDRESS,   BMP085_RA_AC1_H,       0, { 0 },                   run_BMP085   },
+	{ "DS1307",   DS1307_DEFAULT_ADDRESS,   DS1307_RA_SECONDS,     0, { 0 },                   run_DS1307   },
+	{ "HMC5843",  HMC5843_DEFAULT_ADDRESS,  HMC5843_RA_ID_A,       3, { 'H', '4', '3' },       run_HMC5843  },
+	{ "HMC5883L", HMC5883L_DEFAULT_ADDRESS, HMC5883L_RA_ID_A,      3, { 'H', '4', '3' },       run_HMC5883L },
+	{ "IAQ2000",  IAQ2000_DEFAULT_ADDRESS,  0x00,                  2, { 0x01, 0xC2 },          run_IAQ2000  }, // 450 ppm
+	{ "ITG3200",  ITG3200_DEFAULT_ADDRESS,  ITG3200_RA_WHO_AM_I,   1, { 0x68 },                run_ITG3200  },
+	{ "L3G4200D", L3G4200D_DEFAULT_ADDRESS, L3G4200D_RA_WHO_AM_I,  1, { 0xD3 },                run_L3G4200D },
+	{ "LM73",     LM73_DEFAULT_ADDRESS,     LM73_RA_ID,            2, { 0x01, 0x90 },          run_LM73     },
+	{ "MPR121",   MPR121_DEFAULT_ADDRESS,   FILTER_CONFIG,         1, { 0x04 },                run_MPR121   },
+	{ "MPU6050",  MPU6050_DEFAULT_ADDRESS,  MPU6050_RA_WHO_AM_I,   1, { 0x68 },                run_MPU6050  },
+	{ "SSD1308",  SSD1308_DEFAULT_ADDRESS,  0x00,                  0, { 0 },                   run_SSD1308  },
+	{ "TCA6424A", TCA6424A_DEFAULT_ADDRESS, TCA6424A_RA_INPUT0,    0, { 0 },                   run_TCA6424A }
+};
+
+static const int s_driver_count = sizeof (s_driver) / sizeof (s_driver[0]);
+
+/* An I2CdevBus that passes transfers on to another but keeps no timestamps, as most buses won't
+ */
+class sim_plain_bus : public I2CdevBus {
+public:
+	sim_plain_bus (I2CdevBus * bus) : m_bus(bus) { }
+
+	virtual int16_t read (uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t * data, uint16_t timeout) {
+		return m_bus->read (devAddr, regAddr, length, data, timeout);
+	}
+	virtual bool write (uint8_t devAddr, uint8_t regAddr, uint16_t length, const uint8_t * data) {
+		return m_bus->write (devAddr, regAddr, length, data);
+	}
+	virtual int16_t transfer (uint8_t devAddr, const uint8_t * out, uint16_t outLength, uint8_t * in, uint16_t inLength, uint16_t timeout) {
+		return m_bus->transfer (devAddr, out, outLength, in, inLength, timeout);
+	}
+private:
+	I2CdevBus * m_bus;
+};
+
+/* Typical set-up sequences, which are mostly bit updates of configuration registers, or runs of register writes
+ */
+static void configure_ADXL345 (bool bShadow)
+{
+	ADXL345 device;
+	device.setShadowEnabled (bShadow);
+	device.initialize ();
+	device.setRate (ADXL345_RATE_100);
+	device.setRange (ADXL345_RANGE_4G);
+	device.setFullResolution (1);
+	device.setLowPowerEnabled (false);
+	device.setIntDataReadyEnabled (true);
+	device.setShadowEnabled (false);
+}
+
+static void configure_MPU6050 (bool bShadow)
+{
+	MPU6050 device;
+	device.setShadowEnabled (bShadow);
+	device.initialize ();
+	device.setDLPFMode (MPU6050_DLPF_BW_42);
+	device.setDHPFMode (MPU6050_DHPF_5);
+	device.setTempSensorEnabled (true);
+	device.setI2CBypassEnabled (true);
+	device.setIntDataReadyEnabled (true);
+	device.setFIFOEnabled (true);
+	device.resetFIFO ();
+	device.setFIFOEnabled (false);
+	device.setShadowEnabled (false);
+}
+
+/* Shadowed registers and a write batch on the same device: read-modify-writes must see the writes queued before them
+ */
+static void configure_ADXL345_batch (bool bOptimise)
+{
+	ADXL345 device;
+	device.setShadowEnabled (bOptimise);
+	I2Cdev::writeByte (ADXL345_DEFAULT_ADDRESS, ADXL345_RA_POWER_CTL, 0x00);
+	I2Cdev::writeByte (ADXL345_DEFAULT_ADDRESS, ADXL345_RA_DATA_FORMAT, 0x00);
+	if (bOptimise) {
+		I2Cdev::beginWriteBatch (ADXL345_DEFAULT_ADDRESS, I2CDEV_AUTO_INCREMENT);
+	}
+	I2Cdev::writeByte (ADXL345_DEFAULT_ADDRESS, ADXL345_RA_POWER_CTL, 0x08);
+	I2Cdev::writeBit (ADXL345_DEFAULT_ADDRESS, ADXL345_RA_POWER_CTL, 0, 1);
+	I2Cdev::writeByte (ADXL345_DEFAULT_ADDRESS, ADXL345_RA_DATA_FORMAT, 0x01);
+	device.setFullResolution (1);
+	device.setRate (ADXL345_RATE_100);
+	if (bOptimise) {
+		I2Cdev::endWriteBatch ();
+	}
+	device.setShadowEnabled (false);
+}
+
+/* MPR121::initialize() batches its writes; the reference is the same sequence written one register at a time
+ */
+static void configure_MPR121 (bool bBatch)
+{
+	static const uint8_t s_mpr121[][2] = {
+		{ MHD_RISING,  0x01 }, { NHD_AMOUNT_RISING,  0x01 }, { NCL_RISING,  0x00 }, { FDL_RISING,  0x00 },
+		{ MHD_FALLING, 0x01 }, { NHD_AMOUNT_FALLING, 0x01 }, { NCL_FALLING, 0xFF }, { FDL_FALLING, 0x02 }
+	};
+	if (bBatch) {
+		MPR121 device;
+		device.initialize ();
+		return;
+	}
+	for (unsigned r = 0; r < sizeof (s_mpr121) / sizeof (s_mpr121[0]); r++) {
+		I2Cdev::writeByte (MPR121_DEFAULT_ADDRESS, s_mpr121[r][0], s_mpr121[r][1]);
+	}
+	for (uint8_t reg = ELE0_TOUCH_THRESHOLD; reg <= ELE11_RELEASE_THRESHOLD; reg += 2) {
+		I2Cdev::writeByte (MPR121_DEFAULT_ADDRESS, reg,     TOUCH_THRESHOLD);
+		I2Cdev::writeByte (MPR121_DEFAULT_ADDRESS, reg + 1, RELEASE_THRESHOLD);
+	}
+	I2Cdev::writeByte (MPR121_DEFAULT_ADDRESS, FILTER_CONFIG,    0x04);
+	I2Cdev::writeByte (MPR121_DEFAULT_ADDRESS, ELECTRODE_CONFIG, 0x0C);
+}
+
+struct sim_configure {
+	const char * name;
+	uint16_t     device_address;
+	void         (*configure) (bool bOptimise);
+};
+
+static struct sim_configure s_configure[] = {
+	{ "ADXL345",  ADXL345_DEFAULT_ADDRESS,  configure_ADXL345 },
+	{ "ADXL345 b", ADXL345_DEFAULT_ADDRESS, configure_ADXL345_batch },
+	{ "MPR121",   MPR121_DEFAULT_ADDRESS,   configure_MPR121  },
+	{ "MPU6050",  MPU6050_DEFAULT_ADDRESS,  configure_MPU6050 }
+};
+
+static const int s_configure_count = sizeof (s_configure) / sizeof (s_configure[0]);
+
+struct sim_dmp_check {
+	long     packets;
+	int16_t  next;        // expected quaternion w, i.e., packet number, of the first consumer's next packet
+	bool     bPass;
+};
+
+/* A MotionApps 2.0 packet numbered in its quaternion w, gyro z and accel y
+ */
+static void sim_dmp_push (RPi2cSimFIFO & model, int number)
+{
+	uint8_t packet[42];
+
+	memset (packet, 0, sizeof (packet));
+	packet[1]  = static_cast<uint8_t>(number); // w
+	packet[25] = static_cast<uint8_t>(number); // gyro z
+	packet[33] = static_cast<uint8_t>(number); // accel y
+	model.push (packet, sizeof (packet));
+}
+
+static void sim_dmp_consume (const MPU6050DMPPackets * packets, uint16_t i, void * context)
+{
+	struct sim_dmp_check * check = static_cast<struct sim_dmp_check *>(context);
+
+	if (check->packets++ & 1) { // the second consumer sees the same packet
+		return;
+	}
+	int16_t number = packets->quaternion[0][i];
+
+	if (number != check->next || packets->gyro[2][i] != number || packets->accel[1][i] != number || !packets->timestamp[i]) {
+		check->bPass = false;
+	}
+	if (i && packets->timestamp[i] - packets->timestamp[i-1] != 10000000) { // the default 100 Hz
+		check->bPass = false;
+	}
+	check->next = number + 1;
+}
+
+/* An MPU6050 with DMP memory and FIFO on a simulated bus of its own, bound to the calling thread while in scope
+ */
+struct sim_mpu6050_memory {
+	RPi2cSim       sim;
+	RPi2cSimMemory model;
+	RPi2c          i2c;
+	RPi2cScope     scope;
+	MPU6050        device;
+
+	sim_mpu6050_memory (unsigned long clock_hz) :
+		sim(clock_hz),
+		model(MPU6050_RA_BANK_SEL, MPU6050_RA_MEM_START_ADDR, MPU6050_DMP_MEMORY_BANKS,
+			  MPU6050_RA_FIFO_R_W, MPU6050_RA_FIFO_COUNTH, MPU6050_RA_INT_STATUS, 1 << MPU6050_INTERRUPT_FIFO_OFLOW_BIT, MPU6050_FIFO_SIZE),
+		scope(&i2c)
+	{
+		sim.attach (MPU6050_DEFAULT_ADDRESS, &model);
+		i2c.busOpen (&sim);
+	}
+};
+
+int main (int argc, char ** argv)
+{
+	unsigned long clock_hz = RPI2C_SIM_FAST;
+
+	bool bPaced = false;
+
+	for (int argi = 1; argi < argc; argi++) {
+		if (strncmp (argv[argi], "--clock=", 8) == 0) {
+			clock_hz = atol (argv[argi] + 8);
+		} else if (strcmp (argv[argi], "--paced") == 0) {
+			bPaced = true;
+		} else {
+			fprintf (stderr, "usage: RPi2cSimDrivers [--clock=%d] [--paced]\n", RPI2C_SIM_FAST);
+			return -1;
+		}
+	}
+
+	int failures = 0;
+
+	fprintf (stdout, "* * * Drivers at %lu Hz\n", clock_hz);
+
+	for (int d = 0; d < s_driver_count; d++) {
+		RPi2cSim sim (clock_hz);
+		sim.setPaced (bPaced);
+
+		RPi2cSimDevice model;
+		memcpy (model.registers () + s_driver[d].preset_register, s_driver[d].preset, s_driver[d].preset_count);
+		sim.attach (s_driver[d].device_address, &model);
+
+		RPi2c i2c;
+
+		if (!i2c.busOpen (&sim)) {
+			fprintf (stderr, "RPi2cSimDrivers: Failed to open simulated bus, because:\n    %s\n", i2c.lastError ());
+			return -1;
+		}
+		RPi2cScope scope(&i2c);
+
+		bool bPass = s_driver[d].run ();
+
+		if (!bPass || sim.nackCount ()) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu transfers %10.1f us bus time\n", s_driver[d].name, (unsigned) s_driver[d].device_address,
+				 (bPass && !sim.nackCount ()) ? "ok" : "FAIL", sim.transferCount (), sim.busTime () * 1E-3);
+	}
+
+	/* Failure injection: an ADXL345 that fails to acknowledge once, then a bus with no device at all.
+	 */
+	{
+		RPi2cSim sim (clock_hz);
+
+		RPi2cSimDevice model;
+		model.registers ()[ADXL345_RA_DEVID] = 0xE5;
+		sim.attach (ADXL345_DEFAULT_ADDRESS, &model);
+
+		RPi2c i2c;
+		i2c.busOpen (&sim);
+
+		RPi2cScope scope(&i2c);
+
+		uint8_t id = 0; // check I2Cdev's return values directly, since testConnection() may see a stale buffer
+
+		sim.injectNACK (ADXL345_DEFAULT_ADDRESS);
+
+		bool bNACK  = I2Cdev::readByte (ADXL345_DEFAULT_ADDRESS, ADXL345_RA_DEVID, &id) != 1; // should fail...
+		bool bRetry = I2Cdev::readByte (ADXL345_DEFAULT_ADDRESS, ADXL345_RA_DEVID, &id) == 1 && id == 0xE5; // ... then recover
+
+		sim.attach (ADXL345_DEFAULT_ADDRESS, 0);
+
+		bool bAbsent = I2Cdev::readByte (ADXL345_DEFAULT_ADDRESS, ADXL345_RA_DEVID, &id) != 1;
+
+		bool bPass = bNACK && bRetry && bAbsent && (sim.nackCount () == 2);
+
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu transfers, %lu NACKs\n", "NACK", (unsigned) ADXL345_DEFAULT_ADDRESS,
+				 bPass ? "ok" : "FAIL", sim.transferCount (), sim.nackCount ());
+	}
+
+	/* Time-outs: an ADXL345 that stalls once, then one that hangs; retries back off from 1ms
+	 */
+	{
+		RPi2cSim sim (clock_hz);
+
+		RPi2cSimDevice model;
+		model.registers ()[ADXL345_RA_DEVID] = 0xE5;
+		sim.attach (ADXL345_DEFAULT_ADDRESS, &model);
+
+		RPi2c i2c;
+		i2c.busOpen (&sim);
+		i2c.setRetries (5, 1000);
+
+		RPi2cScope scope(&i2c);
+
+		uint8_t id = 0;
+
+		sim.injectTimeout (ADXL345_DEFAULT_ADDRESS, 1, 5000);
+
+		bool bRetry = I2Cdev::readByte (ADXL345_DEFAULT_ADDRESS, ADXL345_RA_DEVID, &id, 100) == 1 && id == 0xE5;
+
+		sim.injectTimeout (ADXL345_DEFAULT_ADDRESS, 100, 5000);
+
+		struct timespec t0;
+		struct timespec t1;
+
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+
+		bool bHung = I2Cdev::readByte (ADXL345_DEFAULT_ADDRESS, ADXL345_RA_DEVID, &id, 20) != 1;
+
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+
+		double ms = (t1.tv_sec - t0.tv_sec) * 1E3 + (t1.tv_nsec - t0.tv_nsec) * 1E-6;
+
+		bool bPass = bRetry && bHung && ms < 40 && sim.recoverCount () > 0;
+
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu retries, %lu recoveries; hung device gave up after %.1f ms\n", "timeout", (unsigned) ADXL345_DEFAULT_ADDRESS,
+				 bPass ? "ok" : "FAIL", i2c.retryCount (), i2c.recoveryCount (), ms);
+	}
+
+	/* Drivers on their own buses: two ADXL345s at the same address on two buses, used side by side from one thread
+	 */
+	fprintf (stdout, "* * * Drivers on their own buses\n");
+	{
+		RPi2cSim sim[2] = { RPi2cSim (clock_hz), RPi2cSim (clock_hz) };
+
+		RPi2cSimDevice model[2];
+
+		RPi2c i2c[2];
+
+		for (int b = 0; b < 2; b++) {
+			model[b].registers ()[ADXL345_RA_DEVID] = 0xE5;
+			sim[b].attach (ADXL345_DEFAULT_ADDRESS, &model[b]);
+			i2c[b].busOpen (&sim[b]);
+		}
+		I2CdevRPi2c bus0(&i2c[0]);
+		I2CdevRPi2c bus1(&i2c[1]);
+
+		I2CdevOnBus<ADXL345> accel0(&bus0);
+		I2CdevOnBus<ADXL345> accel1(&bus1);
+
+		accel0->initialize ();
+		accel1->initialize ();
+		accel0->setRange (ADXL345_RANGE_4G);
+		accel1->setRange (ADXL345_RANGE_16G);
+
+		bool bPass = accel0->testConnection () && accel1->testConnection ();
+
+		bPass = bPass && !I2Cdev::threadBus () // each call's bus lasts only until the end of the statement
+			&& (model[0].registers ()[ADXL345_RA_DATA_FORMAT] & 3) == ADXL345_RANGE_4G
+			&& (model[1].registers ()[ADXL345_RA_DATA_FORMAT] & 3) == ADXL345_RANGE_16G;
+
+		/* a stamped read through a bus that keeps no times mustn't report an earlier RPi2c read's
+		 */
+		sim_plain_bus plain(&bus1);
+
+		I2CdevOnBus<ADXL345> accel2(&plain);
+
+		int16_t x, y, z;
+		I2CdevTimestamp timestamp;
+
+		bPass = bPass && accel0->getAcceleration (&x, &y, &z, &timestamp) && timestamp.start
+			&& !accel2->getAcceleration (&x, &y, &z, &timestamp) && !timestamp.start && !timestamp.end;
+
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu + %lu transfers\n", "ADXL345 x2", (unsigned) ADXL345_DEFAULT_ADDRESS,
+				 bPass ? "ok" : "FAIL", sim[0].transferCount (), sim[1].transferCount ());
+	}
+
+	/* Register shadowing and write batching: the same set-up with and without must leave the same register values
+	 */
+	fprintf (stdout, "* * * Set-up with shadowed registers and batched writes\n");
+
+	for (int c = 0; c < s_configure_count; c++) {
+		unsigned long transfers[2];
+		double        bus_time[2];
+
+		RPi2cSimDevice model[2];
+
+		for (int bOptimise = 0; bOptimise < 2; bOptimise++) {
+			RPi2cSim sim (clock_hz);
+			sim.setPaced (bPaced);
+			sim.attach (s_configure[c].device_address, &model[bOptimise]);
+
+			RPi2c i2c;
+			i2c.busOpen (&sim);
+
+			RPi2cScope scope(&i2c);
+
+			s_configure[c].configure (bOptimise != 0);
+
+			transfers[bOptimise] = sim.transferCount ();
+			bus_time[bOptimise] = sim.busTime () * 1E-3;
+		}
+
+		bool bPass = memcmp (model[0].registers (), model[1].registers (), 256) == 0 && transfers[1] < transfers[0];
+
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu -> %lu transfers %10.1f -> %.1f us bus time\n", s_configure[c].name,
+				 (unsigned) s_configure[c].device_address, bPass ? "ok" : "FAIL", transfers[0], transfers[1], bus_time[0], bus_time[1]);
+	}
+
+	/* Scatter-gather reads: an MPU6050's interrupt status, FIFO count and FIFO data, read separately then all together
+	 */
+	fprintf (stdout, "* * * Scatter-gather reads\n");
+	{
+		unsigned long transfers[2];
+
+		uint8_t  status[2];
+		uint16_t count[2];
+		uint8_t  data[2][28];
+
+		for (int bScatter = 0; bScatter < 2; bScatter++) {
+			RPi2cSim sim (clock_hz);
+
+			RPi2cSimFIFO model (MPU6050_RA_FIFO_R_W, MPU6050_RA_FIFO_COUNTH, MPU6050_RA_INT_STATUS, 1 << MPU6050_INTERRUPT_FIFO_OFLOW_BIT, 1024);
+			model.registers ()[MPU6050_RA_INT_STATUS] = 1 << MPU6050_INTERRUPT_DMP_INT_BIT;
+
+			uint8_t packet[42];
+			for (int ib = 0; ib < 42; ib++) {
+				packet[ib] = static_cast<uint8_t>(ib * 7 + 1);
+			}
+			model.push (packet, 42);
+
+			sim.attach (MPU6050_DEFAULT_ADDRESS, &model);
+
+			RPi2c i2c;
+			i2c.busOpen (&sim);
+
+			RPi2cScope scope(&i2c);
+
+			MPU6050 device;
+
+			if (bScatter) {
+				device.getIntStatusFIFO (status + 1, count + 1, data[1], 28);
+			} else {
+				status[0] = device.getIntStatus ();
+				count[0] = device.getFIFOCount ();
+				device.getFIFOBytes (data[0], 28);
+			}
+			transfers[bScatter] = sim.transferCount ();
+		}
+
+		bool bPass = status[0] == status[1] && count[0] == 42 && count[1] == 42 && memcmp (data[0], data[1], 28) == 0
+			&& data[0][27] == static_cast<uint8_t>(27 * 7 + 1) && transfers[1] == 1;
+
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu -> %lu transfers\n", "MPU6050", (unsigned) MPU6050_DEFAULT_ADDRESS,
+				 bPass ? "ok" : "FAIL", transfers[0], transfers[1]);
+	}
+
+	/* FIFO drain: whole DMP-sized packets, with a partial packet carried over, then an overflow
+	 */
+	{
+		RPi2cSim sim (clock_hz);
+
+		RPi2cSimFIFO model (MPU6050_RA_FIFO_R_W, MPU6050_RA_FIFO_COUNTH, MPU6050_RA_INT_STATUS, 1 << MPU6050_INTERRUPT_FIFO_OFLOW_BIT, MPU6050_FIFO_SIZE);
+		model.setResetBits (MPU6050_RA_USER_CTRL, 1 << MPU6050_USERCTRL_FIFO_RESET_BIT);
+
+		sim.attach (MPU6050_DEFAULT_ADDRESS, &model);
+
+		RPi2c i2c;
+		i2c.busOpen (&sim);
+
+		RPi2cScope scope(&i2c);
+
+		MPU6050 device;
+
+		MPU6050FIFODrain drain (42);
+
+		unsigned long streamed = 0; // bytes pushed; every byte of packet n is n
+		int checked = 0;
+
+		bool bPass = true;
+
+		for (int round = 0; round < 4; round++) {
+			unsigned long byte_count = (round == 0) ? 20 * 42 + 21 : 3 * 42; // the first leaves half a packet over
+
+			for (unsigned long ib = 0; ib < byte_count; ib++, streamed++) {
+				uint8_t byte = static_cast<uint8_t>(streamed / 42);
+				model.push (&byte, 1);
+			}
+
+			MPU6050FIFOPackets packets = device.drainFIFO (&drain);
+
+			for (uint16_t p = 0; p < packets.count; p++, checked++) {
+				const uint8_t * bytes = packets.packet (p);
+
+				if (bytes[0] != static_cast<uint8_t>(checked) || bytes[41] != bytes[0]) {
+					bPass = false;
+				}
+			}
+		}
+		unsigned long transfers = sim.transferCount ();
+
+		uint8_t packet[42] = { 0 };
+
+		for (int p = 0; p < 30; p++) { // more than the FIFO holds
+			model.push (packet, sizeof (packet));
+		}
+		MPU6050FIFOPackets packets = device.drainFIFO (&drain);
+
+		bPass = bPass && checked == 29 && drain.packets == 29 && packets.count == 0 && drain.overflows == 1
+			&& model.level () == 0 && drain.errors == 0;
+
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu transfers for %lu packets, %lu overflow, %lu bytes lost\n", "FIFO drain", (unsigned) MPU6050_DEFAULT_ADDRESS,
+				 bPass ? "ok" : "FAIL", transfers, drain.packets, drain.overflows, drain.lostBytes);
+	}
+
+	/* DMP pipeline: packets drained, decoded in batches and passed to consumers in order, some at a time
+	 */
+	{
+		RPi2cSim sim (clock_hz);
+
+		RPi2cSimFIFO model (MPU6050_RA_FIFO_R_W, MPU6050_RA_FIFO_COUNTH, MPU6050_RA_INT_STATUS, 1 << MPU6050_INTERRUPT_FIFO_OFLOW_BIT, MPU6050_FIFO_SIZE);
+
+		sim.attach (MPU6050_DEFAULT_ADDRESS, &model);
+
+		RPi2c i2c;
+		i2c.busOpen (&sim);
+
+		RPi2cScope scope(&i2c);
+
+		MPU6050 device;
+
+		MPU6050DMPPipeline pipeline;
+
+		struct sim_dmp_check check = { 0, 0, true };
+
+		device.dmpSetPipeline (&pipeline);
+		pipeline.addConsumer (sim_dmp_consume, &check);
+		pipeline.addConsumer (sim_dmp_consume, &check); // every packet twice
+
+		for (int p = 0; p < 25; p++) {
+			sim_dmp_push (model, p);
+			if (p == 19) {
+				uint8_t processed[2] = { 0, 0 };
+
+				device.dmpReadAndProcessFIFOPacket (8, processed);       // drains all 20, processes 8
+				device.dmpReadAndProcessFIFOPacket (255, processed + 1); // the other 12, without reading the FIFO
+				check.bPass = check.bPass && processed[0] == 8 && processed[1] == 12 && model.level () == 0;
+			}
+		}
+		uint8_t processed = 0;
+		device.dmpReadAndProcessFIFOPacket (255, &processed);
+
+		bool bPass = check.bPass && processed == 5 && check.packets == 50 && pipeline.processed == 25 && device.getDMPPipeline () == &pipeline;
+
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu transfers for %lu packets\n", "DMP", (unsigned) MPU6050_DEFAULT_ADDRESS,
+				 bPass ? "ok" : "FAIL", sim.transferCount (), pipeline.processed);
+	}
+
+	/* DMP upload: the MotionApps 2.0 firmware written a bank at a time and verified by CRC, then again with a byte of
+	 * memory stuck, which verification must catch
+	 */
+	{
+		unsigned long transfers = 0;
+		double bus_time = 0;
+
+		bool bPass = true;
+
+		for (int bFault = 0; bFault < 2; bFault++) {
+			sim_mpu6050_memory mpu (clock_hz);
+
+			if (bFault) {
+				mpu.model.setStuck (1000);
+			}
+			bool bVerified = mpu.device.writeProgMemoryBlock (dmpMemory, MPU6050_DMP_CODE_SIZE);
+
+			if (bFault) {
+				bPass = bPass && !bVerified;
+			} else {
+				bPass = bVerified && memcmp (mpu.model.memory (), dmpMemory, MPU6050_DMP_CODE_SIZE) == 0
+					&& mpu.sim.transferCount () == 4 * ((MPU6050_DMP_CODE_SIZE + 255) / 256); // select, write, select, read per bank
+
+				transfers = mpu.sim.transferCount ();
+				bus_time = mpu.sim.busTime () * 1E-3;
+			}
+		}
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu transfers %10.1f us bus time for %d bytes\n", "DMP upload", (unsigned) MPU6050_DEFAULT_ADDRESS,
+				 bPass ? "ok" : "FAIL", transfers, bus_time, MPU6050_DMP_CODE_SIZE);
+	}
+
+	/* DMP configuration: adjacent blocks merged into bursts; a truncated set is rejected before anything is written
+	 */
+	{
+		sim_mpu6050_memory mpu (clock_hz);
+
+		memset (mpu.model.memory () + 2 * 256 + 0x40, 0xFF, 32); // the compass matrix, which the set clears
+
+		const uint8_t cfg8[5] = { 0xF1, 0x20, 0x28, 0x30, 0x38 };
+
+		bool bPass = mpu.device.writeProgDMPConfigurationSet (dmpConfig, MPU6050_DMP_CONFIG_SIZE)
+			&& memcmp (mpu.model.memory () + 7 * 256 + 0x41, cfg8, 5) == 0 && mpu.model.memory ()[1 * 256 + 0xEE] == 0x40
+			&& mpu.model.registers ()[MPU6050_RA_INT_ENABLE] == 0x32;
+
+		for (int ib = 0; ib < 32; ib++) {
+			bPass = bPass && mpu.model.memory ()[2 * 256 + 0x40 + ib] == 0;
+		}
+		unsigned long transfers = mpu.sim.transferCount ();
+		double bus_time = mpu.sim.busTime () * 1E-3;
+
+		const uint8_t truncated[8] = { 0x07, 0x86, 0x01, 0xFE, 0x02, 0x16, 0x02, 0x00 };
+
+		bPass = bPass && !mpu.device.writeDMPConfigurationSet (truncated, 8) && mpu.sim.transferCount () == transfers;
+
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu transfers %10.1f us bus time for %d bytes\n", "DMP config", (unsigned) MPU6050_DEFAULT_ADDRESS,
+				 bPass ? "ok" : "FAIL", transfers, bus_time, MPU6050_DMP_CONFIG_SIZE);
+	}
+
+	/* DMP warm start: with the firmware and configuration left in memory by an earlier start, only registers are set;
+	 * with memory cleared (power off) or a byte of code changed, the fingerprint must not match
+	 */
+	{
+		sim_mpu6050_memory mpu (clock_hz);
+
+		mpu.model.setResetBits (MPU6050_RA_USER_CTRL, 1 << MPU6050_USERCTRL_FIFO_RESET_BIT);
+
+		bool bPass = !mpu.device.dmpFirmwareLoaded ();
+
+		bPass = bPass && mpu.device.writeProgMemoryBlock (dmpMemory, MPU6050_DMP_CODE_SIZE)
+			&& mpu.device.writeProgDMPConfigurationSet (dmpConfig, MPU6050_DMP_CONFIG_SIZE);
+
+		mpu.sim.resetCounts ();
+
+		bPass = bPass && mpu.device.dmpFirmwareLoaded () && mpu.sim.transferCount () == 2 * (MPU6050_DMP_CODE_SIZE / 256 + 1 - MPU6050_DMP_FINGERPRINT_BANK);
+
+		mpu.sim.resetCounts ();
+
+		bPass = bPass && mpu.device.dmpWarmStart () == 0 && mpu.device.dmpGetFIFOPacketSize () == 42
+			&& (mpu.model.registers ()[MPU6050_RA_USER_CTRL] & (1 << MPU6050_USERCTRL_FIFO_EN_BIT))
+			&& mpu.model.registers ()[MPU6050_RA_SMPLRT_DIV] == 4 && mpu.model.registers ()[MPU6050_RA_INT_ENABLE] == 0x12;
+
+		unsigned long transfers = mpu.sim.transferCount ();
+		double bus_time = mpu.sim.busTime () * 1E-3;
+
+		mpu.model.memory ()[5 * 256 + 3] ^= 0x01;
+		bPass = bPass && !mpu.device.dmpFirmwareLoaded ();
+
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu transfers %10.1f us bus time\n", "DMP warm", (unsigned) MPU6050_DEFAULT_ADDRESS,
+				 bPass ? "ok" : "FAIL", transfers, bus_time);
+	}
+
+	/* Capture and replay: record an HMC5883L on the simulated bus, then play the recording back without the model
+	 */
+	fprintf (stdout, "* * * Capture and replay\n");
+	{
+		char filename[] = "/tmp/RPi2cSimDrivers.XXXXXX";
+
+		int fd = mkstemp (filename);
+
+		if (fd >= 0) {
+			close (fd);
+		}
+
+		RPi2cCapture capture;
+
+		int16_t heading[2][3] = { { 0, 0, 0 }, { 0, 0, 0 } };
+
+		bool bPass = (fd >= 0) && capture.open (filename, 1 << 16);
+
+		if (bPass) {
+			RPi2cSim sim (clock_hz);
+
+			RPi2cSimDevice model;
+			memcpy (model.registers () + HMC5883L_RA_ID_A, "H43", 3);
+
+			const uint8_t data[6] = { 0x01, 0x23, 0xFE, 0xDC, 0x00, 0x7F }; // X, Z, Y; MSB first
+			memcpy (model.registers () + HMC5883L_RA_DATAX_H, data, 6);
+
+			sim.attach (HMC5883L_DEFAULT_ADDRESS, &model);
+
+			RPi2c i2c;
+			i2c.busOpen (&sim);
+			i2c.setCapture (&capture);
+
+			RPi2cScope scope(&i2c);
+
+			HMC5883L device;
+			device.initialize ();
+			bPass = device.testConnection ();
+			device.getHeading (heading[0], heading[0] + 1, heading[0] + 2);
+
+			uint8_t id;
+			bPass = bPass && I2Cdev::readByte (HMC5883L_DEFAULT_ADDRESS + 1, HMC5883L_RA_ID_A, &id) < 0; // no device: NACK
+
+			i2c.setCapture (0);
+			capture.close ();
+		}
+
+		RPi2cReplay replay;
+
+		if (bPass) {
+			bPass = replay.open (filename);
+		}
+		if (bPass) {
+			RPi2c i2c;
+			i2c.busOpen (&replay);
+
+			RPi2cScope scope(&i2c);
+
+			HMC5883L device;
+			device.initialize ();
+			bPass = device.testConnection ();
+			device.getHeading (heading[1], heading[1] + 1, heading[1] + 2);
+
+			/* The failed read fails again, with the error that was recorded
+			 */
+			uint8_t id;
+			bPass = bPass && I2Cdev::readByte (HMC5883L_DEFAULT_ADDRESS + 1, HMC5883L_RA_ID_A, &id) < 0 && errno == EREMOTEIO;
+
+			bPass = bPass && !replay.missCount ();
+
+			/* With the recording used up, a retried read fails; a stale ETIMEDOUT must not make it recover the bus
+			 */
+			i2c.setRetries (2, 10);
+			errno = ETIMEDOUT;
+
+			bPass = bPass && I2Cdev::readByte (HMC5883L_DEFAULT_ADDRESS, HMC5883L_RA_ID_A, &id) < 0 && !i2c.recoveryCount ();
+		}
+		if (fd >= 0) {
+			unlink (filename);
+		}
+
+		bPass = bPass && memcmp (heading[0], heading[1], sizeof (heading[0])) == 0 && heading[0][0] == 0x0123
+			&& !replay.mismatchCount () && !capture.droppedCount ();
+
+		if (!bPass) {
+			++failures;
+		}
+		fprintf (stdout, "%-10s 0x%02x %-4s %6lu bytes captured, %lu messages replayed, %lu mismatches\n", "HMC5883L", (unsigned) HMC5883L_DEFAULT_ADDRESS,
+				 bPass ? "ok" : "FAIL", (unsigned long) capture.used (), replay.replayedCount (), replay.mismatchCount ());
+	}
+
+	fprintf (stdout, "%d failure%s\n", failures, (failures == 1) ? "" : "s");
+
+	return failures ? 1 : 0;
+}
@@ -29,12 +29,20 @@ THE SOFTWARE.
 #include <signal.h>
 
 #include "RPi2c.h"
+#include "RPi2cScheduler.h"
+#include "RPi2cTrace.h"
 #include "RPiHacks.h"
 
 #include "ADXL345/ADXL345.h"
 #include "HMC5883L/HMC5883L.h"
 #include "ITG3200/ITG3200.h"
 
+/* The bus runs at the Raspberry Pi's default 100kHz; reading six bytes takes 0.84ms, so polling each sensor at 400Hz
+ * occupies two-thirds of the bus.
+ */
+#define SENSORSTICK_CLOCK  100000
+#define SENSORSTICK_PERIOD 2500 // in microseconds
+
 struct ag_stats {
 	struct {
 		struct {
@@ -44,7 +52,8 @@ struct ag_stats {
 		} x, y, z;
 	} acc, gyr;
 
-	long count;
+	long count;     // accelerometer samples
+	long gyr_count; // gyroscope samples
 };
 
 static struct {
@@ -80,6 +89,74 @@ void accel_sleep (ADXL345 & accel)
 	accel.setSleepEnabled (true /* go to sleep */);
 }
 
+struct ag_sums {
+	struct ag_stats * as;
+
+	long acc_x_sum;
+	long acc_y_sum;
+	long acc_z_sum;
+
+	long gyr_x_sum;
+	long gyr_y_sum;
+	long gyr_z_sum;
+};
+
+static void ag_update (int16_t & ag_min, int16_t & ag_max, int16_t value, bool bFirst)
+{
+	if (bFirst || ag_min > value)
+		ag_min = value;
+	if (bFirst || ag_max < value)
+		ag_max = value;
+}
+
+static void acc_sample (int poll, const uint8_t * data, int status, uint64_t timestamp, void * user)
+{
+	if (status < 0) return;
+
+	struct ag_sums & sums = *reinterpret_cast<struct ag_sums *>(user);
+	struct ag_stats & as = *sums.as;
+
+	int16_t A[3];
+
+	for (int i = 0; i < 3; i++) {
+		A[i] = static_cast<int16_t>(data[2*i] | (data[2*i+1] << 8)); // LSB first
+	}
+
+	ag_update (as.acc.x.ag_min, as.acc.x.ag_max, A[0], !as.count);
+	ag_update (as.acc.y.ag_min, as.acc.y.ag_max, A[1], !as.count);
+	ag_update (as.acc.z.ag_min, as.acc.z.ag_max, A[2], !as.count);
+
+	sums.acc_x_sum += A[0];
+	sums.acc_y_sum += A[1];
+	sums.acc_z_sum += A[2];
+
+	++as.count;
+}
+
+static void gyr_sample (int poll, const uint8_t * data, int status, uint64_t timestamp, void * user)
+{
+	if (status < 0) return;
+
+	struct ag_sums & sums = *reinterpret_cast<struct ag_sums *>(user);
+	struct ag_stats & as = *sums.as;
+
+	int16_t G[3];
+
+	for (int i = 0; i < 3; i++) {
+		G[i] = static_cast<int16_t>((data[2*i] << 8) | data[2*i+1]); // MSB first
+	}
+
+	ag_update (as.gyr.x.ag_min, as.gyr.x.ag_max, G[0], !as.gyr_count);
+	ag_update (as.gyr.y.ag_min, as.gyr.y.ag_max, G[1], !as.gyr_count);
+	ag_update (as.gyr.z.ag_min, as.gyr.z.ag_max, G[2], !as.gyr_count);
+
+	sums.gyr_x_sum += G[0];
+	sums.gyr_y_sum += G[1];
+	sums.gyr_z_sum += G[2];
+
+	++as.gyr_count;
+}
+
 void get_stats (struct ag_stats & as, RPi2c & i2c, bool bQuiet = false)
 {
 	for (int s = 10; s > 0; s--) {
@@ -104,99 +181,49 @@ void get_stats (struct ag_stats & as, RPi2c & i2c, bool bQuiet = false)
 
 	RPiHacks::millisReset ();
 
-	as.count = 0;
-	
-	long acc_x_sum = 0;
-	long acc_y_sum = 0;
-	long acc_z_sum = 0;
-
-	long gyr_x_sum = 0;
-	long gyr_y_sum = 0;
-	long gyr_z_sum = 0;
-
-	while (RPiHacks::millis () < 1000) {
-		int16_t A[3];
-
-		int status = i2c.busRead (ADXL345_ADDRESS_ALT_LOW, ADXL345_RA_DATAX0, 3, reinterpret_cast<uint16_t *>(A), true);
-		if (status < 0) {
-			fprintf (stderr, "SensorStick:  %s\n", i2c.lastError ());
-			break;
-		}
-
-		int16_t G[3];
+	struct ag_sums sums = { &as, 0, 0, 0, 0, 0, 0 };
 
-		status = i2c.busRead (ITG3200_ADDRESS_AD0_LOW, ITG3200_RA_GYRO_XOUT_H, 3, reinterpret_cast<uint16_t *>(G), false);
-		if (status < 0) {
-			fprintf (stderr, "SensorStick:  %s\n", i2c.lastError ());
-			break;
-		}
+	as.count = 0;
+	as.gyr_count = 0;
 
-		if (!as.count) {
-			as.acc.x.ag_min = A[0];
-			as.acc.x.ag_max = A[0];
-			as.acc.y.ag_min = A[1];
-			as.acc.y.ag_max = A[1];
-			as.acc.z.ag_min = A[2];
-			as.acc.z.ag_max = A[2];
-
-			as.gyr.x.ag_min = G[0];
-			as.gyr.x.ag_max = G[0];
-			as.gyr.y.ag_min = G[1];
-			as.gyr.y.ag_max = G[1];
-			as.gyr.z.ag_min = G[2];
-			as.gyr.z.ag_max = G[2];
-		} else {
-			if (as.acc.x.ag_min > A[0])
-				as.acc.x.ag_min = A[0];
-			if (as.acc.x.ag_max < A[0])
-				as.acc.x.ag_max = A[0];
-			if (as.acc.y.ag_min > A[1])
-				as.acc.y.ag_min = A[1];
-			if (as.acc.y.ag_max < A[1])
-				as.acc.y.ag_max = A[1];
-			if (as.acc.z.ag_min > A[2])
-				as.acc.z.ag_min = A[2];
-			if (as.acc.z.ag_max < A[2])
-				as.acc.z.ag_max = A[2];
-
-			if (as.gyr.x.ag_min > G[0])
-				as.gyr.x.ag_min = G[0];
-			if (as.gyr.x.ag_max < G[0])
-				as.gyr.x.ag_max = G[0];
-			if (as.gyr.y.ag_min > G[1])
-				as.gyr.y.ag_min = G[1];
-			if (as.gyr.y.ag_max < G[1])
-				as.gyr.y.ag_max = G[1];
-			if (as.gyr.z.ag_min > G[2])
-				as.gyr.z.ag_min = G[2];
-			if (as.gyr.z.ag_max < G[2])
-				as.gyr.z.ag_max = G[2];
-		}
+	/* Poll the accelerometer and gyroscope at a steady rate for a second, within the bus budget, rather than as fast as
+	 * possible; the accelerometer goes first if both are due.
+	 */
+	RPi2cScheduler scheduler (i2c, SENSORSTICK_CLOCK);
 
-		acc_x_sum += A[0];
-		acc_y_sum += A[1];
-		acc_z_sum += A[2];
+	int acc_poll = scheduler.addPoll (ADXL345_ADDRESS_ALT_LOW, ADXL345_RA_DATAX0, 6, SENSORSTICK_PERIOD, 1, acc_sample, &sums);
+	int gyr_poll = scheduler.addPoll (ITG3200_ADDRESS_AD0_LOW, ITG3200_RA_GYRO_XOUT_H, 6, SENSORSTICK_PERIOD, 0, gyr_sample, &sums);
 
-		gyr_x_sum += G[0];
-		gyr_y_sum += G[1];
-		gyr_z_sum += G[2];
+	if (acc_poll < 0 || gyr_poll < 0) {
+		fprintf (stderr, "SensorStick:  %s\n", scheduler.lastError ());
+		return;
+	}
+	scheduler.run (1000000);
 
-		++as.count;
+	if (scheduler.errors (acc_poll) || scheduler.errors (gyr_poll)) {
+		fprintf (stderr, "SensorStick:  %lu + %lu failed reads\n", scheduler.errors (acc_poll), scheduler.errors (gyr_poll));
+	}
+	if (!bQuiet) {
+		fprintf (stdout, "bus occupancy %.0f%%; jitter p99 %.0f us (accel), %.0f us (gyro); %lu + %lu missed\n",
+				 scheduler.occupancy () * 100, scheduler.jitter (acc_poll).p99 () * 1E-3, scheduler.jitter (gyr_poll).p99 () * 1E-3,
+				 scheduler.missed (acc_poll), scheduler.missed (gyr_poll));
 	}
-	if (as.count) {
-		as.acc.x.ag_mean = acc_x_sum / as.count;
-		as.acc.y.ag_mean = acc_y_sum / as.count;
-		as.acc.z.ag_mean = acc_z_sum / as.count;
 
-		as.gyr.x.ag_mean = gyr_x_sum / as.count;
-		as.gyr.y.ag_mean = gyr_y_sum / as.count;
-		as.gyr.z.ag_mean = gyr_z_sum / as.count;
+	if (as.count) {
+		as.acc.x.ag_mean = sums.acc_x_sum / as.count;
+		as.acc.y.ag_mean = sums.acc_y_sum / as.count;
+		as.acc.z.ag_mean = sums.acc_z_sum / as.count;
+	}
+	if (as.gyr_count) {
+		as.gyr.x.ag_mean = sums.gyr_x_sum / as.gyr_count;
+		as.gyr.y.ag_mean = sums.gyr_y_sum / as.gyr_count;
+		as.gyr.z.ag_mean = sums.gyr_z_sum / as.gyr_count;
 	}
 }
 
 void print_stats (struct ag_stats & as)
 {
-	fprintf (stdout, "%lu samples read in 10s\n", as.count);
+	fprintf (stdout, "%lu + %lu samples read in 1s\n", as.count, as.gyr_count);
 	fprintf (stdout, "acc-x: %d < %d < %d\n", (int) as.acc.x.ag_min, (int) as.acc.x.ag_mean, (int) as.acc.x.ag_max);
 	fprintf (stdout, "acc-y: %d < %d < %d\n", (int) as.acc.y.ag_min, (int) as.acc.y.ag_mean, (int) as.acc.y.ag_max);
 	fprintf (stdout, "acc-z: %d < %d < %d\n", (int) as.acc.z.ag_min, (int) as.acc.z.ag_mean, (int) as.acc.z.ag_max);
@@ -270,6 +297,10 @@ int main (int argc, char ** argv)
 
 	RPi2c::setDefaultBus (&i2c);
 
+	if (!RPi2cTrace::startFromEnvironment ()) { // e.g., RPI2C_TRACE=SensorStick.trace
+		fprintf (stderr, "SensorStick: %s\n", RPi2cTrace::lastError ());
+	}
+
 	ADXL345 accel;
     accel.initialize ();
 